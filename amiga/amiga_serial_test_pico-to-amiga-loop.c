@@ -1,6 +1,9 @@
 /*
  * Amiga Simple Serial Test
  * Minimal implementation for bidirectional communication with Raspberry Pi Pico
+ *
+ * Uses the framework's stream triggers; build with "smake serial_test"
+ * in example/, which links amiga_packet_trigger.o
  */
 
 #include <exec/types.h>
@@ -20,6 +23,8 @@
 #include <proto/dos.h>
 #include <proto/alib.h>  /* For CreatePort, CreateExtIO */
 
+#include "framework/amiga_packet_framework.h"  /* Stream triggers */
+
 /* Define missing console constants */
 #define MY_RAWKEYS 1    /* Replace with actual value if available */
 #define MY_SETF_RAW 1   /* Replace with actual value if available */
@@ -48,6 +53,9 @@ BOOL CheckKeyboard(void);
 char GetKey(void);
 char GetKeyNonBlocking(void);
 
+/* Set by the "Hello Amiga" trigger, cleared once answered */
+static BOOL HelloSeen = FALSE;
+
 /* Debug flag */
 #define DEBUG 1
 
@@ -476,6 +484,12 @@ ULONG ReceiveDataDirect(char *buffer, ULONG maxLength)
     return bytesRead;
 }
 
+/* Trigger callback: matched even when the text spans two reads */
+static void HelloTrigger(LONG id, ULONG offset, APTR userData)
+{
+    HelloSeen = TRUE;
+}
+
 /* Improved keyboard handling for command detection */
 void RunSerialTerminal(void)
 {
@@ -501,6 +515,9 @@ void RunSerialTerminal(void)
     /* Initialize key buffer */
     keyBuffer[0] = '\0';
     
+    /* Watch the serial stream for the Pico's greeting */
+    AddTrigger("Hello Amiga", 11, HelloTrigger, NULL);
+    
     /* Send a dummy character to establish connection */
     sendBuffer[0] = '\r';  /* Simple carriage return */
     SendData(sendBuffer, 1);
@@ -560,9 +577,11 @@ void RunSerialTerminal(void)
                         /* Debug info */
                         printf("[Sending: '%s']\n", keyBuffer);
                         
-                        /* Send with CR+LF */
-                        SendData(keyBuffer, strlen(keyBuffer));
-                        SendData("\r\n", 2);
+                        /* Send line and CR+LF as a single write */
+                        memcpy(sendBuffer, keyBuffer, keyPos);
+                        sendBuffer[keyPos] = '\r';
+                        sendBuffer[keyPos + 1] = '\n';
+                        SendData(sendBuffer, keyPos + 2);
                     }
                     
                     /* Clear key buffer after sending */
@@ -606,8 +625,11 @@ void RunSerialTerminal(void)
                 printf("%s", recvBuffer);
                 
                 /* AUTOMATICALLY SEND RESPONSE when we receive data */
-                /* Check if the received message contains "Hello Amiga" */
-                if (strstr(recvBuffer, "Hello Amiga")) {
+                /* Check if the stream contained "Hello Amiga" */
+                ScanTriggers(recvBuffer, bytesRead);
+                if (HelloSeen) {
+                    HelloSeen = FALSE;
+                    
                     /* Wait a short time before responding */
                     TimerIO->tr_node.io_Command = TR_ADDREQUEST;
                     TimerIO->tr_time.tv_secs = 0;
@@ -0,0 +1,81 @@
+/*
+ * Amiga Packet Communication Framework - Screen Access
+ * Describe a public screen's bitmap and palette for the screen
+ * streaming module (amiga_packet_screen.c).
+ *
+ * The screen stays locked while it is streamed so it cannot close under
+ * the streamer; its bitplanes are read directly, which is safe for the
+ * planar bitmaps of chipset screens. Graphics cards keep their screens
+ * elsewhere and are refused.
+ */
+
+#include <exec/types.h>
+#include <intuition/screens.h>
+#include <graphics/gfx.h>
+#include <graphics/view.h>
+#include <proto/intuition.h>
+#include <proto/graphics.h>
+
+#include "amiga_packet_framework.h"
+
+static struct Screen *LockedScreen = NULL;
+
+BOOL LockScreenSource(const char *name, ScreenSource *source)
+{
+    struct BitMap *bm;
+    UWORD colors;
+    UWORD i;
+
+    if (LockedScreen)
+        return FALSE;
+    LockedScreen = LockPubScreen((UBYTE *)name);
+    if (!LockedScreen)
+        return FALSE;
+
+    bm = LockedScreen->RastPort.BitMap;
+    if (bm->Depth == 0 || bm->Depth > SCREEN_MAX_DEPTH ||
+        (ULONG)bm->BytesPerRow * 8 < (ULONG)LockedScreen->Width) {
+        UnlockScreenSource();
+        return FALSE;
+    }
+
+    for (i = 0; i < bm->Depth; i++)
+        source->planes[i] = (UBYTE *)bm->Planes[i];
+    source->bytesPerRow = bm->BytesPerRow;
+    source->width = (UWORD)LockedScreen->Width;
+    source->height = (UWORD)LockedScreen->Height;
+    source->depth = bm->Depth;
+
+    source->flags = 0;
+    colors = (UWORD)(1 << bm->Depth);
+    if (LockedScreen->ViewPort.Modes & HAM) {
+        source->flags |= SCREEN_FLAG_HAM;
+        colors = 16;
+    } else if (LockedScreen->ViewPort.Modes & EXTRA_HALFBRITE) {
+        source->flags |= SCREEN_FLAG_EHB;
+    }
+    if (colors > SCREEN_MAX_COLORS)
+        colors = SCREEN_MAX_COLORS;
+    source->colors = colors;
+
+    RefreshScreenSource(source);
+    return TRUE;
+}
+
+void RefreshScreenSource(ScreenSource *source)
+{
+    UWORD i;
+
+    if (!LockedScreen)
+        return;
+    for (i = 0; i < source->colors; i++)
+        source->palette[i] = (UWORD)GetRGB4(LockedScreen->ViewPort.ColorMap, i);
+}
+
+void UnlockScreenSource(void)
+{
+    if (LockedScreen) {
+        UnlockPubScreen(NULL, LockedScreen);
+        LockedScreen = NULL;
+    }
+}
@@ -0,0 +1,994 @@
+/*
+ * Amiga Packet Communication Framework - Remote File Access
+ * Open, read, write, stat and list files on the host (pc/file_server.py)
+ * over the framed link, without waiting out a round trip per read.
+ *
+ * Message format, carried as the payload of a FRAME_FILE frame:
+ *   op | seq | handle | status | offset(4) | length(2) | data...
+ * all big-endian. The host answers each request with the same op and
+ * seq. Requests are resent after FILE_REPLY_TICKS with FILE_OP_RESEND
+ * set in op; the host then repeats its earlier reply instead of doing
+ * the operation again, provided it kept one for this very request.
+ * Sequence numbers wrap, so a reply is only taken when its handle,
+ * offset and length also fit the request it answers.
+ *
+ * Reads go through an LRU cache of FILE_BLOCK_SIZE blocks. A reader
+ * that has moved on to the next block FILE_SEQUENTIAL_RUN times running
+ * is taken to be sequential, and the following FILE_READAHEAD blocks
+ * are requested at once, so up to FILE_MAX_PENDING replies are on the
+ * wire together. Scattered reads that rarely hit the cache read only
+ * the bytes asked for. Small writes are gathered into full WRITE
+ * requests that are not waited for until a flush. The host handles
+ * requests in order, so a read sent after a write sees the written data.
+ *
+ * The module uses nothing but the flow link and a poll function, so
+ * the same code runs in the host simulator (host/sim_bench.c).
+ */
+
+#include <exec/types.h>
+
+#include "amiga_packet_framework.h"
+
+/* One cached block */
+typedef struct {
+    WORD fh;                    /* Owning file, -1 when free */
+    ULONG block;                /* Block number within the file */
+    ULONG lastUse;              /* UseClock at the last access */
+    UWORD length;               /* Valid bytes; short at end of file */
+    BOOL ready;                 /* Data is valid */
+    BOOL pending;               /* A READ for it is on the wire */
+    BOOL stale;                 /* Written to while pending: drop the reply */
+    BOOL ahead;                 /* Fetched by read-ahead, not yet used */
+    UBYTE data[FILE_BLOCK_SIZE];
+} CacheBlock;
+
+/* A request on the wire; frame holds the request, then the reply */
+typedef struct {
+    BOOL inUse;
+    BOOL detached;              /* Nobody waits: the reply handler finishes it */
+    BOOL done;
+    UBYTE seq;
+    UBYTE op;
+    WORD fh;
+    WORD slot;                  /* Cache block a READ fills, -1 for none */
+    ULONG block;
+    UWORD status;
+    UWORD tries;
+    ULONG waited;               /* Idle polls since the last send */
+    ULONG length;
+    UBYTE frame[FRAME_MAX_PAYLOAD];
+} PendingRequest;
+
+/* An open file */
+typedef struct {
+    BOOL open;
+    BOOL cached;
+    UBYTE remote;               /* Host's handle */
+    ULONG position;
+    ULONG size;
+    ULONG lastBlock;
+    UWORD run;                  /* Consecutive moves to the next block */
+    UWORD scatterAccesses;      /* Recent non-sequential block accesses */
+    UWORD scatterHits;          /* Of those, blocks found in the cache */
+    UWORD bypassCount;
+    UWORD writeError;           /* Failure of a write-behind request */
+    ULONG writeStart;           /* Gathered writes: file offset and bytes */
+    UWORD writeLength;
+    UBYTE writeBuffer[FILE_WRITE_MAX];
+} RemoteFile;
+
+static FlowLink *Link = NULL;
+static LinkPollFunc Poll = NULL;
+static APTR PollData = NULL;
+static BOOL Caching = TRUE;
+static UBYTE NextSeq = 0;
+static UWORD LastError = FILE_OK;
+static ULONG UseClock = 0;
+static RemoteFileStats Stats;
+
+static RemoteFile Files[FILE_MAX_OPEN];
+static CacheBlock Cache[FILE_CACHE_BLOCKS];
+static PendingRequest Pending[FILE_MAX_PENDING];
+
+/* Forward declarations */
+static void FileFrameReceived(UBYTE type, UWORD credit, const UBYTE *payload,
+                              ULONG length, APTR userData);
+
+static void PutLong(UBYTE *p, ULONG value)
+{
+    p[0] = (UBYTE)(value >> 24);
+    p[1] = (UBYTE)(value >> 16);
+    p[2] = (UBYTE)(value >> 8);
+    p[3] = (UBYTE)value;
+}
+
+static ULONG GetLong(const UBYTE *p)
+{
+    return ((ULONG)p[0] << 24) | ((ULONG)p[1] << 16) | ((ULONG)p[2] << 8) | p[3];
+}
+
+static UWORD GetWord(const UBYTE *p)
+{
+    return (UWORD)((p[0] << 8) | p[1]);
+}
+
+static ULONG StringLength(const char *s)
+{
+    ULONG n = 0;
+
+    while (s[n])
+        n++;
+    return n;
+}
+
+static void ClearStats(void)
+{
+    UBYTE *p = (UBYTE *)&Stats;
+    ULONG i;
+
+    for (i = 0; i < sizeof(Stats); i++)
+        p[i] = 0;
+}
+
+static RemoteFile *FileFor(LONG fh)
+{
+    if (fh < 0 || fh >= FILE_MAX_OPEN || !Files[fh].open) {
+        LastError = FILE_ERR_HANDLE;
+        return NULL;
+    }
+    return &Files[fh];
+}
+
+/* ------------------------------------------------------------------ */
+/* Requests                                                            */
+/* ------------------------------------------------------------------ */
+
+static LONG PendingCount(void)
+{
+    LONG i;
+    LONG n = 0;
+
+    for (i = 0; i < FILE_MAX_PENDING; i++) {
+        if (Pending[i].inUse)
+            n++;
+    }
+    return n;
+}
+
+static BOOL SendRequestFrame(PendingRequest *r)
+{
+    r->waited = 0;
+    Stats.requests++;
+    return FlowSendFrame(Link, FRAME_FILE, r->frame, r->length);
+}
+
+/* Drop a request that will get no reply */
+static void FailRequest(PendingRequest *r, UWORD status)
+{
+    CacheBlock *b;
+
+    if (r->slot >= 0) {
+        b = &Cache[r->slot];
+        b->pending = FALSE;
+        b->ready = FALSE;
+        b->fh = -1;
+    }
+    if (r->op == FILE_OP_WRITE && r->fh >= 0 && Files[r->fh].writeError == FILE_OK)
+        Files[r->fh].writeError = status;
+
+    r->status = status;
+    r->done = TRUE;
+    if (r->detached)
+        r->inUse = FALSE;
+}
+
+/* Take in input once; requests idle for too long are resent or failed */
+static BOOL PollOnce(void)
+{
+    LONG got;
+    LONG i;
+    PendingRequest *r;
+
+    got = Poll(TRUE, PollData);
+    if (got < 0) {
+        LastError = FILE_ERR_LINK;
+        return FALSE;
+    }
+    if (got > 0)
+        return TRUE;
+
+    for (i = 0; i < FILE_MAX_PENDING; i++) {
+        r = &Pending[i];
+        if (!r->inUse || r->done || ++r->waited < FILE_REPLY_TICKS)
+            continue;
+        if (r->tries++ >= FILE_RETRIES) {
+            FailRequest(r, FILE_ERR_TIMEOUT);
+            continue;
+        }
+        r->frame[0] |= FILE_OP_RESEND;
+        Stats.resends++;
+        if (!SendRequestFrame(r))
+            FailRequest(r, FILE_ERR_LINK);
+    }
+    return TRUE;
+}
+
+/* Build and send a request; waits for a free entry if all are in flight */
+static PendingRequest *StartRequest(UBYTE op, WORD fh, UBYTE handle, ULONG offset,
+                                    UWORD length, const UBYTE *data, ULONG dataLength)
+{
+    PendingRequest *r = NULL;
+    UBYTE seq;
+    LONG i;
+
+    if (!Link || dataLength > FRAME_MAX_PAYLOAD - FILE_HEADER_SIZE) {
+        LastError = Link ? FILE_ERR_IO : FILE_ERR_LINK;
+        return NULL;
+    }
+
+    while (!r) {
+        for (i = 0; i < FILE_MAX_PENDING; i++) {
+            if (!Pending[i].inUse) {
+                r = &Pending[i];
+                break;
+            }
+        }
+        if (!r && !PollOnce())
+            return NULL;
+    }
+
+    /* Skip sequence numbers still in flight */
+    do {
+        seq = NextSeq++;
+        for (i = 0; i < FILE_MAX_PENDING; i++) {
+            if (Pending[i].inUse && Pending[i].seq == seq)
+                break;
+        }
+    } while (i < FILE_MAX_PENDING);
+
+    r->inUse = TRUE;
+    r->detached = FALSE;
+    r->done = FALSE;
+    r->seq = seq;
+    r->op = op;
+    r->fh = fh;
+    r->slot = -1;
+    r->status = FILE_OK;
+    r->tries = 0;
+
+    r->frame[0] = op;
+    r->frame[1] = seq;
+    r->frame[2] = handle;
+    r->frame[3] = 0;
+    PutLong(r->frame + 4, offset);
+    r->frame[8] = (UBYTE)(length >> 8);
+    r->frame[9] = (UBYTE)length;
+    if (dataLength > 0)
+        CopyBytes(r->frame + FILE_HEADER_SIZE, data, dataLength);
+    r->length = FILE_HEADER_SIZE + dataLength;
+
+    if (!SendRequestFrame(r)) {
+        r->inUse = FALSE;
+        LastError = FILE_ERR_LINK;
+        return NULL;
+    }
+    return r;
+}
+
+/* Wait for a request's reply; the caller reads r->frame and calls EndRequest() */
+static BOOL WaitRequest(PendingRequest *r)
+{
+    while (!r->done) {
+        if (!PollOnce()) {
+            r->inUse = FALSE;
+            return FALSE;
+        }
+    }
+    if (r->status != FILE_OK) {
+        LastError = r->status;
+        r->inUse = FALSE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void EndRequest(PendingRequest *r)
+{
+    r->inUse = FALSE;
+}
+
+/* Send a request and wait for its reply */
+static PendingRequest *Transact(UBYTE op, WORD fh, UBYTE handle, ULONG offset,
+                                UWORD length, const UBYTE *data, ULONG dataLength)
+{
+    PendingRequest *r;
+
+    r = StartRequest(op, fh, handle, offset, length, data, dataLength);
+    if (!r || !WaitRequest(r))
+        return NULL;
+    return r;
+}
+
+/* Does a reply answer this request? Seq and op alone repeat every 256
+   requests; OPEN, STAT and LIST replies carry new values throughout */
+static BOOL ReplyMatches(const PendingRequest *r, const UBYTE *payload)
+{
+    if (r->seq != payload[1] || r->op != (payload[0] & ~FILE_OP_RESEND))
+        return FALSE;
+
+    switch (r->op) {
+    case FILE_OP_READ:
+        return (BOOL)(payload[2] == r->frame[2] &&
+                      GetLong(payload + 4) == GetLong(r->frame + 4) &&
+                      GetWord(payload + 8) <= GetWord(r->frame + 8));
+    case FILE_OP_WRITE:
+        return (BOOL)(payload[2] == r->frame[2] &&
+                      (payload[3] != FILE_OK || GetWord(payload + 8) == GetWord(r->frame + 8)));
+    case FILE_OP_CLOSE:
+    case FILE_OP_DELTA:
+        return (BOOL)(payload[2] == r->frame[2]);
+    default:
+        return TRUE;
+    }
+}
+
+/* Called by the flow link for every frame of a type it does not handle */
+static void FileFrameReceived(UBYTE type, UWORD credit, const UBYTE *payload,
+                              ULONG length, APTR userData)
+{
+    PendingRequest *r = NULL;
+    CacheBlock *b;
+    ULONG dataLength;
+    LONG i;
+
+    (void)credit;
+    (void)userData;
+    if (type != FRAME_FILE || length < FILE_HEADER_SIZE)
+        return;
+
+    for (i = 0; i < FILE_MAX_PENDING; i++) {
+        if (Pending[i].inUse && !Pending[i].done && ReplyMatches(&Pending[i], payload)) {
+            r = &Pending[i];
+            break;
+        }
+    }
+    if (!r)
+        return;     /* Late reply to a request already resent or given up */
+
+    r->status = payload[3];
+    dataLength = length - FILE_HEADER_SIZE;
+
+    /* Block reads go straight into their cache slot */
+    if (r->slot >= 0) {
+        b = &Cache[r->slot];
+        if (b->pending && b->fh == r->fh && b->block == r->block) {
+            b->pending = FALSE;
+            if (r->status == FILE_OK && !b->stale) {
+                if (dataLength > FILE_BLOCK_SIZE)
+                    dataLength = FILE_BLOCK_SIZE;
+                CopyBytes(b->data, payload + FILE_HEADER_SIZE, dataLength);
+                b->length = (UWORD)dataLength;
+                b->ready = TRUE;
+            } else {
+                b->fh = -1;
+            }
+            b->stale = FALSE;
+        }
+    } else {
+        CopyBytes(r->frame, payload, length);
+        r->length = length;
+    }
+
+    if (r->op == FILE_OP_WRITE && r->status != FILE_OK && r->fh >= 0 &&
+        Files[r->fh].writeError == FILE_OK)
+        Files[r->fh].writeError = r->status;
+
+    r->done = TRUE;
+    if (r->detached)
+        r->inUse = FALSE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Block cache                                                         */
+/* ------------------------------------------------------------------ */
+
+static LONG FindBlock(WORD fh, ULONG block)
+{
+    LONG i;
+
+    for (i = 0; i < FILE_CACHE_BLOCKS; i++) {
+        if (Cache[i].fh == fh && Cache[i].block == block && (Cache[i].ready || Cache[i].pending))
+            return i;
+    }
+    return -1;
+}
+
+/* Free slot, else the least recently used one not waiting for a reply */
+static LONG AllocateBlock(void)
+{
+    LONG best = -1;
+    LONG i;
+
+    for (i = 0; i < FILE_CACHE_BLOCKS; i++) {
+        if (Cache[i].pending)
+            continue;
+        if (Cache[i].fh < 0)
+            return i;
+        if (best < 0 || Cache[i].lastUse < Cache[best].lastUse)
+            best = i;
+    }
+    return best;
+}
+
+/* Request a block into the cache without waiting; returns its slot */
+static LONG RequestBlock(WORD fh, ULONG block, BOOL ahead)
+{
+    PendingRequest *r;
+    CacheBlock *b;
+    LONG slot;
+
+    slot = AllocateBlock();
+    if (slot < 0)
+        return -1;
+
+    b = &Cache[slot];
+    b->fh = fh;
+    b->block = block;
+    b->lastUse = ++UseClock;
+    b->length = 0;
+    b->ready = FALSE;
+    b->pending = TRUE;
+    b->stale = FALSE;
+    b->ahead = ahead;
+
+    r = StartRequest(FILE_OP_READ, fh, Files[fh].remote, block * FILE_BLOCK_SIZE,
+                     FILE_BLOCK_SIZE, NULL, 0);
+    if (!r) {
+        b->pending = FALSE;
+        b->fh = -1;
+        return -1;
+    }
+    r->slot = (WORD)slot;
+    r->block = block;
+    r->detached = TRUE;
+    return slot;
+}
+
+/* Queue reads for the blocks after block, keeping one request free for demand reads */
+static void ReadAhead(WORD fh, ULONG block)
+{
+    RemoteFile *f = &Files[fh];
+    ULONG next;
+    ULONG i;
+
+    for (i = 1; i <= FILE_READAHEAD; i++) {
+        next = block + i;
+        if (next * FILE_BLOCK_SIZE >= f->size)
+            break;
+        if (FindBlock(fh, next) >= 0)
+            continue;
+        if (PendingCount() >= FILE_MAX_PENDING - 1)
+            break;
+        if (RequestBlock(fh, next, TRUE) < 0)
+            break;
+        Stats.readAhead++;
+    }
+}
+
+/* Forget cached data overlapping a write; replies still on the way are dropped */
+static void InvalidateRange(WORD fh, ULONG start, ULONG length)
+{
+    ULONG first = start / FILE_BLOCK_SIZE;
+    ULONG last = (start + length - 1) / FILE_BLOCK_SIZE;
+    CacheBlock *b;
+    LONG i;
+
+    for (i = 0; i < FILE_CACHE_BLOCKS; i++) {
+        b = &Cache[i];
+        if (b->fh != fh || b->block < first || b->block > last)
+            continue;
+        if (b->pending) {
+            b->stale = TRUE;
+        } else {
+            b->fh = -1;
+            b->ready = FALSE;
+        }
+    }
+}
+
+/*
+ * Note an access to block and decide whether to read around the cache.
+ * A reader that keeps moving on to the next block is sequential. Other
+ * accesses are scattered; when few of those find their block cached,
+ * whole-block fetches only cost line time, so most such misses read
+ * just the bytes asked for. Every FILE_SCATTER_SAMPLE-th one still goes
+ * through the cache, so a working set that forms later is noticed.
+ */
+static BOOL BypassCache(RemoteFile *f, WORD fh, ULONG block)
+{
+    BOOL found;
+
+    if (block == f->lastBlock + 1) {
+        if (f->run < FILE_SEQUENTIAL_RUN)
+            f->run++;
+    } else if (block != f->lastBlock) {
+        f->run = 0;
+    }
+    f->lastBlock = block;
+    if (f->run > 0)
+        return FALSE;
+
+    found = (BOOL)(FindBlock(fh, block) >= 0);
+    f->scatterAccesses++;
+    if (found)
+        f->scatterHits++;
+    if (f->scatterAccesses >= FILE_SCATTER_WINDOW) {
+        f->scatterAccesses /= 2;
+        f->scatterHits /= 2;
+    }
+
+    if (found || f->scatterAccesses < FILE_SCATTER_MIN ||
+        f->scatterHits * 4 >= f->scatterAccesses)
+        return FALSE;
+    return (BOOL)(++f->bypassCount % FILE_SCATTER_SAMPLE != 0);
+}
+
+/* Get a block, from the cache or by waiting for it; returns its slot */
+static LONG GetBlock(WORD fh, ULONG block)
+{
+    RemoteFile *f = &Files[fh];
+    CacheBlock *b;
+    LONG slot;
+
+    slot = FindBlock(fh, block);
+    if (slot >= 0 && Cache[slot].ready) {
+        Stats.cacheHits++;
+    } else {
+        Stats.cacheMisses++;
+        if (slot < 0)
+            slot = RequestBlock(fh, block, FALSE);
+        if (slot < 0)
+            return -1;
+    }
+    b = &Cache[slot];
+    b->lastUse = ++UseClock;        /* Not to be evicted by the read-ahead */
+
+    /* A sequential reader gets the next blocks requested before it asks */
+    if (f->run >= FILE_SEQUENTIAL_RUN)
+        ReadAhead(fh, block);
+
+    while (b->pending && b->fh == fh && b->block == block) {
+        if (!PollOnce())
+            return -1;
+    }
+    if (!b->ready || b->fh != fh || b->block != block) {
+        if (LastError == FILE_OK)
+            LastError = FILE_ERR_TIMEOUT;
+        return -1;
+    }
+
+    if (b->ahead) {
+        b->ahead = FALSE;
+        Stats.readAheadUsed++;
+    }
+    return slot;
+}
+
+/* ------------------------------------------------------------------ */
+/* Write-behind                                                        */
+/* ------------------------------------------------------------------ */
+
+/* Send the gathered writes without waiting for the reply */
+static BOOL SendWrites(WORD fh)
+{
+    RemoteFile *f = &Files[fh];
+    PendingRequest *r;
+
+    if (f->writeLength == 0)
+        return TRUE;
+
+    InvalidateRange(fh, f->writeStart, f->writeLength);
+    r = StartRequest(FILE_OP_WRITE, fh, f->remote, f->writeStart, f->writeLength,
+                     f->writeBuffer, f->writeLength);
+    f->writeLength = 0;
+    if (!r)
+        return FALSE;
+
+    r->detached = TRUE;
+    Stats.writeRequests++;
+    return TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Public interface                                                    */
+/* ------------------------------------------------------------------ */
+
+/* Attach to a flow link */
+BOOL InitRemoteFiles(FlowLink *fl, LinkPollFunc poll, APTR pollData)
+{
+    LONG i;
+
+    if (!fl || !poll)
+        return FALSE;
+
+    Link = fl;
+    Poll = poll;
+    PollData = pollData;
+    fl->frameHandler = FileFrameReceived;
+    fl->frameHandlerData = NULL;
+
+    for (i = 0; i < FILE_MAX_OPEN; i++)
+        Files[i].open = FALSE;
+    for (i = 0; i < FILE_CACHE_BLOCKS; i++) {
+        Cache[i].fh = -1;
+        Cache[i].ready = FALSE;
+        Cache[i].pending = FALSE;
+    }
+    for (i = 0; i < FILE_MAX_PENDING; i++)
+        Pending[i].inUse = FALSE;
+
+    Caching = TRUE;
+    LastError = FILE_OK;
+    ClearStats();
+    return TRUE;
+}
+
+/* Close everything and detach */
+void CleanupRemoteFiles(void)
+{
+    LONG i;
+
+    if (!Link)
+        return;
+
+    for (i = 0; i < FILE_MAX_OPEN; i++) {
+        if (Files[i].open)
+            RemoteClose(i);
+    }
+    Link->frameHandler = NULL;
+    Link = NULL;
+}
+
+void SetRemoteCaching(BOOL enable)
+{
+    Caching = enable;
+}
+
+LONG RemoteOpen(const char *path, char mode)
+{
+    PendingRequest *r;
+    RemoteFile *f;
+    ULONG pathLength = StringLength(path);
+    LONG fh;
+
+    for (fh = 0; fh < FILE_MAX_OPEN; fh++) {
+        if (!Files[fh].open)
+            break;
+    }
+    if (fh == FILE_MAX_OPEN || pathLength > FILE_PATH_MAX) {
+        LastError = FILE_ERR_HANDLE;
+        return -1;
+    }
+
+    r = Transact(FILE_OP_OPEN, -1, (UBYTE)mode, 0, 0, (const UBYTE *)path, pathLength);
+    if (!r)
+        return -1;
+
+    f = &Files[fh];
+    f->open = TRUE;
+    f->cached = Caching;
+    f->remote = r->frame[2];
+    f->position = 0;
+    f->size = GetLong(r->frame + 4);
+    f->lastBlock = 0xFFFFFFFFUL;        /* Block 0 counts as the next one */
+    f->run = 0;
+    f->scatterAccesses = 0;
+    f->scatterHits = 0;
+    f->bypassCount = 0;
+    f->writeError = FILE_OK;
+    f->writeLength = 0;
+    EndRequest(r);
+    return fh;
+}
+
+BOOL RemoteClose(LONG fh)
+{
+    PendingRequest *r;
+    RemoteFile *f = FileFor(fh);
+    BOOL ok;
+    LONG i;
+
+    if (!f)
+        return FALSE;
+
+    ok = RemoteFlush(fh);
+
+    /* Read-ahead still on the wire is dropped when it arrives */
+    for (i = 0; i < FILE_CACHE_BLOCKS; i++) {
+        if (Cache[i].fh == fh) {
+            if (Cache[i].pending)
+                Cache[i].stale = TRUE;
+            else
+                Cache[i].fh = -1;
+        }
+    }
+
+    r = Transact(FILE_OP_CLOSE, (WORD)fh, f->remote, 0, 0, NULL, 0);
+    if (r)
+        EndRequest(r);
+    else
+        ok = FALSE;
+
+    f->open = FALSE;
+    return ok;
+}
+
+LONG RemoteRead(LONG fh, APTR buffer, ULONG length)
+{
+    RemoteFile *f = FileFor(fh);
+    PendingRequest *r;
+    UBYTE *out = (UBYTE *)buffer;
+    ULONG total = 0;
+    ULONG block;
+    ULONG offset;
+    ULONG n;
+    LONG slot;
+    CacheBlock *b;
+    BOOL bypass;
+
+    if (!f)
+        return -1;
+
+    /* Gathered writes go first so the read sees them */
+    if (f->writeLength > 0 && !SendWrites((WORD)fh))
+        return -1;
+
+    if (f->position >= f->size)
+        return 0;
+    if (length > f->size - f->position)
+        length = f->size - f->position;
+
+    while (total < length) {
+        n = length - total;
+        block = f->position / FILE_BLOCK_SIZE;
+        offset = f->position % FILE_BLOCK_SIZE;
+        bypass = (BOOL)(!f->cached || BypassCache(f, (WORD)fh, block));
+        if (bypass) {
+            /* One request and one reply per piece, exactly as asked for */
+            if (f->cached) {
+                if (n > FILE_BLOCK_SIZE - offset)
+                    n = FILE_BLOCK_SIZE - offset;
+                Stats.bypassed++;
+            }
+            if (n > FILE_BLOCK_SIZE)
+                n = FILE_BLOCK_SIZE;
+            r = Transact(FILE_OP_READ, (WORD)fh, f->remote, f->position, (UWORD)n, NULL, 0);
+            if (!r)
+                return total ? (LONG)total : -1;
+            n = GetWord(r->frame + 8);
+            if (n > length - total)
+                n = length - total;
+            CopyBytes(out + total, r->frame + FILE_HEADER_SIZE, n);
+            EndRequest(r);
+        } else {
+            slot = GetBlock((WORD)fh, block);
+            if (slot < 0)
+                return total ? (LONG)total : -1;
+            b = &Cache[slot];
+            if (offset >= b->length)
+                break;          /* File is shorter than the host said */
+            n = b->length - offset;
+            if (n > length - total)
+                n = length - total;
+            CopyBytes(out + total, b->data + offset, n);
+        }
+        if (n == 0)
+            break;
+        total += n;
+        f->position += n;
+    }
+
+    Stats.bytesRead += total;
+    return (LONG)total;
+}
+
+LONG RemoteWrite(LONG fh, const APTR data, ULONG length)
+{
+    RemoteFile *f = FileFor(fh);
+    const UBYTE *in = (const UBYTE *)data;
+    PendingRequest *r;
+    ULONG total = 0;
+    ULONG n;
+
+    if (!f)
+        return -1;
+    if (f->writeError != FILE_OK) {
+        LastError = f->writeError;
+        f->writeError = FILE_OK;
+        return -1;
+    }
+
+    Stats.writeCalls++;
+    while (total < length) {
+        n = length - total;
+        if (!f->cached) {
+            if (n > FILE_WRITE_MAX)
+                n = FILE_WRITE_MAX;
+            InvalidateRange((WORD)fh, f->position, n);
+            r = Transact(FILE_OP_WRITE, (WORD)fh, f->remote, f->position, (UWORD)n, in + total, n);
+            if (!r)
+                return total ? (LONG)total : -1;
+            EndRequest(r);
+            Stats.writeRequests++;
+        } else {
+            /* Not contiguous with what is gathered: send that first */
+            if (f->writeLength > 0 && f->position != f->writeStart + f->writeLength) {
+                if (!SendWrites((WORD)fh))
+                    return total ? (LONG)total : -1;
+            }
+            if (f->writeLength == 0)
+                f->writeStart = f->position;
+            if (n > (ULONG)(FILE_WRITE_MAX - f->writeLength))
+                n = FILE_WRITE_MAX - f->writeLength;
+            CopyBytes(f->writeBuffer + f->writeLength, in + total, n);
+            f->writeLength += (UWORD)n;
+        }
+        total += n;
+        f->position += n;
+        if (f->position > f->size)
+            f->size = f->position;
+        if (f->cached && f->writeLength == FILE_WRITE_MAX && !SendWrites((WORD)fh))
+            return -1;
+    }
+
+    Stats.bytesWritten += total;
+    return (LONG)total;
+}
+
+BOOL RemoteSeek(LONG fh, ULONG position)
+{
+    RemoteFile *f = FileFor(fh);
+
+    if (!f)
+        return FALSE;
+    f->position = position;
+    return TRUE;
+}
+
+ULONG RemoteTell(LONG fh)
+{
+    RemoteFile *f = FileFor(fh);
+
+    return f ? f->position : 0;
+}
+
+ULONG RemoteFileSize(LONG fh)
+{
+    RemoteFile *f = FileFor(fh);
+
+    return f ? f->size : 0;
+}
+
+BOOL RemoteFlush(LONG fh)
+{
+    RemoteFile *f = FileFor(fh);
+    BOOL busy = TRUE;
+    LONG i;
+
+    if (!f)
+        return FALSE;
+
+    SendWrites((WORD)fh);
+    while (busy) {
+        busy = FALSE;
+        for (i = 0; i < FILE_MAX_PENDING; i++) {
+            if (Pending[i].inUse && Pending[i].op == FILE_OP_WRITE && Pending[i].fh == fh)
+                busy = TRUE;
+        }
+        if (busy && !PollOnce())
+            return FALSE;
+    }
+
+    if (f->writeError != FILE_OK) {
+        LastError = f->writeError;
+        f->writeError = FILE_OK;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL RemoteStat(const char *path, RemoteStatInfo *info)
+{
+    PendingRequest *r;
+    ULONG pathLength = StringLength(path);
+
+    if (pathLength > FILE_PATH_MAX) {
+        LastError = FILE_ERR_NOTFOUND;
+        return FALSE;
+    }
+
+    r = Transact(FILE_OP_STAT, -1, 0, 0, 0, (const UBYTE *)path, pathLength);
+    if (!r)
+        return FALSE;
+
+    info->size = GetLong(r->frame + 4);
+    info->flags = (UBYTE)GetWord(r->frame + 8);
+    info->modified = (r->length >= FILE_HEADER_SIZE + 4) ? GetLong(r->frame + FILE_HEADER_SIZE) : 0;
+    EndRequest(r);
+    return TRUE;
+}
+
+/* Entries come several to a reply: size(4) modified(4) flags(1) name NUL */
+LONG RemoteList(const char *path, RemoteListCallback callback, APTR userData)
+{
+    PendingRequest *r;
+    RemoteStatInfo info;
+    ULONG pathLength = StringLength(path);
+    ULONG index = 0;
+    ULONG pos;
+    UWORD count;
+    LONG total = 0;
+
+    if (pathLength > FILE_PATH_MAX) {
+        LastError = FILE_ERR_NOTFOUND;
+        return -1;
+    }
+
+    while (index != FILE_LIST_END) {
+        r = Transact(FILE_OP_LIST, -1, 0, index, 0, (const UBYTE *)path, pathLength);
+        if (!r)
+            return -1;
+
+        index = GetLong(r->frame + 4);
+        count = GetWord(r->frame + 8);
+        pos = FILE_HEADER_SIZE;
+        /* The host terminates every name; make sure of it anyway */
+        r->frame[r->length - 1] = '\0';
+        while (count-- > 0 && pos + 10 <= r->length) {
+            info.size = GetLong(r->frame + pos);
+            info.modified = GetLong(r->frame + pos + 4);
+            info.flags = r->frame[pos + 8];
+            pos += 9;
+            callback((const char *)r->frame + pos, &info, userData);
+            pos += StringLength((const char *)r->frame + pos) + 1;
+            total++;
+        }
+        EndRequest(r);
+    }
+    return total;
+}
+
+/* The host keeps what is written to a delta handle as signatures */
+LONG RemoteDelta(LONG fh, ULONG oldLength, UWORD blockSize)
+{
+    PendingRequest *r;
+    RemoteFile *f = FileFor(fh);
+
+    if (!f || !RemoteFlush(fh))
+        return -1;
+
+    r = Transact(FILE_OP_DELTA, (WORD)fh, f->remote, oldLength, blockSize, NULL, 0);
+    if (!r)
+        return -1;
+
+    /* From here on the handle reads the delta stream from its start */
+    InvalidateRange((WORD)fh, 0, 0xFFFFFFFFUL);
+    f->size = GetLong(r->frame + 4);
+    f->position = 0;
+    f->lastBlock = 0xFFFFFFFFUL;
+    f->run = 0;
+    EndRequest(r);
+    return (LONG)f->size;
+}
+
+UWORD RemoteFileError(void)
+{
+    return LastError;
+}
+
+void GetRemoteFileStats(RemoteFileStats *stats, BOOL reset)
+{
+    *stats = Stats;
+    if (reset)
+        ClearStats();
+}
@@ -0,0 +1,371 @@
+/*
+ * Amiga Packet Communication Framework - Credit-Based Flow Control
+ * In-band, binary-safe flow control for links without RTS/CTS.
+ *
+ * Each side advertises a 16-bit credit limit: the count of payload bytes
+ * it has delivered to its application (mod 65536) plus the free space
+ * left in its receive buffer. The sender never lets its own count of
+ * payload bytes sent run past the peer's limit. Limits are cumulative,
+ * so a lost update is repaired by any later frame; every frame carries
+ * the current limit, and a CREDIT frame is only sent on its own when the
+ * window has opened noticeably and nothing else is going out.
+ *
+ * DATA and CREDIT frames also carry the sender's byte offset and the
+ * offset it expects next from the peer (an acknowledgement). The line
+ * keeps frames in order, so DATA that starts past the expected offset
+ * means a frame was lost: it is dropped, and a CREDIT frame with
+ * FLOW_CREDIT_RESEND asks the peer to go back to the expected offset.
+ * Senders keep unacknowledged bytes in txRing for that (go-back-N), so
+ * the application sees the stream without holes.
+ */
+
+#include <exec/types.h>
+
+#include "amiga_packet_framework.h"
+
+#define TX_MASK (FLOW_TX_BUFFER_SIZE - 1)
+
+/* Forward declarations */
+static void FlowFrameReceived(UBYTE type, UWORD credit, const UBYTE *payload,
+                              ULONG length, APTR userData);
+
+/* Current limit this side can advertise */
+static UWORD CurrentLimit(const FlowLink *fl)
+{
+    return (UWORD)(fl->rxConsumed + (fl->rxSize - fl->rxCount));
+}
+
+/* Next payload offset we expect from the peer */
+static UWORD Expected(const FlowLink *fl)
+{
+    return (UWORD)(fl->rxConsumed + fl->rxCount);
+}
+
+/* Does the peer's offset lie past what has arrived, i.e. was data lost? */
+static BOOL Missing(const FlowLink *fl, UWORD offset)
+{
+    UWORD ahead = (UWORD)(offset - Expected(fl));
+
+    return (BOOL)(ahead != 0 && ahead <= FLOW_MAX_WINDOW);
+}
+
+/* Encode and write one frame carrying our current limit */
+static BOOL WriteFlowFrame(FlowLink *fl, UBYTE type, const UBYTE *payload, ULONG length)
+{
+    ULONG encoded;
+    UWORD limit = CurrentLimit(fl);
+
+    encoded = EncodeFrame(type, limit, payload, length, fl->frame, sizeof(fl->frame));
+    if (encoded == 0)
+        return FALSE;
+
+    /* Before the write: a writer that delivers at once may have the
+       peer answer before it returns */
+    fl->advertisedLimit = limit;
+    if (!fl->write(fl->frame, encoded, fl->writeData))
+        return FALSE;
+
+    fl->framesSent++;
+    return TRUE;
+}
+
+/* Offset and acknowledgement, ahead of DATA and CREDIT payloads */
+static void PutFlowHeader(FlowLink *fl, UBYTE *out, UWORD offset)
+{
+    UWORD expected = Expected(fl);
+
+    out[0] = (UBYTE)(offset >> 8);
+    out[1] = (UBYTE)offset;
+    out[2] = (UBYTE)(expected >> 8);
+    out[3] = (UBYTE)expected;
+}
+
+/* A CREDIT frame: our limit, how far we have sent and received, and
+   whether the peer has to go back */
+static BOOL WriteCreditFrame(FlowLink *fl, UBYTE flags)
+{
+    UBYTE credit[FLOW_DATA_HEADER + 1];
+
+    PutFlowHeader(fl, credit, fl->txSent);
+    credit[FLOW_DATA_HEADER] = flags;
+    fl->creditFrames++;
+    return WriteFlowFrame(fl, FRAME_CREDIT, credit, sizeof(credit));
+}
+
+/* Tell the peer once a quarter of the window has opened up, or a
+   quarter of its resend ring, which our acknowledgement frees */
+static void AdvertiseOpening(FlowLink *fl)
+{
+    ULONG step = (fl->rxSize < FLOW_TX_BUFFER_SIZE) ? fl->rxSize : FLOW_TX_BUFFER_SIZE;
+
+    if ((UWORD)(CurrentLimit(fl) - fl->advertisedLimit) >= step / 4)
+        WriteCreditFrame(fl, 0);
+}
+
+/* Send one DATA frame of ring bytes starting at offset */
+static BOOL WriteDataFrame(FlowLink *fl, UWORD offset, ULONG length)
+{
+    ULONG start = offset & TX_MASK;
+    ULONG first = FLOW_TX_BUFFER_SIZE - start;
+
+    if (first > length)
+        first = length;
+    PutFlowHeader(fl, fl->payload, offset);
+    CopyBytes(fl->payload + FLOW_DATA_HEADER, fl->txRing + start, first);
+    CopyBytes(fl->payload + FLOW_DATA_HEADER + first, fl->txRing, length - first);
+    return WriteFlowFrame(fl, FRAME_DATA, fl->payload, FLOW_DATA_HEADER + length);
+}
+
+/* Drop ring bytes the peer has acknowledged */
+static void TakeAck(FlowLink *fl, UWORD ack)
+{
+    /* Only an acknowledgement within what we have sent moves us on */
+    if ((UWORD)(ack - fl->txAcked) <= (UWORD)(fl->txSent - fl->txAcked))
+        fl->txAcked = ack;
+}
+
+/* Go back to the peer's expected offset and send everything again.
+   Those bytes were sent within the peer's limit once, so still fit */
+static void Resend(FlowLink *fl)
+{
+    UWORD offset = fl->txAcked;
+    UWORD chunk;
+
+    while (offset != fl->txSent) {
+        chunk = (UWORD)(fl->txSent - offset);
+        if (chunk > FLOW_MAX_CHUNK)
+            chunk = FLOW_MAX_CHUNK;
+        if (!WriteDataFrame(fl, offset, chunk))
+            break;
+        fl->txResent += chunk;
+        offset = (UWORD)(offset + chunk);
+    }
+}
+
+/* Set up a link over a caller-supplied receive ring */
+void InitFlowLink(FlowLink *fl, UBYTE *rxRing, ULONG rxSize,
+                  LinkWriteFunc write, APTR writeData)
+{
+    /* Limits are 16-bit; the window must stay below half the number space */
+    if (rxSize > FLOW_MAX_WINDOW)
+        rxSize = FLOW_MAX_WINDOW;
+
+    fl->write = write;
+    fl->writeData = writeData;
+    fl->frameHandler = NULL;
+    fl->frameHandlerData = NULL;
+
+    fl->rxRing = rxRing;
+    fl->rxSize = rxSize;
+    fl->rxHead = 0;
+    fl->rxTail = 0;
+    fl->rxCount = 0;
+    fl->rxConsumed = 0;
+    fl->advertisedLimit = 0;
+    fl->rxGap = FALSE;
+    fl->rxGapEnd = 0;
+
+    fl->txSent = 0;
+    fl->txAcked = 0;
+    fl->txLimit = 0;
+
+    fl->creditStalls = 0;
+    fl->creditFrames = 0;
+    fl->framesSent = 0;
+    fl->rxOverruns = 0;
+    fl->rxGaps = 0;
+    fl->txResent = 0;
+
+    InitFrameDecoder(&fl->decoder, FlowFrameReceived, fl);
+}
+
+/* Announce our window; call once after both ends are up */
+BOOL StartFlowLink(FlowLink *fl)
+{
+    return WriteCreditFrame(fl, 0);
+}
+
+/* Payload bytes we may send right now */
+ULONG FlowCredit(const FlowLink *fl)
+{
+    UWORD credit = (UWORD)(fl->txLimit - fl->txSent);
+
+    /* Anything beyond the maximum window is a stale or reordered limit */
+    return (credit > FLOW_MAX_WINDOW) ? 0 : credit;
+}
+
+/* Send as much of the data as the peer has room for */
+ULONG FlowSend(FlowLink *fl, const UBYTE *data, ULONG length)
+{
+    ULONG sent = 0;
+    ULONG chunk;
+    ULONG credit = FlowCredit(fl);
+    ULONG room = FLOW_TX_BUFFER_SIZE - (UWORD)(fl->txSent - fl->txAcked);
+    ULONG start;
+    ULONG first;
+
+    /* Unacknowledged bytes are kept for resending */
+    if (credit > room)
+        credit = room;
+
+    while (sent < length) {
+        chunk = length - sent;
+        if (chunk > FLOW_MAX_CHUNK)
+            chunk = FLOW_MAX_CHUNK;
+        if (chunk > credit)
+            chunk = credit;
+
+        if (chunk == 0) {
+            fl->creditStalls++;
+            break;
+        }
+
+        start = fl->txSent & TX_MASK;
+        first = FLOW_TX_BUFFER_SIZE - start;
+        if (first > chunk)
+            first = chunk;
+        CopyBytes(fl->txRing + start, data + sent, first);
+        CopyBytes(fl->txRing, data + sent + first, chunk - first);
+        if (!WriteDataFrame(fl, fl->txSent, chunk))
+            break;
+
+        fl->txSent = (UWORD)(fl->txSent + chunk);
+        credit -= chunk;
+        sent += chunk;
+    }
+
+    return sent;
+}
+
+/* Send a non-data frame (no credit consumed) with the current limit */
+BOOL FlowSendFrame(FlowLink *fl, UBYTE type, const UBYTE *payload, ULONG length)
+{
+    return WriteFlowFrame(fl, type, payload, length);
+}
+
+/* Frame decoder callback: absorb credit and acknowledgements, store data */
+static void FlowFrameReceived(UBYTE type, UWORD credit, const UBYTE *payload,
+                              ULONG length, APTR userData)
+{
+    FlowLink *fl = (FlowLink *)userData;
+    UWORD offset;
+    UWORD behind;
+    ULONG space;
+    ULONG first;
+
+    /* Take the newer limit; ignore ones that would move it backwards */
+    if ((UWORD)(credit - fl->txLimit) <= FLOW_MAX_WINDOW)
+        fl->txLimit = credit;
+
+    if (type != FRAME_DATA && type != FRAME_CREDIT) {
+        if (fl->frameHandler)
+            fl->frameHandler(type, credit, payload, length, fl->frameHandlerData);
+        return;
+    }
+    if (length < FLOW_DATA_HEADER)
+        return;
+
+    offset = (UWORD)((payload[0] << 8) | payload[1]);
+    TakeAck(fl, (UWORD)((payload[2] << 8) | payload[3]));
+
+    if (type == FRAME_CREDIT) {
+        if (length > FLOW_DATA_HEADER && (payload[FLOW_DATA_HEADER] & FLOW_CREDIT_RESEND))
+            Resend(fl);
+
+        /* The peer has sent more than arrived: its last frames were lost.
+           Ask every time; CREDIT frames come seldom enough */
+        if (Missing(fl, offset)) {
+            fl->rxGap = TRUE;
+            fl->rxGapEnd = offset;
+            WriteCreditFrame(fl, FLOW_CREDIT_RESEND);
+        }
+        return;
+    }
+
+    /* Past the expected offset: an earlier frame was lost. Drop this one
+       and ask once for the frames already in flight; a gap in the resend
+       itself starts below rxGapEnd and is asked for again */
+    if (Missing(fl, offset)) {
+        fl->rxGaps++;
+        behind = (UWORD)(fl->rxGapEnd - offset);
+        if (!fl->rxGap || (behind != 0 && behind <= FLOW_MAX_WINDOW)) {
+            fl->rxGap = TRUE;
+            fl->rxGapEnd = (UWORD)(offset + 1);
+            WriteCreditFrame(fl, FLOW_CREDIT_RESEND);
+        }
+        return;
+    }
+
+    /* Skip anything already received; a resend can overlap */
+    behind = (UWORD)(Expected(fl) - offset);
+    payload += FLOW_DATA_HEADER;
+    length -= FLOW_DATA_HEADER;
+    if (behind >= length)
+        return;
+    payload += behind;
+    length -= behind;
+
+    space = fl->rxSize - fl->rxCount;
+    if (length > space) {
+        /* Peer overran its credit; keep what fits, the rest comes again */
+        fl->rxOverruns += length - space;
+        length = space;
+    }
+    if (length == 0)
+        return;
+
+    first = fl->rxSize - fl->rxHead;
+    if (first > length)
+        first = length;
+    CopyBytes(fl->rxRing + fl->rxHead, payload, first);
+    CopyBytes(fl->rxRing, payload + first, length - first);
+
+    fl->rxHead += length;
+    if (fl->rxHead >= fl->rxSize)
+        fl->rxHead -= fl->rxSize;
+    fl->rxCount += length;
+    fl->rxGap = FALSE;
+}
+
+/* Feed raw bytes from the device */
+void FlowInput(FlowLink *fl, const UBYTE *data, ULONG length)
+{
+    DecodeFrameBytes(&fl->decoder, data, length);
+}
+
+/* Deliver buffered payload to the application and reopen the window */
+ULONG FlowRead(FlowLink *fl, UBYTE *buffer, ULONG maxLength)
+{
+    ULONG count = fl->rxCount;
+    ULONG first;
+
+    if (count > maxLength)
+        count = maxLength;
+
+    /* At most two runs: up to the end of the ring, then from its start */
+    first = fl->rxSize - fl->rxTail;
+    if (first > count)
+        first = count;
+    CopyBytes(buffer, fl->rxRing + fl->rxTail, first);
+    CopyBytes(buffer + first, fl->rxRing, count - first);
+
+    fl->rxTail += count;
+    if (fl->rxTail >= fl->rxSize)
+        fl->rxTail -= fl->rxSize;
+
+    fl->rxCount -= count;
+    fl->rxConsumed = (UWORD)(fl->rxConsumed + count);
+
+    if (count > 0)
+        AdvertiseOpening(fl);
+
+    return count;
+}
+
+/* Re-advertise the window and our offsets; call periodically. This
+   repairs a lost CREDIT frame, and shows the peer when our last DATA
+   frames never arrived so it can ask for them again */
+void FlowRefreshCredit(FlowLink *fl)
+{
+    WriteCreditFrame(fl, 0);
+}
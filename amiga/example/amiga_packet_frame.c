@@ -0,0 +1,153 @@
+/*
+ * Amiga Packet Communication Framework - Binary Framing
+ * Byte-stuffed frames with CRC-16, safe for any payload byte.
+ *
+ * Wire format:
+ *   FEND | type | credit(hi) | credit(lo) | payload... | crc(hi) | crc(lo) | FEND
+ * FEND and FESC inside the frame are sent as FESC TFEND / FESC TFESC.
+ * The CRC is CRC-16/CCITT (poly 0x1021, init 0xFFFF) over type..payload.
+ * The CRC, escaping and plain-run scanning are CPU kernels
+ * (amiga_packet_kernel.c).
+ */
+
+#include <exec/types.h>
+
+#include "amiga_packet_framework.h"
+
+/* Encode a complete frame; returns encoded length or 0 if it does not fit */
+ULONG EncodeFrame(UBYTE type, UWORD credit, const UBYTE *payload, ULONG length,
+                  UBYTE *out, ULONG outSize)
+{
+    UBYTE header[FRAME_HEADER_SIZE];
+    UBYTE trailer[2];
+    UWORD crc;
+    ULONG pos = 0;
+
+    if (length > FRAME_MAX_PAYLOAD || outSize < FRAME_ENCODED_SIZE(length))
+        return 0;
+
+    header[0] = type;
+    header[1] = (UBYTE)(credit >> 8);
+    header[2] = (UBYTE)credit;
+
+    crc = UpdateCrc16(FRAME_CRC_INIT, header, FRAME_HEADER_SIZE);
+    crc = UpdateCrc16(crc, payload, length);
+
+    trailer[0] = (UBYTE)(crc >> 8);
+    trailer[1] = (UBYTE)crc;
+
+    out[pos++] = FRAME_FEND;
+    pos += EscapeBytes(out + pos, header, FRAME_HEADER_SIZE);
+    pos += EscapeBytes(out + pos, payload, length);
+    pos += EscapeBytes(out + pos, trailer, 2);
+    out[pos++] = FRAME_FEND;
+
+    return pos;
+}
+
+/* Reset a decoder to hunt for the next frame */
+void InitFrameDecoder(FrameDecoder *fd, FrameCallback callback, APTR userData)
+{
+    fd->callback = callback;
+    fd->userData = userData;
+    fd->length = 0;
+    fd->escaped = FALSE;
+    fd->discard = FALSE;
+    fd->framesReceived = 0;
+    fd->crcErrors = 0;
+    fd->dropped = 0;
+}
+
+/* Check and deliver a completed frame */
+static void FinishFrame(FrameDecoder *fd)
+{
+    UWORD crc;
+    ULONG payloadLength;
+
+    if (fd->discard) {
+        fd->dropped++;
+        return;
+    }
+
+    /* Back-to-back FENDs produce empty frames; ignore them */
+    if (fd->length == 0)
+        return;
+
+    if (fd->length < FRAME_HEADER_SIZE + 2) {
+        fd->crcErrors++;
+        return;
+    }
+
+    crc = UpdateCrc16(FRAME_CRC_INIT, fd->buffer, fd->length - 2);
+    if (crc != (UWORD)((fd->buffer[fd->length - 2] << 8) | fd->buffer[fd->length - 1])) {
+        fd->crcErrors++;
+        return;
+    }
+
+    fd->framesReceived++;
+    payloadLength = fd->length - FRAME_HEADER_SIZE - 2;
+    fd->callback(fd->buffer[0],
+                 (UWORD)((fd->buffer[1] << 8) | fd->buffer[2]),
+                 fd->buffer + FRAME_HEADER_SIZE, payloadLength, fd->userData);
+}
+
+/* Feed received bytes; complete frames are passed to the callback */
+void DecodeFrameBytes(FrameDecoder *fd, const UBYTE *data, ULONG length)
+{
+    ULONG run;
+    UBYTE c;
+
+    while (length > 0) {
+        /* Plain bytes inside a frame are copied as a run */
+        if (!fd->escaped && !fd->discard) {
+            run = ScanPlainBytes(data, length);
+            if (run > 0) {
+                if (run > sizeof(fd->buffer) - fd->length) {
+                    fd->discard = TRUE;
+                } else {
+                    CopyBytes(fd->buffer + fd->length, data, run);
+                    fd->length += run;
+                }
+                data += run;
+                length -= run;
+                continue;
+            }
+        }
+
+        c = *data++;
+        length--;
+
+        if (c == FRAME_FEND) {
+            FinishFrame(fd);
+            fd->length = 0;
+            fd->escaped = FALSE;
+            fd->discard = FALSE;
+            continue;
+        }
+
+        if (fd->escaped) {
+            fd->escaped = FALSE;
+            if (c == FRAME_TFEND) {
+                c = FRAME_FEND;
+            } else if (c == FRAME_TFESC) {
+                c = FRAME_FESC;
+            } else {
+                /* Protocol violation: drop the rest of this frame */
+                fd->discard = TRUE;
+            }
+        } else if (c == FRAME_FESC) {
+            fd->escaped = TRUE;
+            continue;
+        }
+
+        if (fd->discard)
+            continue;
+
+        if (fd->length >= sizeof(fd->buffer)) {
+            fd->discard = TRUE;
+            continue;
+        }
+
+        fd->buffer[fd->length++] = c;
+    }
+}
@@ -11,7 +11,8 @@
 #include <proto/dos.h>
 #include <proto/alib.h>
 #include <stdio.h>
-#include <string.h>
+
+#include "amiga_packet_framework.h"
 
 /* Global variables for serial communication */
 struct MsgPort *SerialMP = NULL;
@@ -21,16 +22,31 @@ struct MsgPort *TimerMP = NULL;
 struct timerequest *TimerIO = NULL;
 BOOL TimerOpen = FALSE;
 
-/* Packet processing callback type */
-typedef void (*PacketHandler)(const char *packet, ULONG length);
+/* Invariant replies */
+static const CachedResponse HelloReply = CACHED_RESPONSE("Hello Pi!\r\n");
+
+/* The "Hello Amiga" trigger that goes with DefaultPacketHandler */
+static BOOL HelloRegistered = FALSE;
+
+/* Credit-based flow control over the serial device */
+static FlowLink SerialFlow;
+static UBYTE FlowRxRing[FLOW_RX_BUFFER_SIZE];
+static BOOL FlowEnabled = FALSE;
+static ULONG LastCreditRefresh = 0;
+static ULONG SavedRBufLen = 0;
 
-/* Function prototypes */
-BOOL InitPacketFramework(void);
-void CleanupPacketFramework(void);
-BOOL SendPacket(const char *data, ULONG length);
-ULONG ReceivePacket(char *buffer, ULONG maxLength);
-void ProcessPackets(PacketHandler handler);
-void DefaultPacketHandler(const char *packet, ULONG length);
+/* Where SendPacket() output goes instead of the device, if set */
+static LinkWriteFunc PacketSink = NULL;
+static APTR PacketSinkData = NULL;
+
+/* Internal helpers */
+static ULONG CurrentTicks(void);
+static void WaitForInput(void);
+static BOOL DeviceWrite(const UBYTE *data, ULONG length, APTR userData);
+static ULONG DeviceRead(char *buffer, ULONG maxLength);
+static ULONG PumpFlowInput(void);
+static void HelloTrigger(LONG id, ULONG offset, APTR userData);
+static PacketHandler UseHandler(PacketHandler handler);
 
 /* Initialize the packet communication framework */
 BOOL InitPacketFramework(void)
@@ -59,8 +75,8 @@ BOOL InitPacketFramework(void)
     
     SerialOpen = TRUE;
 
-    /* Configure serial port: 9600 baud, 8N1, no flow control */
-    SerialIO->io_Baud = 9600;
+    /* Configure serial port: calibrated rate, 8N1, no flow control */
+    SerialIO->io_Baud = LoadLinkProfile();
     SerialIO->io_ReadLen = 8;
     SerialIO->io_WriteLen = 8;
     SerialIO->io_StopBits = 1;
@@ -90,12 +106,26 @@ BOOL InitPacketFramework(void)
         }
     }
     
+#ifdef PACKET_PROFILE
+    /* Calibrates the idle counter, so it must run before any traffic */
+    if (!StartProfiler()) {
+        printf("Profiler: no EClock or idle counter task\n");
+    }
+#endif
+    
     return TRUE;
 }
 
 /* Clean up framework resources */
 void CleanupPacketFramework(void)
 {
+    StopSerialTask();
+    DisableFlowControl();
+    
+#ifdef PACKET_PROFILE
+    StopProfiler();
+#endif
+    
     if (SerialOpen) {
         CloseDevice((struct IORequest *)SerialIO);
         SerialOpen = FALSE;
@@ -127,8 +157,8 @@ void CleanupPacketFramework(void)
     }
 }
 
-/* Send a packet */
-BOOL SendPacket(const char *data, ULONG length)
+/* Raw device write, below framing */
+static BOOL DeviceWrite(const UBYTE *data, ULONG length, APTR userData)
 {
     if (!SerialOpen || !SerialIO) 
         return FALSE;
@@ -140,12 +170,210 @@ BOOL SendPacket(const char *data, ULONG length)
     return (DoIO((struct IORequest *)SerialIO) == 0);
 }
 
+/* Send a packet */
+BOOL SendPacket(const char *data, ULONG length)
+{
+    ULONG sent;
+    ULONG now;
+    ULONG waited = 0;
+    ULONG total = length;
+    BOOL result = TRUE;
+    
+    PROFILE_BEGIN(PROFILE_SEND);
+    
+    if (PacketSink) {
+        result = PacketSink((const UBYTE *)data, length, PacketSinkData);
+        PROFILE_END(PROFILE_SEND, length);
+        return result;
+    }
+    
+    if (!FlowEnabled) {
+        result = DeviceWrite((const UBYTE *)data, length, NULL);
+        PROFILE_END(PROFILE_SEND, length);
+        return result;
+    }
+    
+    /* Framed mode: never exceed the peer's credit */
+    while (length > 0) {
+        sent = FlowSend(&SerialFlow, (const UBYTE *)data, length);
+        data += sent;
+        length -= sent;
+        
+        if (length == 0)
+            break;
+        
+        /* Out of credit: take in frames until the peer opens its window */
+        if (!PumpFlowInput()) {
+            if (waited++ >= FLOW_SEND_TIMEOUT) {
+                result = FALSE;
+                break;
+            }
+            WaitForInput();
+        } else {
+            waited = 0;
+        }
+        
+        /* A lost tail of DATA only comes back once the peer sees our offset */
+        now = CurrentTicks();
+        if (now - LastCreditRefresh >= FLOW_REFRESH_TICKS) {
+            FlowRefreshCredit(&SerialFlow);
+            LastCreditRefresh = now;
+        }
+        
+        if (SetSignal(0, 0) & SIGBREAKF_CTRL_C) {
+            result = FALSE;
+            break;
+        }
+    }
+    
+    PROFILE_END(PROFILE_SEND, total - length);
+    return result;
+}
+
+/* Divert SendPacket() output to write; NULL returns it to the device */
+void SetPacketSink(LinkWriteFunc write, APTR userData)
+{
+    PacketSink = write;
+    PacketSinkData = userData;
+}
+
 /* Receive a packet (non-blocking) */
 ULONG ReceivePacket(char *buffer, ULONG maxLength)
 {
+    ULONG now;
+    
+    if (!FlowEnabled)
+        return DeviceRead(buffer, maxLength);
+    
+    PumpFlowInput();
+    
+    /* Periodic re-advertisement repairs a lost credit update */
+    now = CurrentTicks();
+    if (now - LastCreditRefresh >= FLOW_REFRESH_TICKS) {
+        FlowRefreshCredit(&SerialFlow);
+        LastCreditRefresh = now;
+    }
+    
+    return FlowRead(&SerialFlow, (UBYTE *)buffer, maxLength);
+}
+
+/* Framed input for clients waiting on their own frame types; payload stays queued */
+LONG PollFlowInput(BOOL wait, APTR userData)
+{
+    ULONG got;
+    ULONG now;
+
+    if (!FlowEnabled)
+        return -1;
+
+    got = PumpFlowInput();
+    if (got == 0 && wait) {
+        WaitForInput();
+        got = PumpFlowInput();
+    }
+
+    now = CurrentTicks();
+    if (now - LastCreditRefresh >= FLOW_REFRESH_TICKS) {
+        FlowRefreshCredit(&SerialFlow);
+        LastCreditRefresh = now;
+    }
+
+    if (SetSignal(0, 0) & SIGBREAKF_CTRL_C)
+        return -1;
+
+    return (LONG)got;
+}
+
+/* Move raw device input through the frame decoder; returns bytes taken in */
+static ULONG PumpFlowInput(void)
+{
+    char raw[FRAME_ENCODED_SIZE(FRAME_MAX_PAYLOAD)];
+    ULONG bytesRead;
+    ULONG total = 0;
+    
+    while ((bytesRead = DeviceRead(raw, sizeof(raw))) > 0) {
+        FlowInput(&SerialFlow, (const UBYTE *)raw, bytesRead);
+        total += bytesRead;
+    }
+    
+    return total;
+}
+
+/* Switch the link to framed mode with credit-based flow control */
+BOOL EnableFlowControl(void)
+{
+    if (!SerialOpen || !SerialIO)
+        return FALSE;
+    
+    /* The window is in payload bytes; make room for their framing too */
+    if (SerialIO->io_RBufLen < FLOW_DEVICE_BUFFER_SIZE && !SerialTaskRunning()) {
+        if (!SavedRBufLen)
+            SavedRBufLen = SerialIO->io_RBufLen;
+        SerialIO->io_RBufLen = FLOW_DEVICE_BUFFER_SIZE;
+        SerialIO->IOSer.io_Command = SDCMD_SETPARAMS;
+        DoIO((struct IORequest *)SerialIO);
+    }
+    
+    InitFlowLink(&SerialFlow, FlowRxRing, sizeof(FlowRxRing), DeviceWrite, NULL);
+    FlowEnabled = TRUE;
+    LastCreditRefresh = CurrentTicks();
+    
+    return StartFlowLink(&SerialFlow);
+}
+
+/* Return to the raw byte stream, with the device buffer we started from */
+void DisableFlowControl(void)
+{
+    FlowEnabled = FALSE;
+    
+    if (SavedRBufLen && SerialOpen && SerialIO && !SerialTaskRunning()) {
+        SerialIO->io_RBufLen = SavedRBufLen;
+        SerialIO->IOSer.io_Command = SDCMD_SETPARAMS;
+        DoIO((struct IORequest *)SerialIO);
+        SavedRBufLen = 0;
+    }
+}
+
+/* The framework's flow link, or NULL when not in framed mode */
+FlowLink *GetFlowLink(void)
+{
+    return FlowEnabled ? &SerialFlow : NULL;
+}
+
+/* Change the serial rate, keeping the other parameters */
+BOOL SetSerialBaud(ULONG baud)
+{
+    if (!SerialOpen || !SerialIO || SerialTaskRunning())
+        return FALSE;
+    
+    SerialIO->io_Baud = baud;
+    SerialIO->IOSer.io_Command = SDCMD_SETPARAMS;
+    return (BOOL)(DoIO((struct IORequest *)SerialIO) == 0);
+}
+
+/* Current serial rate */
+ULONG GetSerialBaud(void)
+{
+    return SerialIO ? SerialIO->io_Baud : 0;
+}
+
+/* Raw device read, below framing (non-blocking) */
+static ULONG DeviceRead(char *buffer, ULONG maxLength)
+{
+    ULONG actual = 0;
+    
     if (!SerialOpen || !SerialIO) 
         return 0;
     
+    PROFILE_BEGIN(PROFILE_READ);
+    
+    /* The I/O task owns the device's receive side when running */
+    if (SerialTaskRunning()) {
+        actual = ReceiveFromSerialTask(buffer, maxLength);
+        PROFILE_END(PROFILE_READ, actual);
+        return actual;
+    }
+    
     /* Check if data is available */
     SerialIO->IOSer.io_Command = SDCMD_QUERY;
     DoIO((struct IORequest *)SerialIO);
@@ -157,10 +385,14 @@ ULONG ReceivePacket(char *buffer, ULONG maxLength)
         SerialIO->IOSer.io_Length = (SerialIO->IOSer.io_Actual < maxLength) ? 
                                    SerialIO->IOSer.io_Actual : maxLength;
         DoIO((struct IORequest *)SerialIO);
-        return SerialIO->IOSer.io_Actual;
+        
+        /* Overflows and line errors feed the recalibration monitor */
+        NoteLinkTraffic(SerialIO->IOSer.io_Actual, SerialIO->IOSer.io_Error ? 1 : 0);
+        actual = SerialIO->IOSer.io_Actual;
     }
     
-    return 0;
+    PROFILE_END(PROFILE_READ, actual);
+    return actual;
 }
 
 /* Default packet handler - just prints received packets */
@@ -169,13 +401,23 @@ void DefaultPacketHandler(const char *packet, ULONG length)
     printf("Received packet (%lu bytes): ", length);
     fwrite(packet, 1, length, stdout);
     printf("\n");
-    
-    /* Auto-respond to "Hello Amiga" messages */
-    if (strstr(packet, "Hello Amiga")) {
-        char response[] = "Hello Pi!\r\n";
-        SendPacket(response, strlen(response));
-        printf("Sent auto-response: Hello Pi!\n");
-    }
+}
+
+/* Auto-respond to "Hello Amiga", wherever the read boundaries fall */
+static void HelloTrigger(LONG id, ULONG offset, APTR userData)
+{
+    SendCachedResponse(&HelloReply);
+    printf("Sent auto-response: Hello Pi!\n");
+}
+
+/* NULL means DefaultPacketHandler; its auto-response is registered once */
+static PacketHandler UseHandler(PacketHandler handler)
+{
+    if (!handler)
+        handler = DefaultPacketHandler;
+    if (handler == DefaultPacketHandler && !HelloRegistered)
+        HelloRegistered = (BOOL)(AddTrigger("Hello Amiga", 11, HelloTrigger, NULL) >= 0);
+    return handler;
 }
 
 /* Main packet processing loop */
@@ -185,9 +427,7 @@ void ProcessPackets(PacketHandler handler)
     ULONG bytesRead;
     BOOL running = TRUE;
     
-    if (!handler) {
-        handler = DefaultPacketHandler;
-    }
+    handler = UseHandler(handler);
     
     printf("Packet framework started. Press Ctrl+C to exit.\n");
     
@@ -196,15 +436,22 @@ void ProcessPackets(PacketHandler handler)
         bytesRead = ReceivePacket(buffer, sizeof(buffer) - 1);
         
         if (bytesRead > 0) {
+            StampReceiveTime();
+            
             /* Null-terminate for string operations */
             buffer[bytesRead] = '\0';
             
+            /* Triggers see the raw stream, before the handler */
+            ScanTriggers(buffer, bytesRead);
+            
             /* Process the packet */
             handler(buffer, bytesRead);
         }
         
+        PollTelemetry(CurrentTicks());
+        
         /* Small delay to prevent busy waiting */
-        Delay(1);
+        WaitForInput();
         
         /* Check for break signal (simplified - in real use you'd want proper signal handling) */
         if (SetSignal(0, 0) & SIGBREAKF_CTRL_C) {
@@ -213,6 +460,91 @@ void ProcessPackets(PacketHandler handler)
     }
 }
 
+/* Monotonic tick count (1/50 s) for rate limiting */
+static ULONG CurrentTicks(void)
+{
+    struct DateStamp ds;
+    
+    DateStamp(&ds);
+    return ((ULONG)ds.ds_Days * 1440 + ds.ds_Minute) * 60 * TICKS_PER_SECOND + ds.ds_Tick;
+}
+
+/* Sleep until input arrives or one tick passes */
+static void WaitForInput(void)
+{
+    ULONG timerMask = 0;
+    ULONG signals;
+    
+    if (!SerialTaskRunning()) {
+        Delay(1);
+        return;
+    }
+    
+    /* The tick timeout keeps telemetry and Ctrl+C checks running */
+    if (TimerOpen) {
+        TimerIO->tr_node.io_Command = TR_ADDREQUEST;
+        TimerIO->tr_time.tv_secs = 0;
+        TimerIO->tr_time.tv_micro = 1000000 / TICKS_PER_SECOND;
+        SendIO((struct IORequest *)TimerIO);
+        timerMask = 1L << TimerMP->mp_SigBit;
+    }
+    
+    signals = Wait(SerialTaskSignal() | timerMask | SIGBREAKF_CTRL_C);
+    
+    if (TimerOpen) {
+        if (!CheckIO((struct IORequest *)TimerIO))
+            AbortIO((struct IORequest *)TimerIO);
+        WaitIO((struct IORequest *)TimerIO);
+    }
+    
+    /* Wait() cleared Ctrl+C; raise it again for the loop's check */
+    if (signals & SIGBREAKF_CTRL_C)
+        SetSignal(SIGBREAKF_CTRL_C, SIGBREAKF_CTRL_C);
+}
+
+/* Line-oriented processing loop with request tags and pipelining */
+void ProcessLines(PacketHandler handler)
+{
+    char buffer[1024];
+    ULONG bytesRead;
+    BOOL running = TRUE;
+    
+    handler = UseHandler(handler);
+    
+    printf("Line processor started. Press Ctrl+C to exit.\n");
+    
+    while (running) {
+        bytesRead = ReceivePacket(buffer, sizeof(buffer));
+        if (bytesRead > 0)
+            StampReceiveTime();
+        ScanTriggers(buffer, bytesRead);
+        ProcessLineInput(handler, buffer, bytesRead, CurrentTicks());
+        
+        PollTelemetry(CurrentTicks());
+        
+        /* Give up on a stream whose sender has gone quiet */
+        if (bytesRead == 0)
+            ExpireStream(CurrentTicks());
+        
+        /* Recalibrate between commands once the error rate has climbed */
+        if (bytesRead == 0 && LineInputIdle() && CalibrationDue()) {
+            printf("Receive errors climbing, recalibrating link rate\n");
+            CalibrateLink();
+        }
+        
+        /* Only sleep when the device had nothing queued */
+        if (bytesRead == 0) {
+            WaitForInput();
+        }
+        
+        if (SetSignal(0, 0) & SIGBREAKF_CTRL_C) {
+            running = FALSE;
+        }
+    }
+    
+    AbortStream();
+}
+
 /* Only include main if building standalone framework */
 #ifdef STANDALONE_FRAMEWORK
 /* Example usage */
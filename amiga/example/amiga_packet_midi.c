@@ -0,0 +1,429 @@
+/*
+ * Amiga Packet Communication Framework - MIDI Transport
+ * Runs the serial port at 31250 baud as a MIDI interface. Input is
+ * timestamped with the EClock when it is read and parsed into messages,
+ * honouring running status and real-time bytes (clock, start, stop, ...)
+ * that may arrive between the bytes of another message.
+ *
+ * Output is scheduled: ScheduleMidi() puts a message in a time-ordered
+ * queue and WaitMidi() sleeps on timer.device's UNIT_WAITECLOCK until the
+ * first one is due, so events leave within the EClock's resolution of
+ * their time instead of on the next 1/50 s tick. Everything due at once
+ * goes out in a single device write.
+ */
+
+#include <exec/types.h>
+#include <devices/timer.h>
+#include <proto/exec.h>
+#include <proto/alib.h>
+
+#include "amiga_packet_framework.h"
+
+/* One scheduled message */
+typedef struct {
+    LinkTime due;
+    UBYTE data[3];
+    UBYTE length;
+} MidiQueueEntry;
+
+/* Time-ordered ring; the head is due first */
+static MidiQueueEntry MidiQueue[MIDI_QUEUE_SIZE];
+static UWORD QueueHead = 0;
+static UWORD QueueCount = 0;
+
+static struct MsgPort *MidiTimerMP = NULL;
+static struct timerequest *MidiTimerIO = NULL;
+static BOOL MidiActive = FALSE;
+static ULONG SavedBaud = 0;
+static LONG SavedPriority = 0;
+static ULONG PollTicks = 0;             /* MIDI_POLL_MICROS in EClock ticks */
+static UBYTE OutStatus = 0;             /* Running status on output */
+static MidiStats Stats;
+
+/* Data bytes that follow a status byte */
+static UBYTE MidiDataLength(UBYTE status)
+{
+    if (status < 0xF0)
+        return (UBYTE)(((status & 0xE0) == 0xC0) ? 1 : 2);  /* Program change, pressure */
+
+    switch (status) {
+        case 0xF1:                      /* Time code quarter frame */
+        case 0xF3:                      /* Song select */
+            return 1;
+        case 0xF2:                      /* Song position */
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+/* Start a parser with no running status */
+void InitMidiParser(MidiParser *mp, MidiCallback callback, APTR userData)
+{
+    mp->callback = callback;
+    mp->userData = userData;
+    mp->status = 0;
+    mp->needed = 0;
+    mp->count = 0;
+    mp->inSysex = FALSE;
+    mp->sysexOverflow = FALSE;
+    mp->sysexLength = 0;
+    mp->messages = 0;
+    mp->realtime = 0;
+    mp->sysexTruncated = 0;
+    mp->strayBytes = 0;
+}
+
+/* Hand a channel or system common message to the callback */
+static void DeliverMessage(MidiParser *mp, UBYTE status, const LinkTime *time)
+{
+    MidiEvent ev;
+
+    ev.time = *time;
+    ev.data[0] = status;
+    ev.data[1] = mp->data[0];
+    ev.data[2] = mp->data[1];
+    ev.length = (UBYTE)(1 + mp->needed);
+    ev.sysex = NULL;
+    ev.sysexLength = 0;
+    mp->messages++;
+    mp->callback(&ev, mp->userData);
+}
+
+/* Hand a finished (or interrupted) SysEx message to the callback */
+static void DeliverSysex(MidiParser *mp, const LinkTime *time)
+{
+    MidiEvent ev;
+
+    ev.time = *time;
+    ev.data[0] = 0xF0;
+    ev.length = 1;
+    ev.sysex = mp->sysex;
+    ev.sysexLength = mp->sysexLength;
+    mp->inSysex = FALSE;
+    mp->messages++;
+    if (mp->sysexOverflow)
+        mp->sysexTruncated++;
+    mp->callback(&ev, mp->userData);
+}
+
+/* Collect a SysEx byte; the rest of an oversized message is dropped */
+static void AppendSysex(MidiParser *mp, UBYTE byte)
+{
+    if (mp->sysexLength < MIDI_SYSEX_MAX)
+        mp->sysex[mp->sysexLength++] = byte;
+    else
+        mp->sysexOverflow = TRUE;
+}
+
+/* Parse received bytes; all of them share the read time */
+void ParseMidiBytes(MidiParser *mp, const UBYTE *data, ULONG length, const LinkTime *time)
+{
+    MidiEvent ev;
+    UBYTE byte;
+    ULONG i;
+
+    for (i = 0; i < length; i++) {
+        byte = data[i];
+
+        /* Real-time bytes stand alone and leave the current message intact */
+        if (byte >= 0xF8) {
+            ev.time = *time;
+            ev.data[0] = byte;
+            ev.length = 1;
+            ev.sysex = NULL;
+            ev.sysexLength = 0;
+            mp->realtime++;
+            mp->callback(&ev, mp->userData);
+            continue;
+        }
+
+        if (byte & 0x80) {
+            /* Any status byte ends a SysEx; EOX is part of it */
+            if (mp->inSysex) {
+                if (byte == 0xF7) {
+                    AppendSysex(mp, byte);
+                    DeliverSysex(mp, time);
+                    continue;
+                }
+                DeliverSysex(mp, time);
+            }
+
+            if (byte == 0xF0) {
+                mp->inSysex = TRUE;
+                mp->sysexOverflow = FALSE;
+                mp->sysexLength = 0;
+                AppendSysex(mp, byte);
+                mp->status = 0;
+                continue;
+            }
+            if (byte == 0xF7) {
+                mp->strayBytes++;
+                continue;
+            }
+
+            mp->status = byte;
+            mp->needed = MidiDataLength(byte);
+            mp->count = 0;
+            if (mp->needed == 0) {
+                DeliverMessage(mp, byte, time);
+                mp->status = 0;             /* System common ends running status */
+            }
+            continue;
+        }
+
+        /* Data byte */
+        if (mp->inSysex) {
+            AppendSysex(mp, byte);
+            continue;
+        }
+        if (!mp->status) {
+            mp->strayBytes++;
+            continue;
+        }
+
+        mp->data[mp->count++] = byte;
+        if (mp->count == mp->needed) {
+            DeliverMessage(mp, mp->status, time);
+            mp->count = 0;
+            if (mp->status >= 0xF0)
+                mp->status = 0;
+        }
+    }
+}
+
+/* Enter MIDI mode: 31250 baud, scheduling timer, raised priority */
+BOOL EnableMidiMode(void)
+{
+    LinkTime now;
+    ULONG frequency;
+
+    if (MidiActive)
+        return TRUE;
+    if (GetFlowLink())
+        return FALSE;
+
+    frequency = ReadLinkClock(&now);
+    if (!frequency)
+        return FALSE;
+
+    MidiTimerMP = CreatePort(NULL, 0);
+    if (!MidiTimerMP)
+        return FALSE;
+    MidiTimerIO = (struct timerequest *)CreateExtIO(MidiTimerMP, sizeof(struct timerequest));
+    if (!MidiTimerIO || OpenDevice("timer.device", UNIT_WAITECLOCK,
+                                   (struct IORequest *)MidiTimerIO, 0) != 0) {
+        if (MidiTimerIO)
+            DeleteExtIO((struct IORequest *)MidiTimerIO);
+        DeletePort(MidiTimerMP);
+        MidiTimerIO = NULL;
+        MidiTimerMP = NULL;
+        return FALSE;
+    }
+
+    SavedBaud = GetSerialBaud();
+    if (!SetSerialBaud(MIDI_BAUD)) {
+        CloseDevice((struct IORequest *)MidiTimerIO);
+        DeleteExtIO((struct IORequest *)MidiTimerIO);
+        DeletePort(MidiTimerMP);
+        MidiTimerIO = NULL;
+        MidiTimerMP = NULL;
+        return FALSE;
+    }
+
+    PollTicks = frequency / (1000000 / MIDI_POLL_MICROS);
+    QueueHead = 0;
+    QueueCount = 0;
+    OutStatus = 0;
+    Stats.sent = 0;
+    Stats.bytes = 0;
+    Stats.queueFull = 0;
+    Stats.maxLate = 0;
+    SavedPriority = SetTaskPri(FindTask(NULL), MIDI_PRIORITY);
+    MidiActive = TRUE;
+
+    return TRUE;
+}
+
+/* Leave MIDI mode and put back what EnableMidiMode() changed */
+void DisableMidiMode(void)
+{
+    if (!MidiActive)
+        return;
+
+    MidiActive = FALSE;
+    QueueCount = 0;
+    SetTaskPri(FindTask(NULL), SavedPriority);
+    SetSerialBaud(SavedBaud);
+
+    CloseDevice((struct IORequest *)MidiTimerIO);
+    DeleteExtIO((struct IORequest *)MidiTimerIO);
+    DeletePort(MidiTimerMP);
+    MidiTimerIO = NULL;
+    MidiTimerMP = NULL;
+}
+
+/* TRUE while in MIDI mode */
+BOOL MidiModeActive(void)
+{
+    return MidiActive;
+}
+
+/* Queue a message for output at an EClock time */
+BOOL ScheduleMidi(const UBYTE *message, UWORD length, const LinkTime *when)
+{
+    MidiQueueEntry *entry;
+    LinkTime now;
+    UWORD slot;
+    UWORD prev;
+
+    if (!MidiActive || length == 0 || length > 3)
+        return FALSE;
+    if (QueueCount >= MIDI_QUEUE_SIZE) {
+        Stats.queueFull++;
+        return FALSE;
+    }
+
+    if (!when) {
+        ReadLinkClock(&now);
+        when = &now;
+    }
+
+    /* Insertion from the tail; usually the new message is the latest */
+    slot = (UWORD)((QueueHead + QueueCount) % MIDI_QUEUE_SIZE);
+    while (slot != QueueHead) {
+        prev = (UWORD)((slot + MIDI_QUEUE_SIZE - 1) % MIDI_QUEUE_SIZE);
+        if (CompareLinkTime(&MidiQueue[prev].due, when) <= 0)
+            break;
+        MidiQueue[slot] = MidiQueue[prev];
+        slot = prev;
+    }
+
+    entry = &MidiQueue[slot];
+    entry->due = *when;
+    entry->data[0] = message[0];
+    entry->data[1] = (length > 1) ? message[1] : 0;
+    entry->data[2] = (length > 2) ? message[2] : 0;
+    entry->length = (UBYTE)length;
+    QueueCount++;
+
+    return TRUE;
+}
+
+/* Free queue entries */
+UWORD MidiQueueSpace(void)
+{
+    return (UWORD)(MIDI_QUEUE_SIZE - QueueCount);
+}
+
+/* Write everything that is due, in one device write */
+ULONG SendDueMidi(void)
+{
+    UBYTE out[MIDI_QUEUE_SIZE * 3];
+    MidiQueueEntry *entry;
+    LinkTime now;
+    ULONG length = 0;
+    ULONG count = 0;
+    ULONG late = 0;
+    UBYTE status;
+
+    if (!MidiActive || QueueCount == 0)
+        return 0;
+
+    ReadLinkClock(&now);
+
+    while (QueueCount > 0) {
+        entry = &MidiQueue[QueueHead];
+        if (CompareLinkTime(&entry->due, &now) > 0)
+            break;
+
+        if (count == 0)
+            late = now.lo - entry->due.lo;  /* The first one waited longest */
+
+        /* Running status for channel messages; system common cancels it,
+           real-time leaves it alone */
+        status = entry->data[0];
+        if (status >= 0xF8) {
+            out[length++] = status;
+        } else {
+            if (status != OutStatus || status >= 0xF0)
+                out[length++] = status;
+            OutStatus = (UBYTE)((status < 0xF0) ? status : 0);
+        }
+        if (entry->length > 1)
+            out[length++] = entry->data[1];
+        if (entry->length > 2)
+            out[length++] = entry->data[2];
+
+        QueueHead = (UWORD)((QueueHead + 1) % MIDI_QUEUE_SIZE);
+        QueueCount--;
+        count++;
+    }
+
+    if (count == 0)
+        return 0;
+
+    SendPacket((const char *)out, length);
+    Stats.sent += count;
+    Stats.bytes += length;
+    if (late > Stats.maxLate)
+        Stats.maxLate = late;
+
+    return count;
+}
+
+/* Take in pending input, then send due output */
+void PollMidi(MidiParser *mp)
+{
+    UBYTE buffer[256];
+    ULONG bytesRead;
+    LinkTime now;
+
+    while ((bytesRead = ReceivePacket((char *)buffer, sizeof(buffer))) > 0) {
+        ReadLinkClock(&now);
+        ParseMidiBytes(mp, buffer, bytesRead, &now);
+    }
+
+    SendDueMidi();
+}
+
+/* Sleep until output is due, input arrives or the poll interval passes */
+void WaitMidi(void)
+{
+    LinkTime wake;
+    ULONG taskMask = 0;
+    ULONG signals;
+
+    if (!MidiActive)
+        return;
+
+    /* Without the serial task, input is polled every MIDI_POLL_MICROS */
+    ReadLinkClock(&wake);
+    AddLinkTime(&wake, PollTicks);
+    if (QueueCount > 0 && CompareLinkTime(&MidiQueue[QueueHead].due, &wake) < 0)
+        wake = MidiQueue[QueueHead].due;
+    if (SerialTaskRunning())
+        taskMask = SerialTaskSignal();
+
+    /* UNIT_WAITECLOCK takes an absolute EClock time in tr_time */
+    MidiTimerIO->tr_node.io_Command = TR_ADDREQUEST;
+    MidiTimerIO->tr_time.tv_secs = wake.hi;
+    MidiTimerIO->tr_time.tv_micro = wake.lo;
+    SendIO((struct IORequest *)MidiTimerIO);
+
+    signals = Wait((1L << MidiTimerMP->mp_SigBit) | taskMask | SIGBREAKF_CTRL_C);
+
+    if (!CheckIO((struct IORequest *)MidiTimerIO))
+        AbortIO((struct IORequest *)MidiTimerIO);
+    WaitIO((struct IORequest *)MidiTimerIO);
+
+    /* Wait() cleared Ctrl+C; raise it again for the caller's check */
+    if (signals & SIGBREAKF_CTRL_C)
+        SetSignal(SIGBREAKF_CTRL_C, SIGBREAKF_CTRL_C);
+}
+
+/* Copy the output counters */
+void GetMidiStats(MidiStats *stats)
+{
+    *stats = Stats;
+}
@@ -0,0 +1,409 @@
+/*
+ * Amiga Packet Communication Framework - Response Builder
+ * Bounds-checked, allocation-free reply formatting into a preallocated
+ * transmit buffer. Replaces sprintf/strcat/strlen chains in handlers.
+ * Also holds the cache for invariant replies and patchable templates.
+ */
+
+#include <exec/types.h>
+
+#include "amiga_packet_framework.h"
+
+/* Shared transmit buffer handed out by BeginResponse() */
+static char TxBuffer[PACKET_TX_BUFFER_SIZE];
+static ResponseBuilder TxBuilder;
+
+/* Bump-allocated storage for cached responses and template text */
+static char CachePool[PACKET_CACHE_POOL_SIZE];
+static ULONG CachePoolUsed = 0;
+
+/* Forward declarations */
+static char *AllocCacheSpace(ULONG size);
+static UWORD FormatULong(char *dst, ULONG value);
+
+/* Powers of ten for division-free decimal conversion (68000 has no 32-bit DIVU) */
+static const ULONG PowersOfTen[10] = {
+    1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL,
+    10000UL, 1000UL, 100UL, 10UL, 1UL
+};
+
+static const char HexDigits[] = "0123456789ABCDEF";
+
+/* Initialize a builder over a caller-supplied buffer */
+void InitResponse(ResponseBuilder *rb, char *buffer, ULONG size)
+{
+    rb->buffer = buffer;
+    rb->size = size;
+    rb->length = 0;
+    rb->overflow = FALSE;
+}
+
+/* Start a new response in the framework transmit buffer */
+ResponseBuilder *BeginResponse(void)
+{
+    PROFILE_BEGIN(PROFILE_FORMAT);
+    InitResponse(&TxBuilder, TxBuffer, sizeof(TxBuffer));
+    return &TxBuilder;
+}
+
+/* Discard the contents of a builder, keeping its buffer */
+void ResetResponse(ResponseBuilder *rb)
+{
+    rb->length = 0;
+    rb->overflow = FALSE;
+}
+
+/* Bytes still available in the builder */
+ULONG ResponseSpace(const ResponseBuilder *rb)
+{
+    return rb->size - rb->length;
+}
+
+/* Append a single character */
+BOOL AppendChar(ResponseBuilder *rb, char c)
+{
+    if (rb->length >= rb->size) {
+        rb->overflow = TRUE;
+        return FALSE;
+    }
+
+    rb->buffer[rb->length++] = c;
+    return TRUE;
+}
+
+/* Append a block of bytes of known length */
+BOOL AppendData(ResponseBuilder *rb, const char *data, ULONG length)
+{
+    char *dst;
+
+    if (length > rb->size - rb->length) {
+        rb->overflow = TRUE;
+        return FALSE;
+    }
+
+    dst = rb->buffer + rb->length;
+    rb->length += length;
+    while (length--) {
+        *dst++ = *data++;
+    }
+
+    return TRUE;
+}
+
+/* Append a NUL-terminated string, copying and bounds checking in one pass */
+BOOL AppendString(ResponseBuilder *rb, const char *str)
+{
+    char *dst = rb->buffer + rb->length;
+    char *end = rb->buffer + rb->size;
+
+    while (*str) {
+        if (dst >= end) {
+            rb->length = rb->size;
+            rb->overflow = TRUE;
+            return FALSE;
+        }
+        *dst++ = *str++;
+    }
+
+    rb->length = dst - rb->buffer;
+    return TRUE;
+}
+
+/* Convert to decimal without division; returns number of digits written */
+static UWORD FormatULong(char *dst, ULONG value)
+{
+    UWORD count = 0;
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        char digit = '0';
+        ULONG power = PowersOfTen[i];
+
+        while (value >= power) {
+            value -= power;
+            digit++;
+        }
+
+        /* Skip leading zeros, but always emit the final digit */
+        if (count > 0 || digit != '0' || i == 9) {
+            dst[count++] = digit;
+        }
+    }
+
+    return count;
+}
+
+/* Append an unsigned decimal number */
+BOOL AppendULong(ResponseBuilder *rb, ULONG value)
+{
+    char digits[TEMPLATE_ULONG_WIDTH];
+
+    return AppendData(rb, digits, FormatULong(digits, value));
+}
+
+/* Append a signed decimal number */
+BOOL AppendLong(ResponseBuilder *rb, LONG value)
+{
+    if (value < 0) {
+        if (!AppendChar(rb, '-'))
+            return FALSE;
+        return AppendULong(rb, (ULONG)0 - (ULONG)value);
+    }
+
+    return AppendULong(rb, (ULONG)value);
+}
+
+/* Append a zero-padded uppercase hexadecimal number of 1-8 digits */
+BOOL AppendHex(ResponseBuilder *rb, ULONG value, UWORD digits)
+{
+    char hex[8];
+    UWORD i;
+
+    if (digits < 1)
+        digits = 1;
+    if (digits > 8)
+        digits = 8;
+
+    for (i = digits; i > 0; i--) {
+        hex[i - 1] = HexDigits[value & 0x0F];
+        value >>= 4;
+    }
+
+    return AppendData(rb, hex, digits);
+}
+
+/* Append a string as a fixed-width field, truncated or space padded */
+BOOL AppendField(ResponseBuilder *rb, const char *str, UWORD width)
+{
+    char *dst;
+
+    if (width > rb->size - rb->length) {
+        rb->overflow = TRUE;
+        return FALSE;
+    }
+
+    dst = rb->buffer + rb->length;
+    rb->length += width;
+    while (width && *str) {
+        *dst++ = *str++;
+        width--;
+    }
+    while (width--) {
+        *dst++ = ' ';
+    }
+
+    return TRUE;
+}
+
+/* Send the finished response and reset the builder for reuse */
+BOOL SendResponse(ResponseBuilder *rb)
+{
+    BOOL result;
+
+    PROFILE_END(PROFILE_FORMAT, rb->length);
+
+    /* Never transmit a truncated reply */
+    if (rb->overflow) {
+        ResetResponse(rb);
+        return FALSE;
+    }
+
+    result = (rb->length == 0) ? TRUE : SendReply(rb->buffer, rb->length);
+    ResetResponse(rb);
+    return result;
+}
+
+/* Take space from the cache pool; cached data lives until program exit */
+static char *AllocCacheSpace(ULONG size)
+{
+    char *space;
+
+    /* Keep allocations word aligned for the 68000 */
+    size = (size + 1) & ~1UL;
+    if (size > sizeof(CachePool) - CachePoolUsed)
+        return NULL;
+
+    space = CachePool + CachePoolUsed;
+    CachePoolUsed += size;
+    return space;
+}
+
+/* Send an invariant reply straight from its buffer */
+BOOL SendCachedResponse(const CachedResponse *cr)
+{
+    return SendReply(cr->data, cr->length);
+}
+
+/* Freeze the contents of a builder into the cache pool */
+BOOL CacheResponse(CachedResponse *cr, ResponseBuilder *rb)
+{
+    char *space;
+    ULONG i;
+
+    /* Ends the builder's use like SendResponse() does */
+    PROFILE_END(PROFILE_FORMAT, rb->length);
+
+    if (rb->overflow) {
+        ResetResponse(rb);
+        return FALSE;
+    }
+
+    space = AllocCacheSpace(rb->length);
+    if (!space)
+        return FALSE;
+
+    for (i = 0; i < rb->length; i++) {
+        space[i] = rb->buffer[i];
+    }
+
+    cr->data = space;
+    cr->length = rb->length;
+    ResetResponse(rb);
+    return TRUE;
+}
+
+/* Parse a template pattern, reserving space for each field */
+BOOL InitResponseTemplate(ResponseTemplate *t, const char *pattern)
+{
+    const char *p;
+    ULONG length = 0;
+    UWORD width;
+    UWORD i;
+    BOOL numeric;
+    TemplateField *field;
+    char *dst;
+
+    t->fieldCount = 0;
+
+    /* First pass: measure and record field positions */
+    for (p = pattern; *p; p++) {
+        if (*p != '%' || *++p == '%') {
+            length++;
+            continue;
+        }
+
+        if (t->fieldCount >= TEMPLATE_MAX_FIELDS)
+            return FALSE;
+
+        width = 0;
+        while (*p >= '0' && *p <= '9') {
+            width = width * 10 + (*p++ - '0');
+        }
+
+        numeric = (*p == 'u');
+        if (numeric) {
+            width = TEMPLATE_ULONG_WIDTH;
+        } else if (*p != 's' || width == 0) {
+            return FALSE;
+        }
+
+        field = &t->fields[t->fieldCount++];
+        field->offset = (UWORD)length;
+        field->width = width;
+        field->numeric = numeric;
+        length += width;
+    }
+
+    t->buffer = AllocCacheSpace(length);
+    if (!t->buffer)
+        return FALSE;
+    t->length = length;
+
+    /* Second pass: copy the fixed text around the reserved field space */
+    dst = t->buffer;
+    i = 0;
+    for (p = pattern; *p; p++) {
+        if (*p != '%' || *++p == '%') {
+            *dst++ = *p;
+            continue;
+        }
+
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+        dst += t->fields[i++].width;
+    }
+
+    /* Numeric fields start out as "0", string fields empty */
+    for (i = 0; i < t->fieldCount; i++) {
+        field = &t->fields[i];
+        if (field->numeric) {
+            field->start = field->offset + field->width - 1;
+            field->length = 1;
+            field->value = 0;
+            t->buffer[field->start] = '0';
+        } else {
+            field->start = field->offset;
+            field->length = 0;
+        }
+    }
+
+    return TRUE;
+}
+
+/* Write a number right-aligned into its field, only when it changed */
+void SetTemplateULong(ResponseTemplate *t, UWORD field, ULONG value)
+{
+    TemplateField *f = &t->fields[field];
+    char digits[TEMPLATE_ULONG_WIDTH];
+    UWORD count;
+    UWORD i;
+
+    if (value == f->value)
+        return;
+
+    count = FormatULong(digits, value);
+    f->start = f->offset + f->width - count;
+    f->length = count;
+    f->value = value;
+
+    for (i = 0; i < count; i++) {
+        t->buffer[f->start + i] = digits[i];
+    }
+}
+
+/* Write a string left-aligned into its field */
+void SetTemplateString(ResponseTemplate *t, UWORD field, const char *str)
+{
+    TemplateField *f = &t->fields[field];
+    char *dst = t->buffer + f->offset;
+    UWORD count = 0;
+
+    while (count < f->width && str[count]) {
+        dst[count] = str[count];
+        count++;
+    }
+
+    f->start = f->offset;
+    f->length = count;
+}
+
+/* Send the fixed text and the significant part of each field */
+BOOL SendTemplate(const ResponseTemplate *t)
+{
+    PacketSegment segments[TEMPLATE_MAX_FIELDS * 2 + 1];
+    const TemplateField *f;
+    ULONG count = 0;
+    ULONG pos = 0;
+    UWORD i;
+
+    for (i = 0; i < t->fieldCount; i++) {
+        f = &t->fields[i];
+
+        segments[count].data = t->buffer + pos;
+        segments[count].length = f->offset - pos;
+        count++;
+
+        segments[count].data = t->buffer + f->start;
+        segments[count].length = f->length;
+        count++;
+
+        pos = f->offset + f->width;
+    }
+
+    segments[count].data = t->buffer + pos;
+    segments[count].length = t->length - pos;
+    count++;
+
+    return SendReplyV(segments, count);
+}
@@ -0,0 +1,549 @@
+/*
+ * Amiga Packet Communication Framework - Screen Streaming
+ * Mirror a planar screen to the host (pc/screen_viewer.py) over the
+ * framed link, sending only the parts that changed.
+ *
+ * The screen is cut into tiles of SCREEN_TILE_BYTES x SCREEN_TILE_ROWS
+ * (32 x 8 pixels), so a tile row is one longword per plane and an
+ * unchanged tile costs a handful of longword compares per plane against
+ * a shadow copy of what the host has. A changed plane goes out as its
+ * raw bytes, as ByteRun1 (the IFF ILBM run-length code) of them, or as
+ * ByteRun1 of them XORed with the shadow, whichever is shortest: fills
+ * and blank areas pack as runs, small edits as runs of zero.
+ *
+ * Message format, carried as the payload of a FRAME_SCREEN frame:
+ *   op | seq | ...
+ * with TILES messages packing as many tile records as fit in a frame.
+ * Records within a message are in scan order, so the last
+ * SCREEN_HISTORY messages are remembered as tile ranges. seq counts
+ * every message: the host sees a lost one and answers RESEND with its
+ * seq, and the tiles it carried are marked dirty and sent again whole,
+ * without XOR, when the scan next reaches them. A loss too old to look
+ * up, or a lost FORMAT, costs a REFRESH: the shadow is cleared and every
+ * non-blank tile sent again. A pass over the whole screen ends with END,
+ * which the host uses to count frames.
+ *
+ * The module uses nothing but the flow link and a poll function, so
+ * the same code runs in the host simulator (host/sim_bench.c).
+ */
+
+#include <exec/types.h>
+
+#include "amiga_packet_framework.h"
+
+#define SCREEN_HEADER_SIZE 2
+#define SCREEN_RECORD_MAX (3 + SCREEN_MAX_DEPTH * (1 + SCREEN_PLANE_TILE))
+
+/* A message sent recently, for RESEND */
+typedef struct {
+    BOOL valid;
+    UBYTE seq;
+    UBYTE op;
+    UWORD firstTile;            /* TILES: range of tiles it carried */
+    UWORD lastTile;
+} SentMessage;
+
+/* Low address bits, for alignment tests */
+#define ADDRESS_BITS(p) ((ULONG)((const UBYTE *)(p) - (const UBYTE *)0))
+
+static FlowLink *Link = NULL;
+static LinkPollFunc Poll = NULL;
+static APTR PollData = NULL;
+static FrameCallback ChainHandler = NULL;
+static APTR ChainData = NULL;
+
+static const ScreenSource *Source = NULL;
+static UBYTE *Shadow = NULL;
+static UBYTE *Dirty = NULL;         /* A bit per tile, after the planes */
+static UWORD RowBytes;              /* Shadow row: the width, word aligned */
+static ULONG PlaneSize;             /* Shadow bytes per plane */
+static UWORD TileColumns;
+static UWORD TileCount;
+
+static BOOL RefreshDue = FALSE;
+static UWORD NextTile = 0;          /* Where the scan resumes */
+static UBYTE Seq = 0;
+static UWORD FrameNumber = 0;
+static ULONG PassTiles = 0;
+static ULONG PassBytes = 0;
+static UWORD SentColors = 0;
+static UWORD SentPalette[SCREEN_MAX_COLORS];
+static SentMessage History[SCREEN_HISTORY];
+static ScreenStreamStats Stats;
+
+static UBYTE Message[FRAME_MAX_PAYLOAD];
+static ULONG MessageLength = 0;
+static UWORD MessageFirstTile = 0;
+static UWORD MessageLastTile = 0;
+
+/* Forward declarations */
+static void ScreenFrameReceived(UBYTE type, UWORD credit, const UBYTE *payload,
+                                ULONG length, APTR userData);
+
+static void PutWord(UBYTE *p, UWORD value)
+{
+    p[0] = (UBYTE)(value >> 8);
+    p[1] = (UBYTE)value;
+}
+
+static void ClearStats(void)
+{
+    ULONG i;
+
+    for (i = 0; i < sizeof(Stats); i++)
+        ((UBYTE *)&Stats)[i] = 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Encoding                                                            */
+/* ------------------------------------------------------------------ */
+
+/* ByteRun1: n = 0..127 copies the next n + 1 bytes, n = -1..-127
+   repeats the next byte 1 - n times. Gives up, returning limit, as soon
+   as the result could not be shorter than limit. */
+static UWORD PackBytes(const UBYTE *src, UWORD length, UBYTE *dst, UWORD limit)
+{
+    UWORD in = 0;
+    UWORD out = 0;
+    UWORD run;
+    UWORD literal;
+
+    while (in < length) {
+        run = 1;
+        while (in + run < length && run < 128 && src[in + run] == src[in])
+            run++;
+        if (run >= 2) {
+            if (out + 2 >= limit)
+                return limit;
+            dst[out++] = (UBYTE)(257 - run);
+            dst[out++] = src[in];
+            in += run;
+            continue;
+        }
+
+        /* Literal bytes up to the next run of three */
+        literal = 1;
+        while (in + literal < length && literal < 128 &&
+               !(in + literal + 2 < length && src[in + literal] == src[in + literal + 1] &&
+                 src[in + literal] == src[in + literal + 2]))
+            literal++;
+        if (out + 1 + literal >= limit)
+            return limit;
+        dst[out++] = (UBYTE)(literal - 1);
+        while (literal--)
+            dst[out++] = src[in++];
+    }
+    return out;
+}
+
+/* One changed plane of a tile: encoding byte and data. Without old,
+   the host's copy is unknown and XOR is not tried. Returns the size */
+static UWORD EncodePlane(UBYTE *out, const UBYTE *now, const UBYTE *old, UWORD length)
+{
+    UBYTE diff[SCREEN_PLANE_TILE];
+    UBYTE packed[SCREEN_PLANE_TILE];
+    UWORD best = length;
+    UWORD n;
+    UWORD i;
+
+    out[0] = SCREEN_ENC_RAW;
+    if (old) {
+        for (i = 0; i < length; i++)
+            diff[i] = now[i] ^ old[i];
+        n = PackBytes(diff, length, out + 1, best);
+        if (n < best) {
+            best = n;
+            out[0] = SCREEN_ENC_XOR;
+        }
+    }
+    n = PackBytes(now, length, packed, best);
+    if (n < best) {
+        best = n;
+        out[0] = SCREEN_ENC_RLE;
+        for (i = 0; i < n; i++)
+            out[1 + i] = packed[i];
+    }
+
+    switch (out[0]) {
+    case SCREEN_ENC_RAW:
+        for (i = 0; i < length; i++)
+            out[1 + i] = now[i];
+        Stats.rawPlanes++;
+        break;
+    case SCREEN_ENC_RLE:
+        Stats.rlePlanes++;
+        break;
+    default:
+        Stats.xorPlanes++;
+        break;
+    }
+    return (UWORD)(best + 1);
+}
+
+/* Compare one plane of a tile with the shadow; tiles are 4 bytes wide,
+   or 2 at the right edge of a screen that is not a multiple of 32 */
+static BOOL PlaneTileChanged(const UBYTE *src, const UBYTE *shadow, UWORD bytes, UWORD rows)
+{
+    UWORD modulo = Source->bytesPerRow;
+
+    if (bytes == SCREEN_TILE_BYTES) {
+        while (rows--) {
+            if (*(const ULONG *)src != *(const ULONG *)shadow)
+                return TRUE;
+            src += modulo;
+            shadow += RowBytes;
+        }
+    } else {
+        while (rows--) {
+            if (*(const UWORD *)src != *(const UWORD *)shadow)
+                return TRUE;
+            src += modulo;
+            shadow += RowBytes;
+        }
+    }
+    return FALSE;
+}
+
+/* Build the record for one tile and bring its shadow up to date; a
+   dirty tile has every plane sent. Returns the record size, 0 if
+   nothing changed */
+static UWORD EncodeTile(UWORD tile, UBYTE *record)
+{
+    UBYTE now[SCREEN_PLANE_TILE];
+    UBYTE old[SCREEN_PLANE_TILE];
+    UWORD x = (UWORD)((tile % TileColumns) * SCREEN_TILE_BYTES);
+    UWORD y = (UWORD)((tile / TileColumns) * SCREEN_TILE_ROWS);
+    UWORD bytes = (UWORD)(RowBytes - x);
+    UWORD rows = (UWORD)(Source->height - y);
+    UWORD size = 3;
+    UWORD length;
+    UWORD modulo = Source->bytesPerRow;
+    UBYTE mask = 0;
+    UBYTE dirtyBit = (UBYTE)(1 << (tile & 7));
+    BOOL dirty = (BOOL)((Dirty[tile >> 3] & dirtyBit) != 0);
+    const UBYTE *src;
+    UBYTE *shadow;
+    UWORD p;
+    UWORD r;
+    UWORD b;
+    UWORD i;
+
+    if (bytes > SCREEN_TILE_BYTES)
+        bytes = SCREEN_TILE_BYTES;
+    if (rows > SCREEN_TILE_ROWS)
+        rows = SCREEN_TILE_ROWS;
+    length = (UWORD)(bytes * rows);
+
+    for (p = 0; p < Source->depth; p++) {
+        src = Source->planes[p] + (ULONG)y * modulo + x;
+        shadow = Shadow + p * PlaneSize + (ULONG)y * RowBytes + x;
+        if (!dirty && !PlaneTileChanged(src, shadow, bytes, rows))
+            continue;
+
+        /* Take the bytes once: the screen may change under us, and the
+           shadow has to hold exactly what was sent */
+        i = 0;
+        for (r = 0; r < rows; r++) {
+            for (b = 0; b < bytes; b++, i++) {
+                now[i] = src[b];
+                old[i] = shadow[b];
+                shadow[b] = now[i];
+            }
+            src += modulo;
+            shadow += RowBytes;
+        }
+        size += EncodePlane(record + size, now, dirty ? NULL : old, length);
+        mask |= (UBYTE)(1 << p);
+        Stats.planesSent++;
+        Stats.rawBytes += length;
+    }
+    if (dirty) {
+        Dirty[tile >> 3] &= (UBYTE)~dirtyBit;
+        Stats.tilesResent++;
+    }
+    if (!mask)
+        return 0;
+
+    PutWord(record, tile);
+    record[2] = mask;
+    return size;
+}
+
+/* ------------------------------------------------------------------ */
+/* Messages                                                            */
+/* ------------------------------------------------------------------ */
+
+static BOOL SendMessage(UBYTE *payload, ULONG length)
+{
+    SentMessage *m = &History[Seq % SCREEN_HISTORY];
+
+    m->valid = TRUE;
+    m->seq = Seq;
+    m->op = payload[0];
+    payload[1] = Seq++;
+    if (!FlowSendFrame(Link, FRAME_SCREEN, payload, length))
+        return FALSE;
+    Stats.messages++;
+    Stats.bytesSent += length;
+    PassBytes += length;
+    return TRUE;
+}
+
+/* Send the tile records gathered so far */
+static BOOL FlushTiles(void)
+{
+    BOOL ok = TRUE;
+
+    if (MessageLength > SCREEN_HEADER_SIZE) {
+        History[Seq % SCREEN_HISTORY].firstTile = MessageFirstTile;
+        History[Seq % SCREEN_HISTORY].lastTile = MessageLastTile;
+        ok = SendMessage(Message, MessageLength);
+    }
+    MessageLength = SCREEN_HEADER_SIZE;
+    return ok;
+}
+
+static BOOL SendPalette(void)
+{
+    UBYTE message[3 + 2 * SCREEN_MAX_COLORS];
+    UWORD colors = Source->colors;
+    BOOL changed;
+    UWORD i;
+
+    if (colors > SCREEN_MAX_COLORS)
+        colors = SCREEN_MAX_COLORS;
+    changed = (BOOL)(colors != SentColors);
+    for (i = 0; i < colors && !changed; i++)
+        changed = (BOOL)(Source->palette[i] != SentPalette[i]);
+    if (!changed)
+        return TRUE;
+
+    message[0] = SCREEN_OP_PALETTE;
+    message[2] = (UBYTE)colors;
+    for (i = 0; i < colors; i++) {
+        PutWord(message + 3 + 2 * i, Source->palette[i]);
+        SentPalette[i] = Source->palette[i];
+    }
+    SentColors = colors;
+    return SendMessage(message, 3 + 2 * colors);
+}
+
+/* Forget what the host has: it clears its image on FORMAT */
+static BOOL StartRefresh(void)
+{
+    UBYTE message[8];
+    UWORD *p = (UWORD *)Shadow;
+    ULONG n = ScreenShadowSize(Source) / 2;
+
+    while (n--)
+        *p++ = 0;
+    RefreshDue = FALSE;
+    NextTile = 0;
+    PassTiles = 0;
+    PassBytes = 0;
+    SentColors = 0;
+    Stats.refreshes++;
+
+    message[0] = SCREEN_OP_FORMAT;
+    PutWord(message + 2, Source->width);
+    PutWord(message + 4, Source->height);
+    message[6] = Source->depth;
+    message[7] = Source->flags;
+    return SendMessage(message, sizeof(message));
+}
+
+/* The scan reached the end of the screen */
+static BOOL EndPass(void)
+{
+    UBYTE message[10];
+
+    message[0] = SCREEN_OP_END;
+    PutWord(message + 2, FrameNumber);
+    PutWord(message + 4, (UWORD)(PassTiles > 0xFFFF ? 0xFFFF : PassTiles));
+    PassBytes += sizeof(message);
+    message[6] = (UBYTE)(PassBytes >> 24);
+    message[7] = (UBYTE)(PassBytes >> 16);
+    message[8] = (UBYTE)(PassBytes >> 8);
+    message[9] = (UBYTE)PassBytes;
+    PassBytes -= sizeof(message);       /* SendMessage() counts it */
+    if (!SendMessage(message, sizeof(message)))
+        return FALSE;
+
+    Stats.frames++;
+    Stats.lastFrameBytes = PassBytes;
+    if (PassBytes > Stats.maxFrameBytes)
+        Stats.maxFrameBytes = PassBytes;
+    FrameNumber++;
+    NextTile = 0;
+    PassTiles = 0;
+    PassBytes = 0;
+    return TRUE;
+}
+
+/* The host lost a message: have what it carried sent again */
+static void ResendMessage(UBYTE seq)
+{
+    SentMessage *m = &History[seq % SCREEN_HISTORY];
+    UWORD tile;
+
+    if (!m->valid || m->seq != seq) {
+        RefreshDue = TRUE;          /* Too long ago to know */
+        return;
+    }
+    switch (m->op) {
+    case SCREEN_OP_TILES:
+        for (tile = m->firstTile; tile <= m->lastTile; tile++)
+            Dirty[tile >> 3] |= (UBYTE)(1 << (tile & 7));
+        break;
+    case SCREEN_OP_PALETTE:
+        SentColors = 0;
+        break;
+    case SCREEN_OP_END:
+        break;
+    default:
+        RefreshDue = TRUE;
+        break;
+    }
+}
+
+static void ScreenFrameReceived(UBYTE type, UWORD credit, const UBYTE *payload,
+                                ULONG length, APTR userData)
+{
+    (void)userData;
+    if (type != FRAME_SCREEN) {
+        if (ChainHandler)
+            ChainHandler(type, credit, payload, length, ChainData);
+        return;
+    }
+    if (length >= 1 && payload[0] == SCREEN_OP_REFRESH)
+        RefreshDue = TRUE;
+    if (length >= 1 && payload[0] == SCREEN_OP_RESEND) {
+        while (--length > 0)
+            ResendMessage(*++payload);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Public interface                                                    */
+/* ------------------------------------------------------------------ */
+
+ULONG ScreenShadowSize(const ScreenSource *source)
+{
+    ULONG rowBytes = ((source->width + 15) >> 4) << 1;
+    ULONG tiles = ((rowBytes + SCREEN_TILE_BYTES - 1) / SCREEN_TILE_BYTES) *
+                  ((source->height + SCREEN_TILE_ROWS - 1) / SCREEN_TILE_ROWS);
+
+    return rowBytes * source->height * source->depth + ((tiles + 15) >> 4) * 2;
+}
+
+BOOL InitScreenStream(FlowLink *fl, LinkPollFunc poll, APTR pollData,
+                      const ScreenSource *source, UBYTE *shadow)
+{
+    UWORD rowBytes;
+    UWORD p;
+
+    if (!fl || !source || !shadow || source->depth == 0 || source->depth > SCREEN_MAX_DEPTH ||
+        source->width == 0 || source->height == 0)
+        return FALSE;
+    rowBytes = (UWORD)(((source->width + 15) >> 4) << 1);
+    if (rowBytes > source->bytesPerRow || (source->bytesPerRow & 1) || (ADDRESS_BITS(shadow) & 1))
+        return FALSE;
+    for (p = 0; p < source->depth; p++) {
+        if (ADDRESS_BITS(source->planes[p]) & 1)
+            return FALSE;
+    }
+
+    Link = fl;
+    Poll = poll;
+    PollData = pollData;
+    ChainHandler = fl->frameHandler;
+    ChainData = fl->frameHandlerData;
+    fl->frameHandler = ScreenFrameReceived;
+    fl->frameHandlerData = NULL;
+
+    Source = source;
+    Shadow = shadow;
+    RowBytes = rowBytes;
+    PlaneSize = (ULONG)rowBytes * source->height;
+    TileColumns = (UWORD)((rowBytes + SCREEN_TILE_BYTES - 1) / SCREEN_TILE_BYTES);
+    TileCount = (UWORD)(TileColumns * ((source->height + SCREEN_TILE_ROWS - 1) / SCREEN_TILE_ROWS));
+    Dirty = shadow + PlaneSize * source->depth;
+    for (p = 0; p < SCREEN_HISTORY; p++)
+        History[p].valid = FALSE;
+
+    RefreshDue = TRUE;
+    Seq = 0;
+    FrameNumber = 0;
+    MessageLength = SCREEN_HEADER_SIZE;
+    Message[0] = SCREEN_OP_TILES;
+    ClearStats();
+    return TRUE;
+}
+
+void CleanupScreenStream(void)
+{
+    if (!Link)
+        return;
+
+    Link->frameHandler = ChainHandler;
+    Link->frameHandlerData = ChainData;
+    Link = NULL;
+    Source = NULL;
+}
+
+LONG SendScreenUpdate(ULONG maxBytes)
+{
+    UBYTE record[SCREEN_RECORD_MAX];
+    ULONG start = Stats.bytesSent;
+    UWORD size;
+    UWORD i;
+
+    if (!Link)
+        return -1;
+    if (Poll && Poll(FALSE, PollData) < 0)
+        return -1;
+
+    if (RefreshDue && !StartRefresh())
+        return -1;
+    if (!SendPalette())
+        return -1;
+
+    while (maxBytes == 0 || Stats.bytesSent - start + MessageLength < maxBytes) {
+        if (NextTile == TileCount) {
+            if (!FlushTiles() || !EndPass())
+                return -1;
+            break;
+        }
+        size = EncodeTile(NextTile, record);
+        NextTile++;
+        Stats.tilesScanned++;
+        if (size == 0)
+            continue;
+
+        if (MessageLength + size > FRAME_MAX_PAYLOAD && !FlushTiles())
+            return -1;
+        if (MessageLength == SCREEN_HEADER_SIZE)
+            MessageFirstTile = (UWORD)(NextTile - 1);
+        MessageLastTile = (UWORD)(NextTile - 1);
+        for (i = 0; i < size; i++)
+            Message[MessageLength + i] = record[i];
+        MessageLength += size;
+        Stats.tilesSent++;
+        PassTiles++;
+    }
+    if (!FlushTiles())
+        return -1;
+    return (LONG)(Stats.bytesSent - start);
+}
+
+void RequestScreenRefresh(void)
+{
+    RefreshDue = TRUE;
+}
+
+void GetScreenStreamStats(ScreenStreamStats *stats, BOOL reset)
+{
+    *stats = Stats;
+    if (reset)
+        ClearStats();
+}
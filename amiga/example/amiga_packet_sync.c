@@ -0,0 +1,262 @@
+/*
+ * Amiga Packet Communication Framework - Delta Synchronization
+ * Update a local file from its host copy by moving only what changed,
+ * in the manner of rsync, over the remote file access module.
+ *
+ * The Amiga cuts its old copy into blocks and writes one signature per
+ * block, a weak sum and a CRC-32, to a FILE_MODE_DELTA handle. The host
+ * rolls the weak sum over its file, confirms candidates by CRC and
+ * answers with a stream of
+ *   COPY block(4) count(2) | LITERAL length(2) data | END length(4) crc(4)
+ * which is read back through the same handle, so read-ahead keeps the
+ * line busy while the new file is written.
+ *
+ * The Amiga only sums whole blocks; the rolling is done on the host.
+ * Both passes over the old copy cost two word adds and one table lookup
+ * per byte, and the module needs SYNC_MAX_BLOCK bytes of buffer plus a
+ * 1 KB CRC table.
+ */
+
+#include <exec/types.h>
+
+#include "amiga_packet_framework.h"
+
+static ULONG Crc32Table[256];
+static BOOL Crc32TableReady = FALSE;
+static UBYTE Buffer[SYNC_MAX_BLOCK];
+
+static void PutLong(UBYTE *p, ULONG value)
+{
+    p[0] = (UBYTE)(value >> 24);
+    p[1] = (UBYTE)(value >> 16);
+    p[2] = (UBYTE)(value >> 8);
+    p[3] = (UBYTE)value;
+}
+
+static ULONG GetLong(const UBYTE *p)
+{
+    return ((ULONG)p[0] << 24) | ((ULONG)p[1] << 16) | ((ULONG)p[2] << 8) | p[3];
+}
+
+static void BuildCrc32Table(void)
+{
+    ULONG c;
+    int i;
+    int k;
+
+    for (i = 0; i < 256; i++) {
+        c = (ULONG)i;
+        for (k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+        Crc32Table[i] = c;
+    }
+    Crc32TableReady = TRUE;
+}
+
+ULONG SyncCrc32(ULONG crc, const UBYTE *data, ULONG length)
+{
+    if (!Crc32TableReady)
+        BuildCrc32Table();
+
+    crc = ~crc;
+    while (length--)
+        crc = Crc32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/* Word sums wrap just as the host's mod 65536 sums do, and word adds
+   are the cheap ones on a 68000 */
+ULONG SyncWeakSum(const UBYTE *data, ULONG length)
+{
+    UWORD a = 0;
+    UWORD b = 0;
+
+    while (length--) {
+        a += *data++;
+        b += a;
+    }
+    return ((ULONG)b << 16) | a;
+}
+
+UWORD SyncBlockSize(ULONG length)
+{
+    ULONG size = SYNC_MIN_BLOCK;
+
+    if (length >= (ULONG)SYNC_MAX_BLOCK * SYNC_MAX_BLOCK / 8)
+        return SYNC_MAX_BLOCK;
+    while (size < SYNC_MAX_BLOCK && size * size < length * 8)
+        size += 16;
+    return (UWORD)size;
+}
+
+/* Read exactly length bytes of the delta stream */
+static BOOL ReadDelta(LONG fh, UBYTE *buffer, ULONG length, SyncStats *stats)
+{
+    LONG got = RemoteRead(fh, buffer, length);
+
+    if (got == (LONG)length)
+        return TRUE;
+    stats->error = (got < 0) ? RemoteFileError() : SYNC_ERR_FORMAT;
+    return FALSE;
+}
+
+/* Pass data on to the new file, keeping its CRC */
+static BOOL WriteNew(const SyncTarget *target, ULONG length, ULONG *crc, SyncStats *stats)
+{
+    *crc = SyncCrc32(*crc, Buffer, length);
+    if (!target->write(Buffer, length, target->userData)) {
+        stats->error = SYNC_ERR_LOCAL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Build the new file from the delta stream */
+static BOOL ApplyDelta(LONG fh, const SyncTarget *target, UWORD blockSize, SyncStats *stats)
+{
+    UBYTE op[9];
+    ULONG crc = 0;
+    ULONG written = 0;
+    ULONG offset;
+    ULONG length;
+    ULONG n;
+
+    for (;;) {
+        if (!ReadDelta(fh, op, 1, stats))
+            return FALSE;
+
+        switch (op[0]) {
+        case SYNC_OP_COPY:
+            if (!ReadDelta(fh, op + 1, 6, stats))
+                return FALSE;
+            offset = GetLong(op + 1) * blockSize;
+            length = (((ULONG)op[5] << 8) | op[6]) * blockSize;
+            if (length == 0 || offset >= target->oldLength) {
+                stats->error = SYNC_ERR_FORMAT;
+                return FALSE;
+            }
+            if (length > target->oldLength - offset)
+                length = target->oldLength - offset;   /* Short last block */
+            while (length > 0) {
+                n = (length < blockSize) ? length : blockSize;
+                if (target->readOld(offset, Buffer, n, target->userData) != (LONG)n) {
+                    stats->error = SYNC_ERR_LOCAL;
+                    return FALSE;
+                }
+                if (!WriteNew(target, n, &crc, stats))
+                    return FALSE;
+                offset += n;
+                length -= n;
+                written += n;
+                stats->copiedBytes += n;
+            }
+            break;
+
+        case SYNC_OP_LITERAL:
+            if (!ReadDelta(fh, op + 1, 2, stats))
+                return FALSE;
+            length = ((ULONG)op[1] << 8) | op[2];
+            while (length > 0) {
+                n = (length < SYNC_MAX_BLOCK) ? length : SYNC_MAX_BLOCK;
+                if (!ReadDelta(fh, Buffer, n, stats) || !WriteNew(target, n, &crc, stats))
+                    return FALSE;
+                length -= n;
+                written += n;
+                stats->literalBytes += n;
+            }
+            break;
+
+        case SYNC_OP_END:
+            if (!ReadDelta(fh, op + 1, 8, stats))
+                return FALSE;
+            if (GetLong(op + 1) != written || GetLong(op + 5) != crc) {
+                stats->error = SYNC_ERR_VERIFY;
+                return FALSE;
+            }
+            stats->error = FILE_OK;
+            return TRUE;
+
+        default:
+            stats->error = SYNC_ERR_FORMAT;
+            return FALSE;
+        }
+    }
+}
+
+/* One exchange: signatures of the old copy (if used) up, delta down */
+static BOOL SyncPass(const char *remotePath, const SyncTarget *target, SyncStats *stats,
+                     BOOL useOld)
+{
+    UBYTE signature[SYNC_SIGNATURE_SIZE];
+    ULONG oldLength = useOld ? target->oldLength : 0;
+    ULONG offset;
+    ULONG n;
+    UWORD blockSize;
+    LONG deltaLength;
+    LONG fh;
+    BOOL ok;
+
+    fh = RemoteOpen(remotePath, FILE_MODE_DELTA);
+    if (fh < 0) {
+        stats->error = RemoteFileError();
+        return FALSE;
+    }
+    stats->fileLength = RemoteFileSize(fh);
+    blockSize = SyncBlockSize(oldLength);
+    stats->blockSize = blockSize;
+
+    /* Signatures go out through write-behind, many to a request */
+    for (offset = 0; offset < oldLength; offset += n) {
+        n = oldLength - offset;
+        if (n > blockSize)
+            n = blockSize;
+        if (target->readOld(offset, Buffer, n, target->userData) != (LONG)n) {
+            stats->error = SYNC_ERR_LOCAL;
+            RemoteClose(fh);
+            return FALSE;
+        }
+        PutLong(signature, SyncWeakSum(Buffer, n));
+        PutLong(signature + 4, SyncCrc32(0, Buffer, n));
+        if (RemoteWrite(fh, signature, SYNC_SIGNATURE_SIZE) != SYNC_SIGNATURE_SIZE) {
+            stats->error = RemoteFileError();
+            RemoteClose(fh);
+            return FALSE;
+        }
+        stats->signatureBytes += SYNC_SIGNATURE_SIZE;
+    }
+
+    deltaLength = RemoteDelta(fh, oldLength, blockSize);
+    if (deltaLength < 0) {
+        stats->error = RemoteFileError();
+        RemoteClose(fh);
+        return FALSE;
+    }
+    stats->deltaBytes += (ULONG)deltaLength;
+
+    ok = ApplyDelta(fh, target, blockSize, stats);
+    RemoteClose(fh);
+    return ok;
+}
+
+BOOL SyncFile(const char *remotePath, const SyncTarget *target, SyncStats *stats)
+{
+    ULONG i;
+
+    for (i = 0; i < sizeof(SyncStats); i++)
+        ((UBYTE *)stats)[i] = 0;
+
+    if (SyncPass(remotePath, target, stats, TRUE))
+        return TRUE;
+    if (stats->error != SYNC_ERR_VERIFY || target->oldLength == 0)
+        return FALSE;
+
+    /* Some block matched on both sums without being equal: send it all */
+    if (!target->restart(target->userData)) {
+        stats->error = SYNC_ERR_LOCAL;
+        return FALSE;
+    }
+    stats->fullCopy = TRUE;
+    stats->copiedBytes = 0;
+    stats->literalBytes = 0;
+    return SyncPass(remotePath, target, stats, FALSE);
+}
@@ -6,6 +6,7 @@
 #include "amiga_packet_framework.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <proto/dos.h>
 #include <proto/exec.h>
 
@@ -34,7 +35,22 @@ void HandleHelpCommand(const char *args);
 void HandlePingCommand(const char *args);
 void HandleSendCommand(const char *args);
 void HandleResetCommand(const char *args);
+void HandleSubscribeCommand(const char *args);
+void HandleUnsubscribeCommand(const char *args);
+void HandleIoStatsCommand(const char *args);
+void HandleStreamCommand(const char *args);
+void HandleCalibrateCommand(const char *args);
+void HandleTimeSyncCommand(const char *args);
+void HandleProfileCommand(const char *args);
+void HandleFileGetCommand(const char *args);
+void HandleFileSyncCommand(const char *args);
+void HandleScreenCommand(const char *args);
 void CustomPacketHandler(const char *packet, ULONG length);
+void BuildResponseCache(void);
+void RegisterAppTelemetry(void);
+#if !defined(PACKET_BENCH) || defined(PACKET_PROFILE)
+static BOOL ArgIs(const char *arg, const char *keyword);
+#endif
 
 /* Command table */
 static Command commands[] = {
@@ -45,21 +61,93 @@ static Command commands[] = {
     {"PING", HandlePingCommand, "Send ping to remote device"},
     {"SEND", HandleSendCommand, "Send custom message"},
     {"RESET", HandleResetCommand, "Reset packet counters"},
+    {"SUBSCRIBE", HandleSubscribeCommand, "Push state changes [interval ms]"},
+    {"UNSUBSCRIBE", HandleUnsubscribeCommand, "Stop pushing state changes"},
+    {"IOSTATS", HandleIoStatsCommand, "Show serial I/O task queue counters"},
+    {"STREAM", HandleStreamCommand, "Save the <length> bytes that follow [to file]"},
+    {"CALIBRATE", HandleCalibrateCommand, "Find the fastest clean baud rate (host: link_calibrate.py)"},
+    {"TSYNC", HandleTimeSyncCommand, "Clock sync probe (host: clock_sync.py)"},
+    {"PROFILE", HandleProfileCommand, "Stage cycle costs and idle time [RESET|<cpu MHz>]"},
+    {"FGET", HandleFileGetCommand, "Copy <remote path> to <local file> (host: file_server.py)"},
+    {"FSYNC", HandleFileSyncCommand, "Update <local file> from <remote path>, sending only changes"},
+    {"SCREEN", HandleScreenCommand, "Stream <frames> of a screen [name] (host: screen_viewer.py)"},
     {NULL, NULL, NULL}  /* End marker */
 };
 
+/* Replies that never change, built at compile time */
+static const CachedResponse PongReply = CACHED_RESPONSE("PONG\r\n");
+#ifndef PACKET_BENCH
+static const CachedResponse ReadyReply = CACHED_RESPONSE("READY: Amiga packet application started\r\n");
+static const CachedResponse ShutdownReply = CACHED_RESPONSE("SHUTDOWN: Amiga packet application stopping\r\n");
+#endif
+static const CachedResponse CountersClearedReply = CACHED_RESPONSE("RESET: Counters cleared\r\n");
+static const CachedResponse NoMessageReply = CACHED_RESPONSE("ERROR: No message specified\r\n");
+static const CachedResponse EchoOnReply = CACHED_RESPONSE("ECHO: ON\r\n");
+static const CachedResponse EchoOffReply = CACHED_RESPONSE("ECHO: OFF\r\n");
+static const CachedResponse VerboseOnReply = CACHED_RESPONSE("VERBOSE: ON\r\n");
+static const CachedResponse VerboseOffReply = CACHED_RESPONSE("VERBOSE: OFF\r\n");
+static const CachedResponse UnsubscribedReply = CACHED_RESPONSE("UNSUBSCRIBE: OK\r\n");
+static const CachedResponse UnknownPrefix = CACHED_RESPONSE("ERROR: Unknown command '");
+static const CachedResponse UnknownSuffix = CACHED_RESPONSE("'. Type HELP for available commands.\r\n");
+
+/* Replies built once at startup */
+static CachedResponse HelpReply = { NULL, 0 };
+static ResponseTemplate StatusTemplate;
+static BOOL StatusTemplateReady = FALSE;
+
+/* STATUS template field indices */
+#define STATUS_FIELD_PACKETS  0
+#define STATUS_FIELD_COMMANDS 1
+#define STATUS_FIELD_ECHO     2
+#define STATUS_FIELD_VERBOSE  3
+
+/* Build the cached HELP text and the STATUS template */
+void BuildResponseCache(void)
+{
+    ResponseBuilder *rb = BeginResponse();
+    int i;
+    
+    AppendString(rb, "HELP: Available commands:\r\n");
+    for (i = 0; commands[i].name != NULL; i++) {
+        AppendString(rb, commands[i].name);
+        AppendData(rb, " - ", 3);
+        AppendString(rb, commands[i].description);
+        AppendData(rb, "\r\n", 2);
+    }
+    if (!CacheResponse(&HelpReply, rb)) {
+        HelpReply.data = NULL;
+    }
+    
+    StatusTemplateReady = InitResponseTemplate(&StatusTemplate,
+        "STATUS: Packets=%u Commands=%u Echo=%3s Verbose=%3s\r\n");
+}
+
 /* Command handlers */
 void HandleStatusCommand(const char *args)
 {
-    char response[256];
+    ResponseBuilder *rb;
     
-    sprintf(response, "STATUS: Packets=%lu Commands=%lu Echo=%s Verbose=%s\r\n",
-            appState.packetCount, 
-            appState.commandCount,
-            appState.echoMode ? "ON" : "OFF",
-            appState.verboseMode ? "ON" : "OFF");
+    (void)args;
     
-    SendPacket(response, strlen(response));
+    if (StatusTemplateReady) {
+        SetTemplateULong(&StatusTemplate, STATUS_FIELD_PACKETS, appState.packetCount);
+        SetTemplateULong(&StatusTemplate, STATUS_FIELD_COMMANDS, appState.commandCount);
+        SetTemplateString(&StatusTemplate, STATUS_FIELD_ECHO, appState.echoMode ? "ON" : "OFF");
+        SetTemplateString(&StatusTemplate, STATUS_FIELD_VERBOSE, appState.verboseMode ? "ON" : "OFF");
+        SendTemplate(&StatusTemplate);
+    } else {
+        rb = BeginResponse();
+        AppendString(rb, "STATUS: Packets=");
+        AppendULong(rb, appState.packetCount);
+        AppendString(rb, " Commands=");
+        AppendULong(rb, appState.commandCount);
+        AppendString(rb, " Echo=");
+        AppendString(rb, appState.echoMode ? "ON" : "OFF");
+        AppendString(rb, " Verbose=");
+        AppendString(rb, appState.verboseMode ? "ON" : "OFF");
+        AppendData(rb, "\r\n", 2);
+        SendResponse(rb);
+    }
     
     if (appState.verboseMode) {
         printf("Sent status response\n");
@@ -68,41 +156,63 @@ void HandleStatusCommand(const char *args)
 
 void HandleEchoCommand(const char *args)
 {
+    (void)args;
+    
     appState.echoMode = !appState.echoMode;
     
-    char response[64];
-    sprintf(response, "ECHO: %s\r\n", appState.echoMode ? "ON" : "OFF");
-    SendPacket(response, strlen(response));
+    SendCachedResponse(appState.echoMode ? &EchoOnReply : &EchoOffReply);
     
     printf("Echo mode: %s\n", appState.echoMode ? "ON" : "OFF");
 }
 
 void HandleVerboseCommand(const char *args)
 {
+    (void)args;
+    
     appState.verboseMode = !appState.verboseMode;
     
-    char response[64];
-    sprintf(response, "VERBOSE: %s\r\n", appState.verboseMode ? "ON" : "OFF");
-    SendPacket(response, strlen(response));
+    SendCachedResponse(appState.verboseMode ? &VerboseOnReply : &VerboseOffReply);
     
     printf("Verbose mode: %s\n", appState.verboseMode ? "ON" : "OFF");
 }
 
 void HandleHelpCommand(const char *args)
 {
-    char response[512];
+    ResponseBuilder *rb;
+    ULONG mark;
     int i;
     
-    strcpy(response, "HELP: Available commands:\r\n");
+    (void)args;
+    
+    if (HelpReply.data) {
+        SendCachedResponse(&HelpReply);
+        if (appState.verboseMode) {
+            printf("Sent help information\n");
+        }
+        return;
+    }
+    
+    /* Cache pool exhausted: build the reply on the fly */
+    rb = BeginResponse();
+    AppendString(rb, "HELP: Available commands:\r\n");
     
     for (i = 0; commands[i].name != NULL; i++) {
-        strcat(response, commands[i].name);
-        strcat(response, " - ");
-        strcat(response, commands[i].description);
-        strcat(response, "\r\n");
+        mark = rb->length;
+        AppendString(rb, commands[i].name);
+        AppendData(rb, " - ", 3);
+        AppendString(rb, commands[i].description);
+        AppendData(rb, "\r\n", 2);
+        
+        /* Buffer full: flush the complete lines and retry this entry */
+        if (rb->overflow && mark > 0) {
+            rb->length = mark;
+            rb->overflow = FALSE;
+            SendResponse(rb);
+            i--;
+        }
     }
     
-    SendPacket(response, strlen(response));
+    SendResponse(rb);
     
     if (appState.verboseMode) {
         printf("Sent help information\n");
@@ -111,57 +221,616 @@ void HandleHelpCommand(const char *args)
 
 void HandlePingCommand(const char *args)
 {
-    char response[] = "PONG\r\n";
-    SendPacket(response, strlen(response));
+    (void)args;
+    
+    SendCachedResponse(&PongReply);
     
     printf("Received PING, sent PONG\n");
 }
 
 void HandleSendCommand(const char *args)
 {
-    char response[256];
+    ResponseBuilder *rb;
     
-    if (args && strlen(args) > 0) {
-        sprintf(response, "ECHO: %s\r\n", args);
-        SendPacket(response, strlen(response));
+    if (args && args[0] != '\0') {
+        rb = BeginResponse();
+        AppendData(rb, "ECHO: ", 6);
+        AppendString(rb, args);
+        AppendData(rb, "\r\n", 2);
+        SendResponse(rb);
         
         if (appState.verboseMode) {
             printf("Echoed message: %s\n", args);
         }
     } else {
-        strcpy(response, "ERROR: No message specified\r\n");
-        SendPacket(response, strlen(response));
+        SendCachedResponse(&NoMessageReply);
     }
 }
 
 void HandleResetCommand(const char *args)
 {
+    (void)args;
+    
     appState.packetCount = 0;
     appState.commandCount = 0;
     
-    char response[] = "RESET: Counters cleared\r\n";
-    SendPacket(response, strlen(response));
+    SendCachedResponse(&CountersClearedReply);
     
     printf("Packet counters reset\n");
 }
 
+void HandleSubscribeCommand(const char *args)
+{
+    ResponseBuilder *rb;
+    ULONG interval = 0;
+    
+    /* Interval in milliseconds, default 500 */
+    while (args && *args >= '0' && *args <= '9') {
+        interval = interval * 10 + (*args++ - '0');
+    }
+    if (interval == 0) {
+        interval = 500;
+    }
+    
+    rb = BeginResponse();
+    AppendString(rb, "SUBSCRIBE: OK interval=");
+    AppendULong(rb, interval);
+    AppendData(rb, "ms\r\n", 4);
+    SendResponse(rb);
+    
+    /* Convert to 1/50 s ticks, at least one */
+    interval = (interval + 19) / 20;
+    StartTelemetry(interval);
+    
+    printf("Telemetry subscribed (%lu ticks)\n", (unsigned long)interval);
+}
+
+void HandleUnsubscribeCommand(const char *args)
+{
+    (void)args;
+    
+    StopTelemetry();
+    SendCachedResponse(&UnsubscribedReply);
+    
+    printf("Telemetry unsubscribed\n");
+}
+
+void HandleIoStatsCommand(const char *args)
+{
+    static const CachedResponse NoTaskReply = CACHED_RESPONSE("IOSTATS: Serial task not running\r\n");
+    SerialTaskStats stats;
+    ResponseBuilder *rb;
+    
+    (void)args;
+    
+    if (!SerialTaskRunning()) {
+        SendCachedResponse(&NoTaskReply);
+        return;
+    }
+    
+    GetSerialTaskStats(&stats);
+    
+    rb = BeginResponse();
+    AppendString(rb, "IOSTATS: Depth=");
+    AppendULong(rb, stats.queueDepth);
+    AppendString(rb, " MaxDepth=");
+    AppendULong(rb, stats.maxQueueDepth);
+    AppendString(rb, " Buffers=");
+    AppendULong(rb, stats.buffersDelivered);
+    AppendString(rb, " Bytes=");
+    AppendULong(rb, stats.bytesDelivered);
+    AppendString(rb, " Starved=");
+    AppendULong(rb, stats.starvedReads);
+    AppendString(rb, " Errors=");
+    AppendULong(rb, stats.readErrors);
+    AppendData(rb, "\r\n", 2);
+    SendResponse(rb);
+}
+
+/* Split "<remote path> <local file>"; FALSE if either is missing */
+static BOOL SplitTransferArgs(const char *args, char *remote, const char **local)
+{
+    const char *space = strchr(args, ' ');
+    ULONG length = space ? (ULONG)(space - args) : 0;
+
+    if (length == 0 || length >= FILE_PATH_MAX || space[1] == '\0')
+        return FALSE;
+    memcpy(remote, args, length);
+    remote[length] = '\0';
+    *local = space + 1;
+    return TRUE;
+}
+
+/* Copy a file from the host's file server; needs framed mode */
+void HandleFileGetCommand(const char *args)
+{
+    static const CachedResponse UsageReply = CACHED_RESPONSE("FGET: Usage FGET <remote path> <local file>\r\n");
+    static const CachedResponse NoFlowReply = CACHED_RESPONSE("FGET: Needs framed mode (FLOW)\r\n");
+    char remote[FILE_PATH_MAX];
+    char buffer[1024];
+    const char *local;
+    RemoteFileStats stats;
+    ResponseBuilder *rb;
+    ULONG total = 0;
+    LONG fh;
+    LONG got;
+    BPTR file;
+    BOOL failed = FALSE;
+    
+    if (!SplitTransferArgs(args, remote, &local)) {
+        SendCachedResponse(&UsageReply);
+        return;
+    }
+    if (!GetFlowLink()) {
+        SendCachedResponse(&NoFlowReply);
+        return;
+    }
+    
+    GetRemoteFileStats(&stats, TRUE);
+    fh = RemoteOpen(remote, FILE_MODE_READ);
+    if (fh < 0) {
+        rb = BeginResponse();
+        AppendString(rb, "FGET: Cannot open ");
+        AppendString(rb, remote);
+        AppendString(rb, ", error ");
+        AppendULong(rb, RemoteFileError());
+        AppendData(rb, "\r\n", 2);
+        SendResponse(rb);
+        return;
+    }
+    file = Open((STRPTR)local, MODE_NEWFILE);
+    if (!file) {
+        RemoteClose(fh);
+        rb = BeginResponse();
+        AppendString(rb, "FGET: Cannot create ");
+        AppendString(rb, local);
+        AppendData(rb, "\r\n", 2);
+        SendResponse(rb);
+        return;
+    }
+    
+    while ((got = RemoteRead(fh, buffer, sizeof(buffer))) > 0) {
+        if (Write(file, buffer, got) != got) {
+            failed = TRUE;
+            break;
+        }
+        total += got;
+    }
+    if (got < 0)
+        failed = TRUE;
+    Close(file);
+    RemoteClose(fh);
+    GetRemoteFileStats(&stats, FALSE);
+    
+    rb = BeginResponse();
+    AppendString(rb, failed ? "FGET: FAILED " : "FGET: OK ");
+    AppendULong(rb, total);
+    AppendString(rb, " bytes Requests=");
+    AppendULong(rb, stats.requests);
+    AppendString(rb, " ReadAhead=");
+    AppendULong(rb, stats.readAhead);
+    AppendString(rb, " Resends=");
+    AppendULong(rb, stats.resends);
+    AppendData(rb, "\r\n", 2);
+    SendResponse(rb);
+}
+
+/* SyncFile() target: the old copy is read in place, the new one is
+   written beside it and renamed over it once it has checked out */
+typedef struct {
+    BPTR old;
+    BPTR out;
+    char temp[FILE_PATH_MAX + 6];
+} SyncFiles;
+
+static LONG SyncReadOld(ULONG offset, APTR buffer, ULONG length, APTR userData)
+{
+    SyncFiles *sf = (SyncFiles *)userData;
+    
+    if (Seek(sf->old, (LONG)offset, OFFSET_BEGINNING) < 0)
+        return -1;
+    return Read(sf->old, buffer, (LONG)length);
+}
+
+static BOOL SyncWriteNew(const APTR data, ULONG length, APTR userData)
+{
+    SyncFiles *sf = (SyncFiles *)userData;
+    
+    return (BOOL)(Write(sf->out, data, (LONG)length) == (LONG)length);
+}
+
+static BOOL SyncRestart(APTR userData)
+{
+    SyncFiles *sf = (SyncFiles *)userData;
+    
+    Close(sf->out);
+    sf->out = Open((STRPTR)sf->temp, MODE_NEWFILE);
+    return (BOOL)(sf->out != 0);
+}
+
+/* Bring a local file up to date with the host's copy; needs framed mode */
+void HandleFileSyncCommand(const char *args)
+{
+    static const CachedResponse UsageReply = CACHED_RESPONSE("FSYNC: Usage FSYNC <remote path> <local file>\r\n");
+    static const CachedResponse NoFlowReply = CACHED_RESPONSE("FSYNC: Needs framed mode (FLOW)\r\n");
+    char remote[FILE_PATH_MAX];
+    const char *local;
+    SyncFiles files;
+    SyncTarget target;
+    SyncStats stats;
+    ResponseBuilder *rb;
+    BOOL ok;
+    
+    if (!SplitTransferArgs(args, remote, &local) || strlen(local) > FILE_PATH_MAX) {
+        SendCachedResponse(&UsageReply);
+        return;
+    }
+    if (!GetFlowLink()) {
+        SendCachedResponse(&NoFlowReply);
+        return;
+    }
+    strcpy(files.temp, local);
+    strcat(files.temp, ".sync");
+    
+    /* No local copy yet is fine: everything then comes as literal data */
+    target.oldLength = 0;
+    files.old = Open((STRPTR)local, MODE_OLDFILE);
+    if (files.old) {
+        Seek(files.old, 0, OFFSET_END);
+        target.oldLength = (ULONG)Seek(files.old, 0, OFFSET_BEGINNING);
+    }
+    files.out = Open((STRPTR)files.temp, MODE_NEWFILE);
+    if (!files.out) {
+        if (files.old)
+            Close(files.old);
+        rb = BeginResponse();
+        AppendString(rb, "FSYNC: Cannot create ");
+        AppendString(rb, files.temp);
+        AppendData(rb, "\r\n", 2);
+        SendResponse(rb);
+        return;
+    }
+    target.readOld = SyncReadOld;
+    target.write = SyncWriteNew;
+    target.restart = SyncRestart;
+    target.userData = &files;
+    
+    ok = SyncFile(remote, &target, &stats);
+    
+    if (files.out)
+        Close(files.out);
+    if (files.old)
+        Close(files.old);
+    if (ok) {
+        DeleteFile((STRPTR)local);
+        ok = (BOOL)Rename((STRPTR)files.temp, (STRPTR)local);
+    } else {
+        DeleteFile((STRPTR)files.temp);
+    }
+    
+    rb = BeginResponse();
+    if (ok) {
+        AppendString(rb, "FSYNC: OK ");
+        AppendULong(rb, stats.fileLength);
+        AppendString(rb, " bytes Sent=");
+        AppendULong(rb, stats.signatureBytes);
+        AppendString(rb, " Received=");
+        AppendULong(rb, stats.deltaBytes);
+        AppendString(rb, " Copied=");
+        AppendULong(rb, stats.copiedBytes);
+        AppendString(rb, " Block=");
+        AppendULong(rb, stats.blockSize);
+        if (stats.fullCopy)
+            AppendString(rb, " Resent");
+    } else {
+        AppendString(rb, "FSYNC: FAILED error ");
+        AppendULong(rb, stats.error);
+    }
+    AppendData(rb, "\r\n", 2);
+    SendResponse(rb);
+}
+
+/* Mirror a public screen to the host for <frames> passes; needs framed mode */
+void HandleScreenCommand(const char *args)
+{
+    static const CachedResponse UsageReply = CACHED_RESPONSE("SCREEN: Usage SCREEN <frames> [public screen]\r\n");
+    static const CachedResponse NoFlowReply = CACHED_RESPONSE("SCREEN: Needs framed mode (FLOW)\r\n");
+    static const CachedResponse NoScreenReply = CACHED_RESPONSE("SCREEN: Cannot lock a planar screen\r\n");
+    static const CachedResponse NoMemoryReply = CACHED_RESPONSE("SCREEN: Not enough memory\r\n");
+    static const CachedResponse LayoutReply = CACHED_RESPONSE("SCREEN: Cannot stream this screen's layout\r\n");
+    ScreenSource source;
+    ScreenStreamStats stats;
+    ResponseBuilder *rb;
+    LinkTime start;
+    LinkTime end;
+    UBYTE *shadow;
+    ULONG frames = 0;
+    ULONG frequency;
+    ULONG ms = 0;
+    ULONG fps10 = 0;
+    ULONG lastFrames = 0;
+    ULONG lastTiles = 0;
+    BOOL failed = FALSE;
+    
+    while (args && *args >= '0' && *args <= '9') {
+        frames = frames * 10 + (*args++ - '0');
+    }
+    if (frames == 0 || (*args != '\0' && *args != ' ')) {
+        SendCachedResponse(&UsageReply);
+        return;
+    }
+    while (*args == ' ') {
+        args++;
+    }
+    if (!GetFlowLink()) {
+        SendCachedResponse(&NoFlowReply);
+        return;
+    }
+    if (!LockScreenSource(*args ? args : NULL, &source)) {
+        SendCachedResponse(&NoScreenReply);
+        return;
+    }
+    shadow = (UBYTE *)malloc(ScreenShadowSize(&source));
+    if (!shadow) {
+        UnlockScreenSource();
+        SendCachedResponse(&NoMemoryReply);
+        return;
+    }
+    
+    if (!InitScreenStream(GetFlowLink(), PollFlowInput, NULL, &source, shadow)) {
+        free(shadow);
+        UnlockScreenSource();
+        SendCachedResponse(&LayoutReply);
+        return;
+    }
+    frequency = ReadLinkClock(&start);
+    GetScreenStreamStats(&stats, FALSE);
+    while (stats.frames < frames) {
+        RefreshScreenSource(&source);
+        if (SendScreenUpdate(SCREEN_UPDATE_BUDGET) < 0) {
+            failed = TRUE;
+            break;
+        }
+        GetScreenStreamStats(&stats, FALSE);
+        
+        /* Nothing changed in a whole pass: give the CPU back for a tick */
+        if (stats.frames != lastFrames) {
+            if (stats.tilesSent == lastTiles && PollFlowInput(TRUE, NULL) < 0) {
+                failed = TRUE;
+                break;
+            }
+            lastFrames = stats.frames;
+            lastTiles = stats.tilesSent;
+        }
+    }
+    ReadLinkClock(&end);
+    CleanupScreenStream();
+    UnlockScreenSource();
+    free(shadow);
+    
+    if (frequency >= 1000) {
+        ms = (end.lo - start.lo) / (frequency / 1000);
+    }
+    if (ms > 0) {
+        fps10 = stats.frames * 10000 / ms;
+    }
+    rb = BeginResponse();
+    AppendString(rb, failed ? "SCREEN: STOPPED Frames=" : "SCREEN: OK Frames=");
+    AppendULong(rb, stats.frames);
+    AppendString(rb, " Ms=");
+    AppendULong(rb, ms);
+    AppendString(rb, " Fps=");
+    AppendULong(rb, fps10 / 10);
+    AppendChar(rb, '.');
+    AppendULong(rb, fps10 % 10);
+    AppendString(rb, " Bytes=");
+    AppendULong(rb, stats.bytesSent);
+    AppendString(rb, " PerFrame=");
+    AppendULong(rb, stats.frames ? stats.bytesSent / stats.frames : 0);
+    AppendString(rb, " Tiles=");
+    AppendULong(rb, stats.tilesSent);
+    AppendString(rb, " Raw=");
+    AppendULong(rb, stats.rawBytes);
+    AppendData(rb, "\r\n", 2);
+    SendResponse(rb);
+}
+
+/* Reached only when a STREAM header did not parse */
+void HandleStreamCommand(const char *args)
+{
+    static const CachedResponse StreamUsageReply = CACHED_RESPONSE("ERROR: Usage STREAM <length> [file]\r\n");
+    
+    (void)args;
+    
+    SendCachedResponse(&StreamUsageReply);
+}
+
+void HandleCalibrateCommand(const char *args)
+{
+    static const CachedResponse CalibrateFailedReply = CACHED_RESPONSE("CALIBRATE: Failed, rate unchanged\r\n");
+    ResponseBuilder *rb;
+    ULONG baud;
+    
+    (void)args;
+    
+    baud = CalibrateLink();
+    if (baud == 0) {
+        SendCachedResponse(&CalibrateFailedReply);
+        return;
+    }
+    
+    /* Sent at the new rate */
+    rb = BeginResponse();
+    AppendString(rb, "CALIBRATE: ");
+    AppendULong(rb, baud);
+    AppendString(rb, " baud\r\n");
+    SendResponse(rb);
+    
+    printf("Link calibrated to %lu baud\n", (unsigned long)baud);
+}
+
+/* Timestamps for the host's clock-offset estimate */
+void HandleTimeSyncCommand(const char *args)
+{
+    AnswerTimeSync(args);
+}
+
+/* Profiler report; needs a build with DEFINE=PACKET_PROFILE (smake profile) */
+void HandleProfileCommand(const char *args)
+{
+#ifdef PACKET_PROFILE
+    static const CachedResponse ProfileResetReply = CACHED_RESPONSE("PROFILE: Reset\r\n");
+    ULONG mhz = 0;
+    
+    if (ArgIs(args, "RESET")) {
+        ResetProfile();
+        SendCachedResponse(&ProfileResetReply);
+        return;
+    }
+    
+    /* Clock of an accelerator card, in MHz; default is the stock 68000 */
+    while (*args >= '0' && *args <= '9') {
+        mhz = mhz * 10 + (*args++ - '0');
+    }
+    SendProfileReport(mhz * 1000000);
+#else
+    static const CachedResponse NoProfilerReply =
+        CACHED_RESPONSE("PROFILE: Not built in (smake profile)\r\n");
+    
+    (void)args;
+    SendCachedResponse(&NoProfilerReply);
+#endif
+}
+
+#ifndef PACKET_BENCH
+/* Streamed upload: written to a file piece by piece, never held in memory */
+typedef struct {
+    BPTR file;
+    ULONG expected;
+    ULONG written;
+    BOOL failed;
+    char name[108];
+} StreamUpload;
+
+static StreamUpload upload;
+
+static BOOL UploadBegin(ULONG total, const char *args, ULONG argsLength, APTR userData)
+{
+    StreamUpload *up = (StreamUpload *)userData;
+    ResponseBuilder *rb;
+    
+    if (argsLength == 0) {
+        args = "RAM:stream.bin";
+        argsLength = strlen(args);
+    }
+    if (argsLength > sizeof(up->name) - 1)
+        argsLength = sizeof(up->name) - 1;
+    memcpy(up->name, args, argsLength);
+    up->name[argsLength] = '\0';
+    
+    up->expected = total;
+    up->written = 0;
+    up->failed = FALSE;
+    up->file = Open(up->name, MODE_NEWFILE);
+    
+    if (!up->file) {
+        rb = BeginResponse();
+        AppendString(rb, "STREAM: ERROR Cannot open ");
+        AppendString(rb, up->name);
+        AppendData(rb, "\r\n", 2);
+        SendResponse(rb);
+        return FALSE;
+    }
+    
+    if (appState.verboseMode) {
+        printf("Receiving %lu bytes into %s\n", (unsigned long)total, up->name);
+    }
+    
+    return TRUE;
+}
+
+static void UploadData(const char *data, ULONG length, APTR userData)
+{
+    StreamUpload *up = (StreamUpload *)userData;
+    
+    if (up->failed)
+        return;
+    
+    if (Write(up->file, (APTR)data, length) != (LONG)length) {
+        up->failed = TRUE;
+        return;
+    }
+    up->written += length;
+}
+
+static void UploadEnd(BOOL complete, APTR userData)
+{
+    StreamUpload *up = (StreamUpload *)userData;
+    ResponseBuilder *rb;
+    
+    Close(up->file);
+    up->file = 0;
+    
+    rb = BeginResponse();
+    if (up->failed) {
+        AppendString(rb, "STREAM: ERROR Write failed after ");
+    } else if (!complete) {
+        AppendString(rb, "STREAM: INCOMPLETE ");
+    } else {
+        AppendString(rb, "STREAM: OK ");
+    }
+    AppendULong(rb, up->written);
+    AppendString(rb, " of ");
+    AppendULong(rb, up->expected);
+    AppendString(rb, " bytes to ");
+    AppendString(rb, up->name);
+    AppendData(rb, "\r\n", 2);
+    SendResponse(rb);
+    
+    printf("Stream %s: %lu bytes to %s\n",
+           up->failed ? "failed" : (complete ? "done" : "cut short"),
+           (unsigned long)up->written, up->name);
+}
+
+static const StreamHandler UploadHandler = { UploadBegin, UploadData, UploadEnd, &upload };
+#endif
+
+/* Expose application state to the telemetry stream */
+void RegisterAppTelemetry(void)
+{
+    RegisterTelemetry("packets", &appState.packetCount, sizeof(appState.packetCount));
+    RegisterTelemetry("commands", &appState.commandCount, sizeof(appState.commandCount));
+    RegisterTelemetry("echo", &appState.echoMode, sizeof(appState.echoMode));
+    RegisterTelemetry("verbose", &appState.verboseMode, sizeof(appState.verboseMode));
+}
+
 /* Process a command from the packet */
 void ProcessCommand(const char *packet, ULONG length)
 {
     char command[64];
-    char args[192];
+    char args[PACKET_LINE_BUFFER_SIZE];
     int i;
     const char *space;
+    ULONG commandLength;
+    PacketSegment reply[3];
+    
+    (void)length;
     
     appState.commandCount++;
     
+    PROFILE_BEGIN(PROFILE_PARSE);
+    
     /* Extract command and arguments */
     space = strchr(packet, ' ');
     if (space) {
         /* Command with arguments */
-        strncpy(command, packet, space - packet);
-        command[space - packet] = '\0';
-        strcpy(args, space + 1);
+        commandLength = space - packet;
+        if (commandLength > sizeof(command) - 1)
+            commandLength = sizeof(command) - 1;
+        strncpy(command, packet, commandLength);
+        command[commandLength] = '\0';
+        strncpy(args, space + 1, sizeof(args) - 1);
+        args[sizeof(args) - 1] = '\0';
         
         /* Remove trailing newlines from args */
         char *newline = strchr(args, '\r');
@@ -170,7 +839,8 @@ void ProcessCommand(const char *packet, ULONG length)
         if (newline) *newline = '\0';
     } else {
         /* Command without arguments */
-        strcpy(command, packet);
+        strncpy(command, packet, sizeof(command) - 1);
+        command[sizeof(command) - 1] = '\0';
         args[0] = '\0';
         
         /* Remove trailing newlines from command */
@@ -187,15 +857,22 @@ void ProcessCommand(const char *packet, ULONG length)
     /* Find and execute command */
     for (i = 0; commands[i].name != NULL; i++) {
         if (strcmp(command, commands[i].name) == 0) {
+            PROFILE_END(PROFILE_PARSE, length);
             commands[i].handler(args);
             return;
         }
     }
     
+    PROFILE_END(PROFILE_PARSE, length);
+    
     /* Unknown command */
-    char response[128];
-    sprintf(response, "ERROR: Unknown command '%s'. Type HELP for available commands.\r\n", command);
-    SendPacket(response, strlen(response));
+    reply[0].data = UnknownPrefix.data;
+    reply[0].length = UnknownPrefix.length;
+    reply[1].data = command;
+    reply[1].length = strlen(command);
+    reply[2].data = UnknownSuffix.data;
+    reply[2].length = UnknownSuffix.length;
+    SendReplyV(reply, 3);
     
     if (appState.verboseMode) {
         printf("Unknown command: %s\n", command);
@@ -208,7 +885,8 @@ void CustomPacketHandler(const char *packet, ULONG length)
     appState.packetCount++;
     
     if (appState.verboseMode) {
-        printf("Received packet #%lu (%lu bytes): ", appState.packetCount, length);
+        printf("Received packet #%lu (%lu bytes): ",
+               (unsigned long)appState.packetCount, (unsigned long)length);
         fwrite(packet, 1, length, stdout);
         printf("\n");
     }
@@ -219,11 +897,15 @@ void CustomPacketHandler(const char *packet, ULONG length)
         ProcessCommand(packet, length);
     } else if (appState.echoMode) {
         /* Echo non-command data if echo mode is enabled */
-        char response[256];
-        sprintf(response, "ECHO: ");
-        strncat(response, packet, length < 240 ? length : 240);
-        strcat(response, "\r\n");
-        SendPacket(response, strlen(response));
+        PacketSegment echo[3];
+        
+        echo[0].data = "ECHO: ";
+        echo[0].length = 6;
+        echo[1].data = packet;
+        echo[1].length = length;
+        echo[2].data = "\r\n";
+        echo[2].length = 2;
+        SendReplyV(echo, 3);
         
         if (appState.verboseMode) {
             printf("Echoed data packet\n");
@@ -231,12 +913,174 @@ void CustomPacketHandler(const char *packet, ULONG length)
     }
 }
 
-/* Main application */
-int main(void)
+#if !defined(PACKET_BENCH) || defined(PACKET_PROFILE)
+/* Case-insensitive match of a command line keyword */
+static BOOL ArgIs(const char *arg, const char *keyword)
 {
+    char c;
+    
+    while (*arg && *keyword) {
+        c = *arg++;
+        if (c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        if (c != *keyword++)
+            return FALSE;
+    }
+    
+    return (BOOL)(*arg == '\0' && *keyword == '\0');
+}
+#endif
+
+/* Main application; the benchmark build (DEFINE=PACKET_BENCH) brings its own */
+#ifndef PACKET_BENCH
+
+/* MIDI mode (MIDI [bpm] on the command line): a MIDI clock with a beat
+   note at bpm, scheduled on the EClock, and thru for channel messages.
+   pc/midi_jitter.py records the clock and reports its timing */
+#define MIDI_DEFAULT_BPM 120
+#define MIDI_CLOCKS_PER_BEAT 24
+#define MIDI_LOOKAHEAD_CLOCKS 4         /* Clocks kept in the output queue */
+#define MIDI_BEAT_CHANNEL 9             /* General MIDI drums */
+#define MIDI_BEAT_NOTE 37               /* Side stick */
+
+typedef struct {
+    BOOL stop;
+    ULONG thru;
+    ULONG sysex;
+} MidiSession;
+
+static void MidiThru(const MidiEvent *ev, APTR userData)
+{
+    MidiSession *ms = (MidiSession *)userData;
+    
+    /* System Reset from the host ends MIDI mode */
+    if (ev->data[0] == 0xFF) {
+        ms->stop = TRUE;
+        return;
+    }
+    if (ev->sysex) {
+        ms->sysex++;
+        return;
+    }
+    
+    if (ev->data[0] < 0xF0 && ScheduleMidi(ev->data, ev->length, NULL))
+        ms->thru++;
+}
+
+static void RunMidiMode(ULONG bpm)
+{
+    static const UBYTE ClockMessage[1] = { 0xF8 };
+    static const UBYTE StartMessage[1] = { 0xFA };
+    static const UBYTE StopMessage[1] = { 0xFC };
+    static const UBYTE BeatOn[3] = { 0x90 | MIDI_BEAT_CHANNEL, MIDI_BEAT_NOTE, 100 };
+    static const UBYTE BeatOff[3] = { 0x80 | MIDI_BEAT_CHANNEL, MIDI_BEAT_NOTE, 0 };
+    MidiSession session = { FALSE, 0, 0 };
+    MidiParser parser;
+    MidiStats stats;
+    LinkTime next;
+    LinkTime horizon;
+    ULONG frequency;
+    ULONG divisor;
+    ULONG perClock;
+    ULONG remainder;
+    ULONG error = 0;
+    ULONG clocks = 0;
+    
+    /* Clock period in EClock ticks; the remainder is spread so the tempo
+       does not drift */
+    frequency = ReadLinkClock(&next);
+    divisor = bpm * MIDI_CLOCKS_PER_BEAT;
+    perClock = frequency * 60 / divisor;
+    remainder = frequency * 60 % divisor;
+    
+    printf("MIDI mode at %lu baud: %lu BPM, clock every %lu EClock ticks\n",
+           GetSerialBaud(), bpm, perClock);
+    printf("Send System Reset (FF) or press Ctrl+C to leave\n");
+    
+    InitMidiParser(&parser, MidiThru, &session);
+    AddLinkTime(&next, frequency / 10);
+    ScheduleMidi(StartMessage, 1, &next);
+    
+    while (!session.stop) {
+        ReadLinkClock(&horizon);
+        AddLinkTime(&horizon, perClock * MIDI_LOOKAHEAD_CLOCKS);
+        
+        while (CompareLinkTime(&next, &horizon) < 0 && MidiQueueSpace() >= 2) {
+            ScheduleMidi(ClockMessage, 1, &next);
+            if (clocks % MIDI_CLOCKS_PER_BEAT == 0) {
+                ScheduleMidi(BeatOn, 3, &next);
+            } else if (clocks % MIDI_CLOCKS_PER_BEAT == MIDI_CLOCKS_PER_BEAT / 4) {
+                ScheduleMidi(BeatOff, 3, &next);
+            }
+            clocks++;
+            
+            AddLinkTime(&next, perClock);
+            error += remainder;
+            if (error >= divisor) {
+                error -= divisor;
+                AddLinkTime(&next, 1);
+            }
+        }
+        
+        PollMidi(&parser);
+        WaitMidi();
+        
+        if (SetSignal(0, 0) & SIGBREAKF_CTRL_C) {
+            break;
+        }
+    }
+    
+    ScheduleMidi(StopMessage, 1, NULL);
+    SendDueMidi();
+    
+    GetMidiStats(&stats);
+    printf("MIDI: %lu clocks, %lu messages out (%lu bytes), worst lateness %lu EClock ticks\n",
+           clocks, stats.sent, stats.bytes, stats.maxLate);
+    printf("MIDI: %lu messages in, %lu real-time, %lu thru, %lu SysEx, %lu stray bytes\n",
+           parser.messages, parser.realtime, session.thru, session.sysex, parser.strayBytes);
+}
+
+int main(int argc, char **argv)
+{
+    BOOL useTask = FALSE;
+    BOOL useFlow = FALSE;
+    BOOL calibrate = FALSE;
+    BOOL autoCalibrate = FALSE;
+    ULONG midiBpm = 0;
+    SerialTaskStats stats;
+    FlowLink *flow;
+    int i;
+    
+    /* TASK moves serial reads to their own task, FLOW enables framed mode,
+       CALIBRATE finds the best rate first, AUTOCAL redoes it on errors,
+       MIDI [bpm] runs the MIDI mode instead of the line protocol */
+    for (i = 1; i < argc; i++) {
+        if (ArgIs(argv[i], "TASK")) {
+            useTask = TRUE;
+        } else if (ArgIs(argv[i], "FLOW")) {
+            useFlow = TRUE;
+        } else if (ArgIs(argv[i], "CALIBRATE")) {
+            calibrate = TRUE;
+        } else if (ArgIs(argv[i], "AUTOCAL")) {
+            autoCalibrate = TRUE;
+        } else if (ArgIs(argv[i], "MIDI")) {
+            midiBpm = MIDI_DEFAULT_BPM;
+            if (i + 1 < argc && argv[i + 1][0] >= '1' && argv[i + 1][0] <= '9') {
+                midiBpm = strtoul(argv[++i], NULL, 10);
+            }
+        }
+    }
+    
     printf("Amiga Packet Application Example\n");
     printf("===============================\n");
-    printf("Commands: STATUS, ECHO, VERBOSE, HELP, PING, SEND, RESET\n");
+    printf("Commands: STATUS, ECHO, VERBOSE, HELP, PING, SEND, RESET,\n");
+    printf("          SUBSCRIBE, UNSUBSCRIBE, IOSTATS, STREAM, CALIBRATE,\n");
+    printf("          TSYNC, PROFILE, FGET, FSYNC, SCREEN (HELP describes each)\n");
+    printf("Prefix a command with #<id> to pipeline; replies echo the tag\n");
+    printf("Run with TASK to receive on a dedicated serial I/O task,\n");
+    printf("FLOW for framed mode with credit-based flow control,\n");
+    printf("CALIBRATE to pick the fastest clean rate, AUTOCAL to redo it on errors,\n");
+    printf("MIDI [bpm] for a MIDI clock and thru at 31250 baud\n");
     printf("Press Ctrl+C to exit\n\n");
     
     /* Initialize the packet framework */
@@ -245,22 +1089,80 @@ int main(void)
         return 1;
     }
     
-    printf("Framework initialized successfully\n");
-    printf("Echo mode: %s\n", appState.echoMode ? "ON" : "OFF");
-    printf("Verbose mode: %s\n\n", appState.verboseMode ? "ON" : "OFF");
+    printf("Framework initialized successfully at %lu baud\n", GetSerialBaud());
     
-    /* Send startup notification */
-    char startup[] = "READY: Amiga packet application started\r\n";
-    SendPacket(startup, strlen(startup));
+    /* Calibration needs the device to itself, so it runs before TASK/FLOW */
+    if (calibrate) {
+        printf("Calibrating link rate (run pc/link_calibrate.py on the host)\n");
+        if (CalibrateLink()) {
+            printf("Link rate: %lu baud\n", GetSerialBaud());
+        } else {
+            printf("Calibration failed, staying at %lu baud\n", GetSerialBaud());
+        }
+    }
+    EnableAutoCalibration(autoCalibrate);
     
-    /* Start packet processing with custom handler */
-    ProcessPackets(CustomPacketHandler);
+    /* The rate has to change before the serial task takes the device */
+    if (midiBpm && !EnableMidiMode()) {
+        printf("Cannot enter MIDI mode, staying at %lu baud\n", GetSerialBaud());
+        midiBpm = 0;
+    }
     
-    /* Send shutdown notification */
-    char shutdown[] = "SHUTDOWN: Amiga packet application stopping\r\n";
-    SendPacket(shutdown, strlen(shutdown));
+    if (useTask) {
+        if (StartSerialTask(SERIAL_TASK_PRIORITY)) {
+            printf("Serial I/O task started (priority %d)\n", SERIAL_TASK_PRIORITY);
+        } else {
+            printf("Serial I/O task failed to start, polling instead\n");
+        }
+    }
+
+    if (midiBpm) {
+        RunMidiMode(midiBpm);
+    } else {
+        printf("Echo mode: %s\n", appState.echoMode ? "ON" : "OFF");
+        printf("Verbose mode: %s\n\n", appState.verboseMode ? "ON" : "OFF");
+        
+        if (useFlow) {
+            if (EnableFlowControl()) {
+                printf("Framed mode with credit-based flow control enabled\n");
+                InitRemoteFiles(GetFlowLink(), PollFlowInput, NULL);
+            } else {
+                printf("Failed to enable flow control, using raw stream\n");
+            }
+        }
+        
+        /* Build invariant replies once, then announce startup */
+        BuildResponseCache();
+        RegisterAppTelemetry();
+        SetStreamHandler(&UploadHandler);
+        SendCachedResponse(&ReadyReply);
+        
+        /* Process commands line by line; "#<id> " tags are echoed in replies */
+        ProcessLines(CustomPacketHandler);
+        
+        /* Send shutdown notification */
+        SendCachedResponse(&ShutdownReply);
+    }
     
     /* Cleanup */
+    if (SerialTaskRunning()) {
+        GetSerialTaskStats(&stats);
+        printf("Serial task: %lu buffers, %lu bytes, max queue depth %lu, starved %lu\n",
+               stats.buffersDelivered, stats.bytesDelivered,
+               stats.maxQueueDepth, stats.starvedReads);
+    }
+    flow = GetFlowLink();
+    if (flow) {
+        printf("Flow control: %lu frames in, %lu out, %lu CRC errors, %lu credit stalls, %lu overruns, %lu gaps, %lu resent\n",
+               flow->decoder.framesReceived, flow->framesSent, flow->decoder.crcErrors,
+               flow->creditStalls, flow->rxOverruns, flow->rxGaps, flow->txResent);
+    }
+    /* The rate can only be restored once the serial task has stopped */
+    if (MidiModeActive()) {
+        StopSerialTask();
+        DisableMidiMode();
+    }
+    CleanupRemoteFiles();
     CleanupPacketFramework();
     
     printf("\nApplication terminated\n");
@@ -269,4 +1171,5 @@ int main(void)
     printf("  Commands processed: %lu\n", appState.commandCount);
     
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,612 @@
+/*
+ * Packet Framework Microbenchmarks
+ * Drives the portable hot paths of the framework and the example app -
+ * receive chunk handling, command dispatch, response formatting, framing
+ * and flow control - with a synthetic command mix and with recorded host
+ * input, and prints one line per benchmark:
+ *
+ *   BENCH <name> ops=<n> ns/op=<n> bytes/s=<n> alloc=<n>
+ *
+ * bytes/s counts input bytes for receive benchmarks and output bytes for
+ * formatting ones; alloc is the heap growth over the timed run in bytes.
+ * Replies go to a counting sink (SetPacketSink()), never to the line.
+ * The app's console messages are part of its cost but go to NIL:, so
+ * results are written to stderr, or to a file with -o.
+ *
+ * The same source builds for the Amiga (smake packet_bench, linked with
+ * the real framework) and for a host (make -C amiga/host, linked with
+ * host/bench_port.c), so runs can be compared across changes with
+ * pc/bench_compare.py.
+ *
+ * Usage: packet_bench [-r <recorded input>] [-t <ms per benchmark>]
+ *                     [-o <results file>] [name filter]
+ */
+
+#include "amiga_packet_framework.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PACKET_HOST
+#include <time.h>
+#include <malloc.h>
+#else
+#include <exec/memory.h>
+#include <devices/timer.h>
+#include <proto/exec.h>
+#include <proto/alib.h>
+#include <proto/timer.h>
+#endif
+
+#define BENCH_DEFAULT_MS 1000           /* Timed run per benchmark */
+#define BENCH_CHUNK 64                  /* Receive chunk size fed to the line protocol */
+#define BENCH_RECORD_MAX 32768          /* Largest recorded input loaded */
+#define BENCH_BYTE_LIMIT 0x40000000     /* Stop early before bytes/s overflows */
+#define BENCH_FLOW_BLOCK 4096           /* Bytes per flow-control transfer */
+
+/* Application entry points used by the benchmark */
+void CustomPacketHandler(const char *packet, ULONG length);
+void BuildResponseCache(void);
+
+/* One benchmark: runs a batch, returns operations done, adds to *bytes */
+typedef struct {
+    const char *name;
+    ULONG (*run)(ULONG *bytes);
+} Benchmark;
+
+/* Synthetic workload: the example app's common commands, tagged and not */
+static const char *SyntheticLines[] = {
+    "STATUS",
+    "PING",
+    "#17 PING",
+    "SEND Hello from the host",
+    "IOSTATS",
+    "#3 STATUS",
+    "HELP",
+    "FROB 1 2 3",
+    "0123456789 data line",
+    "#250 SEND tagged message with a longer body to format",
+    NULL
+};
+
+static char SyntheticInput[1024];
+static ULONG SyntheticLength = 0;
+static ULONG SyntheticCount = 0;
+
+static char RecordedInput[BENCH_RECORD_MAX];
+static ULONG RecordedLength = 0;
+
+/* Split copies of the synthetic lines for direct dispatch */
+static char SplitLines[16][80];
+
+/* Output sink */
+static ULONG SinkBytes = 0;
+static ULONG SinkWrites = 0;
+
+/* Where result lines go */
+static FILE *Results = NULL;
+
+/* Lines seen by the counting handler */
+static ULONG LinesHandled = 0;
+
+static UBYTE Payload[FRAME_MAX_PAYLOAD];
+static UBYTE Encoded[FRAME_ENCODED_SIZE(FRAME_MAX_PAYLOAD)];
+static ULONG EncodedLength = 0;
+static ULONG FramesDecoded = 0;
+
+static ResponseTemplate CounterTemplate;
+static const CachedResponse BenchReply = CACHED_RESPONSE("PONG\r\n");
+
+/* Two flow-controlled ends joined back to back */
+static FlowLink FlowA;
+static FlowLink FlowB;
+static UBYTE FlowRingA[FLOW_RX_BUFFER_SIZE];
+static UBYTE FlowRingB[FLOW_RX_BUFFER_SIZE];
+static UBYTE FlowData[BENCH_FLOW_BLOCK];
+
+/* ------------------------------------------------------------------ */
+/* Platform: elapsed time and heap in use                              */
+/* ------------------------------------------------------------------ */
+
+/* a * b / c with a 64-bit intermediate; saturates at 0xFFFFFFFF */
+static ULONG MulDiv(ULONG a, ULONG b, ULONG c)
+{
+    ULONG lo = (a & 0xFFFF) * (b & 0xFFFF);
+    ULONG hi = (a >> 16) * (b >> 16);
+    ULONG mid1 = (a >> 16) * (b & 0xFFFF);
+    ULONG mid2 = (a & 0xFFFF) * (b >> 16);
+    ULONG sum;
+    ULONG quotient = 0;
+    BOOL carry;
+    int i;
+
+    sum = lo + (mid1 << 16);
+    hi += (mid1 >> 16) + (sum < lo ? 1 : 0);
+    lo = sum;
+    sum = lo + (mid2 << 16);
+    hi += (mid2 >> 16) + (sum < lo ? 1 : 0);
+    lo = sum;
+
+    if (c == 0 || hi >= c)
+        return 0xFFFFFFFF;
+
+    for (i = 0; i < 32; i++) {
+        carry = (BOOL)((hi & 0x80000000) != 0);
+        hi = (hi << 1) | (lo >> 31);
+        lo <<= 1;
+        quotient <<= 1;
+        if (carry || hi >= c) {
+            hi -= c;
+            quotient |= 1;
+        }
+    }
+
+    return quotient;
+}
+
+#ifdef PACKET_HOST
+
+static struct timespec ClockStart;
+
+static BOOL OpenBenchClock(void)
+{
+    return TRUE;
+}
+
+static void CloseBenchClock(void)
+{
+}
+
+static void StartClock(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &ClockStart);
+}
+
+/* Microseconds since StartClock() */
+static ULONG ElapsedMicros(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (ULONG)((now.tv_sec - ClockStart.tv_sec) * 1000000 +
+                   (now.tv_nsec - ClockStart.tv_nsec) / 1000);
+}
+
+static LONG HeapInUse(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return (LONG)mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+#define PLATFORM_NAME "host"
+#define NULL_OUTPUT "/dev/null"
+
+#else
+
+/* Library base for ReadEClock() (amiga_packet_clock.c) */
+extern struct Device *TimerBase;
+
+static struct MsgPort *BenchMP = NULL;
+static struct timerequest *BenchIO = NULL;
+static ULONG EClockHz = 0;
+static ULONG ClockStart = 0;
+
+static BOOL OpenBenchClock(void)
+{
+    struct EClockVal ev;
+
+    BenchMP = CreatePort(NULL, 0);
+    if (!BenchMP)
+        return FALSE;
+    BenchIO = (struct timerequest *)CreateExtIO(BenchMP, sizeof(struct timerequest));
+    if (!BenchIO)
+        return FALSE;
+    if (OpenDevice("timer.device", UNIT_ECLOCK, (struct IORequest *)BenchIO, 0) != 0) {
+        DeleteExtIO((struct IORequest *)BenchIO);
+        BenchIO = NULL;
+        return FALSE;
+    }
+
+    TimerBase = BenchIO->tr_node.io_Device;
+    EClockHz = ReadEClock(&ev);
+    return TRUE;
+}
+
+static void CloseBenchClock(void)
+{
+    if (BenchIO) {
+        CloseDevice((struct IORequest *)BenchIO);
+        DeleteExtIO((struct IORequest *)BenchIO);
+        BenchIO = NULL;
+    }
+    if (BenchMP) {
+        DeletePort(BenchMP);
+        BenchMP = NULL;
+    }
+}
+
+static void StartClock(void)
+{
+    struct EClockVal ev;
+
+    ReadEClock(&ev);
+    ClockStart = ev.ev_lo;
+}
+
+/* Microseconds since StartClock(); the low word covers over an hour */
+static ULONG ElapsedMicros(void)
+{
+    struct EClockVal ev;
+
+    ReadEClock(&ev);
+    return MulDiv(ev.ev_lo - ClockStart, 1000000, EClockHz);
+}
+
+/* Free memory shrinks as the heap grows; other tasks add noise */
+static LONG HeapInUse(void)
+{
+    return -(LONG)AvailMem(MEMF_ANY);
+}
+
+#define PLATFORM_NAME "amiga"
+#define NULL_OUTPUT "NIL:"
+
+#endif /* PACKET_HOST */
+
+/* ------------------------------------------------------------------ */
+/* Workloads                                                           */
+/* ------------------------------------------------------------------ */
+
+static BOOL CountingSink(const UBYTE *data, ULONG length, APTR userData)
+{
+    (void)data;
+    (void)userData;
+    SinkBytes += length;
+    SinkWrites++;
+    return TRUE;
+}
+
+/* The app's handler, counted */
+static void BenchHandler(const char *packet, ULONG length)
+{
+    LinesHandled++;
+    CustomPacketHandler(packet, length);
+}
+
+/* Tokenizer only: lines are counted and dropped */
+static void NullHandler(const char *packet, ULONG length)
+{
+    (void)packet;
+    (void)length;
+    LinesHandled++;
+}
+
+static void IgnoreTrigger(LONG id, ULONG offset, APTR userData)
+{
+    (void)id;
+    (void)offset;
+    (void)userData;
+}
+
+static void CountFrame(UBYTE type, UWORD credit, const UBYTE *payload,
+                       ULONG length, APTR userData)
+{
+    (void)type;
+    (void)credit;
+    (void)payload;
+    (void)length;
+    (void)userData;
+    FramesDecoded++;
+}
+
+/* Flow links write straight into each other */
+static BOOL FlowWire(const UBYTE *data, ULONG length, APTR userData)
+{
+    FlowInput((FlowLink *)userData, data, length);
+    return TRUE;
+}
+
+static void BuildSyntheticInput(void)
+{
+    ULONG length;
+    int i;
+
+    for (i = 0; SyntheticLines[i] != NULL; i++) {
+        length = strlen(SyntheticLines[i]);
+        memcpy(SyntheticInput + SyntheticLength, SyntheticLines[i], length);
+        SyntheticLength += length;
+        SyntheticInput[SyntheticLength++] = '\r';
+        SyntheticInput[SyntheticLength++] = '\n';
+
+        /* Direct dispatch gets the lines as ProcessLineInput() would:
+           tag stripped, NUL-terminated */
+        if (SyntheticLines[i][0] == '#')
+            strcpy(SplitLines[i], strchr(SyntheticLines[i], ' ') + 1);
+        else
+            strcpy(SplitLines[i], SyntheticLines[i]);
+    }
+    SyntheticCount = i;
+}
+
+/* Load recorded host-to-Amiga bytes, e.g. a capture of a pc/ tool session */
+static BOOL LoadRecording(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+        return FALSE;
+    RecordedLength = fread(RecordedInput, 1, sizeof(RecordedInput), f);
+    fclose(f);
+    return (BOOL)(RecordedLength > 0);
+}
+
+static void PrepareWorkloads(void)
+{
+    ULONG seed = 1;
+    ULONG i;
+
+    BuildSyntheticInput();
+    BuildResponseCache();
+    InitResponseTemplate(&CounterTemplate, "COUNTERS: lines=%u replies=%u bytes=%u\r\n");
+
+    for (i = 0; i < sizeof(Payload); i++) {
+        seed = seed * 1103515245 + 12345;
+        Payload[i] = (UBYTE)(seed >> 16);
+    }
+    EncodedLength = EncodeFrame(FRAME_DATA, 0, Payload, sizeof(Payload),
+                                Encoded, sizeof(Encoded));
+
+    for (i = 0; i < sizeof(FlowData); i++) {
+        FlowData[i] = (UBYTE)i;
+    }
+    InitFlowLink(&FlowA, FlowRingA, sizeof(FlowRingA), FlowWire, &FlowB);
+    InitFlowLink(&FlowB, FlowRingB, sizeof(FlowRingB), FlowWire, &FlowA);
+    StartFlowLink(&FlowA);
+    StartFlowLink(&FlowB);
+
+    AddTrigger("Hello Amiga", 11, IgnoreTrigger, NULL);
+    CompileTriggers();
+}
+
+/* Feed input to the line protocol in fixed-size reads */
+static ULONG FeedLines(const char *input, ULONG length, ULONG chunk,
+                       PacketHandler handler, ULONG *bytes)
+{
+    ULONG before = LinesHandled;
+    ULONG i;
+    ULONG n;
+
+    for (i = 0; i < length; i += n) {
+        n = (length - i < chunk) ? length - i : chunk;
+        ProcessLineInput(handler, input + i, n, 0);
+    }
+
+    *bytes += length;
+    return LinesHandled - before;
+}
+
+/* ------------------------------------------------------------------ */
+/* Benchmarks                                                          */
+/* ------------------------------------------------------------------ */
+
+static ULONG RunDispatchSynthetic(ULONG *bytes)
+{
+    return FeedLines(SyntheticInput, SyntheticLength, BENCH_CHUNK, BenchHandler, bytes);
+}
+
+static ULONG RunDispatchRecorded(ULONG *bytes)
+{
+    return FeedLines(RecordedInput, RecordedLength, BENCH_CHUNK, BenchHandler, bytes);
+}
+
+static ULONG RunRxChunk64(ULONG *bytes)
+{
+    return FeedLines(SyntheticInput, SyntheticLength, BENCH_CHUNK, NullHandler, bytes);
+}
+
+static ULONG RunRxChunk1(ULONG *bytes)
+{
+    return FeedLines(SyntheticInput, SyntheticLength, 1, NullHandler, bytes);
+}
+
+static ULONG RunRxTriggers(ULONG *bytes)
+{
+    ScanTriggers(SyntheticInput, SyntheticLength);
+    *bytes += SyntheticLength;
+    return 1;
+}
+
+static ULONG RunCommandDispatch(ULONG *bytes)
+{
+    ULONG i;
+
+    for (i = 0; i < SyntheticCount; i++) {
+        CustomPacketHandler(SplitLines[i], strlen(SplitLines[i]));
+        *bytes += strlen(SplitLines[i]);
+    }
+    return SyntheticCount;
+}
+
+static ULONG RunFormatBuilder(ULONG *bytes)
+{
+    ResponseBuilder *rb;
+    ULONG before = SinkBytes;
+
+    rb = BeginResponse();
+    AppendString(rb, "IOSTATS: reads=");
+    AppendULong(rb, LinesHandled);
+    AppendString(rb, " bytes=");
+    AppendULong(rb, SinkBytes);
+    AppendString(rb, " crc=");
+    AppendHex(rb, SinkWrites, 4);
+    AppendData(rb, "\r\n", 2);
+    SendResponse(rb);
+
+    *bytes += SinkBytes - before;
+    return 1;
+}
+
+static ULONG RunFormatTemplate(ULONG *bytes)
+{
+    ULONG before = SinkBytes;
+
+    SetTemplateULong(&CounterTemplate, 0, LinesHandled);
+    SetTemplateULong(&CounterTemplate, 1, SinkWrites);
+    SetTemplateULong(&CounterTemplate, 2, SinkBytes);
+    SendTemplate(&CounterTemplate);
+
+    *bytes += SinkBytes - before;
+    return 1;
+}
+
+static ULONG RunFormatCached(ULONG *bytes)
+{
+    ULONG before = SinkBytes;
+
+    SendCachedResponse(&BenchReply);
+
+    *bytes += SinkBytes - before;
+    return 1;
+}
+
+static ULONG RunFrameEncode(ULONG *bytes)
+{
+    EncodeFrame(FRAME_DATA, 0, Payload, sizeof(Payload), Encoded, sizeof(Encoded));
+    *bytes += sizeof(Payload);
+    return 1;
+}
+
+static ULONG RunFrameDecode(ULONG *bytes)
+{
+    FrameDecoder fd;
+
+    InitFrameDecoder(&fd, CountFrame, NULL);
+    DecodeFrameBytes(&fd, Encoded, EncodedLength);
+    *bytes += sizeof(Payload);
+    return 1;
+}
+
+/* One block through send, frame, decode, ring and read, credit returning */
+static ULONG RunFlowTransfer(ULONG *bytes)
+{
+    UBYTE buffer[512];
+    ULONG sent = 0;
+
+    while (sent < sizeof(FlowData)) {
+        sent += FlowSend(&FlowA, FlowData + sent, sizeof(FlowData) - sent);
+        while (FlowRead(&FlowB, buffer, sizeof(buffer)) > 0)
+            ;
+    }
+
+    *bytes += sizeof(FlowData);
+    return 1;
+}
+
+static const Benchmark Benchmarks[] = {
+    { "dispatch.synthetic", RunDispatchSynthetic },
+    { "dispatch.recorded",  RunDispatchRecorded },
+    { "command.dispatch",   RunCommandDispatch },
+    { "rx.chunk64",         RunRxChunk64 },
+    { "rx.chunk1",          RunRxChunk1 },
+    { "rx.triggers",        RunRxTriggers },
+    { "format.builder",     RunFormatBuilder },
+    { "format.template",    RunFormatTemplate },
+    { "format.cached",      RunFormatCached },
+    { "frame.encode",       RunFrameEncode },
+    { "frame.decode",       RunFrameDecode },
+    { "flow.transfer",      RunFlowTransfer },
+    { NULL, NULL }
+};
+
+/* Repeat one benchmark for the given time and print its line */
+static void Measure(const Benchmark *b, ULONG micros)
+{
+    ULONG ops = 0;
+    ULONG bytes = 0;
+    ULONG warm = 0;
+    ULONG elapsed;
+    LONG heap;
+
+    b->run(&warm);
+
+    heap = HeapInUse();
+    StartClock();
+    do {
+        ops += b->run(&bytes);
+        elapsed = ElapsedMicros();
+    } while (elapsed < micros && bytes < BENCH_BYTE_LIMIT);
+    heap = HeapInUse() - heap;
+
+    if (elapsed == 0)
+        elapsed = 1;
+
+    fprintf(Results, "BENCH %s ops=%lu ns/op=%lu bytes/s=%lu alloc=%ld\n", b->name, (unsigned long)ops,
+           (unsigned long)(ops ? MulDiv(elapsed, 1000, ops) : 0),
+           (unsigned long)MulDiv(bytes, 1000000, elapsed), (long)heap);
+}
+
+int main(int argc, char **argv)
+{
+    const char *recording = NULL;
+    const char *filter = NULL;
+    const char *output = NULL;
+    ULONG milliseconds = BENCH_DEFAULT_MS;
+    const Benchmark *b;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            recording = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            milliseconds = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    if (!OpenBenchClock()) {
+        printf("Cannot open timer.device\n");
+        CloseBenchClock();
+        return 20;
+    }
+
+    Results = output ? fopen(output, "w") : stderr;
+    if (!Results) {
+        printf("Cannot write %s\n", output);
+        CloseBenchClock();
+        return 20;
+    }
+
+    SetPacketSink(CountingSink, NULL);
+    PrepareWorkloads();
+    if (recording && !LoadRecording(recording)) {
+        fprintf(Results, "Cannot read %s\n", recording);
+        recording = NULL;
+    }
+
+    /* The app logs to the console as it handles commands */
+    fflush(stdout);
+    freopen(NULL_OUTPUT, "w", stdout);
+
+    fprintf(Results, "BENCHINFO platform=%s kernels=%s ms=%lu recorded=%s\n", PLATFORM_NAME,
+           KernelVariant(), (unsigned long)milliseconds, recording ? recording : "-");
+
+    for (b = Benchmarks; b->name != NULL; b++) {
+        if (filter && !strstr(b->name, filter))
+            continue;
+        if (b->run == RunDispatchRecorded && RecordedLength == 0)
+            continue;
+        Measure(b, milliseconds * 1000);
+    }
+
+    SetPacketSink(NULL, NULL);
+    if (Results != stderr)
+        fclose(Results);
+    CloseBenchClock();
+    return 0;
+}
@@ -0,0 +1,362 @@
+/*
+ * Amiga Packet Communication Framework - Link-Rate Calibration
+ * Finds the fastest baud rate a particular cable, level shifter and
+ * Amiga can sustain. The rates are tried from slowest to fastest: each
+ * step is negotiated at the current (home) rate, then a PRBS-7 burst is
+ * sent both ways at the trial rate, and both ends fall back home. The
+ * fastest rate that is clean both ways, and stays clean over a longer
+ * confirmation burst, is stored as the profile and loaded by later
+ * InitPacketFramework() calls.
+ *
+ * Exchange, host side in pc/link_calibrate.py:
+ *   home:  Amiga "CALRATE <baud> <length>"
+ *                                   host "CALRATE OK"     both switch
+ *   trial: Amiga <burst>            host "CALRESULT <received> <errors>"
+ *                                   host <burst>          both switch back
+ *   home:  Amiga "CALSET <baud>"    host "CALSET OK"      both switch
+ * When no rate is clean, CALSET names the home rate and nothing is stored.
+ */
+
+#include <exec/types.h>
+#include <devices/serial.h>
+#include <proto/exec.h>
+#include <proto/dos.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "amiga_packet_framework.h"
+
+/* Serial request opened by InitPacketFramework() */
+extern struct IOExtSer *SerialIO;
+extern BOOL SerialOpen;
+
+/* Rates tried, slowest first */
+static const ULONG CalRates[] = { 9600, 19200, 38400, 57600, 115200 };
+#define CAL_RATE_COUNT (sizeof(CalRates) / sizeof(CalRates[0]))
+
+static CalibrationStep Steps[CAL_RATE_COUNT + 1];
+static ULONG StepCount = 0;
+
+/* Error-rate monitor */
+static BOOL AutoCalibrate = FALSE;
+static BOOL CalibrationPending = FALSE;
+static ULONG WindowBytes = 0;
+static ULONG WindowErrors = 0;
+
+/* Next byte of the PRBS-7 (x^7 + x^6 + 1) sequence, MSB first */
+static UBYTE PrbsByte(UBYTE *state)
+{
+    UBYTE out = 0;
+    UBYTE bit;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        bit = (UBYTE)(((*state >> 6) ^ (*state >> 5)) & 1);
+        *state = (UBYTE)(((*state << 1) | bit) & 0x7F);
+        out = (UBYTE)((out << 1) | bit);
+    }
+
+    return out;
+}
+
+/* Raw write at the current rate */
+static BOOL CalWrite(const char *data, ULONG length)
+{
+    SerialIO->IOSer.io_Command = CMD_WRITE;
+    SerialIO->IOSer.io_Data = (APTR)data;
+    SerialIO->IOSer.io_Length = length;
+    return (BOOL)(DoIO((struct IORequest *)SerialIO) == 0);
+}
+
+/* Drop anything received so far, e.g. garbage from a rate switch */
+static void CalClear(void)
+{
+    SerialIO->IOSer.io_Command = CMD_CLEAR;
+    SerialIO->IOSer.io_Data = NULL;
+    SerialIO->IOSer.io_Length = 0;
+    DoIO((struct IORequest *)SerialIO);
+}
+
+/* Read up to length bytes, polling once per tick; stops at '\n' if line is set */
+static ULONG CalRead(char *buffer, ULONG length, ULONG ticks, BOOL line, ULONG *overruns)
+{
+    ULONG got = 0;
+    ULONG available;
+
+    while (got < length) {
+        SerialIO->IOSer.io_Command = SDCMD_QUERY;
+        DoIO((struct IORequest *)SerialIO);
+        available = SerialIO->IOSer.io_Actual;
+
+        if (available == 0) {
+            if (ticks-- == 0)
+                break;
+            Delay(1);
+            continue;
+        }
+
+        /* Lines are read a byte at a time so a following burst stays queued */
+        if (line)
+            available = 1;
+        if (available > length - got)
+            available = length - got;
+
+        SerialIO->IOSer.io_Command = CMD_READ;
+        SerialIO->IOSer.io_Data = buffer + got;
+        SerialIO->IOSer.io_Length = available;
+        DoIO((struct IORequest *)SerialIO);
+        if (SerialIO->IOSer.io_Error == SerErr_BufOverflow && overruns)
+            (*overruns)++;
+        got += SerialIO->IOSer.io_Actual;
+
+        if (line && got > 0 && buffer[got - 1] == '\n')
+            break;
+    }
+
+    return got;
+}
+
+/* Send "<keyword> <baud> [<length>]" at the current rate and wait for "<keyword> OK" */
+static BOOL CalCommand(const char *keyword, ULONG baud, ULONG burstLength)
+{
+    char line[40];
+    char reply[40];
+    ULONG length;
+    ULONG got;
+    int attempt;
+
+    if (burstLength)
+        length = sprintf(line, "%s %lu %lu\r\n", keyword, baud, burstLength);
+    else
+        length = sprintf(line, "%s %lu\r\n", keyword, baud);
+
+    /* A degraded home rate still passes a short line after a retry or two */
+    for (attempt = 0; attempt < CAL_RETRIES; attempt++) {
+        CalClear();
+        if (!CalWrite(line, length))
+            return FALSE;
+
+        got = CalRead(reply, sizeof(reply) - 1, CAL_REPLY_TICKS, TRUE, NULL);
+        reply[got] = '\0';
+        if (strncmp(reply, keyword, strlen(keyword)) == 0 && strstr(reply, " OK"))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Burst time in ticks at a rate, plus slack for the host's turnaround */
+static ULONG BurstTicks(ULONG baud, ULONG length)
+{
+    return (length * 10 * TICKS_PER_SECOND) / baud + TICKS_PER_SECOND;
+}
+
+/* One trial: negotiate, burst both ways, come back home */
+static BOOL CalibrateStep(ULONG home, ULONG baud, ULONG length, CalibrationStep *step)
+{
+    static char burst[CAL_BURST_LENGTH * CAL_CONFIRM_FACTOR];
+    char reply[40];
+    UBYTE state;
+    ULONG got;
+    ULONG i;
+    char *p;
+
+    if (length > sizeof(burst))
+        length = sizeof(burst);
+
+    step->baud = baud;
+    step->sent = length;
+    step->hostReceived = 0;
+    step->hostErrors = length;
+    step->received = 0;
+    step->errors = length;
+    step->overruns = 0;
+    step->clean = FALSE;
+
+    if (!CalCommand("CALRATE", baud, length))
+        return FALSE;
+
+    /* Give the host time to switch before the first byte */
+    SetSerialBaud(baud);
+    Delay(CAL_SETTLE_TICKS);
+    CalClear();
+
+    state = CAL_PRBS_SEED;
+    for (i = 0; i < length; i++) {
+        burst[i] = (char)PrbsByte(&state);
+    }
+    CalWrite(burst, length);
+
+    /* Host's verdict on our burst, then its burst */
+    got = CalRead(reply, sizeof(reply) - 1, BurstTicks(baud, length), TRUE, &step->overruns);
+    reply[got] = '\0';
+    p = strstr(reply, "CALRESULT ");
+    if (p) {
+        step->hostReceived = strtoul(p + 10, &p, 10);
+        step->hostErrors = strtoul(p, NULL, 10);
+    }
+
+    got = CalRead(burst, length, BurstTicks(baud, length), FALSE, &step->overruns);
+    step->received = got;
+    step->errors = length - got;
+    state = CAL_PRBS_SEED;
+    for (i = 0; i < got; i++) {
+        if ((UBYTE)burst[i] != PrbsByte(&state))
+            step->errors++;
+    }
+
+    SetSerialBaud(home);
+    Delay(CAL_SETTLE_TICKS);
+    CalClear();
+
+    step->clean = (BOOL)(step->hostReceived == length && step->hostErrors == 0 &&
+                         step->received == length && step->errors == 0 &&
+                         step->overruns == 0);
+    return TRUE;
+}
+
+/* The bursts need the device to ourselves, unframed */
+static BOOL CanCalibrate(void)
+{
+    return (BOOL)(SerialOpen && SerialIO && !SerialTaskRunning() && !GetFlowLink());
+}
+
+/* Step up through the rates; returns the chosen rate, 0 if the host did not answer */
+ULONG CalibrateLink(void)
+{
+    ULONG home;
+    ULONG best = 0;
+    ULONG previous = 0;
+    ULONG i;
+    CalibrationStep *step;
+
+    /* Whatever the outcome, start a fresh error window */
+    CalibrationPending = FALSE;
+    WindowBytes = 0;
+    WindowErrors = 0;
+
+    if (!CanCalibrate())
+        return 0;
+
+    home = SerialIO->io_Baud;
+    StepCount = 0;
+
+    for (i = 0; i < CAL_RATE_COUNT; i++) {
+        step = &Steps[StepCount];
+        if (!CalibrateStep(home, CalRates[i], CAL_BURST_LENGTH, step))
+            break;
+        StepCount++;
+
+        printf("Calibrate %6lu baud: out %lu/%lu errors %lu, in %lu/%lu errors %lu, overruns %lu\n",
+               step->baud, step->hostReceived, step->sent, step->hostErrors,
+               step->received, step->sent, step->errors, step->overruns);
+
+        if (!step->clean)
+            break;
+        previous = best;
+        best = CalRates[i];
+    }
+
+    if (StepCount == 0)
+        return 0;
+
+    /* Margin: the winner must also survive a longer burst, else drop a rate */
+    if (best > CalRates[0]) {
+        step = &Steps[StepCount];
+        if (CalibrateStep(home, best, CAL_BURST_LENGTH * CAL_CONFIRM_FACTOR, step)) {
+            StepCount++;
+            if (!step->clean)
+                best = previous;
+        } else {
+            best = previous;
+        }
+    }
+
+    /* Not even the slowest rate was clean: stay home, keep the old profile.
+       CALSET home still tells the host that calibration is over */
+    if (best == 0) {
+        CalCommand("CALSET", home, 0);
+        return 0;
+    }
+
+    if (CalCommand("CALSET", best, 0)) {
+        SetSerialBaud(best);
+        Delay(CAL_SETTLE_TICKS);
+        CalClear();
+        SaveLinkProfile(best);
+    } else {
+        best = home;
+    }
+
+    return best;
+}
+
+/* Results of the last CalibrateLink() */
+const CalibrationStep *GetCalibrationSteps(ULONG *count)
+{
+    *count = StepCount;
+    return Steps;
+}
+
+/* Stored rate, or CAL_BASE_BAUD when there is no valid profile */
+ULONG LoadLinkProfile(void)
+{
+    char value[16];
+    ULONG baud;
+    ULONG i;
+
+    if (GetVar(CAL_PROFILE_VAR, value, sizeof(value), GVF_GLOBAL_ONLY) <= 0)
+        return CAL_BASE_BAUD;
+
+    baud = strtoul(value, NULL, 10);
+    for (i = 0; i < CAL_RATE_COUNT; i++) {
+        if (CalRates[i] == baud)
+            return baud;
+    }
+
+    return CAL_BASE_BAUD;
+}
+
+/* Store the rate in ENV: and ENVARC: */
+BOOL SaveLinkProfile(ULONG baud)
+{
+    char value[16];
+
+    sprintf(value, "%lu", baud);
+    return (BOOL)SetVar(CAL_PROFILE_VAR, value, -1, GVF_GLOBAL_ONLY | GVF_SAVE_VAR);
+}
+
+/* Let ProcessLines() recalibrate when the error rate climbs */
+void EnableAutoCalibration(BOOL enable)
+{
+    AutoCalibrate = enable;
+    CalibrationPending = FALSE;
+    WindowBytes = 0;
+    WindowErrors = 0;
+}
+
+/* Account received bytes and errors; flags a recalibration when due */
+void NoteLinkTraffic(ULONG bytes, ULONG errors)
+{
+    if (!AutoCalibrate)
+        return;
+
+    WindowBytes += bytes;
+    WindowErrors += errors;
+
+    if (WindowErrors >= CAL_ERROR_LIMIT) {
+        CalibrationPending = TRUE;
+    }
+
+    if (WindowBytes >= CAL_HEALTH_WINDOW) {
+        WindowBytes = 0;
+        WindowErrors = 0;
+    }
+}
+
+/* Returns TRUE when the monitor wants CalibrateLink() run and it can */
+BOOL CalibrationDue(void)
+{
+    return (BOOL)(CalibrationPending && CanCalibrate());
+}
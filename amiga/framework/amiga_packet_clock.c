@@ -0,0 +1,117 @@
+/*
+ * Amiga Packet Communication Framework - Clock Synchronization
+ * Timestamps for NTP-style probes from the host. Each "TSYNC" request is
+ * answered with the EClock time its line was read and the time the reply
+ * was started; the host adds its own send and receive times and keeps
+ * the probes with the shortest round trip, which are the ones least
+ * disturbed by queueing and by the main loop's polling interval.
+ *
+ *   host  t1  "TSYNC <seq> <t1>"
+ *   Amiga t2  line read                 t3  reply started
+ *   host  t4  "TSYNC <seq> <t1> <t2> <t3> <frequency>" received
+ *
+ * t2 and t3 are 16 hex digits of EClock count; the host (pc/clock_sync.py)
+ * turns them into seconds with the frequency and fits offset and drift.
+ */
+
+#include <exec/types.h>
+#include <devices/timer.h>
+#include <proto/exec.h>
+#include <proto/timer.h>
+#include <string.h>
+
+#include "amiga_packet_framework.h"
+
+/* timer.device opened by InitPacketFramework() */
+extern struct timerequest *TimerIO;
+extern BOOL TimerOpen;
+
+/* Library base for ReadEClock(); timer.device is also a library */
+struct Device *TimerBase = NULL;
+
+/* EClock time of the last read that returned data */
+static LinkTime ReceiveTime = { 0, 0 };
+
+/* Read the EClock; returns its frequency, 0 without timer.device */
+ULONG ReadLinkClock(LinkTime *t)
+{
+    struct EClockVal ev;
+    ULONG frequency;
+
+    if (!TimerOpen || !TimerIO) {
+        t->hi = 0;
+        t->lo = 0;
+        return 0;
+    }
+
+    TimerBase = TimerIO->tr_node.io_Device;
+    frequency = ReadEClock(&ev);
+    t->hi = ev.ev_hi;
+    t->lo = ev.ev_lo;
+    return frequency;
+}
+
+/* Note when the data now being processed was read */
+void StampReceiveTime(void)
+{
+    ReadLinkClock(&ReceiveTime);
+}
+
+/* Read time of the line being processed */
+void GetReceiveTime(LinkTime *t)
+{
+    *t = ReceiveTime;
+}
+
+/* Append a time as 16 hex digits */
+BOOL AppendLinkTime(ResponseBuilder *rb, const LinkTime *t)
+{
+    AppendHex(rb, t->hi, 8);
+    return AppendHex(rb, t->lo, 8);
+}
+
+/* Answer one probe; t3 is read as late as the reply allows */
+BOOL AnswerTimeSync(const char *args)
+{
+    ResponseBuilder *rb;
+    LinkTime sent;
+    ULONG frequency;
+    ULONG length;
+
+    length = strlen(args);
+    if (length > CLOCK_SYNC_ARGS_MAX)
+        length = CLOCK_SYNC_ARGS_MAX;
+
+    rb = BeginResponse();
+    AppendData(rb, "TSYNC ", 6);
+    AppendData(rb, args, length);
+    AppendChar(rb, ' ');
+    AppendLinkTime(rb, &ReceiveTime);
+    AppendChar(rb, ' ');
+
+    frequency = ReadLinkClock(&sent);
+    AppendLinkTime(rb, &sent);
+    AppendChar(rb, ' ');
+    AppendULong(rb, frequency);
+    AppendData(rb, "\r\n", 2);
+
+    return SendResponse(rb);
+}
+
+/* Advance a time by ticks, carrying into the high word */
+void AddLinkTime(LinkTime *t, ULONG ticks)
+{
+    t->lo += ticks;
+    if (t->lo < ticks)
+        t->hi++;
+}
+
+/* Order two times */
+LONG CompareLinkTime(const LinkTime *a, const LinkTime *b)
+{
+    if (a->hi != b->hi)
+        return (a->hi < b->hi) ? -1 : 1;
+    if (a->lo != b->lo)
+        return (a->lo < b->lo) ? -1 : 1;
+    return 0;
+}
@@ -8,14 +8,493 @@
 
 #include <exec/types.h>
 
+/* Size of the shared transmit buffer used by BeginResponse() */
+#define PACKET_TX_BUFFER_SIZE 1024
+
+/* Storage for responses cached at startup and template buffers */
+#define PACKET_CACHE_POOL_SIZE 2048
+#define TEMPLATE_MAX_FIELDS 8
+#define TEMPLATE_ULONG_WIDTH 10
+
+/* Segments up to this size are copied into the coalescing buffer by SendPacketV() */
+#define PACKET_COALESCE_LIMIT 64
+#define PACKET_COALESCE_BUFFER_SIZE 256
+
+/* One (pointer, length) piece of a scatter-gather transmission */
+typedef struct {
+    const char *data;
+    ULONG length;
+} PacketSegment;
+
+/* Invariant reply, built at compile time or once at startup */
+typedef struct {
+    const char *data;
+    ULONG length;
+} CachedResponse;
+
+/* Initializer for compile-time cached responses from a string literal */
+#define CACHED_RESPONSE(text) { text, sizeof(text) - 1 }
+
+/* Patchable field inside a response template */
+typedef struct {
+    UWORD offset;       /* First byte reserved for the field */
+    UWORD width;        /* Bytes reserved for the field */
+    UWORD start;        /* First significant byte of the current value */
+    UWORD length;       /* Significant bytes of the current value */
+    ULONG value;        /* Last numeric value written (skips re-conversion) */
+    BOOL numeric;       /* TRUE for %u fields, FALSE for %<n>s */
+} TemplateField;
+
+/* Reply with fixed text and a few fields patched in place */
+typedef struct {
+    char *buffer;       /* Template text with field space reserved */
+    ULONG length;       /* Total template length */
+    UWORD fieldCount;
+    TemplateField fields[TEMPLATE_MAX_FIELDS];
+} ResponseTemplate;
+
+/* Line assembly buffer for ProcessLines() and maximum request tag length */
+#define PACKET_LINE_BUFFER_SIZE 256
+#define PACKET_TAG_MAX_LENGTH 8
+
+/* "STREAM <length> [args]" starts a streamed message in ProcessLines();
+   a stream with no data for PACKET_STREAM_TIMEOUT ticks is abandoned */
+#define PACKET_STREAM_KEYWORD "STREAM"
+#define PACKET_STREAM_TIMEOUT 250
+
+/* Maximum number of variables reported by the telemetry stream */
+#define TELEMETRY_MAX_CHANNELS 16
+
+/* Serial I/O task receive buffers */
+#define SERIAL_TASK_BUFFERS 8
+#define SERIAL_TASK_BUFFER_SIZE 512
+#define SERIAL_TASK_STACK_SIZE 4096
+#define SERIAL_TASK_PRIORITY 20
+
+/* Counters kept by the serial I/O task */
+typedef struct {
+    ULONG buffersDelivered;     /* Buffers passed to the application */
+    ULONG bytesDelivered;       /* Bytes passed to the application */
+    ULONG queueDepth;           /* Buffers waiting for the application now */
+    ULONG maxQueueDepth;        /* Highest queueDepth seen */
+    ULONG starvedReads;         /* Times no free buffer was left for a read */
+    ULONG readErrors;           /* Reads completed with an error */
+} SerialTaskStats;
+
+/* Binary framing (see amiga_packet_frame.c for the wire format) */
+#define FRAME_FEND  0xC0
+#define FRAME_FESC  0xDB
+#define FRAME_TFEND 0xDC
+#define FRAME_TFESC 0xDD
+#define FRAME_HEADER_SIZE 3
+#define FRAME_MAX_PAYLOAD 256
+#define FRAME_CRC_INIT 0xFFFF
+#define FRAME_ENCODED_SIZE(n) (2 * ((n) + FRAME_HEADER_SIZE + 2) + 2)
+
+/* Frame types */
+#define FRAME_DATA   0x01   /* offset(2) ack(2), then stream payload; consumes credit */
+#define FRAME_CREDIT 0x02   /* offset(2) ack(2) flags(1): credit and acknowledgement */
+
+/* Credit-based flow control */
+#define FLOW_RX_BUFFER_SIZE 2048
+#define FLOW_MAX_WINDOW 32767
+#define FLOW_REFRESH_TICKS 100      /* Re-advertise credit every 2 s */
+#define FLOW_SEND_TIMEOUT 500       /* Give up after 10 s without credit */
+#define FLOW_DATA_HEADER 4          /* Sender's offset and acknowledgement */
+#define FLOW_MAX_CHUNK (FRAME_MAX_PAYLOAD - FLOW_DATA_HEADER)
+#define FLOW_TX_BUFFER_SIZE 2048    /* Unacknowledged bytes kept; a power of two */
+#define FLOW_CREDIT_RESEND 0x01     /* CREDIT flag: data was lost, go back to ack */
+
+/* serial.device buffer in framed mode: a full window of stuffed
+   full-size frames must fit while the application is busy */
+#define FLOW_DEVICE_BUFFER_SIZE \
+    (((FLOW_RX_BUFFER_SIZE + FLOW_MAX_CHUNK - 1) / FLOW_MAX_CHUNK) * \
+     FRAME_ENCODED_SIZE(FRAME_MAX_PAYLOAD))
+
+/* Link-rate calibration */
+#define CAL_BASE_BAUD 9600              /* Rate used when there is no profile */
+#define CAL_PROFILE_VAR "KixGod/SerialBaud"
+#define CAL_BURST_LENGTH 512            /* PRBS-7 bytes each way per step */
+#define CAL_CONFIRM_FACTOR 4            /* Winner must pass a burst this much longer */
+#define CAL_PRBS_SEED 0x7F
+#define CAL_RETRIES 3
+#define CAL_REPLY_TICKS 50              /* Wait for a reply at the home rate */
+#define CAL_SETTLE_TICKS 5              /* Pause around each rate switch */
+#define CAL_HEALTH_WINDOW 4096          /* Error rate is judged per this many bytes */
+#define CAL_ERROR_LIMIT 4               /* Errors in one window that trigger recalibration */
+
+/* Outcome of one calibration step */
+typedef struct {
+    ULONG baud;
+    ULONG sent;             /* Burst length each way */
+    ULONG hostReceived;     /* Bytes of our burst the host got */
+    ULONG hostErrors;       /* Wrong or missing bytes in our burst */
+    ULONG received;         /* Bytes of the host's burst we got */
+    ULONG errors;           /* Wrong or missing bytes in the host's burst */
+    ULONG overruns;         /* Receive buffer overflows during the step */
+    BOOL clean;
+} CalibrationStep;
+
+/* Profiler stages (amiga_packet_profile.c); compiled in only with
+   DEFINE=PACKET_PROFILE, otherwise the brackets cost nothing */
+#define PROFILE_READ     0      /* DeviceRead(): query and read */
+#define PROFILE_DISPATCH 1      /* DispatchLine(): tag, stream check, handler */
+#define PROFILE_PARSE    2      /* Application command parsing */
+#define PROFILE_FORMAT   3      /* BeginResponse() to SendResponse() */
+#define PROFILE_SEND     4      /* SendPacket() */
+#define PROFILE_STAGES   5
+#define PROFILE_IDLE_PRIORITY -127      /* Idle counter task */
+#define PROFILE_IDLE_CALIBRATION 25     /* Ticks the idle counter is calibrated over */
+#define PROFILE_CPU_PER_ECLOCK 10       /* 68000 clock / EClock on stock machines */
+
+#ifdef PACKET_PROFILE
+#define PROFILE_BEGIN(stage) ProfileBegin(stage)
+#define PROFILE_END(stage, bytes) ProfileEnd(stage, bytes)
+#else
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage, bytes)
+#endif
+
+/* CPU kernels (amiga_packet_kernel.c): SAS/C CPU=68020 and up selects
+   the word-at-a-time variant; DEFINE=PACKET_CPU_020 forces it */
+#if defined(_M68020) || defined(_M68030) || defined(_M68040) || defined(_M68060)
+#ifndef PACKET_CPU_020
+#define PACKET_CPU_020
+#endif
+#endif
+
+/* Clock synchronization: "TSYNC <host args>" is answered with the EClock
+   times the request arrived and the reply left (amiga_packet_clock.c) */
+#define CLOCK_SYNC_ARGS_MAX 48          /* Longest host argument text echoed */
+
+/* 64-bit EClock count, same layout as struct EClockVal */
+typedef struct {
+    ULONG hi;
+    ULONG lo;
+} LinkTime;
+
+/* MIDI transport (amiga_packet_midi.c): 31250 baud, timestamped input,
+   output scheduled against the EClock through timer.device's
+   UNIT_WAITECLOCK rather than the main loop's ticks */
+#define MIDI_BAUD 31250
+#define MIDI_QUEUE_SIZE 64              /* Scheduled outgoing messages */
+#define MIDI_SYSEX_MAX 256              /* Longer SysEx messages are truncated */
+#define MIDI_POLL_MICROS 1000           /* Input poll interval in WaitMidi() */
+#define MIDI_PRIORITY 10                /* Task priority while in MIDI mode */
+
+/* One MIDI message; for SysEx, data[0] is 0xF0 and sysex holds the
+   whole message (F0 ... F7, valid only during the callback) */
+typedef struct {
+    LinkTime time;              /* EClock time read, or when due */
+    UBYTE data[3];              /* Status byte and up to two data bytes */
+    UBYTE length;               /* Bytes used in data */
+    const UBYTE *sysex;
+    UWORD sysexLength;
+} MidiEvent;
+
+/* Called for each complete message, real-time bytes included */
+typedef void (*MidiCallback)(const MidiEvent *ev, APTR userData);
+
+/* Incremental MIDI parser: running status, real-time bytes anywhere */
+typedef struct {
+    MidiCallback callback;
+    APTR userData;
+    UBYTE status;               /* Running status, 0 when there is none */
+    UBYTE needed;               /* Data bytes the status takes */
+    UBYTE count;                /* Data bytes collected */
+    UBYTE data[2];
+    BOOL inSysex;
+    BOOL sysexOverflow;
+    UWORD sysexLength;
+    UBYTE sysex[MIDI_SYSEX_MAX];
+
+    /* Statistics */
+    ULONG messages;             /* Channel and system common messages */
+    ULONG realtime;             /* Real-time bytes (clock, start, ...) */
+    ULONG sysexTruncated;
+    ULONG strayBytes;           /* Data bytes without a status */
+} MidiParser;
+
+/* Output counters */
+typedef struct {
+    ULONG sent;                 /* Messages written */
+    ULONG bytes;                /* Bytes written, after running status */
+    ULONG queueFull;            /* ScheduleMidi() calls refused */
+    ULONG maxLate;              /* Worst EClock ticks between due and written */
+} MidiStats;
+
+/* Called for each good frame: type, peer's credit limit and payload */
+typedef void (*FrameCallback)(UBYTE type, UWORD credit, const UBYTE *payload,
+                              ULONG length, APTR userData);
+
+/* Incremental frame decoder; survives any split of the byte stream */
+typedef struct {
+    FrameCallback callback;
+    APTR userData;
+    UBYTE buffer[FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD + 2];
+    ULONG length;
+    BOOL escaped;
+    BOOL discard;
+    ULONG framesReceived;       /* Frames with a good CRC */
+    ULONG crcErrors;            /* Frames with a bad CRC or too short */
+    ULONG dropped;              /* Frames too long or badly escaped */
+} FrameDecoder;
+
+/* Raw transport writer used by a flow link */
+typedef BOOL (*LinkWriteFunc)(const UBYTE *data, ULONG length, APTR userData);
+
+/* One end of a credit-controlled framed link */
+typedef struct {
+    LinkWriteFunc write;
+    APTR writeData;
+    FrameCallback frameHandler;     /* Receives frame types other than DATA/CREDIT */
+    APTR frameHandlerData;
+    FrameDecoder decoder;
+
+    /* Receive side */
+    UBYTE *rxRing;
+    ULONG rxSize;
+    ULONG rxHead;
+    ULONG rxTail;
+    ULONG rxCount;
+    UWORD rxConsumed;           /* Payload bytes delivered, mod 65536 */
+    UWORD advertisedLimit;      /* Limit carried by our last frame */
+    BOOL rxGap;                 /* Data went missing; a resend was asked for */
+    UWORD rxGapEnd;             /* DATA below this offset is a new resend */
+
+    /* Transmit side */
+    UWORD txSent;               /* Payload bytes sent, mod 65536 */
+    UWORD txAcked;              /* Payload bytes the peer has received */
+    UWORD txLimit;              /* Peer's most recent limit */
+    UBYTE txRing[FLOW_TX_BUFFER_SIZE];  /* Bytes from txAcked on, by offset */
+
+    /* Statistics */
+    ULONG creditStalls;         /* FlowSend() calls cut short by credit */
+    ULONG creditFrames;         /* Standalone CREDIT frames sent */
+    ULONG framesSent;
+    ULONG rxOverruns;           /* Payload bytes dropped because the peer overran */
+    ULONG rxGaps;               /* DATA frames dropped after a lost one */
+    ULONG txResent;             /* Payload bytes sent again */
+
+    UBYTE payload[FRAME_MAX_PAYLOAD];   /* DATA payload behind its header */
+    UBYTE frame[FRAME_ENCODED_SIZE(FRAME_MAX_PAYLOAD)];
+} FlowLink;
+
+/* Remote file access (amiga_packet_file.c): requests and replies travel
+   as FRAME_FILE frames on the flow link, served by pc/file_server.py */
+#define FRAME_FILE 0x03
+#define FILE_HEADER_SIZE 10         /* op, seq, handle, status, offset(4), length(2) */
+#define FILE_BLOCK_SIZE 240         /* Cache block; one block per reply frame */
+#define FILE_WRITE_MAX (FRAME_MAX_PAYLOAD - FILE_HEADER_SIZE)
+#define FILE_CACHE_BLOCKS 16        /* LRU block cache, 3840 bytes */
+#define FILE_MAX_PENDING 6          /* Requests in flight; their replies must
+                                       fit serial.device's buffer */
+#define FILE_READAHEAD 4            /* Blocks fetched ahead of a sequential reader */
+#define FILE_SEQUENTIAL_RUN 2       /* Next-block moves before read-ahead starts */
+#define FILE_SCATTER_MIN 16         /* Scattered accesses seen before the cache is bypassed */
+#define FILE_SCATTER_WINDOW 32      /* Scatter counts are halved at this many */
+#define FILE_SCATTER_SAMPLE 8       /* Every n-th bypassable miss still fills the cache */
+#define FILE_MAX_OPEN 4
+#define FILE_PATH_MAX 200
+#define FILE_REPLY_TICKS 150        /* Resend a request unanswered this long */
+#define FILE_RETRIES 3
+
+/* Request codes */
+#define FILE_OP_OPEN  1             /* handle = mode, data = path; reply offset = size */
+#define FILE_OP_CLOSE 2
+#define FILE_OP_READ  3             /* offset, length; reply carries the data */
+#define FILE_OP_WRITE 4             /* offset, data; reply offset = new size */
+#define FILE_OP_STAT  5             /* data = path; reply offset = size, length = flags */
+#define FILE_OP_LIST  6             /* data = path, offset = first entry; reply
+                                       length = entries, offset = next entry */
+#define FILE_OP_DELTA 7             /* offset = old length, length = block size;
+                                       reply offset = delta length */
+#define FILE_OP_RESEND 0x80         /* Set on a repeated request */
+
+/* Open modes */
+#define FILE_MODE_READ   'r'
+#define FILE_MODE_WRITE  'w'        /* Create or truncate */
+#define FILE_MODE_UPDATE 'u'        /* Read and write an existing file */
+#define FILE_MODE_DELTA  'd'        /* Write signatures, then read the delta */
+
+/* Status codes; the last two are raised locally */
+#define FILE_OK           0
+#define FILE_ERR_NOTFOUND 1
+#define FILE_ERR_IO       2
+#define FILE_ERR_HANDLE   3
+#define FILE_ERR_DENIED   4
+#define FILE_ERR_TIMEOUT  5
+#define FILE_ERR_LINK     6
+
+#define FILE_FLAG_DIRECTORY 0x01
+#define FILE_LIST_END 0xFFFFFFFFUL
+
+/* Result of RemoteStat() and each RemoteList() entry */
+typedef struct {
+    ULONG size;
+    ULONG modified;             /* Seconds since 1970, host time */
+    UBYTE flags;                /* FILE_FLAG_... */
+} RemoteStatInfo;
+
+/* Called for each directory entry; name is valid during the call only */
+typedef void (*RemoteListCallback)(const char *name, const RemoteStatInfo *info,
+                                   APTR userData);
+
+/* Take in link input: returns bytes taken in, -1 to give up (Ctrl+C).
+   With wait set, sleeps up to one tick first when nothing is there. */
+typedef LONG (*LinkPollFunc)(BOOL wait, APTR userData);
+
+/* Counters kept by the remote file client */
+typedef struct {
+    ULONG requests;             /* Requests sent, resends included */
+    ULONG resends;
+    ULONG cacheHits;            /* Blocks found in the cache */
+    ULONG cacheMisses;          /* Blocks a reader had to wait for */
+    ULONG bypassed;             /* Scattered reads sent around the cache */
+    ULONG readAhead;            /* Blocks requested ahead of the reader */
+    ULONG readAheadUsed;        /* Of those, blocks later read */
+    ULONG writeCalls;           /* RemoteWrite() calls */
+    ULONG writeRequests;        /* WRITE requests they were coalesced into */
+    ULONG bytesRead;
+    ULONG bytesWritten;
+} RemoteFileStats;
+
+/* Delta synchronization (amiga_packet_sync.c). The receiver's copy is
+   cut into blocks, each described by a weak rolling sum and a CRC-32;
+   the host answers with copies of matching blocks and literal data. */
+#define SYNC_MIN_BLOCK 64
+#define SYNC_MAX_BLOCK 2048
+#define SYNC_SIGNATURE_SIZE 8       /* weak(4) crc(4) per block */
+#define SYNC_OP_COPY    1           /* block(4) count(2): old blocks */
+#define SYNC_OP_LITERAL 2           /* length(2) data */
+#define SYNC_OP_END     3           /* length(4) crc(4) of the new file */
+
+/* SyncFile() status codes, following the FILE_ ones */
+#define SYNC_ERR_FORMAT 16          /* Delta stream did not parse */
+#define SYNC_ERR_VERIFY 17          /* Result failed its length or CRC check */
+#define SYNC_ERR_LOCAL  18          /* A SyncTarget call failed */
+
+/* Where SyncFile() reads the old copy and writes the new one */
+typedef struct {
+    ULONG oldLength;                /* 0 when there is no old copy */
+    LONG (*readOld)(ULONG offset, APTR buffer, ULONG length, APTR userData);
+    BOOL (*write)(const APTR data, ULONG length, APTR userData);
+    BOOL (*restart)(APTR userData); /* Discard what was written so far */
+    APTR userData;
+} SyncTarget;
+
+/* What a SyncFile() call moved */
+typedef struct {
+    ULONG fileLength;           /* New file */
+    ULONG blockSize;
+    ULONG signatureBytes;       /* Sent to the host */
+    ULONG deltaBytes;           /* Received from the host */
+    ULONG copiedBytes;          /* Taken from the old copy */
+    ULONG literalBytes;
+    BOOL fullCopy;              /* Verification failed and the file was resent */
+    UWORD error;                /* FILE_OK, FILE_ERR_... or SYNC_ERR_... */
+} SyncStats;
+
+/* Screen streaming (amiga_packet_screen.c): changed tiles of a planar
+   screen travel as FRAME_SCREEN frames to pc/screen_viewer.py */
+#define FRAME_SCREEN 0x04
+#define SCREEN_TILE_BYTES 4         /* Tile width: 32 pixels, a longword per plane row */
+#define SCREEN_TILE_ROWS 8
+#define SCREEN_PLANE_TILE (SCREEN_TILE_BYTES * SCREEN_TILE_ROWS)
+#define SCREEN_MAX_DEPTH 6          /* OCS/ECS, EHB and HAM6 included */
+#define SCREEN_MAX_COLORS 32
+#define SCREEN_HISTORY 32           /* Messages remembered for RESEND; divides 256 */
+#define SCREEN_UPDATE_BUDGET 2048   /* Bytes per SendScreenUpdate() in the example app */
+
+/* Messages, each starting op | seq; seq counts every message sent so
+   the host can tell when one was lost and have its tiles sent again */
+#define SCREEN_OP_FORMAT  1         /* width(2) height(2) depth(1) flags(1);
+                                       the host clears its image */
+#define SCREEN_OP_PALETTE 2         /* count(1), then count 0x0RGB words */
+#define SCREEN_OP_TILES   3         /* Records: tile(2) planes(1), then for each
+                                       plane bit set, encoding(1) data */
+#define SCREEN_OP_END     4         /* frame(2) tiles(2) bytes(4): a pass is complete */
+#define SCREEN_OP_REFRESH 5         /* Host to Amiga: send the whole screen again */
+#define SCREEN_OP_RESEND  6         /* Host to Amiga: seq... of lost messages */
+
+/* Plane encodings within a tile record */
+#define SCREEN_ENC_RAW 0            /* The bytes as they are */
+#define SCREEN_ENC_RLE 1            /* ByteRun1 of the bytes */
+#define SCREEN_ENC_XOR 2            /* ByteRun1 of the bytes XOR the previous ones */
+
+#define SCREEN_FLAG_HAM 0x01
+#define SCREEN_FLAG_EHB 0x02
+
+/* The screen being streamed; planes must be word aligned */
+typedef struct {
+    UBYTE *planes[SCREEN_MAX_DEPTH];
+    UWORD bytesPerRow;          /* Distance between rows, more than the
+                                   width for interleaved bitmaps */
+    UWORD width;                /* Pixels */
+    UWORD height;
+    UBYTE depth;
+    UBYTE flags;                /* SCREEN_FLAG_... */
+    UWORD colors;               /* Entries used in palette */
+    UWORD palette[SCREEN_MAX_COLORS];   /* 0x0RGB, kept current by the caller */
+} ScreenSource;
+
+/* Counters kept by the screen streamer */
+typedef struct {
+    ULONG frames;               /* Complete passes over the screen */
+    ULONG tilesScanned;
+    ULONG tilesSent;            /* Tiles with at least one changed plane */
+    ULONG planesSent;
+    ULONG rawPlanes;            /* Planes sent by each encoding */
+    ULONG rlePlanes;
+    ULONG xorPlanes;
+    ULONG bytesSent;            /* Message payload, headers included */
+    ULONG rawBytes;             /* What the changed planes hold uncompressed */
+    ULONG messages;
+    ULONG refreshes;            /* Whole screen resends, the first included */
+    ULONG tilesResent;          /* Tiles sent again after a RESEND */
+    ULONG lastFrameBytes;       /* Bytes sent for the last complete pass */
+    ULONG maxFrameBytes;
+} ScreenStreamStats;
+
+/* Stream trigger automaton limits */
+#define TRIGGER_MAX_PATTERNS 16
+#define TRIGGER_MAX_STATES 128
+#define TRIGGER_MAX_CLASSES 48
+
+/* Called when a registered pattern is seen; offset is the index of its
+   last byte within the chunk passed to ScanTriggers() */
+typedef void (*TriggerCallback)(LONG id, ULONG offset, APTR userData);
+
 /* Packet processing callback type */
 typedef void (*PacketHandler)(const char *packet, ULONG length);
 
+/* Streaming handler for messages of any size, delivered in pieces.
+   begin() gets the declared total and the header's arguments (valid only
+   during the call) and returns FALSE to refuse the stream; its bytes are
+   then skipped. data() is
+   called with each piece straight from the receive buffer. end() is
+   called once with complete = FALSE if the stream was cut short. */
+typedef struct {
+    BOOL (*begin)(ULONG total, const char *args, ULONG argsLength, APTR userData);
+    void (*data)(const char *data, ULONG length, APTR userData);
+    void (*end)(BOOL complete, APTR userData);
+    APTR userData;
+} StreamHandler;
+
+/* Response builder - appends into a preallocated buffer without sprintf/strlen */
+typedef struct {
+    char *buffer;       /* Destination buffer */
+    ULONG size;         /* Capacity of buffer in bytes */
+    ULONG length;       /* Bytes used so far */
+    BOOL overflow;      /* Set when an append did not fit */
+} ResponseBuilder;
+
 /* Function prototypes */
 
 /**
  * Initialize the packet communication framework
- * Sets up serial communication at 9600 baud, 8N1, no flow control
+ * Sets up serial communication at the calibrated rate from the stored
+ * profile (9600 baud without one), 8N1, no flow control
  * Returns TRUE on success, FALSE on failure
  */
 BOOL InitPacketFramework(void);
@@ -34,6 +513,13 @@ void CleanupPacketFramework(void);
  */
 BOOL SendPacket(const char *data, ULONG length);
 
+/**
+ * Divert everything SendPacket() sends to a function instead of the
+ * serial device, e.g. to measure the reply path without the line
+ * @param write - receives each write, NULL to use the device again
+ */
+void SetPacketSink(LinkWriteFunc write, APTR userData);
+
 /**
  * Receive a packet from the serial port (non-blocking)
  * @param buffer - buffer to store received data
@@ -49,12 +535,875 @@ ULONG ReceivePacket(char *buffer, ULONG maxLength);
  */
 void ProcessPackets(PacketHandler handler);
 
+/**
+ * Line-oriented processing loop for command protocols
+ * Assembles complete lines across reads, so commands split over several
+ * reads or queued several per read are each delivered once. A line may
+ * start with a "#<id> " tag; the tag is stripped before the handler is
+ * called and echoed at the start of every SendReply() made for it, so a
+ * host can pipeline commands and match replies. All queued input is
+ * drained before the loop sleeps.
+ * @param handler - called once per line, without CR/LF, NUL-terminated
+ */
+void ProcessLines(PacketHandler handler);
+
 /**
  * Default packet handler implementation
- * Prints received packets and auto-responds to "Hello Amiga" messages
+ * Prints received packets. Whenever it is the handler (or NULL is passed),
+ * ProcessPackets() and ProcessLines() register a "Hello Amiga" trigger
+ * alongside it, once, that sends the auto-response
  * @param packet - received packet data
  * @param length - length of packet
  */
 void DefaultPacketHandler(const char *packet, ULONG length);
 
+/* Line protocol (amiga_packet_lines.c) */
+
+/**
+ * Send several buffers as one logical transmission (scatter-gather)
+ * Small segments are coalesced into a single device write, large ones
+ * are written directly from the caller's memory. There is no length cap.
+ * @param segments - array of (pointer, length) pairs, sent in order
+ * @param count - number of entries in segments
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL SendPacketV(const PacketSegment *segments, ULONG count);
+
+/**
+ * Send a reply to the request currently being processed
+ * If the request carried a "#<id> " tag, the same tag is sent first,
+ * in the same device write. Otherwise identical to SendPacket().
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL SendReply(const char *data, ULONG length);
+
+/**
+ * Scatter-gather variant of SendReply()
+ */
+BOOL SendReplyV(const PacketSegment *segments, ULONG count);
+
+/**
+ * Set the tag prefixed to replies (normally done by ProcessLines(), which
+ * answers a request with a longer tag "#<tag> ERROR: Tag too long" itself)
+ * @param tag - tag characters without '#', NULL to clear
+ * @param length - tag length; only the first PACKET_TAG_MAX_LENGTH are kept
+ */
+void SetReplyTag(const char *tag, ULONG length);
+
+/**
+ * Feed received bytes to the line protocol (ProcessLines() does this
+ * for every read). Complete lines go to handler, tags are stripped and
+ * streams are passed through; partial lines are kept for the next call.
+ * @param now - current tick count, for the stream timeout
+ */
+void ProcessLineInput(PacketHandler handler, const char *data, ULONG length, ULONG now);
+
+/**
+ * Returns TRUE when no partial line is held and no stream is open
+ */
+BOOL LineInputIdle(void);
+
+/**
+ * Close a stream that has had no data for PACKET_STREAM_TIMEOUT ticks
+ */
+void ExpireStream(ULONG now);
+
+/**
+ * Close any open stream as incomplete
+ */
+void AbortStream(void);
+
+/**
+ * Register the handler for streamed messages in the line protocol
+ * A line "STREAM <length> [args]" (optionally tagged) switches the input
+ * to binary mode: the next <length> bytes after the line's CR/LF go to
+ * the handler's data() callback in pieces, without being buffered or
+ * split into lines, and line mode resumes afterwards. The request tag
+ * stays set until end() returns, so replies made there are tagged.
+ * @param handler - callbacks, or NULL to treat STREAM as a normal line
+ */
+void SetStreamHandler(const StreamHandler *handler);
+
+/**
+ * Returns TRUE while the line protocol is inside a streamed message
+ */
+BOOL StreamActive(void);
+
+/* Response builder (amiga_packet_response.c) */
+
+/**
+ * Start a new response in the framework's shared transmit buffer
+ * The returned builder is valid until the next BeginResponse() call
+ */
+ResponseBuilder *BeginResponse(void);
+
+/**
+ * Initialize a builder over a caller-supplied buffer
+ * @param rb - builder to initialize
+ * @param buffer - destination buffer
+ * @param size - capacity of buffer in bytes
+ */
+void InitResponse(ResponseBuilder *rb, char *buffer, ULONG size);
+
+/**
+ * Discard the builder contents and clear the overflow flag
+ */
+void ResetResponse(ResponseBuilder *rb);
+
+/**
+ * Returns the number of bytes that can still be appended
+ */
+ULONG ResponseSpace(const ResponseBuilder *rb);
+
+/**
+ * Append helpers - each returns FALSE and sets rb->overflow if the
+ * data does not fit; nothing partial is written except by AppendString
+ */
+BOOL AppendChar(ResponseBuilder *rb, char c);
+BOOL AppendData(ResponseBuilder *rb, const char *data, ULONG length);
+BOOL AppendString(ResponseBuilder *rb, const char *str);
+BOOL AppendULong(ResponseBuilder *rb, ULONG value);
+BOOL AppendLong(ResponseBuilder *rb, LONG value);
+BOOL AppendHex(ResponseBuilder *rb, ULONG value, UWORD digits);
+
+/**
+ * Append a string as a fixed-width field, truncated or padded with spaces
+ * @param width - exact number of bytes the field occupies
+ */
+BOOL AppendField(ResponseBuilder *rb, const char *str, UWORD width);
+
+/**
+ * Send the built response through SendPacket() and reset the builder
+ * Overflowed responses are discarded rather than sent truncated
+ * Returns TRUE on success, FALSE on overflow or send failure
+ */
+BOOL SendResponse(ResponseBuilder *rb);
+
+/* Serial I/O task (amiga_packet_task.c) */
+
+/**
+ * Spawn a high-priority task that owns the receive side of serial.device
+ * It keeps a read queued at all times and passes filled buffers to the
+ * calling task; ReceivePacket() and the processing loops then read from
+ * those buffers and wake on arrival instead of polling.
+ * Call after InitPacketFramework(); CleanupPacketFramework() stops it.
+ * @param priority - exec priority of the I/O task (SERIAL_TASK_PRIORITY)
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL StartSerialTask(LONG priority);
+
+/**
+ * Stop the serial I/O task and free its buffers
+ */
+void StopSerialTask(void);
+
+/**
+ * Returns TRUE while the serial I/O task is running
+ */
+BOOL SerialTaskRunning(void);
+
+/**
+ * Signal mask raised when the I/O task delivers a buffer
+ */
+ULONG SerialTaskSignal(void);
+
+/**
+ * Copy the I/O task counters
+ */
+void GetSerialTaskStats(SerialTaskStats *stats);
+
+/**
+ * Read data delivered by the I/O task (used by ReceivePacket())
+ * Returns number of bytes copied, 0 if nothing is queued
+ */
+ULONG ReceiveFromSerialTask(char *buffer, ULONG maxLength);
+
+/* Framed mode with flow control (amiga_packet_framework.c) */
+
+/**
+ * Switch the serial link to framed mode with credit-based flow control
+ * From then on SendPacket() waits for credit instead of overrunning the
+ * peer, and ReceivePacket() returns deframed payload. Both ends must use
+ * framed mode (see pc/packet_link.py for the host side). Unless the
+ * serial I/O task is draining the device, serial.device's buffer is
+ * enlarged to FLOW_DEVICE_BUFFER_SIZE so a full window always fits.
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL EnableFlowControl(void);
+
+/**
+ * Return to the raw byte stream, giving serial.device back the
+ * buffer size it had before EnableFlowControl()
+ */
+void DisableFlowControl(void);
+
+/**
+ * The framework's flow link (for statistics and extra frame types),
+ * or NULL when framed mode is off
+ */
+FlowLink *GetFlowLink(void);
+
+/**
+ * Change the serial rate; fails while the serial I/O task is running
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL SetSerialBaud(ULONG baud);
+
+/**
+ * Current serial rate
+ */
+ULONG GetSerialBaud(void);
+
+/**
+ * Take in framed input without reading payload (a LinkPollFunc)
+ * Used by clients that wait for their own frame types, such as the
+ * remote file client; DATA payload stays queued for ReceivePacket().
+ * @param wait - sleep up to one tick, or until input, if nothing came in
+ * Returns bytes taken in, -1 on Ctrl+C or when framed mode is off
+ */
+LONG PollFlowInput(BOOL wait, APTR userData);
+
+/* Remote file access (amiga_packet_file.c) */
+
+/**
+ * Start the remote file client on a flow link
+ * Installs the link's frame handler for FRAME_FILE replies. Block
+ * caching, read-ahead and write-behind start enabled.
+ * @param fl - framed link, normally GetFlowLink()
+ * @param poll - takes in link input while waiting, normally PollFlowInput
+ * Returns FALSE if fl is NULL
+ */
+BOOL InitRemoteFiles(FlowLink *fl, LinkPollFunc poll, APTR pollData);
+
+/**
+ * Flush and close every open file and detach from the link
+ */
+void CleanupRemoteFiles(void);
+
+/**
+ * Turn the block cache, read-ahead and write-behind on or off
+ * With caching off every read and write is one request and one reply,
+ * exactly as asked for; used to measure what the cache gains.
+ * Affects files opened afterwards.
+ */
+void SetRemoteCaching(BOOL enable);
+
+/**
+ * Open a file on the host
+ * @param path - path below the server's root, '/' separated
+ * @param mode - FILE_MODE_READ, FILE_MODE_WRITE or FILE_MODE_UPDATE
+ * Returns a handle, or -1 (see RemoteFileError())
+ */
+LONG RemoteOpen(const char *path, char mode);
+
+/**
+ * Flush pending writes and close
+ * Returns FALSE if a write or the close failed
+ */
+BOOL RemoteClose(LONG fh);
+
+/**
+ * Read from the current position
+ * Blocks come from the cache where possible. Once reads are found to
+ * be sequential, up to FILE_READAHEAD following blocks are requested
+ * before they are needed, so their transfer overlaps the caller's work.
+ * Scattered reads that seldom hit the cache fetch only what they need.
+ * Returns bytes read (0 at end of file), -1 on error
+ */
+LONG RemoteRead(LONG fh, APTR buffer, ULONG length);
+
+/**
+ * Write at the current position
+ * Consecutive small writes are gathered into one WRITE request of up
+ * to FILE_WRITE_MAX bytes, sent when it is full or the position moves
+ * elsewhere; replies are not waited for until RemoteFlush(). An error
+ * on a write-behind request is reported by a later call.
+ * Returns bytes accepted, -1 on error
+ */
+LONG RemoteWrite(LONG fh, const APTR data, ULONG length);
+
+/**
+ * Move the current position
+ */
+BOOL RemoteSeek(LONG fh, ULONG position);
+
+/**
+ * Current position
+ */
+ULONG RemoteTell(LONG fh);
+
+/**
+ * File size, including data still held for write-behind
+ */
+ULONG RemoteFileSize(LONG fh);
+
+/**
+ * Send gathered writes and wait until the host has stored them all
+ * Returns FALSE if any write failed
+ */
+BOOL RemoteFlush(LONG fh);
+
+/**
+ * Size, date and type of a file or directory
+ * Returns FALSE if it does not exist or the host did not answer
+ */
+BOOL RemoteStat(const char *path, RemoteStatInfo *info);
+
+/**
+ * Call callback for each entry of a directory
+ * Returns the number of entries, -1 on error
+ */
+LONG RemoteList(const char *path, RemoteListCallback callback, APTR userData);
+
+/**
+ * FILE_OK or the status of the last failed call
+ */
+UWORD RemoteFileError(void);
+
+/**
+ * Copy the client counters; reset clears them afterwards
+ */
+void GetRemoteFileStats(RemoteFileStats *stats, BOOL reset);
+
+/**
+ * Turn the signatures written to a FILE_MODE_DELTA handle into the
+ * host's delta stream; reads on the handle then return the delta
+ * @param oldLength - Length of the copy the signatures describe
+ * @param blockSize - Block size they were made with
+ * Returns the length of the delta stream, or -1
+ */
+LONG RemoteDelta(LONG fh, ULONG oldLength, UWORD blockSize);
+
+/* Delta synchronization (amiga_packet_sync.c) */
+
+/**
+ * Bring the local copy of a host file up to date, moving only the
+ * blocks that changed; needs InitRemoteFiles()
+ * Old blocks are read twice (signatures, then copies) and the result is
+ * checked against the host's CRC-32; on a mismatch it is sent whole.
+ * Returns TRUE if target holds the new file, else see stats->error
+ */
+BOOL SyncFile(const char *remotePath, const SyncTarget *target, SyncStats *stats);
+
+/**
+ * Block size for an old copy of the given length: about sqrt(8 * length),
+ * which balances signature bytes against literal bytes per change
+ */
+UWORD SyncBlockSize(ULONG length);
+
+/**
+ * Weak checksum of a block (rsync's a + b << 16), rollable by the host
+ */
+ULONG SyncWeakSum(const UBYTE *data, ULONG length);
+
+/**
+ * Continue a CRC-32 (as zlib's crc32(); start with 0)
+ */
+ULONG SyncCrc32(ULONG crc, const UBYTE *data, ULONG length);
+
+/* Screen streaming (amiga_packet_screen.c) */
+
+/**
+ * Bytes of shadow memory InitScreenStream() needs for a source:
+ * one copy of every plane, rows packed to the width, and a bit per tile
+ */
+ULONG ScreenShadowSize(const ScreenSource *source);
+
+/**
+ * Start streaming a screen over a flow link
+ * Chains the link's frame handler, so it may be called after
+ * InitRemoteFiles(); clean up in the opposite order. The first update
+ * sends the format, the palette and every non-blank tile.
+ * @param poll - takes in link input for refresh requests, normally PollFlowInput
+ * @param shadow - ScreenShadowSize(source) bytes, owned by the caller
+ * Returns FALSE if the source is deeper than SCREEN_MAX_DEPTH or not word aligned
+ */
+BOOL InitScreenStream(FlowLink *fl, LinkPollFunc poll, APTR pollData,
+                      const ScreenSource *source, UBYTE *shadow);
+
+/**
+ * Detach from the link, restoring its previous frame handler
+ */
+void CleanupScreenStream(void);
+
+/**
+ * Send changed tiles, continuing the scan where the last call stopped
+ * Each tile is compared plane by plane against the shadow copy; changed
+ * planes go out raw, run-length coded or as a run-length coded XOR
+ * against what the host has, whichever is shortest. Tiles the host
+ * reported lost are sent whole when the scan reaches them. Palette
+ * changes are sent first. When the scan reaches the end of the screen
+ * an END message completes the frame.
+ * @param maxBytes - stop once this much has been sent, 0 for a whole pass
+ * Returns bytes sent, -1 if the link failed or the poll function gave up
+ */
+LONG SendScreenUpdate(ULONG maxBytes);
+
+/**
+ * Send the whole screen again with the next update, as a host refresh does
+ */
+void RequestScreenRefresh(void);
+
+/**
+ * Copy the streamer's counters; reset clears them afterwards
+ */
+void GetScreenStreamStats(ScreenStreamStats *stats, BOOL reset);
+
+/* Screen access (amiga_packet_display.c) */
+
+/**
+ * Lock a public screen and describe its bitmap
+ * Only planar (chipset) screens of up to SCREEN_MAX_DEPTH planes can be
+ * described; one screen can be locked at a time.
+ * @param name - public screen name, NULL for the default (Workbench)
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL LockScreenSource(const char *name, ScreenSource *source);
+
+/**
+ * Read the locked screen's palette into source
+ */
+void RefreshScreenSource(ScreenSource *source);
+
+/**
+ * Release the screen locked by LockScreenSource()
+ */
+void UnlockScreenSource(void);
+
+/* Link-rate calibration (amiga_packet_calibrate.c) */
+
+/**
+ * Find the fastest clean rate with the host (pc/link_calibrate.py)
+ * Steps up from 9600 baud, bursting PRBS-7 both ways at each rate, and
+ * settles on the fastest rate that is clean both ways and also passes a
+ * longer confirmation burst. The rate is switched to and saved as the
+ * profile. Not available with the serial I/O task or framed mode.
+ * Returns the chosen rate, or 0 if the host did not take part or no
+ * rate was clean; the link then stays at its rate and profile
+ */
+ULONG CalibrateLink(void);
+
+/**
+ * Per-rate results of the last CalibrateLink()
+ * @param count - set to the number of steps
+ */
+const CalibrationStep *GetCalibrationSteps(ULONG *count);
+
+/**
+ * Rate stored in ENV:KixGod/SerialBaud, or CAL_BASE_BAUD
+ */
+ULONG LoadLinkProfile(void);
+
+/**
+ * Store the rate in ENV: and ENVARC: for later InitPacketFramework() calls
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL SaveLinkProfile(ULONG baud);
+
+/**
+ * Recalibrate from ProcessLines() when receive errors reach
+ * CAL_ERROR_LIMIT within CAL_HEALTH_WINDOW bytes (needs a host running
+ * pc/link_calibrate.py)
+ */
+void EnableAutoCalibration(BOOL enable);
+
+/**
+ * Account received bytes and receive errors (called by the framework)
+ */
+void NoteLinkTraffic(ULONG bytes, ULONG errors);
+
+/**
+ * Returns TRUE when the error monitor wants CalibrateLink() run; always
+ * FALSE while framed or while the I/O task runs, where it cannot
+ */
+BOOL CalibrationDue(void);
+
+/* Clock synchronization (amiga_packet_clock.c) */
+
+/**
+ * Read the EClock
+ * @param t - set to the current count, or zero without timer.device
+ * Returns the EClock frequency in Hz, or 0 without timer.device
+ */
+ULONG ReadLinkClock(LinkTime *t);
+
+/**
+ * Record the arrival time of the data just read (called by ProcessLines())
+ */
+void StampReceiveTime(void);
+
+/**
+ * EClock time at which the line being processed was read from the device
+ */
+void GetReceiveTime(LinkTime *t);
+
+/**
+ * Append a time as 16 hex digits
+ */
+BOOL AppendLinkTime(ResponseBuilder *rb, const LinkTime *t);
+
+/**
+ * Answer a "TSYNC <args>" probe from pc/clock_sync.py
+ * Replies "TSYNC <args> <received> <sent> <frequency>", with the EClock
+ * times the request was read and the reply was started. The host echoes
+ * its own send time in args and estimates offset and drift from many
+ * probes.
+ * @param args - the request's argument text
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL AnswerTimeSync(const char *args);
+
+/**
+ * Advance a time by a number of EClock ticks
+ */
+void AddLinkTime(LinkTime *t, ULONG ticks);
+
+/**
+ * Order two times
+ * Returns < 0 if a is before b, 0 if equal, > 0 if after
+ */
+LONG CompareLinkTime(const LinkTime *a, const LinkTime *b);
+
+/* MIDI transport (amiga_packet_midi.c) */
+
+/**
+ * Initialize a MIDI input parser
+ * @param callback - receives each message with the time its bytes were read
+ */
+void InitMidiParser(MidiParser *mp, MidiCallback callback, APTR userData);
+
+/**
+ * Feed received bytes to the parser, in chunks of any size
+ * @param time - EClock time the bytes were read
+ */
+void ParseMidiBytes(MidiParser *mp, const UBYTE *data, ULONG length, const LinkTime *time);
+
+/**
+ * Switch the serial port to MIDI_BAUD and open the scheduling timer
+ * Call before StartSerialTask() (the rate cannot change while it runs)
+ * and with framed mode off. Raises the task to MIDI_PRIORITY until
+ * DisableMidiMode().
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL EnableMidiMode(void);
+
+/**
+ * Drop unsent messages, restore the previous rate and task priority
+ * Stop the serial I/O task first, or the rate stays at MIDI_BAUD
+ */
+void DisableMidiMode(void);
+
+/**
+ * Returns TRUE while MIDI mode is on
+ */
+BOOL MidiModeActive(void);
+
+/**
+ * Queue a short message (1-3 bytes) for output at an EClock time
+ * Messages due at the same time keep their order. Channel messages are
+ * written with running status.
+ * @param when - EClock time to send at, NULL for now
+ * Returns FALSE if the queue is full or MIDI mode is off
+ */
+BOOL ScheduleMidi(const UBYTE *message, UWORD length, const LinkTime *when);
+
+/**
+ * Free entries in the output queue
+ */
+UWORD MidiQueueSpace(void);
+
+/**
+ * Write every queued message that is due, in one device write
+ * Returns number of messages written
+ */
+ULONG SendDueMidi(void);
+
+/**
+ * Read and parse pending input, then send due output
+ */
+void PollMidi(MidiParser *mp);
+
+/**
+ * Sleep until the next message is due, input arrives (serial I/O task)
+ * or MIDI_POLL_MICROS pass, or Ctrl+C
+ */
+void WaitMidi(void);
+
+/**
+ * Copy the output counters
+ */
+void GetMidiStats(MidiStats *stats);
+
+/* Profiler (amiga_packet_profile.c, only with DEFINE=PACKET_PROFILE) */
+
+/**
+ * Start the idle counter task and calibrate it against an idle system
+ * Called by InitPacketFramework(). Blocks for PROFILE_IDLE_CALIBRATION
+ * ticks.
+ * Returns FALSE without timer.device or if the task could not be started
+ * (stage timing still works in the latter case)
+ */
+BOOL StartProfiler(void);
+
+/**
+ * Stop the idle counter task (called by CleanupPacketFramework())
+ */
+void StopProfiler(void);
+
+/**
+ * Clear all stage accumulators and restart the idle window
+ */
+void ResetProfile(void);
+
+/**
+ * Open a stage bracket (use the PROFILE_BEGIN macro)
+ */
+void ProfileBegin(UWORD stage);
+
+/**
+ * Close a stage bracket and account its time (use the PROFILE_END macro)
+ * Ignored if the stage is not open.
+ * @param bytes - bytes the stage handled this call
+ */
+void ProfileEnd(UWORD stage, ULONG bytes);
+
+/**
+ * Send one "PROFILE <stage> ..." line per stage with calls, bytes,
+ * cycles per call and per byte, then the idle percentage since the
+ * last report. Stage times are inclusive: dispatch contains parse,
+ * format and send. Bracket overhead is measured and taken out.
+ * @param cpuHz - CPU clock for the cycle figures, 0 for a stock 68000
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL SendProfileReport(ULONG cpuHz);
+
+/* CPU kernels (amiga_packet_kernel.c) */
+
+/**
+ * Name of the kernel variant compiled in: "68000" or "68020+"
+ */
+const char *KernelVariant(void);
+
+/**
+ * Continue a CRC-16/CCITT over more data; start with FRAME_CRC_INIT
+ */
+UWORD UpdateCrc16(UWORD crc, const UBYTE *data, ULONG length);
+
+/**
+ * Copy length bytes between non-overlapping buffers of any alignment
+ */
+void CopyBytes(UBYTE *dst, const UBYTE *src, ULONG length);
+
+/**
+ * Find the first CR or LF
+ * Returns its index, or length if there is none
+ */
+ULONG FindLineEnd(const char *data, ULONG length);
+
+/**
+ * Count the leading bytes that are neither FRAME_FEND nor FRAME_FESC
+ */
+ULONG ScanPlainBytes(const UBYTE *data, ULONG length);
+
+/**
+ * Byte-stuff data for framing (FEND and FESC become two-byte escapes)
+ * @param out - room for up to 2 * length bytes
+ * Returns bytes written to out
+ */
+ULONG EscapeBytes(UBYTE *out, const UBYTE *data, ULONG length);
+
+/* Binary framing (amiga_packet_frame.c) */
+
+/**
+ * Encode one frame into out
+ * @param type - frame type (FRAME_DATA, FRAME_CREDIT, ...)
+ * @param credit - sender's current credit limit
+ * @param payload - up to FRAME_MAX_PAYLOAD bytes
+ * @param outSize - at least FRAME_ENCODED_SIZE(length)
+ * Returns encoded length, or 0 if the frame does not fit
+ */
+ULONG EncodeFrame(UBYTE type, UWORD credit, const UBYTE *payload, ULONG length,
+                  UBYTE *out, ULONG outSize);
+
+/**
+ * Reset a decoder; callback is called for each frame with a good CRC
+ */
+void InitFrameDecoder(FrameDecoder *fd, FrameCallback callback, APTR userData);
+
+/**
+ * Feed received bytes, in chunks of any size
+ */
+void DecodeFrameBytes(FrameDecoder *fd, const UBYTE *data, ULONG length);
+
+/* Credit-based flow control (amiga_packet_flow.c) */
+
+/**
+ * Set up one end of a flow-controlled link
+ * @param rxRing - receive buffer whose free space is advertised as credit
+ * @param rxSize - size of rxRing, at most FLOW_MAX_WINDOW
+ * @param write - raw transport writer
+ */
+void InitFlowLink(FlowLink *fl, UBYTE *rxRing, ULONG rxSize,
+                  LinkWriteFunc write, APTR writeData);
+
+/**
+ * Announce the initial window to the peer
+ */
+BOOL StartFlowLink(FlowLink *fl);
+
+/**
+ * Returns the number of payload bytes the peer can accept right now
+ */
+ULONG FlowCredit(const FlowLink *fl);
+
+/**
+ * Send up to length bytes, limited by credit and by room to keep them
+ * until the peer acknowledges them
+ * Returns the number of bytes actually sent
+ */
+ULONG FlowSend(FlowLink *fl, const UBYTE *data, ULONG length);
+
+/**
+ * Send a frame of another type; it carries credit but consumes none
+ */
+BOOL FlowSendFrame(FlowLink *fl, UBYTE type, const UBYTE *payload, ULONG length);
+
+/**
+ * Feed raw bytes received from the transport
+ */
+void FlowInput(FlowLink *fl, const UBYTE *data, ULONG length);
+
+/**
+ * Take received payload; sends a credit update once enough space frees up
+ * Returns the number of bytes copied
+ */
+ULONG FlowRead(FlowLink *fl, UBYTE *buffer, ULONG maxLength);
+
+/**
+ * Re-advertise the current window and our offsets (call periodically).
+ * Repairs a lost credit update, and lets the peer notice that our last
+ * DATA frames never arrived and ask for them again
+ */
+void FlowRefreshCredit(FlowLink *fl);
+
+/* Stream triggers (amiga_packet_trigger.c) */
+
+/**
+ * Register a byte pattern to watch for in the incoming stream
+ * Patterns may contain any bytes, including NUL. The pattern memory
+ * must stay valid while registered. The automaton is rebuilt here,
+ * so a scan never has to.
+ * @param pattern - bytes to match
+ * @param length - pattern length
+ * @param callback - called once per occurrence
+ * Returns the pattern id, or -1 if the table is full or the pattern
+ * would exceed TRIGGER_MAX_STATES or TRIGGER_MAX_CLASSES; patterns
+ * added before it keep working
+ */
+LONG AddTrigger(const char *pattern, UWORD length, TriggerCallback callback, APTR userData);
+
+/**
+ * Remove all registered patterns, DefaultPacketHandler's "Hello Amiga"
+ * auto-response included
+ */
+void ClearTriggers(void);
+
+/**
+ * Rebuild the automaton from the registered patterns; AddTrigger()
+ * already does this
+ * Returns FALSE if the patterns exceed the state or class limits
+ */
+BOOL CompileTriggers(void);
+
+/**
+ * Run all patterns over the next chunk of the stream in a single pass
+ * Partial matches carry over to the next call. The processing loops
+ * call this for every read, before the packet handler.
+ */
+void ScanTriggers(const char *data, ULONG length);
+
+/**
+ * Forget any partial match carried from earlier chunks
+ */
+void ResetTriggerScan(void);
+
+/* Telemetry stream (amiga_packet_telemetry.c) */
+
+/**
+ * Register a variable for the telemetry stream
+ * @param name - short name sent once in the "@D" dictionary line
+ * @param value - variable to sample; must stay valid while registered
+ * @param size - width of the variable in bytes (1, 2 or 4)
+ * Returns the channel id, or -1 if the table is full or size is invalid
+ */
+LONG RegisterTelemetry(const char *name, const void *value, UWORD size);
+
+/**
+ * Start pushing telemetry to the host
+ * The next poll sends the dictionary and a full "@T" snapshot; after
+ * that, "@T" records carry only changed channels, at most one record
+ * per interval. An idle application sends nothing.
+ * @param interval - minimum time between records, in ticks (1/50 s)
+ */
+void StartTelemetry(ULONG interval);
+
+/**
+ * Stop pushing telemetry
+ */
+void StopTelemetry(void);
+
+/**
+ * Returns TRUE while a host is subscribed
+ */
+BOOL TelemetryActive(void);
+
+/**
+ * Check for changes and push a record if the interval has elapsed
+ * Called from ProcessPackets() and ProcessLines() on every iteration
+ * @param now - current time in ticks
+ */
+void PollTelemetry(ULONG now);
+
+/* Response cache (amiga_packet_response.c) */
+
+/**
+ * Send a cached response directly from its buffer
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL SendCachedResponse(const CachedResponse *cr);
+
+/**
+ * Copy a built response into the cache pool so it can be resent as-is
+ * @param cr - cache entry to fill in
+ * @param rb - finished builder; it is reset afterwards
+ * Returns FALSE if the builder overflowed or the pool is exhausted
+ */
+BOOL CacheResponse(CachedResponse *cr, ResponseBuilder *rb);
+
+/**
+ * Prepare a response template from a pattern, once at startup
+ * "%u" reserves a decimal ULONG field, "%<n>s" an n-byte string field,
+ * "%%" is a literal percent sign; all other text is copied verbatim
+ * @param t - template to initialize
+ * @param pattern - e.g. "STATUS: Packets=%u Echo=%3s\r\n"
+ * Returns FALSE on a malformed pattern, too many fields or pool exhaustion
+ */
+BOOL InitResponseTemplate(ResponseTemplate *t, const char *pattern);
+
+/**
+ * Patch a numeric field in place; unchanged values cost one compare
+ */
+void SetTemplateULong(ResponseTemplate *t, UWORD field, ULONG value);
+
+/**
+ * Patch a string field in place, truncating to the reserved width
+ */
+void SetTemplateString(ResponseTemplate *t, UWORD field, const char *str);
+
+/**
+ * Send a template, skipping the unused part of each field
+ * Returns TRUE on success, FALSE on failure
+ */
+BOOL SendTemplate(const ResponseTemplate *t);
+
 #endif /* AMIGA_PACKET_FRAMEWORK_H */
\ No newline at end of file
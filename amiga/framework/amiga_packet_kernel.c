@@ -0,0 +1,260 @@
+/*
+ * Amiga Packet Communication Framework - CPU Kernels
+ * The inner loops of the framework, in two builds:
+ *
+ * 68000 (default): byte loops with a cheap range test in front of the
+ *   exact compares, and long-word copies only when both pointers share
+ *   word alignment (the 68000 faults on odd long-word addresses).
+ * 68020 and up (SAS/C CPU=68020 or higher, or DEFINE=PACKET_CPU_020):
+ *   32-bit word-at-a-time processing. Misaligned long-word access is
+ *   legal there, so four bytes are loaded at once and tested for the
+ *   interesting values with the "has zero byte" bit trick; the CRC runs
+ *   four bytes per step through sliced tables (2 KB, built on first use).
+ *
+ * All variants produce identical results; amiga_packet_kernel_bench.c
+ * measures them.
+ */
+
+#include <exec/types.h>
+
+#include "amiga_packet_framework.h"
+
+/* CRC-16/CCITT lookup tables, built on first use; [k] is a byte followed
+   by k zero bytes, so slices 1-3 are only needed by the 68020 build */
+#ifdef PACKET_CPU_020
+#define CRC_SLICES 4
+#else
+#define CRC_SLICES 1
+#endif
+
+static UWORD CrcTable[CRC_SLICES][256];
+static BOOL CrcTableReady = FALSE;
+
+#ifdef PACKET_CPU_020
+
+/* Big-endian 32-bit access at any address; host builds go through bytes */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LOAD32(p) (((ULONG)(p)[0] << 24) | ((ULONG)(p)[1] << 16) | \
+                   ((ULONG)(p)[2] << 8) | (ULONG)(p)[3])
+#define STORE32(p, v) ((p)[0] = (UBYTE)((v) >> 24), (p)[1] = (UBYTE)((v) >> 16), \
+                       (p)[2] = (UBYTE)((v) >> 8), (p)[3] = (UBYTE)(v))
+#else
+#define LOAD32(p) (*(const ULONG *)(p))
+#define STORE32(p, v) (*(ULONG *)(p) = (v))
+#endif
+
+/* Non-zero if any byte of w is zero */
+#define HAS_ZERO(w) (((w) - 0x01010101UL) & ~(w) & 0x80808080UL)
+
+/* Non-zero if any byte of w equals b */
+#define HAS_BYTE(w, b) HAS_ZERO((w) ^ ((ULONG)(b) * 0x01010101UL))
+
+#endif /* PACKET_CPU_020 */
+
+/* Low address bits, for alignment tests */
+#define ADDRESS_BITS(p) ((ULONG)((const UBYTE *)(p) - (const UBYTE *)0))
+
+static void BuildCrcTable(void)
+{
+    UWORD crc;
+    int i, bit;
+#ifdef PACKET_CPU_020
+    int k;
+#endif
+
+    for (i = 0; i < 256; i++) {
+        crc = (UWORD)(i << 8);
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (UWORD)((crc << 1) ^ 0x1021) : (UWORD)(crc << 1);
+        }
+        CrcTable[0][i] = crc;
+    }
+
+#ifdef PACKET_CPU_020
+    for (k = 1; k < CRC_SLICES; k++) {
+        for (i = 0; i < 256; i++) {
+            crc = CrcTable[k - 1][i];
+            CrcTable[k][i] = (UWORD)((crc << 8) ^ CrcTable[0][crc >> 8]);
+        }
+    }
+#endif
+
+    CrcTableReady = TRUE;
+}
+
+/* Name of the variant compiled in */
+const char *KernelVariant(void)
+{
+#ifdef PACKET_CPU_020
+    return "68020+";
+#else
+    return "68000";
+#endif
+}
+
+/* Continue a CRC over more data; start with FRAME_CRC_INIT */
+UWORD UpdateCrc16(UWORD crc, const UBYTE *data, ULONG length)
+{
+#ifdef PACKET_CPU_020
+    ULONG w;
+#endif
+
+    if (!CrcTableReady)
+        BuildCrcTable();
+
+#ifdef PACKET_CPU_020
+    /* Four bytes per step: the CRC is folded into the top half of the word */
+    while (length >= 4) {
+        w = LOAD32(data) ^ ((ULONG)crc << 16);
+        crc = (UWORD)(CrcTable[3][w >> 24] ^ CrcTable[2][(w >> 16) & 0xFF] ^
+                      CrcTable[1][(w >> 8) & 0xFF] ^ CrcTable[0][w & 0xFF]);
+        data += 4;
+        length -= 4;
+    }
+#endif
+
+    while (length--) {
+        crc = (UWORD)((crc << 8) ^ CrcTable[0][(crc >> 8) ^ *data++]);
+    }
+
+    return crc;
+}
+
+/* Copy non-overlapping memory */
+void CopyBytes(UBYTE *dst, const UBYTE *src, ULONG length)
+{
+#ifdef PACKET_CPU_020
+    ULONG w;
+
+    /* Align the destination; the source may stay misaligned */
+    while (length > 0 && (ADDRESS_BITS(dst) & 3)) {
+        *dst++ = *src++;
+        length--;
+    }
+    while (length >= 16) {
+        w = LOAD32(src);      STORE32(dst, w);
+        w = LOAD32(src + 4);  STORE32(dst + 4, w);
+        w = LOAD32(src + 8);  STORE32(dst + 8, w);
+        w = LOAD32(src + 12); STORE32(dst + 12, w);
+        src += 16;
+        dst += 16;
+        length -= 16;
+    }
+    while (length >= 4) {
+        w = LOAD32(src);
+        STORE32(dst, w);
+        src += 4;
+        dst += 4;
+        length -= 4;
+    }
+#else
+    ULONG *d;
+    const ULONG *s;
+    ULONG longs;
+
+    /* Long moves need both pointers on the same word boundary */
+    if (length >= 16 && ((ADDRESS_BITS(dst) ^ ADDRESS_BITS(src)) & 1) == 0) {
+        if (ADDRESS_BITS(dst) & 1) {
+            *dst++ = *src++;
+            length--;
+        }
+        d = (ULONG *)dst;
+        s = (const ULONG *)src;
+        longs = length >> 2;
+        length &= 3;
+        while (longs >= 4) {
+            *d++ = *s++;
+            *d++ = *s++;
+            *d++ = *s++;
+            *d++ = *s++;
+            longs -= 4;
+        }
+        while (longs--) {
+            *d++ = *s++;
+        }
+        dst = (UBYTE *)d;
+        src = (const UBYTE *)s;
+    }
+#endif
+
+    while (length--) {
+        *dst++ = *src++;
+    }
+}
+
+/* Index of the first CR or LF, or length if there is none */
+ULONG FindLineEnd(const char *data, ULONG length)
+{
+    const UBYTE *p = (const UBYTE *)data;
+    ULONG i = 0;
+#ifdef PACKET_CPU_020
+    ULONG w;
+
+    while (length - i >= 4) {
+        w = LOAD32(p + i);
+        if (HAS_BYTE(w, '\r') || HAS_BYTE(w, '\n'))
+            break;
+        i += 4;
+    }
+#endif
+
+    /* Text is mostly above CR, so one compare rejects most bytes */
+    for (; i < length; i++) {
+        if (p[i] <= '\r' && (p[i] == '\r' || p[i] == '\n'))
+            break;
+    }
+
+    return i;
+}
+
+/* Number of leading bytes that need no escaping */
+ULONG ScanPlainBytes(const UBYTE *data, ULONG length)
+{
+    ULONG i = 0;
+#ifdef PACKET_CPU_020
+    ULONG w;
+
+    while (length - i >= 4) {
+        w = LOAD32(data + i);
+        if (HAS_BYTE(w, FRAME_FEND) || HAS_BYTE(w, FRAME_FESC))
+            break;
+        i += 4;
+    }
+#endif
+
+    /* FEND and FESC are both at or above 0xC0 */
+    for (; i < length; i++) {
+        if (data[i] >= FRAME_FEND && (data[i] == FRAME_FEND || data[i] == FRAME_FESC))
+            break;
+    }
+
+    return i;
+}
+
+/* Byte-stuff data into out (up to twice its length); returns bytes written */
+ULONG EscapeBytes(UBYTE *out, const UBYTE *data, ULONG length)
+{
+    UBYTE *start = out;
+    ULONG run;
+    UBYTE c;
+
+    while (length > 0) {
+        /* Plain runs go across in one copy */
+        run = ScanPlainBytes(data, length);
+        if (run > 0) {
+            CopyBytes(out, data, run);
+            out += run;
+            data += run;
+            length -= run;
+            if (length == 0)
+                break;
+        }
+
+        c = *data++;
+        length--;
+        *out++ = FRAME_FESC;
+        *out++ = (c == FRAME_FEND) ? FRAME_TFEND : FRAME_TFESC;
+    }
+
+    return (ULONG)(out - start);
+}
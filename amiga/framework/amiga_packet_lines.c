@@ -0,0 +1,354 @@
+/*
+ * Amiga Packet Communication Framework - Line Protocol
+ * Everything between the raw byte stream and the application's line
+ * handler: line assembly across reads, "#<id> " request tags, streamed
+ * messages and the coalescing reply writer. Nothing here touches a
+ * device; input arrives through ProcessLineInput() and output leaves
+ * through SendPacket(), so the module also builds on a host machine.
+ */
+
+#include <exec/types.h>
+#include <string.h>
+
+#include "amiga_packet_framework.h"
+
+/* Staging buffer for coalescing small SendPacketV() segments */
+static char CoalesceBuffer[PACKET_COALESCE_BUFFER_SIZE];
+
+/* Request tag of the line being processed, echoed by the reply functions */
+static char ReplyTag[PACKET_TAG_MAX_LENGTH + 2];
+static ULONG ReplyTagLength = 0;
+
+/* Partial line carried between ProcessLineInput() calls */
+static char LineBuffer[PACKET_LINE_BUFFER_SIZE];
+static ULONG LineLength = 0;
+static BOOL LineDiscard = FALSE;
+
+/* Streamed message in progress */
+static const StreamHandler *Streamer = NULL;
+static BOOL StreamOpen = FALSE;
+static BOOL StreamAccepted = FALSE;
+static BOOL StreamSkipLF = FALSE;
+static ULONG StreamRemaining = 0;
+static ULONG StreamLastTicks = 0;
+
+/* Tick count passed to the current ProcessLineInput() call */
+static ULONG InputTicks = 0;
+
+/* Internal helpers */
+static BOOL SendSegments(const char *prefix, ULONG prefixLength,
+                         const PacketSegment *segments, ULONG count);
+static void DispatchLine(PacketHandler handler, char *line, ULONG length);
+static void RefuseLongTag(const char *line, ULONG tagLength);
+static BOOL StartStream(char *line, ULONG length);
+static ULONG FeedStream(const char *data, ULONG length);
+static void FinishStream(BOOL complete);
+
+/* Send a list of segments, coalescing small ones into one device write */
+BOOL SendPacketV(const PacketSegment *segments, ULONG count)
+{
+    return SendSegments(NULL, 0, segments, count);
+}
+
+/* Send a reply, prefixed with the tag of the request being processed */
+BOOL SendReply(const char *data, ULONG length)
+{
+    PacketSegment segment;
+    
+    segment.data = data;
+    segment.length = length;
+    return SendSegments(ReplyTag, ReplyTagLength, &segment, 1);
+}
+
+/* Scatter-gather variant of SendReply() */
+BOOL SendReplyV(const PacketSegment *segments, ULONG count)
+{
+    return SendSegments(ReplyTag, ReplyTagLength, segments, count);
+}
+
+/* Set the tag echoed by SendReply(); NULL or empty clears it, a longer
+   one is cut to PACKET_TAG_MAX_LENGTH characters */
+void SetReplyTag(const char *tag, ULONG length)
+{
+    ULONG i;
+    
+    if (!tag || length == 0) {
+        ReplyTagLength = 0;
+        return;
+    }
+    if (length > PACKET_TAG_MAX_LENGTH)
+        length = PACKET_TAG_MAX_LENGTH;
+    
+    ReplyTag[0] = '#';
+    for (i = 0; i < length; i++) {
+        ReplyTag[i + 1] = tag[i];
+    }
+    ReplyTag[length + 1] = ' ';
+    ReplyTagLength = length + 2;
+}
+
+/* Coalescing writer shared by SendPacketV() and the reply functions */
+static BOOL SendSegments(const char *prefix, ULONG prefixLength,
+                         const PacketSegment *segments, ULONG count)
+{
+    ULONG fill = 0;
+    ULONG i;
+    const char *src;
+    ULONG length;
+    ULONG chunk;
+    
+    /* The prefix is always small enough to stage */
+    while (fill < prefixLength) {
+        CoalesceBuffer[fill] = prefix[fill];
+        fill++;
+    }
+    
+    for (i = 0; i < count; i++) {
+        src = segments[i].data;
+        length = segments[i].length;
+        
+        if (length == 0)
+            continue;
+        
+        if (length <= PACKET_COALESCE_LIMIT) {
+            /* Small segment: copy into the staging buffer */
+            if (fill + length > sizeof(CoalesceBuffer)) {
+                if (!SendPacket(CoalesceBuffer, fill))
+                    return FALSE;
+                fill = 0;
+            }
+            CopyBytes((UBYTE *)CoalesceBuffer + fill, (const UBYTE *)src, length);
+            fill += length;
+        } else {
+            /* Large segment: top up what is staged with its start, so a
+               tag leaves in the same write as its reply, then write the
+               rest in place */
+            if (fill > 0) {
+                chunk = sizeof(CoalesceBuffer) - fill;
+                if (chunk > length)
+                    chunk = length;
+                CopyBytes((UBYTE *)CoalesceBuffer + fill, (const UBYTE *)src, chunk);
+                if (!SendPacket(CoalesceBuffer, fill + chunk))
+                    return FALSE;
+                fill = 0;
+                src += chunk;
+                length -= chunk;
+            }
+            if (length > 0 && !SendPacket(src, length))
+                return FALSE;
+        }
+    }
+    
+    if (fill > 0)
+        return SendPacket(CoalesceBuffer, fill);
+    
+    return TRUE;
+}
+
+/* Strip an optional "#<id> " request tag and hand one line to the handler */
+static void DispatchLine(PacketHandler handler, char *line, ULONG length)
+{
+    ULONG tagLength = 0;
+    
+    PROFILE_BEGIN(PROFILE_DISPATCH);
+    
+    if (length > 1 && line[0] == '#') {
+        while (tagLength + 1 < length && line[tagLength + 1] != ' ') {
+            tagLength++;
+        }
+        if (tagLength > PACKET_TAG_MAX_LENGTH) {
+            RefuseLongTag(line, tagLength);
+            PROFILE_END(PROFILE_DISPATCH, length);
+            return;
+        }
+        SetReplyTag(line + 1, tagLength);
+        
+        /* Skip '#', the tag and the separating space */
+        tagLength += (tagLength + 1 < length) ? 2 : 1;
+        line += tagLength;
+        length -= tagLength;
+    }
+    
+    line[length] = '\0';
+    
+    /* A stream header keeps the tag until the stream ends */
+    if (StartStream(line, length)) {
+        PROFILE_END(PROFILE_DISPATCH, length);
+        return;
+    }
+    
+    handler(line, length);
+    
+    ReplyTagLength = 0;
+    PROFILE_END(PROFILE_DISPATCH, length);
+}
+
+/* Answer a request whose tag is too long to keep, under that same tag:
+   an untagged reply could not be matched by a pipelining host */
+static void RefuseLongTag(const char *line, ULONG tagLength)
+{
+    static const char Refusal[] = " ERROR: Tag too long\r\n";
+    PacketSegment segments[2];
+    
+    segments[0].data = line;
+    segments[0].length = tagLength + 1;
+    segments[1].data = Refusal;
+    segments[1].length = sizeof(Refusal) - 1;
+    SendPacketV(segments, 2);
+}
+
+/* Register the handler for "STREAM <length> [args]" messages */
+void SetStreamHandler(const StreamHandler *handler)
+{
+    if (StreamOpen)
+        FinishStream(FALSE);
+    Streamer = handler;
+}
+
+/* Returns TRUE while a streamed message is being received */
+BOOL StreamActive(void)
+{
+    return StreamOpen;
+}
+
+/* Check a line for a stream header and open the stream; returns TRUE if it was one */
+static BOOL StartStream(char *line, ULONG length)
+{
+    ULONG keywordLength = sizeof(PACKET_STREAM_KEYWORD) - 1;
+    ULONG total = 0;
+    ULONG digit;
+    ULONG i;
+    
+    if (!Streamer || length <= keywordLength + 1 ||
+        strncmp(line, PACKET_STREAM_KEYWORD, keywordLength) != 0 ||
+        line[keywordLength] != ' ')
+        return FALSE;
+    
+    i = keywordLength + 1;
+    if (line[i] < '0' || line[i] > '9')
+        return FALSE;
+    while (i < length && line[i] >= '0' && line[i] <= '9') {
+        digit = (ULONG)(line[i] - '0');
+        /* A length past a ULONG is no stream header; the handler refuses it */
+        if (total > (0xFFFFFFFFUL - digit) / 10)
+            return FALSE;
+        total = total * 10 + digit;
+        i++;
+    }
+    if (i < length && line[i] != ' ')
+        return FALSE;
+    if (i < length)
+        i++;
+    
+    StreamOpen = TRUE;
+    StreamRemaining = total;
+    StreamLastTicks = InputTicks;
+    StreamAccepted = Streamer->begin(total, line + i, length - i, Streamer->userData);
+    
+    if (total == 0)
+        FinishStream(TRUE);
+    
+    return TRUE;
+}
+
+/* Pass stream bytes to the handler; returns how many were consumed */
+static ULONG FeedStream(const char *data, ULONG length)
+{
+    if (length > StreamRemaining)
+        length = StreamRemaining;
+    
+    if (StreamAccepted)
+        Streamer->data(data, length, Streamer->userData);
+    
+    StreamRemaining -= length;
+    StreamLastTicks = InputTicks;
+    
+    if (StreamRemaining == 0)
+        FinishStream(TRUE);
+    
+    return length;
+}
+
+/* Close the current stream and return to line mode */
+static void FinishStream(BOOL complete)
+{
+    if (StreamAccepted)
+        Streamer->end(complete, Streamer->userData);
+    
+    StreamOpen = FALSE;
+    StreamAccepted = FALSE;
+    StreamRemaining = 0;
+    ReplyTagLength = 0;
+}
+
+/* Split received bytes into lines and streams and dispatch them */
+void ProcessLineInput(PacketHandler handler, const char *data, ULONG length, ULONG now)
+{
+    ULONG i = 0;
+    ULONG run;
+    char c;
+    
+    InputTicks = now;
+    
+    while (i < length) {
+        c = data[i];
+        
+        /* The LF of a stream header's CR/LF is not stream data */
+        if (StreamSkipLF) {
+            StreamSkipLF = FALSE;
+            if (c == '\n') {
+                i++;
+                continue;
+            }
+        }
+        
+        /* Stream bytes go to the handler straight from the buffer */
+        if (StreamOpen) {
+            i += FeedStream(data + i, length - i);
+            continue;
+        }
+        
+        /* Text up to the next line end is copied as one run */
+        run = FindLineEnd(data + i, length - i);
+        if (run > 0) {
+            if (!LineDiscard && LineLength + run < sizeof(LineBuffer)) {
+                CopyBytes((UBYTE *)LineBuffer + LineLength, (const UBYTE *)data + i, run);
+                LineLength += run;
+            } else {
+                /* Line longer than the buffer: drop it whole */
+                LineDiscard = TRUE;
+            }
+            i += run;
+            continue;
+        }
+        
+        /* End of line: dispatch unless empty or overlong */
+        i++;
+        if (LineLength > 0 && !LineDiscard) {
+            DispatchLine(handler, LineBuffer, LineLength);
+            StreamSkipLF = (BOOL)(StreamOpen && c == '\r');
+        }
+        LineLength = 0;
+        LineDiscard = FALSE;
+    }
+}
+
+/* TRUE between lines: no partial line held and no stream open */
+BOOL LineInputIdle(void)
+{
+    return (BOOL)(LineLength == 0 && !StreamOpen);
+}
+
+/* Give up on a stream whose sender has gone quiet */
+void ExpireStream(ULONG now)
+{
+    if (StreamOpen && now - StreamLastTicks > PACKET_STREAM_TIMEOUT)
+        FinishStream(FALSE);
+}
+
+/* Close an open stream as incomplete */
+void AbortStream(void)
+{
+    if (StreamOpen)
+        FinishStream(FALSE);
+}
@@ -0,0 +1,329 @@
+/*
+ * Amiga Packet Communication Framework - Stage Profiler
+ * Brackets around the framework's key stages read the EClock into
+ * preallocated accumulators; a report turns them into CPU cycles per
+ * call and per byte. A counter task at the lowest priority measures
+ * what is left over: it spins only when nothing else wants the CPU, so
+ * its rate against an idle-system calibration is the idle percentage.
+ *
+ * Everything here is compiled only with DEFINE=PACKET_PROFILE (smake
+ * profile); without it the PROFILE_BEGIN/PROFILE_END brackets vanish.
+ */
+
+#include <exec/types.h>
+#include <exec/tasks.h>
+#include <proto/exec.h>
+#include <proto/dos.h>
+#include <proto/alib.h>
+
+#include "amiga_packet_framework.h"
+
+#ifdef PACKET_PROFILE
+
+#define IDLE_STACK_SIZE 1024
+#define OVERHEAD_SAMPLES 16
+
+/* Accumulator for one stage; times in EClock ticks */
+typedef struct {
+    ULONG calls;
+    ULONG bytes;
+    ULONG ticksHi;          /* 64-bit total */
+    ULONG ticksLo;
+    ULONG maxTicks;
+    ULONG start;            /* Low EClock word at ProfileBegin() */
+    BOOL open;
+} ProfileStage;
+
+static ProfileStage Stages[PROFILE_STAGES];
+static const char *StageNames[PROFILE_STAGES] = {
+    "read", "dispatch", "parse", "format", "send"
+};
+static ULONG EClockHz = 0;
+static ULONG Overhead = 0;          /* Ticks one empty bracket costs */
+
+/* Idle counter task */
+static struct Task *IdleTask = NULL;
+static struct Task *ProfilerTask = NULL;
+static BYTE IdleSignal = -1;
+static volatile ULONG IdleCount = 0;
+static volatile BOOL IdleRun = FALSE;
+static ULONG IdlePerTick = 0;       /* Counts per tick with nothing else running */
+static ULONG WindowCount = 0;
+static LinkTime WindowStart;
+
+/* Runs only when every other task is waiting */
+static void __saveds IdleTaskEntry(void)
+{
+    while (IdleRun) {
+        IdleCount++;
+    }
+
+    /* Stay in Forbid() so the parent cannot free our code before we exit */
+    Forbid();
+    Signal(ProfilerTask, 1L << IdleSignal);
+}
+
+/* (hi:lo) *= m; bits above 64 are lost */
+static void Mul64(ULONG *hi, ULONG *lo, UWORD m)
+{
+    ULONG low = (*lo & 0xFFFF) * m;
+    ULONG high = (*lo >> 16) * m;
+    ULONG result = low + (high << 16);
+
+    *hi = *hi * m + (high >> 16) + (result < low ? 1 : 0);
+    *lo = result;
+}
+
+/* (hi:lo) / d, saturating when the quotient needs more than 32 bits */
+static ULONG Div64(ULONG hi, ULONG lo, ULONG d)
+{
+    ULONG quotient = 0;
+    BOOL carry;
+    int i;
+
+    if (d == 0)
+        return 0;
+    if (hi >= d)
+        return 0xFFFFFFFF;
+
+    for (i = 0; i < 32; i++) {
+        carry = (BOOL)((hi & 0x80000000) != 0);
+        hi = (hi << 1) | (lo >> 31);
+        lo <<= 1;
+        quotient <<= 1;
+        if (carry || hi >= d) {
+            hi -= d;
+            quotient |= 1;
+        }
+    }
+
+    return quotient;
+}
+
+/* Cost of the brackets themselves, taken out of every call in reports */
+static void MeasureOverhead(void)
+{
+    ProfileStage *st = &Stages[PROFILE_READ];
+    int i;
+
+    ResetProfile();
+    for (i = 0; i < OVERHEAD_SAMPLES; i++) {
+        ProfileBegin(PROFILE_READ);
+        ProfileEnd(PROFILE_READ, 0);
+    }
+    Overhead = st->ticksLo / OVERHEAD_SAMPLES;
+}
+
+/* Start the idle counter and calibrate it */
+BOOL StartProfiler(void)
+{
+    LinkTime now;
+    ULONG before;
+
+    if (IdleTask)
+        return TRUE;
+
+    EClockHz = ReadLinkClock(&now);
+    if (EClockHz == 0)
+        return FALSE;
+
+    /* Stage brackets work from here on, even without the idle counter */
+    MeasureOverhead();
+    ResetProfile();
+
+    ProfilerTask = FindTask(NULL);
+    IdleSignal = AllocSignal(-1);
+    if (IdleSignal == -1)
+        return FALSE;
+
+    IdleRun = TRUE;
+    IdleCount = 0;
+    IdleTask = CreateTask("KixGod idle counter", PROFILE_IDLE_PRIORITY,
+                          (APTR)IdleTaskEntry, IDLE_STACK_SIZE);
+    if (!IdleTask) {
+        FreeSignal(IdleSignal);
+        IdleSignal = -1;
+        return FALSE;
+    }
+
+    /* While we sleep the counter has the machine to itself */
+    before = IdleCount;
+    Delay(PROFILE_IDLE_CALIBRATION);
+    IdlePerTick = (IdleCount - before) / PROFILE_IDLE_CALIBRATION;
+
+    ResetProfile();
+    return TRUE;
+}
+
+/* Stop the idle counter */
+void StopProfiler(void)
+{
+    if (IdleTask) {
+        IdleRun = FALSE;
+        Wait(1L << IdleSignal);
+        IdleTask = NULL;
+    }
+
+    if (IdleSignal != -1) {
+        FreeSignal(IdleSignal);
+        IdleSignal = -1;
+    }
+}
+
+/* Clear the accumulators and restart the idle window */
+void ResetProfile(void)
+{
+    UWORD i;
+
+    for (i = 0; i < PROFILE_STAGES; i++) {
+        Stages[i].calls = 0;
+        Stages[i].bytes = 0;
+        Stages[i].ticksHi = 0;
+        Stages[i].ticksLo = 0;
+        Stages[i].maxTicks = 0;
+        Stages[i].open = FALSE;
+    }
+
+    WindowCount = IdleCount;
+    ReadLinkClock(&WindowStart);
+}
+
+void ProfileBegin(UWORD stage)
+{
+    LinkTime now;
+
+    ReadLinkClock(&now);
+    Stages[stage].start = now.lo;
+    Stages[stage].open = TRUE;
+}
+
+void ProfileEnd(UWORD stage, ULONG bytes)
+{
+    ProfileStage *st = &Stages[stage];
+    LinkTime now;
+    ULONG elapsed;
+
+    if (!st->open)
+        return;
+
+    ReadLinkClock(&now);
+    st->open = FALSE;
+
+    /* Low words are enough for one call; the difference wraps correctly */
+    elapsed = now.lo - st->start;
+    st->calls++;
+    st->bytes += bytes;
+    st->ticksLo += elapsed;
+    if (st->ticksLo < elapsed)
+        st->ticksHi++;
+    if (elapsed > st->maxTicks)
+        st->maxTicks = elapsed;
+}
+
+/* Idle percentage since the window started, or -1 without the counter;
+   starts a new window */
+static LONG IdlePercent(void)
+{
+    LinkTime now;
+    ULONG ticks;
+    ULONG counts;
+    ULONG percent;
+
+    ReadLinkClock(&now);
+    ticks = Div64(now.hi - WindowStart.hi - (now.lo < WindowStart.lo ? 1 : 0),
+                  now.lo - WindowStart.lo, EClockHz / TICKS_PER_SECOND);
+    counts = IdleCount - WindowCount;
+
+    WindowCount = IdleCount;
+    WindowStart = now;
+
+    if (ticks == 0 || IdlePerTick == 0)
+        return -1;
+
+    percent = (counts / ticks) * 100 / IdlePerTick;
+    return (LONG)((percent > 100) ? 100 : percent);
+}
+
+/* Report every stage and the idle time */
+BOOL SendProfileReport(ULONG cpuHz)
+{
+    char report[PROFILE_STAGES * 112 + 64];
+    ResponseBuilder rb;
+    ProfileStage *st;
+    ULONG hi, lo;
+    ULONG oHi, oLo;
+    ULONG maxHi, maxLo;
+    UWORD ratio;
+    UWORD i;
+    LONG idle;
+
+    if (EClockHz == 0)
+        return FALSE;
+
+    /* CPU cycles per EClock tick, in 1/16ths */
+    if (cpuHz == 0)
+        cpuHz = EClockHz * PROFILE_CPU_PER_ECLOCK;
+    ratio = (UWORD)((cpuHz * 16 + EClockHz / 2) / EClockHz);
+
+    InitResponse(&rb, report, sizeof(report));
+
+    for (i = 0; i < PROFILE_STAGES; i++) {
+        st = &Stages[i];
+
+        /* Net time: total less the bracket overhead of every call */
+        oHi = 0;
+        oLo = st->calls;
+        Mul64(&oHi, &oLo, (UWORD)Overhead);
+        hi = st->ticksHi;
+        lo = st->ticksLo;
+        if (hi > oHi || (hi == oHi && lo >= oLo)) {
+            hi = hi - oHi - (lo < oLo ? 1 : 0);
+            lo -= oLo;
+        } else {
+            hi = 0;
+            lo = 0;
+        }
+
+        Mul64(&hi, &lo, ratio);
+        maxHi = 0;
+        maxLo = (st->maxTicks > Overhead) ? st->maxTicks - Overhead : 0;
+        Mul64(&maxHi, &maxLo, ratio);
+
+        AppendString(&rb, "PROFILE ");
+        AppendString(&rb, StageNames[i]);
+        AppendString(&rb, " calls=");
+        AppendULong(&rb, st->calls);
+        AppendString(&rb, " bytes=");
+        AppendULong(&rb, st->bytes);
+        AppendString(&rb, " cycles/call=");
+        AppendULong(&rb, Div64(hi, lo, st->calls * 16));
+        AppendString(&rb, " cycles/byte=");
+        if (st->bytes)
+            AppendULong(&rb, Div64(hi, lo, st->bytes * 16));
+        else
+            AppendChar(&rb, '-');
+        AppendString(&rb, " max=");
+        AppendULong(&rb, Div64(maxHi, maxLo, 16));
+        AppendData(&rb, "\r\n", 2);
+    }
+
+    AppendString(&rb, "PROFILE idle=");
+    idle = IdlePercent();
+    if (idle >= 0) {
+        AppendULong(&rb, (ULONG)idle);
+        AppendChar(&rb, '%');
+    } else {
+        AppendChar(&rb, '-');
+    }
+    AppendString(&rb, " cpu=");
+    AppendULong(&rb, cpuHz);
+    AppendString(&rb, "Hz eclock=");
+    AppendULong(&rb, EClockHz);
+    AppendString(&rb, "Hz\r\n");
+
+    if (rb.overflow)
+        return FALSE;
+    return SendReply(rb.buffer, rb.length);
+}
+
+#endif /* PACKET_PROFILE */
@@ -0,0 +1,315 @@
+/*
+ * Amiga Packet Communication Framework - Serial I/O Task
+ * Optional high-priority exec task that keeps a read queued on
+ * serial.device at all times and passes filled buffers to the
+ * application task through a message port. Slow packet handlers
+ * then no longer stall the receive side.
+ */
+
+#include <exec/types.h>
+#include <exec/memory.h>
+#include <exec/ports.h>
+#include <exec/tasks.h>
+#include <devices/serial.h>
+#include <proto/exec.h>
+#include <proto/alib.h>
+
+#include "amiga_packet_framework.h"
+
+/* Serial request opened by InitPacketFramework() */
+extern struct IOExtSer *SerialIO;
+extern BOOL SerialOpen;
+
+/* Receive buffer passed between the tasks */
+typedef struct {
+    struct Message msg;
+    ULONG length;
+    char data[SERIAL_TASK_BUFFER_SIZE];
+} SerialBuffer;
+
+static struct Task *IoTask = NULL;
+static struct Task *AppTask = NULL;
+static struct MsgPort *DataPort = NULL;     /* Filled buffers, owned by the app task */
+static struct MsgPort *FreePort = NULL;     /* Returned buffers, owned by the I/O task */
+static SerialBuffer *Buffers = NULL;
+static BYTE HandshakeSignal = -1;
+static BOOL TaskStarted = FALSE;
+
+/* Buffer the application is currently reading from */
+static SerialBuffer *Current = NULL;
+static ULONG CurrentOffset = 0;
+
+/* Counters shared between the tasks; updated under Forbid() */
+static SerialTaskStats Stats;
+
+/* Body of the I/O task */
+static void __saveds SerialTaskEntry(void)
+{
+    struct MsgPort *readPort = NULL;
+    struct IOExtSer *readIO = NULL;
+    struct List freeList;
+    SerialBuffer *reading = NULL;
+    SerialBuffer *buffer;
+    struct Message *msg;
+    ULONG signals;
+    ULONG readMask;
+    ULONG freeMask;
+    ULONG available;
+    BOOL starved = FALSE;
+    BOOL running = TRUE;
+    int i;
+
+    NewList(&freeList);
+
+    FreePort = CreatePort(NULL, 0);
+    readPort = CreatePort(NULL, 0);
+    if (readPort) {
+        readIO = (struct IOExtSer *)CreateExtIO(readPort, sizeof(struct IOExtSer));
+    }
+
+    if (!FreePort || !readIO) {
+        running = FALSE;
+    } else {
+        /* Clone the opened request so reads and writes can run concurrently */
+        *readIO = *SerialIO;
+        readIO->IOSer.io_Message.mn_ReplyPort = readPort;
+
+        for (i = 0; i < SERIAL_TASK_BUFFERS; i++) {
+            Buffers[i].msg.mn_ReplyPort = FreePort;
+            Buffers[i].msg.mn_Length = sizeof(SerialBuffer);
+            AddTail(&freeList, &Buffers[i].msg.mn_Node);
+        }
+
+        TaskStarted = TRUE;
+    }
+
+    /* Tell StartSerialTask() we are up (or failed) */
+    Signal(AppTask, 1L << HandshakeSignal);
+
+    if (running) {
+        readMask = 1L << readPort->mp_SigBit;
+        freeMask = 1L << FreePort->mp_SigBit;
+    }
+
+    while (running) {
+        /* Keep exactly one read queued whenever a buffer is free */
+        if (!reading) {
+            reading = (SerialBuffer *)RemHead(&freeList);
+            if (reading) {
+                readIO->IOSer.io_Command = CMD_READ;
+                readIO->IOSer.io_Data = reading->data;
+                readIO->IOSer.io_Length = 1;
+                SendIO((struct IORequest *)readIO);
+                starved = FALSE;
+            } else if (!starved) {
+                /* Device buffer keeps filling; nothing is lost until it overruns */
+                Forbid();
+                Stats.starvedReads++;
+                Permit();
+                starved = TRUE;
+            }
+        }
+
+        signals = Wait(readMask | freeMask | SIGBREAKF_CTRL_C);
+
+        if (signals & SIGBREAKF_CTRL_C) {
+            running = FALSE;
+        }
+
+        while ((msg = GetMsg(FreePort)) != NULL) {
+            AddTail(&freeList, &msg->mn_Node);
+        }
+
+        if (reading && CheckIO((struct IORequest *)readIO)) {
+            WaitIO((struct IORequest *)readIO);
+            buffer = reading;
+            reading = NULL;
+
+            if (readIO->IOSer.io_Error != 0) {
+                Forbid();
+                Stats.readErrors++;
+                Permit();
+                AddTail(&freeList, &buffer->msg.mn_Node);
+                continue;
+            }
+
+            /* Got the first byte; take whatever else is already buffered */
+            buffer->length = readIO->IOSer.io_Actual;
+            readIO->IOSer.io_Command = SDCMD_QUERY;
+            DoIO((struct IORequest *)readIO);
+            available = readIO->IOSer.io_Actual;
+
+            if (available > 0) {
+                if (available > SERIAL_TASK_BUFFER_SIZE - buffer->length)
+                    available = SERIAL_TASK_BUFFER_SIZE - buffer->length;
+                readIO->IOSer.io_Command = CMD_READ;
+                readIO->IOSer.io_Data = buffer->data + buffer->length;
+                readIO->IOSer.io_Length = available;
+                DoIO((struct IORequest *)readIO);
+                buffer->length += readIO->IOSer.io_Actual;
+            }
+
+            Forbid();
+            Stats.buffersDelivered++;
+            Stats.bytesDelivered += buffer->length;
+            Stats.queueDepth++;
+            if (Stats.queueDepth > Stats.maxQueueDepth)
+                Stats.maxQueueDepth = Stats.queueDepth;
+            Permit();
+
+            PutMsg(DataPort, &buffer->msg);
+        }
+    }
+
+    if (reading) {
+        AbortIO((struct IORequest *)readIO);
+        WaitIO((struct IORequest *)readIO);
+    }
+    if (readIO)
+        DeleteExtIO((struct IORequest *)readIO);
+    if (readPort)
+        DeletePort(readPort);
+    if (FreePort) {
+        DeletePort(FreePort);
+        FreePort = NULL;
+    }
+
+    /* Stay in Forbid() so the parent cannot free our code before we exit */
+    Forbid();
+    if (TaskStarted) {
+        Signal(AppTask, 1L << HandshakeSignal);
+    }
+}
+
+/* Spawn the I/O task; the framework must already be initialized */
+BOOL StartSerialTask(LONG priority)
+{
+    if (IoTask || !SerialOpen || !SerialIO)
+        return FALSE;
+
+    AppTask = FindTask(NULL);
+    HandshakeSignal = AllocSignal(-1);
+    if (HandshakeSignal == -1)
+        return FALSE;
+
+    Buffers = (SerialBuffer *)AllocMem(sizeof(SerialBuffer) * SERIAL_TASK_BUFFERS,
+                                       MEMF_PUBLIC | MEMF_CLEAR);
+    DataPort = CreatePort(NULL, 0);
+    if (!Buffers || !DataPort) {
+        StopSerialTask();
+        return FALSE;
+    }
+
+    Stats.buffersDelivered = 0;
+    Stats.bytesDelivered = 0;
+    Stats.queueDepth = 0;
+    Stats.maxQueueDepth = 0;
+    Stats.starvedReads = 0;
+    Stats.readErrors = 0;
+    TaskStarted = FALSE;
+
+    IoTask = CreateTask("KixGod serial I/O", priority, (APTR)SerialTaskEntry,
+                        SERIAL_TASK_STACK_SIZE);
+    if (!IoTask) {
+        StopSerialTask();
+        return FALSE;
+    }
+
+    Wait(1L << HandshakeSignal);
+    if (!TaskStarted) {
+        /* Task failed to set up and has already exited */
+        IoTask = NULL;
+        StopSerialTask();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Stop the I/O task and release all buffers */
+void StopSerialTask(void)
+{
+    if (IoTask) {
+        /* The I/O task owns the buffers' reply port; drop ours first */
+        Current = NULL;
+        CurrentOffset = 0;
+        while (GetMsg(DataPort) != NULL)
+            ;
+
+        Signal(IoTask, SIGBREAKF_CTRL_C);
+        Wait(1L << HandshakeSignal);
+        IoTask = NULL;
+        TaskStarted = FALSE;
+    }
+
+    if (DataPort) {
+        DeletePort(DataPort);
+        DataPort = NULL;
+    }
+
+    if (Buffers) {
+        FreeMem(Buffers, sizeof(SerialBuffer) * SERIAL_TASK_BUFFERS);
+        Buffers = NULL;
+    }
+
+    if (HandshakeSignal != -1) {
+        FreeSignal(HandshakeSignal);
+        HandshakeSignal = -1;
+    }
+}
+
+/* Returns TRUE while the I/O task owns the receive side */
+BOOL SerialTaskRunning(void)
+{
+    return (BOOL)(IoTask != NULL);
+}
+
+/* Signal mask raised when the I/O task delivers a buffer */
+ULONG SerialTaskSignal(void)
+{
+    return DataPort ? (1L << DataPort->mp_SigBit) : 0;
+}
+
+/* Copy out the counters consistently */
+void GetSerialTaskStats(SerialTaskStats *stats)
+{
+    Forbid();
+    *stats = Stats;
+    Permit();
+}
+
+/* Read delivered data; used by ReceivePacket() while the task runs */
+ULONG ReceiveFromSerialTask(char *buffer, ULONG maxLength)
+{
+    ULONG copied = 0;
+    ULONG count;
+
+    while (copied < maxLength) {
+        if (!Current) {
+            Current = (SerialBuffer *)GetMsg(DataPort);
+            if (!Current)
+                break;
+            CurrentOffset = 0;
+
+            Forbid();
+            Stats.queueDepth--;
+            Permit();
+        }
+
+        count = Current->length - CurrentOffset;
+        if (count > maxLength - copied)
+            count = maxLength - copied;
+
+        CopyBytes((UBYTE *)buffer + copied, (UBYTE *)Current->data + CurrentOffset, count);
+        CurrentOffset += count;
+        copied += count;
+
+        /* Fully consumed: hand the buffer back for the next read */
+        if (CurrentOffset >= Current->length) {
+            ReplyMsg(&Current->msg);
+            Current = NULL;
+        }
+    }
+
+    return copied;
+}
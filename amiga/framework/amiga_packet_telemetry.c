@@ -0,0 +1,155 @@
+/*
+ * Amiga Packet Communication Framework - Telemetry Stream
+ * Pushes compact records of changed application counters to a subscribed
+ * host, coalesced and rate limited to one record per interval.
+ *
+ * Wire format (one line each, never tagged):
+ *   @D <id>=<name> ...     channel dictionary, sent on subscribe
+ *   @T <id>=<value> ...    changed channels since the previous record
+ */
+
+#include <exec/types.h>
+
+#include "amiga_packet_framework.h"
+
+/* One registered telemetry channel */
+typedef struct {
+    const char *name;
+    const void *value;
+    UWORD size;
+    ULONG lastSent;
+} TelemetryChannel;
+
+static TelemetryChannel Channels[TELEMETRY_MAX_CHANNELS];
+static UWORD ChannelCount = 0;
+
+static BOOL Subscribed = FALSE;
+static BOOL SnapshotPending = FALSE;
+static ULONG IntervalTicks = 0;
+static ULONG LastPushTicks = 0;
+
+/* Read the current value of a channel, whatever its width */
+static ULONG ReadChannel(const TelemetryChannel *ch)
+{
+    switch (ch->size) {
+        case 1:
+            return *(const UBYTE *)ch->value;
+        case 2:
+            return *(const UWORD *)ch->value;
+        default:
+            return *(const ULONG *)ch->value;
+    }
+}
+
+/* Register a variable to be reported; returns channel id or -1 */
+LONG RegisterTelemetry(const char *name, const void *value, UWORD size)
+{
+    TelemetryChannel *ch;
+
+    if (ChannelCount >= TELEMETRY_MAX_CHANNELS || !value)
+        return -1;
+    if (size != 1 && size != 2 && size != 4)
+        return -1;
+
+    ch = &Channels[ChannelCount];
+    ch->name = name;
+    ch->value = value;
+    ch->size = size;
+    ch->lastSent = ReadChannel(ch);
+
+    return ChannelCount++;
+}
+
+/* Subscribe the host; the next poll sends dictionary and full snapshot */
+void StartTelemetry(ULONG interval)
+{
+    IntervalTicks = interval;
+    Subscribed = TRUE;
+    SnapshotPending = TRUE;
+}
+
+/* Stop pushing records */
+void StopTelemetry(void)
+{
+    Subscribed = FALSE;
+    SnapshotPending = FALSE;
+}
+
+/* Returns TRUE while a host is subscribed */
+BOOL TelemetryActive(void)
+{
+    return Subscribed;
+}
+
+/* Send the channel dictionary line */
+static void SendDictionary(void)
+{
+    ResponseBuilder *rb = BeginResponse();
+    UWORD i;
+
+    AppendData(rb, "@D", 2);
+    for (i = 0; i < ChannelCount; i++) {
+        AppendChar(rb, ' ');
+        AppendULong(rb, i);
+        AppendChar(rb, '=');
+        AppendString(rb, Channels[i].name);
+    }
+    AppendData(rb, "\r\n", 2);
+
+    PROFILE_END(PROFILE_FORMAT, rb->length);
+    if (!rb->overflow)
+        SendPacket(rb->buffer, rb->length);
+    ResetResponse(rb);
+}
+
+/* Called from the processing loops; sends at most one record per interval */
+void PollTelemetry(ULONG now)
+{
+    ResponseBuilder *rb;
+    TelemetryChannel *ch;
+    ULONG value;
+    BOOL changed = FALSE;
+    UWORD i;
+
+    if (!Subscribed)
+        return;
+
+    if (!SnapshotPending && now - LastPushTicks < IntervalTicks)
+        return;
+
+    if (SnapshotPending)
+        SendDictionary();
+
+    rb = BeginResponse();
+    AppendData(rb, "@T", 2);
+
+    for (i = 0; i < ChannelCount; i++) {
+        ch = &Channels[i];
+        value = ReadChannel(ch);
+
+        /* Only changed channels, except for the initial snapshot */
+        if (value == ch->lastSent && !SnapshotPending)
+            continue;
+
+        AppendChar(rb, ' ');
+        AppendULong(rb, i);
+        AppendChar(rb, '=');
+        AppendULong(rb, value);
+        ch->lastSent = value;
+        changed = TRUE;
+    }
+
+    /* Sent raw, so close BeginResponse()'s profiler bracket here */
+    PROFILE_END(PROFILE_FORMAT, rb->length);
+
+    /* Nothing changed: stay silent; the first later change goes out at once */
+    if (changed) {
+        AppendData(rb, "\r\n", 2);
+        if (!rb->overflow)
+            SendPacket(rb->buffer, rb->length);
+        LastPushTicks = now;
+    }
+
+    ResetResponse(rb);
+    SnapshotPending = FALSE;
+}
@@ -0,0 +1,207 @@
+/*
+ * Amiga Packet Communication Framework - Stream Triggers
+ * Multi-pattern matching over the incoming byte stream with an
+ * Aho-Corasick automaton compiled to a dense DFA. The automaton state
+ * is carried across reads, so patterns split between two CMD_READs are
+ * still found, and embedded NULs are ordinary bytes. Each input byte
+ * costs one table lookup no matter how many patterns are registered.
+ *
+ * To keep the table small, input bytes are first mapped to classes:
+ * every byte that appears in some pattern gets its own class, all other
+ * bytes share class 0.
+ */
+
+#include <exec/types.h>
+
+#include "amiga_packet_framework.h"
+
+/* Registered pattern */
+typedef struct {
+    const UBYTE *pattern;
+    UWORD length;
+    TriggerCallback callback;
+    APTR userData;
+} Trigger;
+
+static Trigger Triggers[TRIGGER_MAX_PATTERNS];
+static UWORD TriggerCount = 0;
+
+/* Compiled automaton */
+static UBYTE ByteClass[256];
+static UWORD ClassCount = 1;
+static UBYTE Delta[TRIGGER_MAX_STATES][TRIGGER_MAX_CLASSES];
+static UBYTE Fail[TRIGGER_MAX_STATES];
+static UBYTE Depth[TRIGGER_MAX_STATES];
+static UBYTE OutputPattern[TRIGGER_MAX_STATES];   /* Pattern ending here + 1, or 0 */
+static UBYTE OutputLink[TRIGGER_MAX_STATES];      /* Next state with an output, or 0 */
+static UWORD StateCount = 1;
+static BOOL Compiled = FALSE;
+
+/* Streaming state */
+static UBYTE ScanState = 0;
+
+/* Register a pattern; returns its id, or -1 if it does not fit */
+LONG AddTrigger(const char *pattern, UWORD length, TriggerCallback callback, APTR userData)
+{
+    Trigger *t;
+
+    if (TriggerCount >= TRIGGER_MAX_PATTERNS || length == 0 || !callback)
+        return -1;
+
+    t = &Triggers[TriggerCount];
+    t->pattern = (const UBYTE *)pattern;
+    t->length = length;
+    t->callback = callback;
+    t->userData = userData;
+    TriggerCount++;
+
+    /* Build here, not on the receive path; a pattern that overflows the
+       tables is refused and the ones before it stay live */
+    if (!CompileTriggers()) {
+        TriggerCount--;
+        CompileTriggers();
+        return -1;
+    }
+    return TriggerCount - 1;
+}
+
+/* Remove all patterns */
+void ClearTriggers(void)
+{
+    TriggerCount = 0;
+    Compiled = FALSE;
+    ScanState = 0;
+}
+
+/* Build the DFA from the registered patterns */
+BOOL CompileTriggers(void)
+{
+    UBYTE queue[TRIGGER_MAX_STATES];
+    UWORD head = 0;
+    UWORD tail = 0;
+    UWORD i, j, c;
+    UBYTE state;
+    UBYTE next;
+    UBYTE child;
+    UBYTE cls;
+
+    Compiled = FALSE;
+    ScanState = 0;
+
+    /* Assign byte classes */
+    for (i = 0; i < 256; i++) {
+        ByteClass[i] = 0;
+    }
+    ClassCount = 1;
+    for (i = 0; i < TriggerCount; i++) {
+        for (j = 0; j < Triggers[i].length; j++) {
+            c = Triggers[i].pattern[j];
+            if (ByteClass[c] == 0) {
+                if (ClassCount >= TRIGGER_MAX_CLASSES)
+                    return FALSE;
+                ByteClass[c] = (UBYTE)ClassCount++;
+            }
+        }
+    }
+
+    /* Build the trie; 0 in Delta means "no edge" while building */
+    for (i = 0; i < TRIGGER_MAX_STATES; i++) {
+        for (c = 0; c < ClassCount; c++) {
+            Delta[i][c] = 0;
+        }
+        Fail[i] = 0;
+        Depth[i] = 0;
+        OutputPattern[i] = 0;
+        OutputLink[i] = 0;
+    }
+    StateCount = 1;
+
+    for (i = 0; i < TriggerCount; i++) {
+        state = 0;
+        for (j = 0; j < Triggers[i].length; j++) {
+            cls = ByteClass[Triggers[i].pattern[j]];
+            if (Delta[state][cls] == 0) {
+                if (StateCount >= TRIGGER_MAX_STATES)
+                    return FALSE;
+                Delta[state][cls] = (UBYTE)StateCount;
+                Depth[StateCount] = (UBYTE)(j + 1);
+                StateCount++;
+            }
+            state = Delta[state][cls];
+        }
+        /* Duplicate patterns keep the first registration */
+        if (OutputPattern[state] == 0)
+            OutputPattern[state] = (UBYTE)(i + 1);
+    }
+
+    /* Breadth-first pass: failure links, then complete the DFA edges */
+    for (c = 0; c < ClassCount; c++) {
+        child = Delta[0][c];
+        if (child != 0) {
+            Fail[child] = 0;
+            queue[tail++] = child;
+        }
+    }
+
+    while (head < tail) {
+        state = queue[head++];
+
+        /* Nearest proper suffix state that reports a match */
+        next = Fail[state];
+        OutputLink[state] = OutputPattern[next] ? next : OutputLink[next];
+
+        for (c = 0; c < ClassCount; c++) {
+            child = Delta[state][c];
+            if (child != 0 && Depth[child] > Depth[state]) {
+                Fail[child] = Delta[Fail[state]][c];
+                queue[tail++] = child;
+            } else {
+                Delta[state][c] = Delta[Fail[state]][c];
+            }
+        }
+    }
+
+    Compiled = TRUE;
+    return TRUE;
+}
+
+/* Report every pattern ending at the given state */
+static void ReportMatches(UBYTE state, ULONG offset)
+{
+    Trigger *t;
+
+    if (OutputPattern[state] == 0)
+        state = OutputLink[state];
+
+    while (state != 0) {
+        t = &Triggers[OutputPattern[state] - 1];
+        t->callback(OutputPattern[state] - 1, offset, t->userData);
+        state = OutputLink[state];
+    }
+}
+
+/* Run the automaton over a chunk of the stream */
+void ScanTriggers(const char *data, ULONG length)
+{
+    const UBYTE *p = (const UBYTE *)data;
+    UBYTE state;
+    ULONG i;
+
+    if (!Compiled)
+        return;
+
+    state = ScanState;
+    for (i = 0; i < length; i++) {
+        state = Delta[state][ByteClass[p[i]]];
+        if (OutputPattern[state] | OutputLink[state]) {
+            ReportMatches(state, i);
+        }
+    }
+    ScanState = state;
+}
+
+/* Forget any partial match, e.g. after a link reset */
+void ResetTriggerScan(void)
+{
+    ScanState = 0;
+}
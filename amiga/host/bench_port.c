@@ -0,0 +1,161 @@
+/*
+ * Amiga Packet Communication Framework - Host Port for the Microbenchmarks
+ * Stands in for the device-facing parts of the framework when the
+ * portable modules and the example app are built on a host: SendPacket()
+ * only ever reaches the sink, and the serial task, calibration and
+ * clock answer as they do on an Amiga where InitPacketFramework() has
+ * not opened any devices. dos.library file calls discard their data,
+ * like NIL:.
+ */
+
+#include <string.h>
+
+#include <proto/dos.h>
+
+#include "amiga_packet_framework.h"
+
+static LinkWriteFunc PacketSink = NULL;
+static APTR PacketSinkData = NULL;
+
+BOOL SendPacket(const char *data, ULONG length)
+{
+    if (!PacketSink)
+        return FALSE;
+    return PacketSink((const UBYTE *)data, length, PacketSinkData);
+}
+
+void SetPacketSink(LinkWriteFunc write, APTR userData)
+{
+    PacketSink = write;
+    PacketSinkData = userData;
+}
+
+BOOL SerialTaskRunning(void)
+{
+    return FALSE;
+}
+
+void GetSerialTaskStats(SerialTaskStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+/* The link stays raw, so commands needing framed mode refuse */
+FlowLink *GetFlowLink(void)
+{
+    return NULL;
+}
+
+/* Framed mode is never on here */
+LONG PollFlowInput(BOOL wait, APTR userData)
+{
+    (void)wait;
+    (void)userData;
+    return -1;
+}
+
+ULONG CalibrateLink(void)
+{
+    return 0;
+}
+
+/* As amiga_packet_clock.c without timer.device */
+ULONG ReadLinkClock(LinkTime *t)
+{
+    t->hi = 0;
+    t->lo = 0;
+    return 0;
+}
+
+/* Same reply as amiga_packet_clock.c without timer.device: zero times */
+BOOL AnswerTimeSync(const char *args)
+{
+    ResponseBuilder *rb;
+    LinkTime zero = { 0, 0 };
+    ULONG length;
+
+    length = strlen(args);
+    if (length > CLOCK_SYNC_ARGS_MAX)
+        length = CLOCK_SYNC_ARGS_MAX;
+
+    rb = BeginResponse();
+    AppendData(rb, "TSYNC ", 6);
+    AppendData(rb, args, length);
+    AppendChar(rb, ' ');
+    AppendHex(rb, zero.hi, 8);
+    AppendHex(rb, zero.lo, 8);
+    AppendChar(rb, ' ');
+    AppendHex(rb, zero.hi, 8);
+    AppendHex(rb, zero.lo, 8);
+    AppendChar(rb, ' ');
+    AppendULong(rb, 0);
+    AppendData(rb, "\r\n", 2);
+
+    return SendResponse(rb);
+}
+
+BPTR Open(CONST_STRPTR name, LONG mode)
+{
+    (void)name;
+    (void)mode;
+    return 1;
+}
+
+LONG Read(BPTR file, APTR buffer, LONG length)
+{
+    (void)file;
+    (void)buffer;
+    (void)length;
+    return 0;
+}
+
+LONG Write(BPTR file, APTR buffer, LONG length)
+{
+    (void)file;
+    (void)buffer;
+    return length;
+}
+
+LONG Seek(BPTR file, LONG position, LONG mode)
+{
+    (void)file;
+    (void)position;
+    (void)mode;
+    return 0;
+}
+
+BOOL Close(BPTR file)
+{
+    (void)file;
+    return TRUE;
+}
+
+BOOL DeleteFile(CONST_STRPTR name)
+{
+    (void)name;
+    return TRUE;
+}
+
+BOOL Rename(CONST_STRPTR oldName, CONST_STRPTR newName)
+{
+    (void)oldName;
+    (void)newName;
+    return TRUE;
+}
+
+/* No screens to lock on a host */
+BOOL LockScreenSource(const char *name, ScreenSource *source)
+{
+    (void)name;
+    (void)source;
+    return FALSE;
+}
+
+void RefreshScreenSource(ScreenSource *source)
+{
+    (void)source;
+}
+
+void UnlockScreenSource(void)
+{
+}
@@ -0,0 +1,19 @@
+/*
+ * Minimal dos/dos.h for host builds of the example app: only what its
+ * command handlers use.
+ */
+
+#ifndef DOS_DOS_H
+#define DOS_DOS_H
+
+#include <exec/types.h>
+
+typedef long BPTR;
+
+#define MODE_OLDFILE 1005
+#define MODE_NEWFILE 1006
+
+#define OFFSET_BEGINNING -1
+#define OFFSET_END 1
+
+#endif
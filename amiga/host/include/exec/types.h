@@ -0,0 +1,33 @@
+/*
+ * Minimal exec/types.h for building the portable framework modules on a
+ * host machine. Widths match the Amiga: ULONG and LONG are 32 bits.
+ */
+
+#ifndef EXEC_TYPES_H
+#define EXEC_TYPES_H
+
+typedef unsigned int ULONG;
+typedef int LONG;
+typedef unsigned short UWORD;
+typedef short WORD;
+typedef unsigned char UBYTE;
+typedef signed char BYTE;
+typedef short BOOL;
+typedef void *APTR;
+typedef char *STRPTR;
+typedef const char *CONST_STRPTR;
+
+#define TRUE 1
+#define FALSE 0
+
+#ifndef NULL
+#define NULL ((void *)0)
+#endif
+
+/* SAS/C keywords */
+#define __saveds
+#define __asm
+#define __regargs
+#define __stdargs
+
+#endif
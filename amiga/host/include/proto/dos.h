@@ -0,0 +1,19 @@
+/*
+ * Minimal proto/dos.h for host builds of the example app; host/bench_port.c
+ * implements these over a discarding file.
+ */
+
+#ifndef PROTO_DOS_H
+#define PROTO_DOS_H
+
+#include <dos/dos.h>
+
+BPTR Open(CONST_STRPTR name, LONG mode);
+LONG Read(BPTR file, APTR buffer, LONG length);
+LONG Write(BPTR file, APTR buffer, LONG length);
+LONG Seek(BPTR file, LONG position, LONG mode);
+BOOL Close(BPTR file);
+BOOL DeleteFile(CONST_STRPTR name);
+BOOL Rename(CONST_STRPTR oldName, CONST_STRPTR newName);
+
+#endif
@@ -0,0 +1,11 @@
+/*
+ * Minimal proto/exec.h for host builds: the portable modules include it
+ * but call nothing from exec.library.
+ */
+
+#ifndef PROTO_EXEC_H
+#define PROTO_EXEC_H
+
+#include <exec/types.h>
+
+#endif
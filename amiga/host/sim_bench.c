@@ -0,0 +1,1606 @@
+/*
+ * Amiga Packet Communication Framework - Simulated Link Benchmarks
+ * Runs the framework's framing and flow control, and models of its
+ * polling loops, over the simulated cable at real line rates. All times
+ * are virtual; a full run takes well under a second of host CPU.
+ *
+ * Usage: sim_bench [latency|overrun|errors|mismatch|files|sync|screen|all] [seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_link.h"
+#include "amiga_packet_framework.h"
+
+/* Scheduler resolution: both ends get a look-in this often */
+#define QUANTUM SIM_US(100)
+
+/* Stop when no payload moves for this long */
+#define STALL_LIMIT SIM_MS(3000)
+
+/* Size of the buffer ProcessPackets()/ProcessLines() read into */
+#define APP_READ_SIZE 1024
+
+static const ULONG Rates[] = { 9600, 19200, 38400, 57600, 115200 };
+#define RATE_COUNT (sizeof(Rates) / sizeof(Rates[0]))
+
+static ULONG Seed = 1;
+
+/* Amiga receive loop models */
+#define LOOP_POLLED 0   /* Delay(1) when idle, as ProcessPackets() */
+#define LOOP_EVENT  1   /* Woken by the serial I/O task's signal */
+
+static double Ms(SimTime t)
+{
+    return (double)t / 1e6;
+}
+
+/* ------------------------------------------------------------------ */
+/* Request/response latency                                            */
+/* ------------------------------------------------------------------ */
+
+/* Does a chunk of input end a line? */
+static BOOL HasLineEnd(const UBYTE *data, ULONG length)
+{
+    ULONG i;
+
+    for (i = 0; i < length; i++) {
+        if (data[i] == '\n')
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Round trip of "PING" -> "PONG" with the Amiga polling or event driven */
+static double PingLatency(ULONG baud, int loop, int rounds)
+{
+    SimLineConfig config;
+    SimLink link;
+    UBYTE buffer[APP_READ_SIZE];
+    SimTime amigaBusy = 0;
+    SimTime sentAt = 0;
+    SimTime total = 0;
+    ULONG got;
+    int done = 0;
+    BOOL waiting = FALSE;
+
+    SimDefaultConfig(&config, baud);
+    if (!SimInit(&link, &config, &config, Seed))
+        return -1.0;
+
+    while (done < rounds) {
+        /* Host: send the next request once the previous reply is in and
+           neither end holds anything left over from it */
+        if (!waiting) {
+            while (SimQuery(&link, SIM_HOST) > 0)
+                SimRead(&link, SIM_HOST, buffer, sizeof(buffer));
+            while (SimQuery(&link, SIM_AMIGA) > 0)
+                SimRead(&link, SIM_AMIGA, buffer, sizeof(buffer));
+            SimWrite(&link, SIM_HOST, (const UBYTE *)"PING\r\n", 6, FALSE);
+            sentAt = link.now;
+            waiting = TRUE;
+        }
+
+        /* Amiga: one pass of its receive loop when not blocked; the
+           command is handled once its whole line is in */
+        if (link.now >= amigaBusy) {
+            got = SimRead(&link, SIM_AMIGA, buffer, sizeof(buffer));
+            if (HasLineEnd(buffer, got)) {
+                /* DoIO(CMD_WRITE) blocks the task until the reply is sent */
+                amigaBusy = SimWrite(&link, SIM_AMIGA, (const UBYTE *)"PONG\r\n", 6, FALSE);
+            } else if (got == 0 && loop == LOOP_POLLED) {
+                amigaBusy = link.now + SIM_TICK;
+            }
+        }
+
+        /* Host: the round trip ends with the reply's line end */
+        got = SimRead(&link, SIM_HOST, buffer, sizeof(buffer));
+        if (waiting && HasLineEnd(buffer, got)) {
+            total += link.now - sentAt;
+            waiting = FALSE;
+            done++;
+            continue;
+        }
+
+        SimAdvance(&link, QUANTUM);
+    }
+
+    SimFree(&link);
+    return Ms(total) / rounds;
+}
+
+static void BenchLatency(void)
+{
+    ULONG i;
+    double wire;
+
+    printf("PING/PONG round trip (ms), 6-byte request and reply\n");
+    printf("%8s %10s %10s %10s\n", "baud", "wire", "Delay(1)", "task");
+    for (i = 0; i < RATE_COUNT; i++) {
+        wire = 2.0 * 6 * 10 * 1000.0 / Rates[i];
+        printf("%8lu %10.2f %10.2f %10.2f\n", (unsigned long)Rates[i], wire,
+               PingLatency(Rates[i], LOOP_POLLED, 50),
+               PingLatency(Rates[i], LOOP_EVENT, 50));
+    }
+    printf("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* Bulk transfer host -> Amiga, raw and flow controlled                */
+/* ------------------------------------------------------------------ */
+
+typedef struct {
+    SimLink *link;
+    int end;
+} SimWriter;
+
+static BOOL WriteToSim(const UBYTE *data, ULONG length, APTR userData)
+{
+    SimWriter *w = (SimWriter *)userData;
+
+    SimWrite(w->link, w->end, data, length, FALSE);
+    return TRUE;
+}
+
+typedef struct {
+    ULONG delivered;        /* Payload bytes that reached the application */
+    ULONG intact;           /* Of those, bytes known to be good */
+    SimTime elapsed;
+    BOOL stalled;
+    SimLineStats wire;      /* Host -> Amiga direction */
+    ULONG frames;
+    ULONG crcErrors;
+    ULONG dropped;
+    ULONG resent;           /* Payload bytes the host had to send again */
+    ULONG creditStalls;
+} TransferResult;
+
+/* Test payload: position-dependent so losses show up as mismatches */
+static UBYTE PayloadByte(ULONG i)
+{
+    return (UBYTE)((i * 7 + (i >> 8)) & 0xFF);
+}
+
+/*
+ * Send total bytes host -> Amiga. The Amiga reads the device each loop
+ * pass and spends handlerCost per non-empty read, like a handler that
+ * prints or writes to disk. With flow set, both ends run FlowLinks.
+ */
+static void Transfer(const SimLineConfig *toAmiga, ULONG total, SimTime handlerCost,
+                     int loop, BOOL flow, TransferResult *result)
+{
+    SimLineConfig back;
+    SimLink link;
+    SimWriter amigaWriter;
+    SimWriter hostWriter;
+    FlowLink amigaFlow;
+    FlowLink hostFlow;
+    static UBYTE amigaRing[FLOW_RX_BUFFER_SIZE];
+    static UBYTE hostRing[FLOW_RX_BUFFER_SIZE];
+    UBYTE chunk[FLOW_MAX_CHUNK];
+    UBYTE buffer[APP_READ_SIZE];
+    SimTime amigaBusy = 0;
+    SimTime lastProgress = 0;
+    SimTime lastRefresh = 0;
+    ULONG sent = 0;
+    ULONG got;
+    ULONG n;
+    ULONG i;
+
+    memset(result, 0, sizeof(*result));
+
+    SimDefaultConfig(&back, toAmiga->baud);
+    if (!SimInit(&link, &back, toAmiga, Seed))
+        return;
+
+    amigaWriter.link = &link;
+    amigaWriter.end = SIM_AMIGA;
+    hostWriter.link = &link;
+    hostWriter.end = SIM_HOST;
+
+    if (flow) {
+        InitFlowLink(&amigaFlow, amigaRing, sizeof(amigaRing), WriteToSim, &amigaWriter);
+        InitFlowLink(&hostFlow, hostRing, sizeof(hostRing), WriteToSim, &hostWriter);
+        StartFlowLink(&amigaFlow);
+        StartFlowLink(&hostFlow);
+    }
+
+    while (result->delivered < total) {
+        /* Host: the PC side never stalls; it sends whenever allowed */
+        if (flow) {
+            n = SimRead(&link, SIM_HOST, buffer, sizeof(buffer));
+            FlowInput(&hostFlow, buffer, n);
+            while (sent < total && FlowCredit(&hostFlow) > 0) {
+                n = total - sent;
+                if (n > sizeof(chunk))
+                    n = sizeof(chunk);
+                for (i = 0; i < n; i++)
+                    chunk[i] = PayloadByte(sent + i);
+                n = FlowSend(&hostFlow, chunk, n);
+                if (n == 0)
+                    break;
+                sent += n;
+            }
+        } else if (sent < total) {
+            /* Keep about one line ahead of the wire, like a paced write() */
+            if (link.line[SIM_HOST].wireCount < 256) {
+                n = total - sent;
+                if (n > sizeof(chunk))
+                    n = sizeof(chunk);
+                for (i = 0; i < n; i++)
+                    chunk[i] = PayloadByte(sent + i);
+                SimWrite(&link, SIM_HOST, chunk, n, FALSE);
+                sent += n;
+            }
+        }
+
+        /* Amiga: one pass of its receive loop when not busy */
+        if (link.now >= amigaBusy) {
+            if (flow) {
+                n = SimRead(&link, SIM_AMIGA, buffer, sizeof(buffer));
+                FlowInput(&amigaFlow, buffer, n);
+                got = FlowRead(&amigaFlow, buffer, sizeof(buffer) - 1);
+            } else {
+                got = SimRead(&link, SIM_AMIGA, buffer, sizeof(buffer) - 1);
+            }
+
+            if (got > 0) {
+                /* Framed payload has passed its CRC; raw bytes are checked by position */
+                if (flow) {
+                    result->intact += got;
+                } else {
+                    for (i = 0; i < got; i++) {
+                        if (buffer[i] == PayloadByte(result->delivered + i))
+                            result->intact++;
+                    }
+                }
+                result->delivered += got;
+                lastProgress = link.now;
+                amigaBusy = link.now + handlerCost;
+            } else if (loop == LOOP_POLLED) {
+                amigaBusy = link.now + SIM_TICK;
+            }
+
+            /* Periodic re-advertisement, as ReceivePacket() and the host's
+               FlowLink.poll() do; the offsets bring back lost frames */
+            if (flow && link.now - lastRefresh >= FLOW_REFRESH_TICKS * SIM_TICK) {
+                FlowRefreshCredit(&amigaFlow);
+                FlowRefreshCredit(&hostFlow);
+                lastRefresh = link.now;
+            }
+        }
+
+        /* Raw mode loses bytes silently, and framed mode sends lost
+           frames again; stop once the line has drained and, framed,
+           everything sent has been acknowledged */
+        if (sent >= total && link.line[SIM_HOST].wireCount == 0 &&
+            SimQuery(&link, SIM_AMIGA) == 0 &&
+            (!flow || (amigaFlow.rxCount == 0 && hostFlow.txAcked == hostFlow.txSent)))
+            break;
+
+        if (link.now - lastProgress > STALL_LIMIT)
+            break;
+
+        SimAdvance(&link, QUANTUM);
+    }
+
+    /* Time to the last delivery, not including the wait for more */
+    result->elapsed = lastProgress;
+    result->stalled = (BOOL)(link.now - lastProgress > STALL_LIMIT);
+    SimGetStats(&link, SIM_HOST, &result->wire);
+    if (flow) {
+        result->frames = amigaFlow.decoder.framesReceived;
+        result->crcErrors = amigaFlow.decoder.crcErrors;
+        result->dropped = amigaFlow.decoder.dropped;
+        result->resent = hostFlow.txResent;
+        result->creditStalls = hostFlow.creditStalls;
+    }
+
+    SimFree(&link);
+}
+
+static double Goodput(const TransferResult *r)
+{
+    return r->elapsed ? (double)r->intact * 1e9 / (double)r->elapsed : 0.0;
+}
+
+/* A stalled run has no throughput to speak of; say so instead */
+static const char *GoodputText(const TransferResult *r, char *text)
+{
+    if (r->stalled)
+        return "stalled";
+    sprintf(text, "%.0f", Goodput(r));
+    return text;
+}
+
+static void BenchOverrun(void)
+{
+    SimLineConfig config;
+    SimLineConfig framedConfig;
+    TransferResult raw;
+    TransferResult framed;
+    char rawRate[16];
+    char framedRate[16];
+    ULONG i;
+
+    printf("32 KB host -> Amiga, 2 KB device buffer, 100 ms handler per read\n");
+    printf("%8s | %8s %8s %9s | %8s %8s %9s %7s\n",
+           "baud", "raw B/s", "overrun", "intact", "flow B/s", "overrun", "intact", "stalls");
+    for (i = 0; i < RATE_COUNT; i++) {
+        SimDefaultConfig(&config, Rates[i]);
+        Transfer(&config, 32768, SIM_MS(100), LOOP_POLLED, FALSE, &raw);
+        /* EnableFlowControl() enlarges the device buffer to match the window */
+        framedConfig = config;
+        framedConfig.rxBufferSize = FLOW_DEVICE_BUFFER_SIZE;
+        Transfer(&framedConfig, 32768, SIM_MS(100), LOOP_POLLED, TRUE, &framed);
+        printf("%8lu | %8s %8lu %8.1f%% | %8s %8lu %8.1f%% %7lu\n",
+               (unsigned long)Rates[i],
+               GoodputText(&raw, rawRate), (unsigned long)raw.wire.overruns,
+               100.0 * raw.intact / 32768,
+               GoodputText(&framed, framedRate), (unsigned long)framed.wire.overruns,
+               100.0 * framed.intact / 32768, (unsigned long)framed.creditStalls);
+    }
+    printf("\n");
+}
+
+static void BenchErrors(void)
+{
+    static const struct {
+        const char *name;
+        ULONG bitErrorPpm;
+        ULONG dropPpm;
+        ULONG breakPpm;
+    } Cases[] = {
+        { "clean",          0,   0,  0 },
+        { "ber 1e-5",      10,   0,  0 },
+        { "ber 1e-4",     100,   0,  0 },
+        { "ber 1e-3",    1000,   0,  0 },
+        { "drop 1e-4",      0, 100,  0 },
+        { "break 5e-5",     0,   0, 50 },
+    };
+    SimLineConfig config;
+    TransferResult r;
+    char rate[16];
+    ULONG i;
+
+    printf("16 KB framed + flow control at 57600, event-driven receiver\n");
+    printf("%-12s %8s %7s %6s %6s %9s %7s\n",
+           "fault", "good B/s", "frames", "crc", "drop", "delivered", "resent");
+    for (i = 0; i < sizeof(Cases) / sizeof(Cases[0]); i++) {
+        SimDefaultConfig(&config, 57600);
+        config.bitErrorPpm = Cases[i].bitErrorPpm;
+        config.dropPpm = Cases[i].dropPpm;
+        config.breakPpm = Cases[i].breakPpm;
+        Transfer(&config, 16384, 0, LOOP_EVENT, TRUE, &r);
+        printf("%-12s %8s %7lu %6lu %6lu %9lu %7lu\n", Cases[i].name, GoodputText(&r, rate),
+               (unsigned long)r.frames, (unsigned long)r.crcErrors,
+               (unsigned long)r.dropped, (unsigned long)r.delivered, (unsigned long)r.resent);
+    }
+    printf("\n");
+}
+
+static void BenchMismatch(void)
+{
+    static const int Percent[] = { 0, 2, 3, 4, 5, 6, 8 };
+    SimLineConfig config;
+    TransferResult r;
+    ULONG i;
+
+    printf("8 KB raw host -> Amiga at 9600 with the Amiga's receive clock off\n");
+    printf("%8s %8s %9s %13s %9s\n", "error", "rx baud", "garbled", "framing errs", "intact");
+    for (i = 0; i < sizeof(Percent) / sizeof(Percent[0]); i++) {
+        SimDefaultConfig(&config, 9600);
+        config.rxBaud = 9600 + 96 * Percent[i];
+        Transfer(&config, 8192, 0, LOOP_EVENT, FALSE, &r);
+        /* A late stop bit is flagged even when the data bits came through */
+        printf("%7d%% %8lu %9lu %13lu %8.1f%%\n", Percent[i], (unsigned long)config.rxBaud,
+               (unsigned long)(r.delivered - r.intact), (unsigned long)r.wire.framingErrors,
+               100.0 * r.intact / 8192);
+    }
+    printf("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* Remote file access, cached and uncached                             */
+/* ------------------------------------------------------------------ */
+
+#define FB_FILE_SIZE 16384
+#define FB_SERVICE SIM_MS(2)        /* Host time per request (SD card, Python) */
+#define FB_APP_WORK SIM_US(500)     /* Amiga time spent on each read's data */
+#define FB_QUEUE 16
+#define FB_RANDOM_READS 128
+#define FB_DELTA_HANDLE 2
+#define FB_SIGNATURES (FB_FILE_SIZE / SYNC_MIN_BLOCK * SYNC_SIGNATURE_SIZE)
+#define FB_DELTA_SIZE (FB_FILE_SIZE + 1024)
+
+/* The host end: a file server for one in-memory file */
+typedef struct {
+    SimLink link;
+    SimWriter amigaWriter;
+    SimWriter hostWriter;
+    FlowLink amigaFlow;
+    FlowLink hostFlow;
+    UBYTE file[FB_FILE_SIZE];
+    ULONG fileSize;
+    UBYTE signatures[FB_SIGNATURES];    /* Written to the delta handle */
+    ULONG signatureLength;
+    UBYTE delta[FB_DELTA_SIZE];
+    ULONG deltaLength;
+    UBYTE queue[FB_QUEUE][FRAME_MAX_PAYLOAD];
+    ULONG queueLength[FB_QUEUE];
+    ULONG queueHead;
+    ULONG queueCount;
+    BOOL serving;               /* queue[queueHead] is being worked on */
+    SimTime servedAt;
+} FileSim;
+
+static UBYTE FbAmigaRing[FLOW_RX_BUFFER_SIZE];
+static UBYTE FbHostRing[FLOW_RX_BUFFER_SIZE];
+
+static void FbHostFrame(UBYTE type, UWORD credit, const UBYTE *payload,
+                        ULONG length, APTR userData)
+{
+    FileSim *s = (FileSim *)userData;
+    ULONG slot;
+
+    (void)credit;
+    if (type != FRAME_FILE || length < FILE_HEADER_SIZE || s->queueCount == FB_QUEUE)
+        return;
+    slot = (s->queueHead + s->queueCount++) % FB_QUEUE;
+    memcpy(s->queue[slot], payload, length);
+    s->queueLength[slot] = length;
+}
+
+static void FbPut(FileSim *s, ULONG value, int bytes)
+{
+    while (bytes-- > 0)
+        s->delta[s->deltaLength++] = (UBYTE)(value >> (bytes * 8));
+}
+
+static void FbEmitCopy(FileSim *s, ULONG block, ULONG count)
+{
+    if (count == 0)
+        return;
+    FbPut(s, SYNC_OP_COPY, 1);
+    FbPut(s, block, 4);
+    FbPut(s, count, 2);
+}
+
+static void FbEmitLiteral(FileSim *s, ULONG from, ULONG to)
+{
+    ULONG n;
+
+    while (from < to) {
+        n = (to - from > 0xFFFF) ? 0xFFFF : to - from;
+        FbPut(s, SYNC_OP_LITERAL, 1);
+        FbPut(s, n, 2);
+        memcpy(s->delta + s->deltaLength, s->file + from, n);
+        s->deltaLength += n;
+        from += n;
+    }
+}
+
+static ULONG FbSignature(FileSim *s, ULONG block, int part)
+{
+    const UBYTE *p = s->signatures + block * SYNC_SIGNATURE_SIZE + part * 4;
+
+    return ((ULONG)p[0] << 24) | ((ULONG)p[1] << 16) | ((ULONG)p[2] << 8) | p[3];
+}
+
+/* The rsync sender, as in pc/file_server.py: roll the weak sum over the
+   file, confirm candidates by CRC, merge runs of consecutive blocks */
+static ULONG FbMakeDelta(FileSim *s, ULONG oldLength, ULONG blockSize)
+{
+    static LONG head[256];
+    static LONG next[FB_SIGNATURES / SYNC_SIGNATURE_SIZE];
+    ULONG blocks = s->signatureLength / SYNC_SIGNATURE_SIZE;
+    ULONG lastLength = blocks ? oldLength - (blocks - 1) * blockSize : 0;
+    ULONG n = s->fileSize;
+    ULONG copyBlock = 0;
+    ULONG copyCount = 0;
+    ULONG literal = 0;
+    ULONG i = 0;
+    ULONG a = 0;
+    ULONG b = 0;
+    ULONG weak;
+    ULONG crc;
+    ULONG tail;
+    LONG match;
+    LONG k;
+
+    for (k = 0; k < 256; k++)
+        head[k] = -1;
+    for (k = (LONG)blocks - 1; k >= 0; k--) {
+        if (k == (LONG)blocks - 1 && lastLength < blockSize)
+            continue;       /* The short last block can only match at the end */
+        weak = FbSignature(s, k, 0);
+        next[k] = head[(weak ^ (weak >> 16)) & 0xFF];
+        head[(weak ^ (weak >> 16)) & 0xFF] = k;
+    }
+
+    s->deltaLength = 0;
+    if (blocks > 0 && n >= blockSize) {
+        weak = SyncWeakSum(s->file, blockSize);
+        a = weak & 0xFFFF;
+        b = weak >> 16;
+    }
+    while (blocks > 0 && i + blockSize <= n) {
+        weak = (b << 16) | a;
+        match = -1;
+        crc = 0;
+        for (k = head[(weak ^ (weak >> 16)) & 0xFF]; k >= 0; k = next[k]) {
+            if (FbSignature(s, k, 0) != weak)
+                continue;
+            if (match == -1) {
+                crc = SyncCrc32(0, s->file + i, blockSize);
+                match = -2;
+            }
+            if (FbSignature(s, k, 1) == crc) {
+                match = k;
+                break;
+            }
+        }
+        if (match >= 0) {
+            if (literal < i) {
+                FbEmitCopy(s, copyBlock, copyCount);
+                copyCount = 0;
+                FbEmitLiteral(s, literal, i);
+            }
+            if (copyCount > 0 && copyBlock + copyCount == (ULONG)match && copyCount < 0xFFFF) {
+                copyCount++;
+            } else {
+                FbEmitCopy(s, copyBlock, copyCount);
+                copyBlock = (ULONG)match;
+                copyCount = 1;
+            }
+            i += blockSize;
+            literal = i;
+            if (i + blockSize <= n) {
+                weak = SyncWeakSum(s->file + i, blockSize);
+                a = weak & 0xFFFF;
+                b = weak >> 16;
+            }
+            continue;
+        }
+        if (i + blockSize < n) {
+            a = (a - s->file[i] + s->file[i + blockSize]) & 0xFFFF;
+            b = (b - blockSize * s->file[i] + a) & 0xFFFF;
+        }
+        i++;
+    }
+
+    /* The old copy's short last block, at the very end of the new file */
+    if (blocks > 0 && lastLength < blockSize && n >= lastLength && n - lastLength >= literal) {
+        tail = n - lastLength;
+        if (SyncWeakSum(s->file + tail, lastLength) == FbSignature(s, blocks - 1, 0) &&
+            SyncCrc32(0, s->file + tail, lastLength) == FbSignature(s, blocks - 1, 1)) {
+            if (literal < tail) {
+                FbEmitCopy(s, copyBlock, copyCount);
+                copyCount = 0;
+                FbEmitLiteral(s, literal, tail);
+            }
+            if (copyCount > 0 && copyBlock + copyCount == blocks - 1) {
+                copyCount++;
+            } else {
+                FbEmitCopy(s, copyBlock, copyCount);
+                copyBlock = blocks - 1;
+                copyCount = 1;
+            }
+            literal = n;
+        }
+    }
+    if (literal < n) {
+        FbEmitCopy(s, copyBlock, copyCount);
+        copyCount = 0;
+        FbEmitLiteral(s, literal, n);
+    }
+    FbEmitCopy(s, copyBlock, copyCount);
+    FbPut(s, SYNC_OP_END, 1);
+    FbPut(s, n, 4);
+    FbPut(s, SyncCrc32(0, s->file, n), 4);
+    return s->deltaLength;
+}
+
+/* Answer one request the way pc/file_server.py does */
+static void FbServe(FileSim *s, const UBYTE *request, ULONG length)
+{
+    UBYTE reply[FRAME_MAX_PAYLOAD];
+    ULONG offset = ((ULONG)request[4] << 24) | ((ULONG)request[5] << 16) |
+                   ((ULONG)request[6] << 8) | request[7];
+    ULONG count = ((ULONG)request[8] << 8) | request[9];
+    ULONG data = 0;
+    ULONG value = 0;
+    const UBYTE *source;
+    ULONG size;
+
+    memcpy(reply, request, FILE_HEADER_SIZE);
+    reply[0] &= ~FILE_OP_RESEND;
+    reply[3] = FILE_OK;
+
+    switch (reply[0]) {
+    case FILE_OP_OPEN:
+        reply[2] = (request[2] == FILE_MODE_DELTA) ? FB_DELTA_HANDLE : 1;
+        if (request[2] == FILE_MODE_WRITE)
+            s->fileSize = 0;
+        s->signatureLength = 0;
+        s->deltaLength = 0;
+        value = s->fileSize;
+        break;
+    case FILE_OP_READ:
+        source = (request[2] == FB_DELTA_HANDLE) ? s->delta : s->file;
+        size = (request[2] == FB_DELTA_HANDLE) ? s->deltaLength : s->fileSize;
+        if (offset < size) {
+            data = size - offset;
+            if (data > count)
+                data = count;
+            memcpy(reply + FILE_HEADER_SIZE, source + offset, data);
+        }
+        value = offset;
+        count = data;
+        break;
+    case FILE_OP_WRITE:
+        data = length - FILE_HEADER_SIZE;
+        if (request[2] == FB_DELTA_HANDLE) {
+            if (offset + data > FB_SIGNATURES) {
+                reply[3] = FILE_ERR_IO;
+            } else {
+                memcpy(s->signatures + offset, request + FILE_HEADER_SIZE, data);
+                if (offset + data > s->signatureLength)
+                    s->signatureLength = offset + data;
+            }
+            value = s->signatureLength;
+        } else if (offset + data > FB_FILE_SIZE) {
+            reply[3] = FILE_ERR_IO;
+        } else {
+            memcpy(s->file + offset, request + FILE_HEADER_SIZE, data);
+            if (offset + data > s->fileSize)
+                s->fileSize = offset + data;
+        }
+        if (request[2] != FB_DELTA_HANDLE)
+            value = s->fileSize;
+        count = data;
+        data = 0;
+        break;
+    case FILE_OP_DELTA:
+        value = FbMakeDelta(s, offset, count);
+        count = 0;
+        break;
+    case FILE_OP_CLOSE:
+        break;
+    default:
+        reply[3] = FILE_ERR_IO;
+        break;
+    }
+
+    reply[4] = (UBYTE)(value >> 24);
+    reply[5] = (UBYTE)(value >> 16);
+    reply[6] = (UBYTE)(value >> 8);
+    reply[7] = (UBYTE)value;
+    reply[8] = (UBYTE)(count >> 8);
+    reply[9] = (UBYTE)count;
+    FlowSendFrame(&s->hostFlow, FRAME_FILE, reply, FILE_HEADER_SIZE + data);
+}
+
+/* Host: take in requests and work through them one at a time */
+static void FbHostStep(FileSim *s)
+{
+    UBYTE buffer[APP_READ_SIZE];
+    ULONG n;
+
+    n = SimRead(&s->link, SIM_HOST, buffer, sizeof(buffer));
+    FlowInput(&s->hostFlow, buffer, n);
+
+    if (s->serving && s->link.now >= s->servedAt) {
+        FbServe(s, s->queue[s->queueHead], s->queueLength[s->queueHead]);
+        s->queueHead = (s->queueHead + 1) % FB_QUEUE;
+        s->queueCount--;
+        s->serving = FALSE;
+    }
+    if (!s->serving && s->queueCount > 0) {
+        s->serving = TRUE;
+        s->servedAt = s->link.now + FB_SERVICE;
+    }
+}
+
+/* Let time pass with the Amiga busy elsewhere; the host keeps working */
+static void FbAdvance(FileSim *s, SimTime delta)
+{
+    SimTime end = s->link.now + delta;
+
+    while (s->link.now < end) {
+        FbHostStep(s);
+        SimAdvance(&s->link, QUANTUM);
+    }
+}
+
+/* The client's LinkPollFunc: an event-driven wait of up to one tick */
+static LONG FbPoll(BOOL wait, APTR userData)
+{
+    FileSim *s = (FileSim *)userData;
+    UBYTE buffer[APP_READ_SIZE];
+    SimTime end = s->link.now + SIM_TICK;
+    ULONG total = 0;
+    ULONG n;
+
+    FbHostStep(s);
+    while (wait && SimQuery(&s->link, SIM_AMIGA) == 0 && s->link.now < end) {
+        SimAdvance(&s->link, QUANTUM);
+        FbHostStep(s);
+    }
+    while ((n = SimRead(&s->link, SIM_AMIGA, buffer, sizeof(buffer))) > 0) {
+        FlowInput(&s->amigaFlow, buffer, n);
+        total += n;
+    }
+    return (LONG)total;
+}
+
+/* Connect both ends at baud and attach the file client */
+static BOOL FbStart(FileSim *s, ULONG baud)
+{
+    SimLineConfig toHost;
+    SimLineConfig toAmiga;
+
+    /* EnableFlowControl() enlarges the Amiga's device buffer */
+    SimDefaultConfig(&toHost, baud);
+    SimDefaultConfig(&toAmiga, baud);
+    toAmiga.rxBufferSize = FLOW_DEVICE_BUFFER_SIZE;
+    if (!SimInit(&s->link, &toHost, &toAmiga, Seed))
+        return FALSE;
+
+    s->amigaWriter.link = &s->link;
+    s->amigaWriter.end = SIM_AMIGA;
+    s->hostWriter.link = &s->link;
+    s->hostWriter.end = SIM_HOST;
+    InitFlowLink(&s->amigaFlow, FbAmigaRing, sizeof(FbAmigaRing), WriteToSim, &s->amigaWriter);
+    InitFlowLink(&s->hostFlow, FbHostRing, sizeof(FbHostRing), WriteToSim, &s->hostWriter);
+    s->hostFlow.frameHandler = FbHostFrame;
+    s->hostFlow.frameHandlerData = s;
+    StartFlowLink(&s->amigaFlow);
+    StartFlowLink(&s->hostFlow);
+
+    return InitRemoteFiles(&s->amigaFlow, FbPoll, s);
+}
+
+/* Access patterns */
+#define FB_SEQ_SMALL  0     /* Whole file in 64-byte reads */
+#define FB_SEQ_LARGE  1     /* Whole file in 1 KB reads */
+#define FB_RANDOM     2     /* 64-byte reads anywhere in the file */
+#define FB_RANDOM_HOT 3     /* 64-byte reads within the first 3 KB */
+#define FB_WRITE      4     /* 8 KB written in 32-byte pieces */
+
+typedef struct {
+    ULONG bytes;
+    SimTime elapsed;
+    ULONG errors;           /* Bytes that did not match the file */
+    RemoteFileStats stats;
+} FileBenchResult;
+
+static void FileBench(ULONG baud, int pattern, BOOL cached, FileBenchResult *result)
+{
+    static FileSim s;
+    UBYTE buffer[1024];
+    ULONG random = Seed;
+    ULONG offset;
+    ULONG chunk;
+    ULONG i;
+    ULONG j;
+    LONG fh;
+    LONG got;
+    SimTime start;
+
+    memset(result, 0, sizeof(*result));
+    memset(&s, 0, sizeof(s));
+    for (i = 0; i < FB_FILE_SIZE; i++)
+        s.file[i] = PayloadByte(i);
+    s.fileSize = FB_FILE_SIZE;
+
+    if (!FbStart(&s, baud))
+        return;
+    SetRemoteCaching(cached);
+
+    fh = RemoteOpen("bench.dat", pattern == FB_WRITE ? FILE_MODE_WRITE : FILE_MODE_READ);
+    if (fh < 0) {
+        SimFree(&s.link);
+        return;
+    }
+    GetRemoteFileStats(&result->stats, TRUE);
+    start = s.link.now;
+
+    switch (pattern) {
+    case FB_SEQ_SMALL:
+    case FB_SEQ_LARGE:
+        chunk = (pattern == FB_SEQ_SMALL) ? 64 : 1024;
+        offset = 0;
+        while ((got = RemoteRead(fh, buffer, chunk)) > 0) {
+            for (j = 0; j < (ULONG)got; j++) {
+                if (buffer[j] != PayloadByte(offset + j))
+                    result->errors++;
+            }
+            offset += got;
+            result->bytes += got;
+            FbAdvance(&s, FB_APP_WORK);
+        }
+        break;
+    case FB_RANDOM:
+    case FB_RANDOM_HOT:
+        for (i = 0; i < FB_RANDOM_READS; i++) {
+            random = random * 1103515245UL + 12345;
+            offset = ((random >> 8) % ((pattern == FB_RANDOM ? FB_FILE_SIZE : 3072) / 64)) * 64;
+            RemoteSeek(fh, offset);
+            got = RemoteRead(fh, buffer, 64);
+            if (got < 0) {
+                result->errors++;
+                break;
+            }
+            for (j = 0; j < (ULONG)got; j++) {
+                if (buffer[j] != PayloadByte(offset + j))
+                    result->errors++;
+            }
+            result->bytes += got;
+            FbAdvance(&s, FB_APP_WORK);
+        }
+        break;
+    case FB_WRITE:
+        for (offset = 0; offset < 8192; offset += 32) {
+            for (j = 0; j < 32; j++)
+                buffer[j] = (UBYTE)~PayloadByte(offset + j);
+            if (RemoteWrite(fh, buffer, 32) == 32)
+                result->bytes += 32;
+            FbAdvance(&s, FB_APP_WORK);
+        }
+        RemoteFlush(fh);
+        break;
+    }
+
+    result->elapsed = s.link.now - start;
+    GetRemoteFileStats(&result->stats, FALSE);
+    RemoteClose(fh);
+    CleanupRemoteFiles();
+
+    if (pattern == FB_WRITE) {
+        if (s.fileSize != 8192)
+            result->errors += 8192;
+        for (j = 0; j < s.fileSize && j < 8192; j++) {
+            if ((UBYTE)(s.file[j] ^ PayloadByte(j)) != 0xFF)
+                result->errors++;
+        }
+    }
+
+    SimFree(&s.link);
+}
+
+static void BenchFiles(void)
+{
+    static const char *Names[] = {
+        "seq 64 B reads", "seq 1 KB reads", "random 64 B", "random 64 B, 3 KB", "seq 32 B writes"
+    };
+    static const ULONG FileRates[] = { 9600, 57600 };
+    FileBenchResult plain;
+    FileBenchResult cached;
+    ULONG r;
+    int p;
+
+    printf("Remote file access, 16 KB file, %lu ms host service, %lu us work per call\n",
+           (unsigned long)(FB_SERVICE / SIM_MS(1)), (unsigned long)(FB_APP_WORK / SIM_US(1)));
+    printf("%-18s %6s | %8s %6s | %8s %6s %6s %6s | %5s\n", "pattern", "baud",
+           "plain B/s", "reqs", "cache B/s", "reqs", "hits", "ahead", "gain");
+    for (r = 0; r < sizeof(FileRates) / sizeof(FileRates[0]); r++) {
+        for (p = FB_SEQ_SMALL; p <= FB_WRITE; p++) {
+            FileBench(FileRates[r], p, FALSE, &plain);
+            FileBench(FileRates[r], p, TRUE, &cached);
+            printf("%-18s %6lu | %8.0f %6lu | %8.0f %6lu %6lu %6lu | %4.1fx%s\n",
+                   Names[p], (unsigned long)FileRates[r],
+                   plain.elapsed ? plain.bytes * 1e9 / plain.elapsed : 0.0,
+                   (unsigned long)plain.stats.requests,
+                   cached.elapsed ? cached.bytes * 1e9 / cached.elapsed : 0.0,
+                   (unsigned long)cached.stats.requests,
+                   (unsigned long)cached.stats.cacheHits,
+                   (unsigned long)cached.stats.readAheadUsed,
+                   (cached.elapsed && plain.bytes) ?
+                       ((double)plain.elapsed / plain.bytes) / ((double)cached.elapsed / cached.bytes) : 0.0,
+                   (plain.errors || cached.errors) ? "  DATA ERRORS" : "");
+        }
+    }
+    printf("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* Delta synchronization against a full copy                           */
+/* ------------------------------------------------------------------ */
+
+#define SB_OLD_SIZE 15000
+#define SB_SUM_BYTE SIM_US(6)       /* 68000 at 7 MHz: weak sum and CRC-32 per byte */
+#define SB_CRC_BYTE SIM_US(4)       /* CRC-32 alone */
+
+/* Changes made to the host's copy */
+#define SB_SAME     0
+#define SB_BYTE     1       /* One byte changed in the middle */
+#define SB_INSERT   2       /* 40 bytes inserted near the start */
+#define SB_EDITS    3       /* Five scattered 16-byte edits */
+#define SB_APPEND   4       /* 1 KB appended */
+#define SB_NEW      5       /* Different content throughout */
+#define SB_NO_COPY  6       /* Nothing on the Amiga yet */
+
+/* The Amiga's copy, old and new, in memory */
+typedef struct {
+    FileSim *sim;
+    UBYTE old[SB_OLD_SIZE];
+    UBYTE out[FB_FILE_SIZE];
+    ULONG outLength;
+} SyncSim;
+
+typedef struct {
+    SimTime elapsed;
+    ULONG wireBytes;        /* Both directions, framing included */
+    BOOL ok;
+} SyncBenchResult;
+
+static LONG SbReadOld(ULONG offset, APTR buffer, ULONG length, APTR userData)
+{
+    SyncSim *t = (SyncSim *)userData;
+
+    memcpy(buffer, t->old + offset, length);
+    FbAdvance(t->sim, length * SB_SUM_BYTE);
+    return (LONG)length;
+}
+
+static BOOL SbWrite(const APTR data, ULONG length, APTR userData)
+{
+    SyncSim *t = (SyncSim *)userData;
+
+    if (t->outLength + length > sizeof(t->out))
+        return FALSE;
+    memcpy(t->out + t->outLength, data, length);
+    t->outLength += length;
+    FbAdvance(t->sim, length * SB_CRC_BYTE);
+    return TRUE;
+}
+
+static BOOL SbRestart(APTR userData)
+{
+    ((SyncSim *)userData)->outLength = 0;
+    return TRUE;
+}
+
+/* Text-like bytes that do not repeat, unlike PayloadByte() */
+static void SbFill(UBYTE *buffer, ULONG length, ULONG seed)
+{
+    ULONG i;
+
+    for (i = 0; i < length; i++) {
+        seed = seed * 1103515245UL + 12345;
+        buffer[i] = (UBYTE)(' ' + (seed >> 16) % 95);
+    }
+}
+
+/* Make the host's copy from the Amiga's */
+static void SbChange(FileSim *s, const UBYTE *old, int change)
+{
+    ULONG i;
+
+    memcpy(s->file, old, SB_OLD_SIZE);
+    s->fileSize = SB_OLD_SIZE;
+    switch (change) {
+    case SB_BYTE:
+        s->file[SB_OLD_SIZE / 2] ^= 0x20;
+        break;
+    case SB_INSERT:
+        memmove(s->file + 140, s->file + 100, SB_OLD_SIZE - 100);
+        SbFill(s->file + 100, 40, Seed + 1);
+        s->fileSize += 40;
+        break;
+    case SB_EDITS:
+        for (i = 0; i < 5; i++)
+            SbFill(s->file + 1000 + i * 2900, 16, Seed + 2 + i);
+        break;
+    case SB_APPEND:
+        SbFill(s->file + SB_OLD_SIZE, 1024, Seed + 8);
+        s->fileSize += 1024;
+        break;
+    case SB_NEW:
+        SbFill(s->file, SB_OLD_SIZE, Seed + 9);
+        break;
+    }
+}
+
+static void SyncBench(ULONG baud, int change, BOOL delta, SyncBenchResult *result,
+                      SyncStats *stats)
+{
+    static FileSim s;
+    static SyncSim t;
+    SyncTarget target;
+    SimLineStats up;
+    SimLineStats down;
+    SimTime start;
+    LONG fh;
+    LONG got;
+
+    memset(result, 0, sizeof(*result));
+    memset(stats, 0, sizeof(*stats));
+    memset(&s, 0, sizeof(s));
+    memset(&t, 0, sizeof(t));
+    SbFill(t.old, SB_OLD_SIZE, Seed);
+    SbChange(&s, t.old, change);
+    t.sim = &s;
+
+    if (!FbStart(&s, baud))
+        return;
+    start = s.link.now;
+
+    if (delta) {
+        target.oldLength = (change == SB_NO_COPY) ? 0 : SB_OLD_SIZE;
+        target.readOld = SbReadOld;
+        target.write = SbWrite;
+        target.restart = SbRestart;
+        target.userData = &t;
+        result->ok = SyncFile("sync.dat", &target, stats);
+    } else {
+        /* What FGET does: the whole file through the cache in 1 KB reads */
+        fh = RemoteOpen("sync.dat", FILE_MODE_READ);
+        if (fh >= 0) {
+            while ((got = RemoteRead(fh, t.out + t.outLength, 1024)) > 0)
+                t.outLength += got;
+            result->ok = (BOOL)(got == 0);
+            RemoteClose(fh);
+        }
+    }
+
+    result->elapsed = s.link.now - start;
+    SimGetStats(&s.link, SIM_AMIGA, &up);
+    SimGetStats(&s.link, SIM_HOST, &down);
+    result->wireBytes = up.sent + down.sent;
+    if (t.outLength != s.fileSize || memcmp(t.out, s.file, s.fileSize) != 0)
+        result->ok = FALSE;
+
+    CleanupRemoteFiles();
+    SimFree(&s.link);
+}
+
+static void BenchSync(void)
+{
+    static const char *Names[] = {
+        "unchanged", "1 byte changed", "40 B inserted", "5 x 16 B edits", "1 KB appended",
+        "all new", "no old copy"
+    };
+    static const ULONG SyncRates[] = { 9600, 57600 };
+    SyncBenchResult full;
+    SyncBenchResult sync;
+    SyncStats stats;
+    ULONG r;
+    int c;
+
+    printf("Delta sync of a %lu byte file against a full copy, %lu/%lu us per byte summed/checked\n",
+           (unsigned long)SB_OLD_SIZE, (unsigned long)(SB_SUM_BYTE / SIM_US(1)),
+           (unsigned long)(SB_CRC_BYTE / SIM_US(1)));
+    printf("%-15s %6s | %7s %7s | %5s %5s %6s %6s %7s %7s | %6s %5s\n", "change", "baud",
+           "full B", "full s", "block", "sig", "delta", "copied", "sync B", "sync s", "saved", "gain");
+    for (r = 0; r < sizeof(SyncRates) / sizeof(SyncRates[0]); r++) {
+        for (c = SB_SAME; c <= SB_NO_COPY; c++) {
+            SyncBench(SyncRates[r], c, FALSE, &full, &stats);
+            SyncBench(SyncRates[r], c, TRUE, &sync, &stats);
+            printf("%-15s %6lu | %7lu %7.2f | %5lu %5lu %6lu %6lu %7lu %7.2f | %5.1f%% %4.1fx%s%s\n",
+                   Names[c], (unsigned long)SyncRates[r],
+                   (unsigned long)full.wireBytes, full.elapsed / 1e9,
+                   (unsigned long)stats.blockSize, (unsigned long)stats.signatureBytes,
+                   (unsigned long)stats.deltaBytes, (unsigned long)stats.copiedBytes,
+                   (unsigned long)sync.wireBytes, sync.elapsed / 1e9,
+                   full.wireBytes ? 100.0 - 100.0 * sync.wireBytes / full.wireBytes : 0.0,
+                   sync.elapsed ? (double)full.elapsed / sync.elapsed : 0.0,
+                   stats.fullCopy ? "  resent" : "",
+                   (full.ok && sync.ok) ? "" : "  FAILED");
+        }
+    }
+    printf("\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* Screen streaming                                                    */
+/* ------------------------------------------------------------------ */
+
+#define SC_WIDTH 320
+#define SC_HEIGHT 256
+#define SC_DEPTH 5
+#define SC_ROW_BYTES (SC_WIDTH / 8)
+#define SC_PLANE (SC_ROW_BYTES * SC_HEIGHT)
+#define SC_RAW_FRAME (SC_PLANE * SC_DEPTH)
+#define SC_COMPARE_LONG SIM_US(9)   /* 68000 at 7 MHz: one longword of a tile compared */
+#define SC_ENCODE_PLANE SIM_US(650) /* Gather, XOR and two ByteRun1 tries of a changed plane */
+#define SC_FRAMES 8                 /* Frames timed per scene, after the first */
+#define SC_NOISE_PPM 20             /* Bit errors per million on the noisy line */
+
+/* What changes between frames */
+#define SC_IDLE   0     /* Nothing */
+#define SC_TYPING 1     /* Two characters typed into a shell window */
+#define SC_CLOCK  2     /* Eight characters of a title bar clock */
+#define SC_SCROLL 3     /* The shell window scrolls by a text line */
+#define SC_DRAG   4     /* A 112 x 80 window dragged 16 pixels */
+#define SC_NOISE  5     /* Every pixel */
+#define SC_NOISY  6     /* Typing, over a line with bit errors */
+
+/* The Amiga's screen, its shadow, and the host's copy built from the
+   messages it received */
+typedef struct {
+    FileSim *sim;
+    UBYTE screen[SC_DEPTH][SC_PLANE];
+    UBYTE shadow[SC_RAW_FRAME + 128];
+    UBYTE host[SC_DEPTH][SC_PLANE];
+    UBYTE nextSeq;
+    BOOL seqKnown;
+    UBYTE missing[SCREEN_HISTORY];      /* Lost seqs not yet reported */
+    ULONG missingCount;
+    BOOL refresh;                       /* Loss too large for RESEND */
+    ULONG lost;
+    ULONG resends;
+    ULONG badRecords;
+    ULONG cursor;
+    ULONG random;
+    UWORD dragX;
+} ScreenSim;
+
+typedef struct {
+    ULONG firstBytes;
+    SimTime firstTime;
+    ULONG bytes;            /* Over the timed frames */
+    SimTime elapsed;
+    ULONG wrongTiles;       /* Host copy against the screen, after the last frame */
+    ScreenStreamStats stats;
+    ULONG lost;             /* Messages the host saw go missing */
+    BOOL ok;
+} ScreenBenchResult;
+
+static void ScPixel(ScreenSim *t, ULONG x, ULONG y, UBYTE color)
+{
+    ULONG offset = y * SC_ROW_BYTES + (x >> 3);
+    UBYTE bit = (UBYTE)(0x80 >> (x & 7));
+    int p;
+
+    for (p = 0; p < SC_DEPTH; p++) {
+        if (color & (1 << p))
+            t->screen[p][offset] |= bit;
+        else
+            t->screen[p][offset] &= (UBYTE)~bit;
+    }
+}
+
+static void ScFill(ScreenSim *t, ULONG x, ULONG y, ULONG w, ULONG h, UBYTE color)
+{
+    ULONG i;
+    ULONG j;
+
+    for (j = y; j < y + h && j < SC_HEIGHT; j++)
+        for (i = x; i < x + w && i < SC_WIDTH; i++)
+            ScPixel(t, i, j, color);
+}
+
+/* An 8 x 8 character cell; the glyph is made up from the code */
+static void ScGlyph(ScreenSim *t, ULONG x, ULONG y, ULONG code, UBYTE fg, UBYTE bg)
+{
+    ULONG bits = code * 2654435761UL;
+    ULONG i;
+    ULONG j;
+
+    for (j = 0; j < 8; j++) {
+        for (i = 0; i < 8; i++) {
+            BOOL on = (BOOL)(j > 0 && j < 7 && i > 0 && i < 7 &&
+                             ((bits >> ((j * 5 + i) % 31)) & 1));
+            ScPixel(t, x + i, y + j, on ? fg : bg);
+        }
+    }
+}
+
+static ULONG ScRandom(ScreenSim *t)
+{
+    t->random = t->random * 1103515245UL + 12345;
+    return t->random >> 16;
+}
+
+/* A window with a border and a gradient inside */
+static void ScDrawPicture(ScreenSim *t, ULONG x, ULONG y)
+{
+    ULONG j;
+
+    ScFill(t, x, y, 112, 80, 1);
+    for (j = 2; j < 78; j++)
+        ScFill(t, x + 2, y + j, 108, 1, (UBYTE)(4 + (j * 28) / 78));
+}
+
+/* Title bar, a shell full of text, icons and a picture window */
+static void ScDesktop(ScreenSim *t)
+{
+    ULONG i;
+    ULONG j;
+
+    memset(t->screen, 0, sizeof(t->screen));
+    ScFill(t, 0, 0, SC_WIDTH, 11, 1);
+    for (i = 0; i < 16; i++)
+        ScGlyph(t, 4 + i * 8, 2, 'A' + i, 0, 1);
+
+    ScFill(t, 8, 16, 216, 180, 1);
+    ScFill(t, 10, 26, 212, 168, 0);
+    for (j = 0; j < 20; j++)
+        for (i = 0; i < 25; i++)
+            ScGlyph(t, 14 + i * 8, 28 + j * 8, (ScRandom(t) % 4 == 0) ? ' ' : ScRandom(t), 1, 0);
+
+    for (i = 0; i < 6; i++)
+        for (j = 0; j < 24 * 32; j++)
+            ScPixel(t, 16 + i * 48 + j % 32, 216 + j / 32, (UBYTE)(ScRandom(t) % 8));
+
+    t->dragX = 200;
+    ScDrawPicture(t, t->dragX, 110);
+    t->cursor = 20 * 25 - 40;
+}
+
+static void ScChange(ScreenSim *t, int scene, ULONG frame)
+{
+    ULONG i;
+    ULONG p;
+
+    switch (scene) {
+    case SC_TYPING:
+    case SC_NOISY:
+        for (i = 0; i < 2; i++, t->cursor = (t->cursor + 1) % (20 * 25))
+            ScGlyph(t, 14 + (t->cursor % 25) * 8, 28 + (t->cursor / 25) * 8, ScRandom(t), 1, 0);
+        break;
+    case SC_CLOCK:
+        for (i = 0; i < 8; i++)
+            ScGlyph(t, 248 + i * 8, 2, '0' + (frame * 7 + i) % 10, 0, 1);
+        break;
+    case SC_SCROLL:
+        for (p = 0; p < SC_DEPTH; p++) {
+            for (i = 28; i < 28 + 19 * 8; i++)
+                memcpy(&t->screen[p][i * SC_ROW_BYTES + 1], &t->screen[p][(i + 8) * SC_ROW_BYTES + 1], 27);
+        }
+        for (i = 0; i < 25; i++)
+            ScGlyph(t, 14 + i * 8, 28 + 19 * 8, ScRandom(t), 1, 0);
+        break;
+    case SC_DRAG:
+        ScFill(t, t->dragX, 110, 112, 80, 0);
+        t->dragX = (UWORD)((t->dragX >= 16) ? t->dragX - 16 : 200);
+        ScDrawPicture(t, t->dragX, 110);
+        break;
+    case SC_NOISE:
+        for (p = 0; p < SC_DEPTH; p++)
+            for (i = 0; i < SC_PLANE; i++)
+                t->screen[p][i] = (UBYTE)ScRandom(t);
+        break;
+    }
+}
+
+/* ByteRun1 into exactly length bytes; FALSE if the data is malformed */
+static BOOL ScUnpack(const UBYTE **in, const UBYTE *end, UBYTE *out, ULONG length)
+{
+    ULONG n = 0;
+    ULONG count;
+    UBYTE c;
+
+    while (n < length) {
+        if (*in >= end)
+            return FALSE;
+        c = *(*in)++;
+        if (c < 128) {
+            count = c + 1;
+            if (n + count > length || *in + count > end)
+                return FALSE;
+            memcpy(out + n, *in, count);
+            *in += count;
+        } else if (c > 128) {
+            count = 257 - c;
+            if (n + count > length || *in >= end)
+                return FALSE;
+            memset(out + n, *(*in)++, count);
+        } else {
+            count = 0;
+        }
+        n += count;
+    }
+    return TRUE;
+}
+
+/* Host: apply one TILES message to its copy */
+static void ScApplyTiles(ScreenSim *t, const UBYTE *p, const UBYTE *end)
+{
+    UBYTE data[SCREEN_PLANE_TILE];
+    ULONG columns = (SC_ROW_BYTES + SCREEN_TILE_BYTES - 1) / SCREEN_TILE_BYTES;
+    ULONG tile;
+    ULONG x;
+    ULONG y;
+    ULONG bytes;
+    ULONG rows;
+    ULONG length;
+    ULONG r;
+    ULONG i;
+    UBYTE mask;
+    UBYTE encoding;
+    int plane;
+
+    while (p + 3 <= end) {
+        tile = ((ULONG)p[0] << 8) | p[1];
+        mask = p[2];
+        p += 3;
+        x = (tile % columns) * SCREEN_TILE_BYTES;
+        y = (tile / columns) * SCREEN_TILE_ROWS;
+        bytes = (SC_ROW_BYTES - x < SCREEN_TILE_BYTES) ? SC_ROW_BYTES - x : SCREEN_TILE_BYTES;
+        rows = (SC_HEIGHT - y < SCREEN_TILE_ROWS) ? SC_HEIGHT - y : SCREEN_TILE_ROWS;
+        length = bytes * rows;
+        if (y >= SC_HEIGHT) {
+            t->badRecords++;
+            return;
+        }
+        for (plane = 0; plane < SC_DEPTH; plane++) {
+            if (!(mask & (1 << plane)))
+                continue;
+            if (p >= end) {
+                t->badRecords++;
+                return;
+            }
+            encoding = *p++;
+            if (encoding == SCREEN_ENC_RAW) {
+                if (p + length > end) {
+                    t->badRecords++;
+                    return;
+                }
+                memcpy(data, p, length);
+                p += length;
+            } else if (!ScUnpack(&p, end, data, length)) {
+                t->badRecords++;
+                return;
+            }
+            for (r = 0, i = 0; r < rows; r++) {
+                UBYTE *row = &t->host[plane][(y + r) * SC_ROW_BYTES + x];
+                ULONG b;
+
+                for (b = 0; b < bytes; b++, i++)
+                    row[b] = (encoding == SCREEN_ENC_XOR) ? (UBYTE)(row[b] ^ data[i]) : data[i];
+            }
+        }
+    }
+}
+
+/* Host end of the link: what pc/screen_viewer.py does */
+static void ScHostFrame(UBYTE type, UWORD credit, const UBYTE *payload,
+                        ULONG length, APTR userData)
+{
+    ScreenSim *t = (ScreenSim *)userData;
+    UBYTE seq;
+
+    (void)credit;
+    if (type != FRAME_SCREEN || length < 2)
+        return;
+    seq = payload[1];
+    if (t->seqKnown && seq != t->nextSeq) {
+        t->lost += (UBYTE)(seq - t->nextSeq);
+        if ((UBYTE)(seq - t->nextSeq) > SCREEN_HISTORY / 2 ||
+            t->missingCount + (UBYTE)(seq - t->nextSeq) > SCREEN_HISTORY) {
+            t->refresh = TRUE;
+        } else {
+            while (t->nextSeq != seq)
+                t->missing[t->missingCount++] = t->nextSeq++;
+        }
+    }
+    t->seqKnown = TRUE;
+    t->nextSeq = (UBYTE)(seq + 1);
+
+    switch (payload[0]) {
+    case SCREEN_OP_FORMAT:
+        memset(t->host, 0, sizeof(t->host));
+        break;
+    case SCREEN_OP_TILES:
+        ScApplyTiles(t, payload + 2, payload + length);
+        break;
+    }
+}
+
+/* Host: report losses */
+static void ScHostService(ScreenSim *t)
+{
+    UBYTE message[2 + SCREEN_HISTORY];
+
+    if (t->refresh) {
+        message[0] = SCREEN_OP_REFRESH;
+        message[1] = 0;
+        FlowSendFrame(&t->sim->hostFlow, FRAME_SCREEN, message, 2);
+        t->refresh = FALSE;
+        t->missingCount = 0;
+        t->resends++;
+    } else if (t->missingCount > 0) {
+        message[0] = SCREEN_OP_RESEND;
+        memcpy(message + 1, t->missing, t->missingCount);
+        FlowSendFrame(&t->sim->hostFlow, FRAME_SCREEN, message, 1 + t->missingCount);
+        t->missingCount = 0;
+        t->resends++;
+    }
+}
+
+/* Stream until one more pass over the screen is complete. The Amiga
+   writes with DoIO(), so its scanning and the line take turns */
+static BOOL ScRunFrame(ScreenSim *t)
+{
+    ScreenStreamStats before;
+    ScreenStreamStats after;
+    ULONG target;
+
+    GetScreenStreamStats(&before, FALSE);
+    target = before.frames + 1;
+    do {
+        GetScreenStreamStats(&before, FALSE);
+        if (SendScreenUpdate(SCREEN_UPDATE_BUDGET) < 0)
+            return FALSE;
+        GetScreenStreamStats(&after, FALSE);
+        while (t->sim->link.line[SIM_AMIGA].wireCount > 0)
+            FbAdvance(t->sim, QUANTUM);
+        FbAdvance(t->sim, (after.tilesScanned - before.tilesScanned) * SC_DEPTH *
+                          SCREEN_TILE_ROWS * SC_COMPARE_LONG +
+                          (after.planesSent - before.planesSent) * SC_ENCODE_PLANE);
+        ScHostService(t);
+    } while (after.frames < target);
+    return TRUE;
+}
+
+static ULONG ScWrongTiles(ScreenSim *t)
+{
+    ULONG wrong = 0;
+    ULONG x;
+    ULONG y;
+    ULONG r;
+    int p;
+
+    for (y = 0; y < SC_HEIGHT; y += SCREEN_TILE_ROWS) {
+        for (x = 0; x < SC_ROW_BYTES; x += SCREEN_TILE_BYTES) {
+            BOOL same = TRUE;
+
+            for (p = 0; p < SC_DEPTH && same; p++)
+                for (r = y; r < y + SCREEN_TILE_ROWS && same; r++)
+                    same = (BOOL)(memcmp(&t->screen[p][r * SC_ROW_BYTES + x],
+                                         &t->host[p][r * SC_ROW_BYTES + x], SCREEN_TILE_BYTES) == 0);
+            if (!same)
+                wrong++;
+        }
+    }
+    return wrong;
+}
+
+static void ScreenBench(ULONG baud, int scene, ScreenBenchResult *result)
+{
+    static FileSim s;
+    static ScreenSim t;
+    ScreenSource source;
+    ScreenStreamStats stats;
+    SimTime start;
+    ULONG f;
+    int p;
+
+    memset(result, 0, sizeof(*result));
+    memset(&s, 0, sizeof(s));
+    memset(&t, 0, sizeof(t));
+    t.sim = &s;
+    t.random = Seed;
+    ScDesktop(&t);
+
+    memset(&source, 0, sizeof(source));
+    for (p = 0; p < SC_DEPTH; p++)
+        source.planes[p] = t.screen[p];
+    source.bytesPerRow = SC_ROW_BYTES;
+    source.width = SC_WIDTH;
+    source.height = SC_HEIGHT;
+    source.depth = SC_DEPTH;
+    source.colors = 1 << SC_DEPTH;
+
+    /* Behind the file client, as in the example app */
+    if (!FbStart(&s, baud))
+        return;
+    s.hostFlow.frameHandler = ScHostFrame;
+    s.hostFlow.frameHandlerData = &t;
+    if (ScreenShadowSize(&source) > sizeof(t.shadow) ||
+        !InitScreenStream(&s.amigaFlow, FbPoll, &s, &source, t.shadow)) {
+        CleanupRemoteFiles();
+        SimFree(&s.link);
+        return;
+    }
+
+    result->ok = TRUE;
+    start = s.link.now;
+    if (!ScRunFrame(&t))
+        result->ok = FALSE;
+    result->firstTime = s.link.now - start;
+    GetScreenStreamStats(&stats, TRUE);
+    result->firstBytes = stats.lastFrameBytes;
+    if (ScWrongTiles(&t) != 0)
+        result->ok = FALSE;
+
+    if (scene == SC_NOISY)
+        s.link.line[SIM_AMIGA].config.bitErrorPpm = SC_NOISE_PPM;
+    start = s.link.now;
+    for (f = 0; f < SC_FRAMES && result->ok; f++) {
+        ScChange(&t, scene, f);
+        if (!ScRunFrame(&t))
+            result->ok = FALSE;
+    }
+    result->elapsed = s.link.now - start;
+    GetScreenStreamStats(&result->stats, FALSE);
+    result->bytes = result->stats.bytesSent;
+
+    /* A clean line again: what was lost must have been sent again
+       within two passes */
+    if (scene == SC_NOISY) {
+        s.link.line[SIM_AMIGA].config.bitErrorPpm = 0;
+        for (f = 0; f < 2; f++)
+            ScRunFrame(&t);
+        GetScreenStreamStats(&result->stats, FALSE);
+    }
+    result->wrongTiles = ScWrongTiles(&t);
+    result->lost = t.lost;
+    if (result->wrongTiles || t.badRecords)
+        result->ok = FALSE;
+
+    CleanupScreenStream();
+    CleanupRemoteFiles();
+    SimFree(&s.link);
+}
+
+static void BenchScreen(void)
+{
+    static const char *Names[] = {
+        "idle", "typing", "clock", "scroll", "window drag", "every pixel", "typing, noisy"
+    };
+    static const ULONG ScreenRates[] = { 9600, 38400, 115200 };
+    ScreenBenchResult r;
+    ULONG i;
+    int scene;
+
+    printf("Screen streaming, %dx%dx%d (%lu bytes raw), %dx%d tiles, %lu us per longword compared,\n"
+           "%lu us per plane encoded, %lu byte updates; noisy line %lu bit errors per million\n",
+           SC_WIDTH, SC_HEIGHT, SC_DEPTH, (unsigned long)SC_RAW_FRAME,
+           SCREEN_TILE_BYTES * 8, SCREEN_TILE_ROWS, (unsigned long)(SC_COMPARE_LONG / SIM_US(1)),
+           (unsigned long)(SC_ENCODE_PLANE / SIM_US(1)), (unsigned long)SCREEN_UPDATE_BUDGET,
+           (unsigned long)SC_NOISE_PPM);
+    printf("%-14s %6s | %7s %6s | %8s %7s %6s | %5s %5s %4s %4s %4s | %4s %5s\n", "scene", "baud",
+           "first B", "s", "B/frame", "frame/s", "raw s", "tiles", "xor", "rle", "raw", "lost",
+           "again", "wrong");
+    for (i = 0; i < sizeof(ScreenRates) / sizeof(ScreenRates[0]); i++) {
+        for (scene = SC_IDLE; scene <= SC_NOISY; scene++) {
+            ScreenBench(ScreenRates[i], scene, &r);
+            printf("%-14s %6lu | %7lu %6.2f | %8lu %7.2f %6.1f | %5lu %5lu %4lu %4lu %4lu | %4lu %5lu%s\n",
+                   Names[scene], (unsigned long)ScreenRates[i],
+                   (unsigned long)r.firstBytes, r.firstTime / 1e9,
+                   (unsigned long)(r.bytes / SC_FRAMES),
+                   r.elapsed ? SC_FRAMES * 1e9 / r.elapsed : 0.0,
+                   SC_RAW_FRAME * 10.0 / ScreenRates[i],
+                   (unsigned long)(r.stats.tilesSent / SC_FRAMES),
+                   (unsigned long)r.stats.xorPlanes, (unsigned long)r.stats.rlePlanes,
+                   (unsigned long)r.stats.rawPlanes, (unsigned long)r.lost,
+                   (unsigned long)r.stats.tilesResent, (unsigned long)r.wrongTiles,
+                   r.ok ? "" : "  FAILED");
+        }
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *which = (argc > 1) ? argv[1] : "all";
+    BOOL all = (BOOL)(strcmp(which, "all") == 0);
+
+    if (argc > 2)
+        Seed = (ULONG)strtoul(argv[2], NULL, 0);
+
+    printf("Simulated link benchmarks (seed %lu)\n\n", (unsigned long)Seed);
+
+    if (all || strcmp(which, "latency") == 0)
+        BenchLatency();
+    if (all || strcmp(which, "overrun") == 0)
+        BenchOverrun();
+    if (all || strcmp(which, "errors") == 0)
+        BenchErrors();
+    if (all || strcmp(which, "mismatch") == 0)
+        BenchMismatch();
+    if (all || strcmp(which, "files") == 0)
+        BenchFiles();
+    if (all || strcmp(which, "sync") == 0)
+        BenchSync();
+    if (all || strcmp(which, "screen") == 0)
+        BenchScreen();
+
+    return 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * Amiga Packet Communication Framework - Simulated Serial Link
+ * Event model: every character written gets an arrival time from the
+ * transmitter's baud rate and gaps, and is moved into the receiver's
+ * buffer when the virtual clock passes that time. Faults are decided at
+ * transmit time from a seeded generator, so a run is reproducible.
+ */
+
+#include <stdlib.h>
+
+#include "sim_link.h"
+
+/* xorshift32; deterministic across hosts */
+static ULONG NextRandom(SimLink *link)
+{
+    ULONG x = link->seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    link->seed = x;
+    return x;
+}
+
+/* TRUE with probability ppm / 1000000 */
+static BOOL Chance(SimLink *link, ULONG ppm)
+{
+    return (BOOL)(ppm != 0 && NextRandom(link) % 1000000 < ppm);
+}
+
+void SimDefaultConfig(SimLineConfig *config, ULONG baud)
+{
+    config->baud = baud;
+    config->rxBaud = 0;
+    config->bitsPerChar = 10;
+    config->gapNs = 0;
+    config->gapJitterNs = 0;
+    config->rxBufferSize = 2048;
+    config->bitErrorPpm = 0;
+    config->dropPpm = 0;
+    config->breakPpm = 0;
+    config->breakChars = 4;
+}
+
+static BOOL InitLine(SimLine *line, const SimLineConfig *config)
+{
+    line->config = *config;
+    line->charTime = (SimTime)config->bitsPerChar * 1000000000ULL / config->baud;
+    line->lineFree = 0;
+    line->breakLeft = 0;
+    line->breakSeen = FALSE;
+
+    line->stats.sent = 0;
+    line->stats.received = 0;
+    line->stats.read = 0;
+    line->stats.overruns = 0;
+    line->stats.bitErrors = 0;
+    line->stats.framingErrors = 0;
+    line->stats.dropped = 0;
+    line->stats.breaks = 0;
+
+    line->wire = (SimChar *)malloc(sizeof(SimChar) * SIM_WIRE_QUEUE);
+    line->wireHead = 0;
+    line->wireTail = 0;
+    line->wireCount = 0;
+
+    line->rx = (UBYTE *)malloc(config->rxBufferSize);
+    line->rxHead = 0;
+    line->rxTail = 0;
+    line->rxCount = 0;
+
+    return (BOOL)(line->wire && line->rx);
+}
+
+BOOL SimInit(SimLink *link, const SimLineConfig *amigaToHost,
+             const SimLineConfig *hostToAmiga, ULONG seed)
+{
+    link->now = 0;
+    link->seed = seed ? seed : 1;
+
+    if (!InitLine(&link->line[SIM_AMIGA], amigaToHost) ||
+        !InitLine(&link->line[SIM_HOST], hostToAmiga)) {
+        SimFree(link);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void SimFree(SimLink *link)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        free(link->line[i].wire);
+        free(link->line[i].rx);
+        link->line[i].wire = NULL;
+        link->line[i].rx = NULL;
+    }
+}
+
+/* Move characters that have arrived by now into the receive buffer */
+static void Deliver(SimLine *line, SimTime now)
+{
+    SimChar *ch;
+
+    while (line->wireCount > 0) {
+        ch = &line->wire[line->wireTail];
+        if (ch->arrival > now)
+            break;
+
+        line->wireTail = (line->wireTail + 1) % SIM_WIRE_QUEUE;
+        line->wireCount--;
+
+        if (ch->fate != SIM_CHAR_OK) {
+            if (ch->fate == SIM_CHAR_BREAK)
+                line->breakSeen = TRUE;
+            continue;
+        }
+
+        if (line->rxCount >= line->config.rxBufferSize) {
+            line->stats.overruns++;
+            continue;
+        }
+
+        line->rx[line->rxHead] = ch->data;
+        line->rxHead = (line->rxHead + 1) % line->config.rxBufferSize;
+        line->rxCount++;
+        line->stats.received++;
+    }
+}
+
+void SimAdvance(SimLink *link, SimTime delta)
+{
+    link->now += delta;
+    Deliver(&link->line[0], link->now);
+    Deliver(&link->line[1], link->now);
+}
+
+/*
+ * Receiver sampling drift: the receiver resyncs on each start bit and
+ * samples wire bit n at (n + 0.5) of its own bit times, so a rate error
+ * r moves that point r * (n + 0.5) bits. With 16x oversampling the
+ * start edge is only known to 1/16 bit, leaving 7/16 bit of margin.
+ * Data bits past it come out random; a missed stop bit is a framing
+ * error.
+ */
+static BOOL Misses(ULONG diff, ULONG rx, int n)
+{
+    /* diff / rx * (n + 0.5) >= 7 / 16, in integers */
+    return (BOOL)((ULONG)diff * (2 * n + 1) * 8 >= 7 * rx);
+}
+
+static UBYTE ApplyBaudMismatch(SimLink *link, SimLine *line, UBYTE c, BOOL *garbled)
+{
+    ULONG rx = line->config.rxBaud;
+    ULONG tx = line->config.baud;
+    ULONG diff;
+    int bit;
+
+    *garbled = FALSE;
+    if (rx == 0 || rx == tx)
+        return c;
+
+    diff = (rx > tx) ? rx - tx : tx - rx;
+
+    /* Data bit b is wire bit b + 1, after the start bit */
+    for (bit = 0; bit < 8; bit++) {
+        if (Misses(diff, rx, bit + 1)) {
+            c = (UBYTE)((c & ~(1 << bit)) | ((NextRandom(link) & 1) << bit));
+            *garbled = TRUE;
+        }
+    }
+    if (Misses(diff, rx, line->config.bitsPerChar - 1))
+        *garbled = TRUE;
+
+    return c;
+}
+
+SimTime SimWrite(SimLink *link, int end, const UBYTE *data, ULONG length, BOOL wait)
+{
+    SimLine *line = &link->line[end];
+    SimChar *ch;
+    SimTime start;
+    SimTime arrival = link->now;
+    BOOL garbled;
+    ULONG i;
+    int bit;
+
+    for (i = 0; i < length; i++) {
+        /* Transmitter FIFO full: a real write would block here */
+        if (line->wireCount >= SIM_WIRE_QUEUE)
+            SimAdvance(link, line->wire[line->wireTail].arrival - link->now);
+
+        start = (line->lineFree > link->now) ? line->lineFree : link->now;
+        arrival = start + line->charTime;
+        line->lineFree = arrival + line->config.gapNs;
+        if (line->config.gapJitterNs)
+            line->lineFree += NextRandom(link) % (line->config.gapJitterNs + 1);
+
+        ch = &line->wire[line->wireHead];
+        line->wireHead = (line->wireHead + 1) % SIM_WIRE_QUEUE;
+        line->wireCount++;
+        line->stats.sent++;
+
+        ch->arrival = arrival;
+        ch->data = data[i];
+        ch->fate = SIM_CHAR_OK;
+
+        if (line->breakLeft > 0) {
+            line->breakLeft--;
+            ch->fate = SIM_CHAR_LOST;
+            continue;
+        }
+        if (Chance(link, line->config.breakPpm)) {
+            line->stats.breaks++;
+            line->breakLeft = line->config.breakChars ? line->config.breakChars - 1 : 0;
+            ch->fate = SIM_CHAR_BREAK;
+            continue;
+        }
+        if (Chance(link, line->config.dropPpm)) {
+            line->stats.dropped++;
+            ch->fate = SIM_CHAR_LOST;
+            continue;
+        }
+
+        for (bit = 0; bit < 8; bit++) {
+            if (Chance(link, line->config.bitErrorPpm)) {
+                ch->data ^= (UBYTE)(1 << bit);
+                line->stats.bitErrors++;
+            }
+        }
+
+        ch->data = ApplyBaudMismatch(link, line, ch->data, &garbled);
+        if (garbled)
+            line->stats.framingErrors++;
+    }
+
+    if (wait && arrival > link->now)
+        SimAdvance(link, arrival - link->now);
+
+    return arrival;
+}
+
+ULONG SimQuery(SimLink *link, int end)
+{
+    return link->line[1 - end].rxCount;
+}
+
+ULONG SimRead(SimLink *link, int end, UBYTE *buffer, ULONG maxLength)
+{
+    SimLine *line = &link->line[1 - end];
+    ULONG count = 0;
+
+    while (count < maxLength && line->rxCount > 0) {
+        buffer[count++] = line->rx[line->rxTail];
+        line->rxTail = (line->rxTail + 1) % line->config.rxBufferSize;
+        line->rxCount--;
+    }
+
+    line->stats.read += count;
+    return count;
+}
+
+BOOL SimTakeBreak(SimLink *link, int end)
+{
+    SimLine *line = &link->line[1 - end];
+    BOOL seen = line->breakSeen;
+
+    line->breakSeen = FALSE;
+    return seen;
+}
+
+void SimWaitInput(SimLink *link, int end, SimTime limit)
+{
+    SimLine *line = &link->line[1 - end];
+    SimTime next;
+
+    if (line->rxCount > 0)
+        return;
+
+    if (line->wireCount == 0) {
+        SimAdvance(link, limit);
+        return;
+    }
+
+    next = line->wire[line->wireTail].arrival;
+    if (next <= link->now)
+        next = link->now;
+    SimAdvance(link, (next - link->now < limit) ? next - link->now : limit);
+}
+
+void SimGetStats(SimLink *link, int end, SimLineStats *stats)
+{
+    *stats = link->line[end].stats;
+}
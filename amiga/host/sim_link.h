@@ -0,0 +1,149 @@
+/*
+ * Amiga Packet Communication Framework - Simulated Serial Link
+ * In-process model of the Amiga <-> MAX3232 <-> Pico cable for host
+ * benchmarks. Each direction is clocked at its baud rate on a virtual
+ * clock, delivers into a finite receive buffer that overruns like
+ * serial.device's, and can inject bit errors, dropped characters, line
+ * breaks and receiver baud mismatch. Runs are deterministic for a given
+ * seed and take no real time.
+ */
+
+#ifndef SIM_LINK_H
+#define SIM_LINK_H
+
+#include <exec/types.h>
+
+/* Virtual time in nanoseconds */
+typedef unsigned long long SimTime;
+
+#define SIM_US(n)   ((SimTime)(n) * 1000ULL)
+#define SIM_MS(n)   ((SimTime)(n) * 1000000ULL)
+#define SIM_TICK    SIM_MS(20)          /* One Delay(1) on a PAL Amiga */
+
+/* The two ends of the link */
+#define SIM_AMIGA 0
+#define SIM_HOST  1
+
+/* Characters that may be queued on one direction of the wire */
+#define SIM_WIRE_QUEUE 65536
+
+/* One direction of the cable, as seen from its transmitter */
+typedef struct {
+    ULONG baud;             /* Transmitter rate */
+    ULONG rxBaud;           /* Receiver rate, 0 = same as baud */
+    UWORD bitsPerChar;      /* Start + data + parity + stop, 10 for 8N1 */
+    ULONG gapNs;            /* Idle time between characters */
+    ULONG gapJitterNs;      /* Random extra idle time, 0..gapJitterNs */
+    ULONG rxBufferSize;     /* Receiver buffer (io_RBufLen on the Amiga) */
+    ULONG bitErrorPpm;      /* Chance per data bit of being flipped */
+    ULONG dropPpm;          /* Chance per character of being lost */
+    ULONG breakPpm;         /* Chance per character of a line break */
+    ULONG breakChars;       /* Characters lost to each break */
+} SimLineConfig;
+
+/* Counters for one direction */
+typedef struct {
+    ULONG sent;             /* Characters written by the transmitter */
+    ULONG received;         /* Characters stored in the receive buffer */
+    ULONG read;             /* Characters taken out by the application */
+    ULONG overruns;         /* Characters lost to a full receive buffer */
+    ULONG bitErrors;        /* Bits flipped by noise */
+    ULONG framingErrors;    /* Characters garbled by baud mismatch */
+    ULONG dropped;          /* Characters lost on the wire */
+    ULONG breaks;           /* Line breaks */
+} SimLineStats;
+
+/* Character in flight */
+typedef struct {
+    SimTime arrival;
+    UBYTE data;
+    UBYTE fate;             /* SIM_CHAR_... */
+} SimChar;
+
+#define SIM_CHAR_OK    0
+#define SIM_CHAR_LOST  1
+#define SIM_CHAR_BREAK 2    /* Lost, and starts a break */
+
+typedef struct {
+    SimLineConfig config;
+    SimLineStats stats;
+    SimTime charTime;       /* Wire time of one character */
+    SimTime lineFree;       /* When the transmitter can start the next character */
+    ULONG breakLeft;        /* Characters still swallowed by a break */
+    BOOL breakSeen;         /* Break not yet reported to the receiver */
+
+    SimChar *wire;          /* FIFO of characters in flight */
+    ULONG wireHead;
+    ULONG wireTail;
+    ULONG wireCount;
+
+    UBYTE *rx;              /* Receiver buffer ring */
+    ULONG rxHead;
+    ULONG rxTail;
+    ULONG rxCount;
+} SimLine;
+
+typedef struct {
+    SimTime now;
+    ULONG seed;
+    SimLine line[2];        /* line[end] carries data sent by that end */
+} SimLink;
+
+/**
+ * Set up a link; bytes written at SIM_AMIGA travel over amigaToHost
+ * @param seed - fault injection seed; equal seeds give identical runs
+ * Returns FALSE if the buffers could not be allocated
+ */
+BOOL SimInit(SimLink *link, const SimLineConfig *amigaToHost,
+             const SimLineConfig *hostToAmiga, ULONG seed);
+
+/**
+ * Free the link's buffers
+ */
+void SimFree(SimLink *link);
+
+/**
+ * Default line: given baud, 8N1, 2048-byte receive buffer, no faults
+ */
+void SimDefaultConfig(SimLineConfig *config, ULONG baud);
+
+/**
+ * Queue bytes for transmission from one end
+ * @param wait - TRUE to advance the clock until the last byte is on the
+ *               wire, like DoIO(CMD_WRITE); FALSE for SendIO()
+ * Returns the time the last byte arrives at the other end
+ */
+SimTime SimWrite(SimLink *link, int end, const UBYTE *data, ULONG length, BOOL wait);
+
+/**
+ * Bytes waiting in an end's receive buffer (SDCMD_QUERY)
+ */
+ULONG SimQuery(SimLink *link, int end);
+
+/**
+ * Take up to maxLength bytes from an end's receive buffer (CMD_READ)
+ */
+ULONG SimRead(SimLink *link, int end, UBYTE *buffer, ULONG maxLength);
+
+/**
+ * Returns TRUE once for each break seen by an end's receiver
+ */
+BOOL SimTakeBreak(SimLink *link, int end);
+
+/**
+ * Advance the virtual clock, delivering characters in both directions
+ */
+void SimAdvance(SimLink *link, SimTime delta);
+
+/**
+ * Advance to the next character arrival at an end, or by at most limit;
+ * models a task sleeping on the read signal with a timeout
+ */
+void SimWaitInput(SimLink *link, int end, SimTime limit);
+
+/**
+ * Copy out the counters for data sent by an end
+ */
+void SimGetStats(SimLink *link, int end, SimLineStats *stats);
+
+#endif /* SIM_LINK_H */
@@ -0,0 +1,80 @@
+# file: bench_compare.py
+"""
+Compare two runs of the framework microbenchmarks (packet_bench, built
+for the host by amiga/host/Makefile or for the Amiga by the Smakefile).
+
+Each run is the result lines the benchmark writes:
+    BENCHINFO platform=host kernels=68000 ms=1000 recorded=...
+    BENCH dispatch.synthetic ops=... ns/op=... bytes/s=... alloc=...
+
+    ./packet_bench -r ../example/bench_session.txt -o before.txt
+    ./packet_bench -r ../example/bench_session.txt -o after.txt
+    python bench_compare.py before.txt after.txt --threshold 5
+"""
+import sys
+import argparse
+
+
+def parse_results(path):
+    """Returns (info dict, {name: metrics dict}) from a results file"""
+    info = {}
+    results = {}
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if not fields:
+                continue
+            if fields[0] == "BENCHINFO":
+                info = dict(field.split("=", 1) for field in fields[1:])
+            elif fields[0] == "BENCH" and len(fields) > 2:
+                metrics = {}
+                for field in fields[2:]:
+                    key, _, value = field.partition("=")
+                    metrics[key] = int(value)
+                results[fields[1]] = metrics
+    return info, results
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare two packet_bench result files")
+    parser.add_argument("before", help="Baseline results")
+    parser.add_argument("after", help="New results")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="Percent change in ns/op reported as a difference (default: 5)")
+    args = parser.parse_args()
+
+    before_info, before = parse_results(args.before)
+    after_info, after = parse_results(args.after)
+
+    for key in ("platform", "kernels"):
+        if before_info.get(key) != after_info.get(key):
+            print(f"Warning: {key} differs ({before_info.get(key)} vs {after_info.get(key)})")
+
+    print(f"{'benchmark':<22} {'before ns/op':>12} {'after ns/op':>12} {'change':>8}  note")
+    regressions = 0
+    for name in before:
+        if name not in after:
+            print(f"{name:<22} {before[name]['ns/op']:>12} {'-':>12} {'':>8}  missing")
+            continue
+        old = before[name]["ns/op"]
+        new = after[name]["ns/op"]
+        change = (new - old) * 100.0 / old if old else 0.0
+        notes = []
+        if change > args.threshold:
+            notes.append("slower")
+            regressions += 1
+        elif change < -args.threshold:
+            notes.append("faster")
+        if after[name].get("alloc", 0) > before[name].get("alloc", 0):
+            notes.append(f"alloc {before[name].get('alloc', 0)} -> {after[name]['alloc']}")
+        print(f"{name:<22} {old:>12} {new:>12} {change:>+7.1f}%  {', '.join(notes)}")
+
+    for name in after:
+        if name not in before:
+            print(f"{name:<22} {'-':>12} {after[name]['ns/op']:>12} {'':>8}  new")
+
+    sys.exit(1 if regressions else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,126 @@
+# file: ber_test.py
+"""
+Host side of the PRBS bit-error-rate sweep.
+
+Runs the same generator, checker and table as the Pico's test mode 4
+(pico/prbs.py) over a host serial port with a loopback plug, or over a
+built-in pty loopback that can inject faults to validate the checker:
+
+    python ber_test.py -p /dev/ttyUSB0 --order 15 --bits 200000
+    python ber_test.py --pty --inject-ber 1e-4 --drop-rate 1e-4
+"""
+import os
+import sys
+import random
+import argparse
+import threading
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "pico"))
+import prbs
+
+
+class PtyLoopback:
+    """Echoes everything written to a pty back to it, optionally damaged"""
+
+    def __init__(self, bit_error_rate=0.0, drop_rate=0.0, seed=1):
+        self.master, self.slave = os.openpty()
+        self.name = os.ttyname(self.slave)
+        self.bit_error_rate = bit_error_rate
+        self.drop_rate = drop_rate
+        self.random = random.Random(seed)
+        self.flipped = 0
+        self.dropped = 0
+        self.running = True
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+
+    def _damage(self, data):
+        out = bytearray()
+        for byte in data:
+            if self.drop_rate and self.random.random() < self.drop_rate:
+                self.dropped += 1
+                continue
+            if self.bit_error_rate:
+                for bit in range(8):
+                    if self.random.random() < self.bit_error_rate:
+                        byte ^= 1 << bit
+                        self.flipped += 1
+            out.append(byte)
+        return bytes(out)
+
+    def _run(self):
+        while self.running:
+            try:
+                data = os.read(self.master, 4096)
+            except OSError:
+                break
+            if data:
+                os.write(self.master, self._damage(data))
+
+    def close(self):
+        self.running = False
+        os.close(self.slave)
+        os.close(self.master)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="PRBS bit-error-rate sweep over a serial loopback")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port with a loopback (default: COM6)")
+    parser.add_argument("--pty", action="store_true", help="Use a built-in pty loopback instead of a port")
+    parser.add_argument("--order", type=int, choices=(7, 15), default=7, help="PRBS-7 or PRBS-15 (default: 7)")
+    parser.add_argument("--bits", type=int, default=100000, help="Bits per rate (default: 100000)")
+    parser.add_argument("--rates", type=str, default=None,
+                        help="Comma-separated rates (default: 1200..115200)")
+    parser.add_argument("--inject-ber", type=float, default=0.0, help="pty only: bit flip probability")
+    parser.add_argument("--drop-rate", type=float, default=0.0, help="pty only: byte drop probability")
+    args = parser.parse_args()
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    rates = prbs.SWEEP_RATES
+    if args.rates:
+        rates = [int(r) for r in args.rates.split(",")]
+
+    loopback = None
+    port = args.port
+    if args.pty:
+        loopback = PtyLoopback(args.inject_ber, args.drop_rate)
+        port = loopback.name
+
+    print(f"PRBS-{args.order} BER sweep on {port}, {args.bits} bits per rate")
+    rows = []
+    try:
+        for baud in rates:
+            ser = serial.Serial(port, baudrate=baud, timeout=0,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+            ser.reset_input_buffer()
+
+            def read_waiting():
+                return ser.read(ser.in_waiting) if ser.in_waiting else None
+
+            result = prbs.run_ber_test(ser.write, read_waiting, args.bits, args.order)
+            ser.close()
+            rows.append((baud, result))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if loopback:
+            loopback.close()
+
+    print()
+    for line in prbs.format_ber_table(rows):
+        print(line)
+
+    if loopback and rows:
+        bits = sum(result["sent"] for _, result in rows) * 8
+        print(f"\nInjected: {loopback.flipped} bit flips ({prbs.format_ber(loopback.flipped, bits)}), "
+              f"{loopback.dropped} bytes dropped")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,225 @@
+# file: clock_sync.py
+"""
+Clock-offset and drift estimation between the Amiga's EClock and the
+host's monotonic clock, NTP style (Amiga side: amiga_packet_clock.c).
+
+Each probe is one round trip:
+    host  t1  "TSYNC <seq> <t1>"
+    Amiga t2  line read,  t3  reply started (EClock, hex)
+    host  t4  "TSYNC <seq> <t1> <t2> <t3> <frequency>" received
+
+offset = ((t2 - t1) + (t3 - t4)) / 2 and delay = (t4 - t1) - (t3 - t2),
+after taking out the time the two lines spend being shifted out at the
+line rate. Probes that were held up (queueing, USB latency, the Amiga's
+1/50 s polling) only ever add delay, so the fit uses the probes with the
+smallest delay: a straight line through their offsets gives the offset
+and the drift of the EClock against the host clock. Without the serial
+I/O task the Amiga polls once per tick, so a line waits up to 20 ms to
+be read; a few hundred probes bring the lowest of those waits well under
+a millisecond. With the example app's TASK mode the wait is gone.
+
+With --save the model is written as JSON; ClockModel.load() and
+amiga_to_host() then put Amiga EClock stamps on the host's
+time.monotonic() timeline (see serial_listener.py --monotonic).
+
+    python clock_sync.py -p /dev/ttyUSB0 -b 115200 --save clock.json
+"""
+import sys
+import json
+import time
+import random
+import argparse
+
+BITS_PER_CHAR = 10          # 8N1
+
+
+class ClockModel:
+    """Linear map between Amiga EClock seconds and host monotonic seconds"""
+
+    def __init__(self, frequency, offset, drift, reference, rms=0.0, probes=0):
+        self.frequency = frequency      # EClock ticks per second (nominal)
+        self.offset = offset            # Amiga - host seconds at reference
+        self.drift = drift              # d(offset)/d(host time), e.g. 50e-6
+        self.reference = reference      # host monotonic seconds
+        self.rms = rms                  # residual of the fitted probes, seconds
+        self.probes = probes
+
+    def offset_at(self, host_time):
+        return self.offset + self.drift * (host_time - self.reference)
+
+    def amiga_to_host(self, ticks):
+        """EClock count -> host time.monotonic() seconds"""
+        amiga = ticks / self.frequency
+        return (amiga - self.offset + self.drift * self.reference) / (1 + self.drift)
+
+    def host_to_amiga(self, host_time):
+        """host time.monotonic() seconds -> EClock count"""
+        return round((host_time + self.offset_at(host_time)) * self.frequency)
+
+    def save(self, path):
+        with open(path, "w") as f:
+            json.dump(self.__dict__, f, indent=2)
+
+    @classmethod
+    def load(cls, path):
+        with open(path) as f:
+            return cls(**json.load(f))
+
+
+class Probe:
+    """One timed round trip, all times in seconds"""
+
+    def __init__(self, t1, t2, t3, t4, up_wire, down_wire):
+        self.t1, self.t2, self.t3, self.t4 = t1, t2, t3, t4
+        self.up_wire = up_wire          # request serialization time
+        self.down_wire = down_wire      # reply serialization time
+        self.offset = ((t2 - t1 - up_wire) + (t3 - t4 + down_wire)) / 2
+        self.delay = (t4 - t1) - (t3 - t2) - up_wire - down_wire
+        self.midpoint = (t1 + t4) / 2
+
+
+def fit_line(points):
+    """Least-squares y = a + b (x - x0); returns (x0, a, b, rms)"""
+    n = len(points)
+    x0 = sum(x for x, _ in points) / n
+    y0 = sum(y for _, y in points) / n
+    sxx = sum((x - x0) ** 2 for x, _ in points)
+    sxy = sum((x - x0) * (y - y0) for x, y in points)
+    b = sxy / sxx if sxx > 0 else 0.0
+    rms = (sum((y - y0 - b * (x - x0)) ** 2 for x, y in points) / n) ** 0.5
+    return x0, y0, b, rms
+
+
+def estimate(probes, frequency, keep=0.1, minimum=8):
+    """Fit offset and drift through the lowest-delay fraction of the probes"""
+    ranked = sorted(probes, key=lambda p: p.delay)
+    chosen = ranked[:max(minimum, int(len(ranked) * keep))]
+    x0, offset, drift, rms = fit_line([(p.midpoint, p.offset) for p in chosen])
+    return ClockModel(frequency, offset, drift, x0, rms, len(chosen))
+
+
+class ClockSync:
+    """Runs TSYNC probes on an open pyserial port"""
+
+    def __init__(self, ser, verbose=False):
+        self.ser = ser
+        self.verbose = verbose
+        self.frequency = None
+        self.buffer = bytearray()
+        self.stamp = None
+        self.sequence = 0
+
+    def _read_line(self, timeout):
+        """Next line and the host time its last byte was read, or (None, None)"""
+        deadline = time.monotonic() + timeout
+        while True:
+            if b"\n" in self.buffer:
+                line, _, rest = bytes(self.buffer).partition(b"\n")
+                self.buffer = bytearray(rest)
+                return line.rstrip(b"\r"), self.stamp
+            if time.monotonic() > deadline:
+                return None, None
+            data = self.ser.read(max(1, self.ser.in_waiting))
+            if data:
+                self.stamp = time.monotonic()
+                self.buffer += data
+
+    def probe(self, timeout=1.0):
+        """One round trip; returns a Probe or None if the reply was lost"""
+        self.sequence += 1
+        t1 = time.monotonic()
+        request = f"TSYNC {self.sequence} {t1:.9f}\r\n".encode("ascii")
+        self.ser.write(request)
+
+        while True:
+            line, t4 = self._read_line(timeout)
+            if line is None:
+                return None
+            fields = line.decode("ascii", "replace").split()
+            if len(fields) == 6 and fields[0] == "TSYNC" and fields[1] == str(self.sequence):
+                break
+            if self.verbose and line:
+                print(line.decode("ascii", "replace"))
+
+        frequency = int(fields[5])
+        if frequency == 0:
+            raise RuntimeError("Amiga has no EClock (timer.device not open)")
+        self.frequency = frequency
+
+        baud = self.ser.baudrate
+        return Probe(t1, int(fields[3], 16) / frequency, int(fields[4], 16) / frequency, t4,
+                     len(request) * BITS_PER_CHAR / baud,
+                     (len(line) + 2) * BITS_PER_CHAR / baud)
+
+    def run(self, count, interval):
+        """count probes, spaced randomly so they do not lock to the Amiga's tick"""
+        probes = []
+        for _ in range(count):
+            p = self.probe()
+            if p:
+                probes.append(p)
+            time.sleep(interval * random.uniform(0.5, 1.5))
+        return probes
+
+
+def report(model, probes):
+    """Offset, drift and per-direction one-way delays under the model"""
+    print(f"EClock frequency: {model.frequency} Hz")
+    print(f"Offset (Amiga - host): {model.offset:.6f} s at host {model.reference:.3f}")
+    print(f"Drift: {model.drift * 1e6:+.2f} ppm")
+    print(f"Fit residual: {model.rms * 1e6:.1f} us RMS over {model.probes} of {len(probes)} probes")
+
+    # Wire time excluded. The minimum delays are split evenly by
+    # construction; the excess above them shows which direction queues
+    up = sorted(p.t2 - model.offset_at(p.t1) - p.t1 - p.up_wire for p in probes)
+    down = sorted(p.t4 - (p.t3 - model.offset_at(p.t4)) - p.down_wire for p in probes)
+    for name, values in (("host->Amiga", up), ("Amiga->host", down)):
+        print(f"{name}: min {values[0] * 1e3:.3f} ms  median {values[len(values) // 2] * 1e3:.3f} ms"
+              f"  max {values[-1] * 1e3:.3f} ms")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Estimate the Amiga's EClock offset and drift")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=9600, help="Baud rate (default: 9600)")
+    parser.add_argument("-n", "--probes", type=int, default=300, help="Number of probes (default: 300)")
+    parser.add_argument("-i", "--interval", type=float, default=0.05,
+                        help="Mean seconds between probes (default: 0.05)")
+    parser.add_argument("--keep", type=float, default=0.1,
+                        help="Fraction of lowest-delay probes fitted (default: 0.1)")
+    parser.add_argument("--save", type=str, default=None, help="Write the clock model to a JSON file")
+    parser.add_argument("-v", "--verbose", action="store_true", help="Print other lines received")
+    args = parser.parse_args()
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    ser = serial.serial_for_url(args.port, baudrate=args.baud, timeout=0.01,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+    try:
+        sync = ClockSync(ser, args.verbose)
+        print(f"Probing {args.port} at {args.baud} baud ({args.probes} probes)")
+        probes = sync.run(args.probes, args.interval)
+    except KeyboardInterrupt:
+        probes = []
+    finally:
+        ser.close()
+
+    if len(probes) < 8:
+        print(f"Error: only {len(probes)} probes answered")
+        sys.exit(1)
+
+    model = estimate(probes, sync.frequency, args.keep)
+    report(model, probes)
+
+    if args.save:
+        model.save(args.save)
+        print(f"Model saved to {args.save}")
+
+
+if __name__ == "__main__":
+    main()
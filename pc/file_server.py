@@ -0,0 +1,383 @@
+# file: file_server.py
+"""
+Serve a host directory to the Amiga's remote file access module
+(amiga_packet_file.c) over the framed, credit-controlled link.
+
+Requests and replies travel as FRAME_FILE (0x03) frames next to the
+normal command traffic. Each carries a 10-byte header:
+    op | seq | handle | status | offset(4) | length(2) | data...
+big-endian. Requests are answered strictly in order, so a READ sent
+after a WRITE sees the written data. A request the Amiga resends (op
+has 0x80 set) is answered from the reply kept for it instead of being
+done twice, so a repeated WRITE never appends twice. Sequence numbers
+wrap, so the kept reply is only used when the whole request matches;
+otherwise the first copy was lost and the request is done now.
+
+Paths are relative to --root; anything resolving outside it is refused.
+
+FSYNC (amiga_packet_sync.c) opens a file in delta mode 'd', writes one
+signature per block of its old copy (weak rsync sum, CRC-32) and sends
+DELTA; this side rolls the weak sum over the file and answers with
+COPY/LITERAL/END ops that the Amiga reads back through the handle.
+
+Start the example app with the FLOW argument, then:
+
+    python file_server.py -p COM6 --root ./share
+    python file_server.py -p COM6 --root ./share --read-only -v
+
+and on the Amiga: FGET docs/readme.txt RAM:readme.txt
+                  FSYNC s/startup-sequence S:startup-sequence
+"""
+import os
+import sys
+import time
+import struct
+import zlib
+import argparse
+
+from packet_link import FlowLink, FRAME_MAX_PAYLOAD
+
+FRAME_FILE = 0x03
+HEADER = struct.Struct(">BBBBIH")
+MAX_DATA = FRAME_MAX_PAYLOAD - HEADER.size
+
+OP_OPEN = 1
+OP_CLOSE = 2
+OP_READ = 3
+OP_WRITE = 4
+OP_STAT = 5
+OP_LIST = 6
+OP_DELTA = 7
+OP_RESEND = 0x80
+
+MODE_DELTA = "d"
+SYNC_COPY = 1
+SYNC_LITERAL = 2
+SYNC_END = 3
+
+OK = 0
+ERR_NOTFOUND = 1
+ERR_IO = 2
+ERR_HANDLE = 3
+ERR_DENIED = 4
+
+FLAG_DIRECTORY = 0x01
+LIST_END = 0xFFFFFFFF
+MAX_OPEN = 32
+
+OP_NAMES = {OP_OPEN: "OPEN", OP_CLOSE: "CLOSE", OP_READ: "READ", OP_WRITE: "WRITE",
+            OP_STAT: "STAT", OP_LIST: "LIST", OP_DELTA: "DELTA"}
+
+
+def weak_sum(data):
+    """rsync's weak checksum, as SyncWeakSum() computes it"""
+    a = b = 0
+    for x in data:
+        a += x
+        b += a
+    return ((b & 0xFFFF) << 16) | (a & 0xFFFF)
+
+
+def make_delta(data, signatures, old_length, block_size):
+    """Encode data as copies of the signed blocks plus literal bytes"""
+    count = len(signatures) // 8
+    sigs = [struct.unpack_from(">II", signatures, k * 8) for k in range(count)]
+    last_length = old_length - (count - 1) * block_size if count else 0
+    table = {}
+    for k, (weak, crc) in enumerate(sigs):
+        if k == count - 1 and last_length < block_size:
+            continue        # The short last block can only match at the end
+        table.setdefault(weak, []).append((k, crc))
+
+    out = bytearray()
+    copy = [0, 0]           # first block, count
+
+    def flush_copy():
+        if copy[1]:
+            out.extend(struct.pack(">BIH", SYNC_COPY, copy[0], copy[1]))
+            copy[1] = 0
+
+    def add_copy(k):
+        if copy[1] and copy[0] + copy[1] == k and copy[1] < 0xFFFF:
+            copy[1] += 1
+        else:
+            flush_copy()
+            copy[0], copy[1] = k, 1
+
+    def add_literal(start, end):
+        if start < end:
+            flush_copy()
+        while start < end:
+            n = min(end - start, 0xFFFF)
+            out.extend(struct.pack(">BH", SYNC_LITERAL, n))
+            out.extend(data[start:start + n])
+            start += n
+
+    n = len(data)
+    literal = i = 0
+    a = b = 0
+    if count and n >= block_size:
+        weak = weak_sum(data[:block_size])
+        a, b = weak & 0xFFFF, weak >> 16
+    while count and i + block_size <= n:
+        match = None
+        candidates = table.get((b << 16) | a)
+        if candidates:
+            crc = zlib.crc32(data[i:i + block_size])
+            match = next((k for k, c in candidates if c == crc), None)
+        if match is not None:
+            add_literal(literal, i)
+            add_copy(match)
+            i += block_size
+            literal = i
+            if i + block_size <= n:
+                weak = weak_sum(data[i:i + block_size])
+                a, b = weak & 0xFFFF, weak >> 16
+            continue
+        if i + block_size < n:
+            a = (a - data[i] + data[i + block_size]) & 0xFFFF
+            b = (b - block_size * data[i] + a) & 0xFFFF
+        i += 1
+
+    if count and last_length < block_size and n - last_length >= literal:
+        tail = data[n - last_length:]
+        if (weak_sum(tail), zlib.crc32(tail)) == sigs[-1]:
+            add_literal(literal, n - last_length)
+            add_copy(count - 1)
+            literal = n
+    add_literal(literal, n)
+    flush_copy()
+    out.extend(struct.pack(">BII", SYNC_END, n, zlib.crc32(data)))
+    return bytes(out)
+
+
+class DeltaHandle:
+    """A file opened for FSYNC: signatures in, delta stream out"""
+    mode = "delta"
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        self.signatures = bytearray()
+        self.delta = b""
+
+    def close(self):
+        pass
+
+
+class FileServer:
+    """Answers file requests against one root directory"""
+
+    def __init__(self, root, read_only=False, verbose=False):
+        self.root = os.path.realpath(root)
+        self.read_only = read_only
+        self.verbose = verbose
+        self.handles = {}
+        self.replies = {}       # seq -> (request, reply payload), for resends
+        self.requests = 0
+        self.resends = 0
+        self.bytes_read = 0
+        self.bytes_written = 0
+
+    def resolve(self, raw):
+        """Map an Amiga-style path below the root, or None if it escapes"""
+        name = raw.decode("latin-1").split(":", 1)[-1].replace("\\", "/").lstrip("/")
+        path = os.path.realpath(os.path.join(self.root, name))
+        if path != self.root and not path.startswith(self.root + os.sep):
+            return None
+        return path
+
+    def handle_frame(self, link, payload):
+        if len(payload) < HEADER.size:
+            return
+        op, seq, handle, _, offset, length = HEADER.unpack_from(payload)
+        data = bytes(payload[HEADER.size:])
+        request = bytes([op & ~OP_RESEND]) + bytes(payload[1:])
+        self.requests += 1
+
+        if op & OP_RESEND:
+            op &= ~OP_RESEND
+            self.resends += 1
+            kept = self.replies.get(seq)
+            if kept and kept[0] == request:
+                link.send_frame(FRAME_FILE, kept[1])
+                return
+
+        try:
+            status, handle, offset, length, out = self.serve(op, handle, offset, length, data)
+        except PermissionError:
+            status, out = ERR_DENIED, b""
+        except FileNotFoundError:
+            status, out = ERR_NOTFOUND, b""
+        except OSError:
+            status, out = ERR_IO, b""
+        if self.verbose:
+            print(f"{OP_NAMES.get(op, op):5} seq {seq:3} handle {handle:3} "
+                  f"offset {offset:8} length {length:4} -> status {status}")
+
+        reply = HEADER.pack(op, seq, handle, status, offset & 0xFFFFFFFF, length & 0xFFFF) + out
+        self.replies[seq] = (request, reply)
+        link.send_frame(FRAME_FILE, reply)
+
+    def serve(self, op, handle, offset, length, data):
+        """Returns (status, handle, offset, length, data) for the reply"""
+        if op == OP_OPEN:
+            return self.open(chr(handle), data)
+        if op == OP_CLOSE:
+            f = self.handles.pop(handle, None)
+            if f is None:
+                return ERR_HANDLE, handle, 0, 0, b""
+            f.close()
+            return OK, handle, 0, 0, b""
+        if op == OP_READ:
+            f = self.handles.get(handle)
+            if f is None:
+                return ERR_HANDLE, handle, offset, 0, b""
+            if isinstance(f, DeltaHandle):
+                out = f.delta[offset:offset + min(length, MAX_DATA)]
+                return OK, handle, offset, len(out), out
+            f.seek(offset)
+            out = f.read(min(length, MAX_DATA))
+            self.bytes_read += len(out)
+            return OK, handle, offset, len(out), out
+        if op == OP_WRITE:
+            f = self.handles.get(handle)
+            if f is None or f.mode == "rb":
+                return ERR_HANDLE, handle, offset, 0, b""
+            if isinstance(f, DeltaHandle):
+                f.signatures[offset:offset + len(data)] = data
+                return OK, handle, len(f.signatures), len(data), b""
+            f.seek(offset)
+            f.write(data)
+            f.flush()
+            self.bytes_written += len(data)
+            return OK, handle, os.fstat(f.fileno()).st_size, len(data), b""
+        if op == OP_STAT:
+            path = self.resolve(data)
+            if path is None:
+                return ERR_DENIED, 0, 0, 0, b""
+            st = os.stat(path)
+            flags = FLAG_DIRECTORY if os.path.isdir(path) else 0
+            return OK, 0, st.st_size & 0xFFFFFFFF, flags, struct.pack(">I", int(st.st_mtime) & 0xFFFFFFFF)
+        if op == OP_LIST:
+            return self.list(offset, data)
+        if op == OP_DELTA:
+            f = self.handles.get(handle)
+            if not isinstance(f, DeltaHandle) or length == 0:
+                return ERR_HANDLE, handle, 0, 0, b""
+            f.delta = make_delta(f.data, bytes(f.signatures), offset, length)
+            if self.verbose:
+                print(f"Delta: {len(f.data)} bytes as {len(f.delta)} against "
+                      f"{len(f.signatures) // 8} blocks of {length}")
+            return OK, handle, len(f.delta), 0, b""
+        return ERR_IO, handle, 0, 0, b""
+
+    def open(self, mode, data):
+        path = self.resolve(data)
+        if path is None:
+            return ERR_DENIED, 0, 0, 0, b""
+        if mode != "r" and self.read_only:
+            return ERR_DENIED, 0, 0, 0, b""
+        free = [h for h in range(1, MAX_OPEN + 1) if h not in self.handles]
+        if not free:
+            return ERR_HANDLE, 0, 0, 0, b""
+        if mode == MODE_DELTA:
+            f = DeltaHandle(path)
+        elif mode == "r":
+            f = open(path, "rb")
+        elif mode == "w":
+            f = open(path, "w+b")
+        elif mode == "u":
+            f = open(path, "r+b" if os.path.exists(path) else "w+b")
+        else:
+            return ERR_IO, 0, 0, 0, b""
+        if os.path.isdir(path):
+            f.close()
+            return ERR_DENIED, 0, 0, 0, b""
+        self.handles[free[0]] = f
+        return OK, free[0], os.path.getsize(path) & 0xFFFFFFFF, 0, b""
+
+    def list(self, index, data):
+        """As many entries from index on as fit one reply"""
+        path = self.resolve(data)
+        if path is None:
+            return ERR_DENIED, 0, 0, 0, b""
+        names = sorted(os.listdir(path))
+        out = bytearray()
+        count = 0
+        while index < len(names):
+            name = names[index]
+            try:
+                st = os.stat(os.path.join(path, name))
+            except OSError:
+                index += 1
+                continue
+            flags = FLAG_DIRECTORY if os.path.isdir(os.path.join(path, name)) else 0
+            entry = struct.pack(">IIB", st.st_size & 0xFFFFFFFF, int(st.st_mtime) & 0xFFFFFFFF, flags)
+            entry += name.encode("latin-1", "replace")[:107] + b"\0"
+            if len(out) + len(entry) > MAX_DATA:
+                break
+            out += entry
+            count += 1
+            index += 1
+        following = index if index < len(names) else LIST_END
+        return OK, 0, following, count, bytes(out)
+
+    def close_all(self):
+        for f in self.handles.values():
+            f.close()
+        self.handles.clear()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Serve a directory to the Amiga's remote file access")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=9600, help="Baud rate (default: 9600)")
+    parser.add_argument("--root", default=".", help="Directory to serve (default: current)")
+    parser.add_argument("--read-only", action="store_true", help="Refuse opens for writing")
+    parser.add_argument("-v", "--verbose", action="store_true", help="Print every request")
+    args = parser.parse_args()
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    if not os.path.isdir(args.root):
+        print(f"Error: {args.root} is not a directory")
+        sys.exit(1)
+
+    ser = serial.serial_for_url(args.port, baudrate=args.baud, timeout=0.05,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+    server = FileServer(args.root, args.read_only, args.verbose)
+    link = FlowLink(ser, frame_handler=lambda t, p: server.handle_frame(link, p) if t == FRAME_FILE else None)
+    link.start()
+    print(f"Serving {server.root} on {args.port} at {args.baud} baud (Ctrl+C to stop)")
+
+    last_report = time.monotonic()
+    try:
+        while True:
+            link.poll()
+            while link.rx:
+                # Command replies and other line traffic pass through to the console
+                text = link.read()
+                sys.stdout.write(text.decode("latin-1"))
+                sys.stdout.flush()
+            if args.verbose and time.monotonic() - last_report > 10:
+                last_report = time.monotonic()
+                print(f"{server.requests} requests, {server.resends} resends, "
+                      f"{server.bytes_read} bytes read, {server.bytes_written} written")
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.close_all()
+        ser.close()
+
+    print(f"\n{server.requests} requests ({server.resends} resends), "
+          f"{server.bytes_read} bytes read, {server.bytes_written} bytes written")
+
+
+if __name__ == "__main__":
+    main()
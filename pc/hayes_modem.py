@@ -0,0 +1,538 @@
+# file: hayes_modem.py
+"""
+Hayes modem emulation for the Amiga serial port.
+
+The host answers AT commands on the serial port like a Hayes-compatible
+modem; a TCP connection stands in for the phone line. Dialling a number
+looks it up in a phone book (a JSON file mapping numbers to host:port),
+and a dial string that already is host:port connects directly:
+
+    ATDT5551234     -> phone book entry for 5551234
+    ATDlocalhost:6400
+
+Once connected the modem is in data mode: every chunk read from the
+serial port goes to the socket as it is, with no parsing or buffering.
+The +++ escape is recognised from the guard times around it (S12, in
+fiftieths of a second) by looking at the timing of each chunk, so the
+escape characters themselves are passed on like any other data. After
+the trailing guard time the modem answers OK in online command mode;
+ATO goes back online and ATH hangs up.
+
+Supported commands: A/ AT A D E H I O Q V X Z Sn=v Sn? &F &C &D &K
+(the last three are accepted and ignored). Incoming connections on
+--answer ring the Amiga and are picked up with ATA, or automatically
+after S0 rings.
+
+    python hayes_modem.py -p /dev/ttyUSB0 -b 9600 --phonebook numbers.json
+    python hayes_modem.py -p COM6 --loopback
+    python hayes_modem.py --bench 4000000
+
+--loopback routes every number to a local TCP echo listener, so
+ATDT1 connects without anything else running. --bench measures
+data-mode throughput through the engine against a local TCP sink.
+"""
+import sys
+import json
+import time
+import socket
+import select
+import argparse
+import threading
+
+# Result codes: (numeric, verbose)
+RESULT_OK = (0, "OK")
+RESULT_CONNECT = (1, "CONNECT")
+RESULT_RING = (2, "RING")
+RESULT_NO_CARRIER = (3, "NO CARRIER")
+RESULT_ERROR = (4, "ERROR")
+RESULT_NO_ANSWER = (8, "NO ANSWER")
+RESULT_BUSY = (7, "BUSY")
+
+COMMAND_MAX = 40                    # Characters after AT, as on the original
+RING_INTERVAL = 6.0                 # Seconds between RINGs
+IDENTIFICATION = "KixGod Hayes emulation"
+BENCH_ROUNDS = 3                    # Best of, per chunk size and path
+
+DEFAULT_REGISTERS = {
+    0: 0,                           # Rings before auto-answer (0 = off)
+    1: 0,                           # Ring count
+    2: 43,                          # Escape character ('+'; > 127 disables)
+    3: 13,                          # Command line terminator
+    4: 10,                          # Response line feed
+    5: 8,                           # Backspace
+    7: 50,                          # Seconds to wait for carrier
+    12: 50,                         # Escape guard time, 1/50 s (0 = none)
+}
+
+
+class AtParser:
+    """Incremental AT command line parser, fed one byte at a time"""
+
+    IDLE, GOT_A, LINE = range(3)
+
+    def __init__(self):
+        self.state = self.IDLE
+        self.line = bytearray()
+        self.last = b""
+
+    def feed(self, byte, terminator=13, backspace=8):
+        """Returns the command after "AT" once it is complete, else None"""
+        if self.state == self.LINE:
+            if byte == terminator:
+                self.state = self.IDLE
+                self.last = bytes(self.line)
+                return self.last
+            if byte == backspace:
+                if self.line:
+                    self.line.pop()
+                else:
+                    self.state = self.GOT_A
+            elif byte >= 32 and len(self.line) < COMMAND_MAX:
+                self.line.append(byte)
+            return None
+
+        if self.state == self.GOT_A:
+            if byte in b"Tt":
+                self.state = self.LINE
+                self.line.clear()
+                return None
+            if byte == ord("/"):
+                self.state = self.IDLE
+                return self.last
+            if byte in b"Aa":
+                return None
+
+        self.state = self.GOT_A if byte in b"Aa" else self.IDLE
+        return None
+
+
+class HayesModem:
+    """Command/data mode state machine between a serial port and a TCP line
+
+    write() sends bytes to the serial port. The caller feeds serial input
+    through serial_input(), socket input through line_input() and calls
+    poll() regularly so the escape guard time and rings are noticed.
+    """
+
+    def __init__(self, write, baud=9600, phonebook=None, clock=time.monotonic):
+        self.write = write
+        self.baud = baud
+        self.phonebook = phonebook or {}
+        self.clock = clock
+        self.parser = AtParser()
+        self.line = None                # Connected socket
+        self.online = False             # Data mode
+        self.held = bytearray()         # Line data received in online command mode
+        self.pending = None             # Incoming socket not yet answered
+        self.next_ring = 0.0
+        self.last_data = 0.0
+        self.escape_count = 0
+        self.escapes = 0
+        self.reset()
+
+    def reset(self):
+        """ATZ: hang up and restore the default settings"""
+        self.hang_up()
+        self.registers = dict(DEFAULT_REGISTERS)
+        self.echo = True
+        self.verbose = True
+        self.quiet = False
+        self.extended = True
+        self._escape_settings()
+
+    def _escape_settings(self):
+        escape = self.registers[2]
+        self.escape_char = bytes([escape]) if escape < 128 else None
+        self.guard = self.registers[12] / 50.0
+
+    # Results
+
+    def result(self, code, text=None):
+        if self.quiet:
+            return
+        cr = chr(self.registers[3])
+        lf = chr(self.registers[4])
+        if self.verbose:
+            message = f"{cr}{lf}{text or code[1]}{cr}{lf}"
+        else:
+            message = f"{code[0]}{cr}"
+        self.write(message.encode("ascii"))
+
+    def info(self, text):
+        cr = chr(self.registers[3])
+        lf = chr(self.registers[4])
+        self.write(f"{cr}{lf}{text}".encode("ascii"))
+
+    # Serial side
+
+    def serial_input(self, data, now=None):
+        """Bytes from the serial port, in whatever chunks they arrived"""
+        if now is None:
+            now = self.clock()
+        if self.online:
+            gap = now - self.last_data
+            self.last_data = now
+            # Only a chunk after a silence (or while an escape is under
+            # way) can be part of +++; anything else goes straight out
+            if self.escape_count or gap >= self.guard:
+                self._track_escape(data, gap)
+            self.line.sendall(data)
+            return
+
+        for byte in data:
+            if self.echo:
+                self.write(bytes((byte,)))
+            command = self.parser.feed(byte, self.registers[3], self.registers[5])
+            if command is not None:
+                self.execute(command)
+                if self.online:
+                    return              # Rest of the chunk is line noise
+
+    def _track_escape(self, data, gap):
+        if self.escape_char is None:
+            return
+        if self.escape_count and gap >= self.guard:
+            self.escape_count = 0       # Too slow; this chunk may start a new one
+        if not data.strip(self.escape_char) and self.escape_count + len(data) <= 3:
+            self.escape_count += len(data)
+        else:
+            self.escape_count = 0
+
+    def poll(self, now=None):
+        """Completes a +++ after its trailing guard time and rings"""
+        if now is None:
+            now = self.clock()
+        if self.online and self.escape_count == 3 and now - self.last_data >= self.guard:
+            self.escape_count = 0
+            self.escapes += 1
+            self.online = False
+            self.result(RESULT_OK)
+        if self.pending and not self.line and now >= self.next_ring:
+            self._ring(now)
+
+    # Line side
+
+    def line_input(self, data):
+        """Bytes from the TCP line; empty data means the far end hung up"""
+        if not data:
+            self.hang_up()
+            self.result(RESULT_NO_CARRIER)
+        elif self.online:
+            self.write(data)
+        else:
+            self.held += data
+
+    def incoming(self, sock):
+        """A connection arrived on the answer port"""
+        if self.line or self.pending:
+            sock.close()                # Busy
+            return
+        self.pending = sock
+        self.registers[1] = 0
+        self._ring(self.clock())
+
+    def _ring(self, now):
+        self.next_ring = now + RING_INTERVAL
+        self.registers[1] += 1
+        self.result(RESULT_RING)
+        if self.registers[0] and self.registers[1] >= self.registers[0]:
+            self.answer()
+
+    def hang_up(self):
+        if self.line:
+            self.line.close()
+        self.line = None
+        self.online = False
+        self.escape_count = 0
+        self.held.clear()
+
+    def answer(self):
+        if not self.pending:
+            self.result(RESULT_NO_CARRIER)
+            return
+        self.line, self.pending = self.pending, None
+        self._connect()
+
+    def dial(self, number):
+        address = self.lookup(number)
+        if not address:
+            self.result(RESULT_NO_CARRIER)
+            return
+        host, _, port = address.rpartition(":")
+        try:
+            self.line = socket.create_connection((host, int(port)), timeout=self.registers[7])
+        except ConnectionRefusedError:
+            self.result(RESULT_BUSY)
+            return
+        except socket.timeout:
+            self.result(RESULT_NO_ANSWER)
+            return
+        except (OSError, ValueError):
+            self.result(RESULT_NO_CARRIER)
+            return
+        self.line.settimeout(None)
+        self.line.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self._connect()
+
+    def lookup(self, number):
+        """Dial string to host:port via the phone book ("*" matches any)"""
+        number = number.strip()
+        if number[:1].upper() in ("T", "P"):
+            number = number[1:].strip()
+        if ":" in number:
+            return number
+        digits = "".join(c for c in number if c.isdigit() or c in "*#")
+        return self.phonebook.get(digits) or self.phonebook.get("*")
+
+    def _connect(self):
+        self.online = True
+        self.last_data = self.clock()
+        self.escape_count = 0
+        self.result(RESULT_CONNECT, f"CONNECT {self.baud}" if self.extended else None)
+
+    def go_online(self):
+        if not self.line:
+            self.result(RESULT_NO_CARRIER)
+            return
+        self._connect()
+        if self.held:
+            self.write(bytes(self.held))
+            self.held.clear()
+
+    # Commands
+
+    def execute(self, command):
+        """Runs one command line (the part after AT) and reports the result"""
+        text = command.decode("ascii", "replace")
+        upper = text.upper()
+        i = 0
+
+        while i < len(upper):
+            c = upper[i]
+            i += 1
+            if c == " ":
+                continue
+            if c == "D":
+                self.dial(text[i:])
+                return
+            if c == "A":
+                self.answer()
+                return
+            if c == "O":
+                _, i = _number(upper, i)
+                self.go_online()
+                return
+
+            value, i = _number(upper, i)
+            if c == "E":
+                self.echo = bool(value)
+            elif c == "V":
+                self.verbose = bool(value)
+            elif c == "Q":
+                self.quiet = bool(value)
+            elif c == "X":
+                self.extended = bool(value)
+            elif c in "LM":
+                pass                    # Speaker
+            elif c == "H":
+                if self.pending and not self.line:
+                    self.pending.close()
+                    self.pending = None
+                self.hang_up()
+            elif c == "Z":
+                self.reset()
+            elif c == "I":
+                self.info(IDENTIFICATION if value == 0 else f"{self.baud}")
+            elif c == "S" and value is not None and value in self.registers:
+                if upper[i:i + 1] == "?":
+                    i += 1
+                    self.info(f"{self.registers[value]:03d}")
+                elif upper[i:i + 1] == "=":
+                    setting, i = _number(upper, i + 1)
+                    self.registers[value] = min(setting or 0, 255)
+                    self._escape_settings()
+                else:
+                    self.result(RESULT_ERROR)
+                    return
+            elif c == "&" and i < len(upper):
+                option = upper[i]
+                _, i = _number(upper, i + 1)
+                if option == "F":
+                    self.reset()
+                elif option not in "CDK":
+                    self.result(RESULT_ERROR)
+                    return
+            else:
+                self.result(RESULT_ERROR)
+                return
+
+        self.result(RESULT_OK)
+
+
+def _number(text, i):
+    """Parses an optional decimal number at text[i]; returns (value, next)"""
+    start = i
+    while i < len(text) and text[i].isdigit():
+        i += 1
+    return (int(text[start:i]) if i > start else None), i
+
+
+class LoopbackListener:
+    """Local TCP listener standing in for the remote end of the phone line
+
+    Echoes what it receives, or with sink=True only counts it.
+    """
+
+    def __init__(self, port=0, sink=False):
+        self.server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.server.bind(("127.0.0.1", port))
+        self.server.listen(4)
+        self.port = self.server.getsockname()[1]
+        self.sink = sink
+        self.received = 0
+        self.done = threading.Event()
+        self.expected = None
+        threading.Thread(target=self._accept, daemon=True).start()
+
+    def _accept(self):
+        while True:
+            try:
+                conn, _ = self.server.accept()
+            except OSError:
+                return
+            threading.Thread(target=self._serve, args=(conn,), daemon=True).start()
+
+    def _serve(self, conn):
+        with conn:
+            while True:
+                try:
+                    data = conn.recv(65536)
+                except OSError:
+                    return
+                if not data:
+                    return
+                self.received += len(data)
+                if not self.sink:
+                    conn.sendall(data)
+                if self.expected is not None and self.received >= self.expected:
+                    self.done.set()
+
+    def close(self):
+        self.server.close()
+
+
+def run_port(modem, ser, answer_server=None):
+    """Moves bytes between the serial port, the modem and the line"""
+    while True:
+        waiting = ser.in_waiting
+        data = ser.read(waiting or 1)
+        if data:
+            modem.serial_input(data)
+
+        sockets = [s for s in (modem.line, answer_server) if s]
+        if sockets:
+            readable, _, _ = select.select(sockets, [], [], 0)
+            for s in readable:
+                if s is answer_server:
+                    conn, _ = answer_server.accept()
+                    modem.incoming(conn)
+                elif s is modem.line:
+                    try:
+                        modem.line_input(s.recv(65536))
+                    except OSError:
+                        modem.line_input(b"")
+
+        modem.poll()
+
+
+def benchmark(total):
+    """Data-mode throughput: engine vs. writing the socket directly (best of 3)"""
+    chunk_sizes = (1, 64, 4096)
+    print(f"Data mode throughput, {total} bytes per run into a local TCP sink")
+    print(f"{'chunk':>6} {'direct MB/s':>12} {'modem MB/s':>12} {'overhead':>9}")
+
+    for size in chunk_sizes:
+        count = max(1, total // max(size, 64))  # Single bytes: fewer of them
+        block = bytes(range(256)) * (size // 256 + 1)
+        block = block[:size]
+        rates = [0.0, 0.0]
+
+        for _ in range(BENCH_ROUNDS):
+            for through_modem in (False, True):
+                sink = LoopbackListener(sink=True)
+                sink.expected = count * size
+                modem = HayesModem(lambda data: None, phonebook={"*": f"127.0.0.1:{sink.port}"})
+                if through_modem:
+                    modem.serial_input(b"ATE0DT1\r")
+                    send = modem.serial_input
+                else:
+                    modem.line = socket.create_connection(("127.0.0.1", sink.port))
+                    modem.line.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                    send = modem.line.sendall
+
+                start = time.perf_counter()
+                for _ in range(count):
+                    send(block)
+                sink.done.wait(30)
+                elapsed = time.perf_counter() - start
+                rates[through_modem] = max(rates[through_modem], count * size / elapsed / 1e6)
+                modem.hang_up()
+                sink.close()
+
+        overhead = (rates[0] - rates[1]) * 100.0 / rates[0]
+        print(f"{size:>6} {rates[0]:>12.2f} {rates[1]:>12.2f} {overhead:>+8.1f}%")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Hayes modem emulation over TCP for the Amiga serial port")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=9600, help="Baud rate (default: 9600)")
+    parser.add_argument("--phonebook", help="JSON file mapping numbers to host:port (\"*\" for any)")
+    parser.add_argument("--loopback", action="store_true", help="Route every number to a local TCP echo listener")
+    parser.add_argument("--answer", type=int, default=0, help="Accept incoming calls on this TCP port")
+    parser.add_argument("--bench", type=int, default=0, help="Benchmark data mode with N bytes and exit")
+    args = parser.parse_args()
+
+    if args.bench:
+        benchmark(args.bench)
+        return
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    phonebook = {}
+    if args.phonebook:
+        with open(args.phonebook) as f:
+            phonebook = json.load(f)
+    if args.loopback:
+        listener = LoopbackListener()
+        phonebook.setdefault("*", f"127.0.0.1:{listener.port}")
+        print(f"Loopback line listening on 127.0.0.1:{listener.port}")
+
+    answer_server = None
+    if args.answer:
+        answer_server = socket.create_server(("", args.answer))
+        print(f"Answering calls on port {args.answer}")
+
+    ser = serial.serial_for_url(args.port, baudrate=args.baud, timeout=0.01,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+    modem = HayesModem(ser.write, baud=args.baud, phonebook=phonebook)
+    print(f"Modem ready on {args.port} at {args.baud} baud")
+
+    try:
+        run_port(modem, ser, answer_server)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        modem.hang_up()
+        ser.close()
+        print(f"Escapes: {modem.escapes}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,537 @@
+# file: hpgl_plotter.py
+"""
+HP-GL plotter emulation: an HP 7475A on the Amiga's serial port.
+
+Commands are tokenized as they arrive and drawn straight into an SVG
+file, so a plot of any size needs only the bytes of one unfinished
+command and one polyline of memory. Output queries (OI, OS, OA, OP,
+OH, ...) and the RS-232 device control sequences programs use for
+handshaking (ESC.B buffer space, ESC.O extended status, ...) are
+answered as soon as they are parsed:
+
+    python hpgl_plotter.py -p /dev/ttyUSB0 -o plot.svg
+    python hpgl_plotter.py --file recorded.plt -o plot.svg
+    python hpgl_plotter.py --generate big.plt --commands 2000000
+    python hpgl_plotter.py --bench big.plt
+
+Supported: IN DF IP SC PU PD PA PR SP LT CI AA AR LB DT SI VS PG and
+the O* output commands; anything else is counted and skipped, as the
+plotter would with error 1. The SVG is written while plotting and is
+complete once the plot ends (or the tool is stopped).
+
+--bench parses recorded plot files the way the serial path would, in
+4 KB reads, and reports commands/s and peak memory.
+"""
+import os
+import re
+import sys
+import math
+import time
+import random
+import argparse
+
+# HP 7475A, A4 paper: hard clip limits and default P1/P2 in plotter units (40/mm)
+HARD_LIMITS = (0, 0, 10900, 7650)
+DEFAULT_P1P2 = (430, 200, 10430, 7400)
+UNITS_PER_MM = 40
+READ_SIZE = 4096
+PATH_MAX = 500              # Points per SVG path before it is written out
+PENDING_MAX = 16384         # Longest command kept while waiting for its end
+BUFFER_SIZE = 1024          # Reported by ESC.B / ESC.L
+ETX = "\x03"
+
+PEN_COLOURS = ("none", "black", "red", "green", "blue", "magenta", "cyan", "orange", "brown")
+LINE_DASHES = {1: "4,96", 2: "50,50", 3: "70,30", 4: "80,10,0,10", 5: "70,10,10,10", 6: "50,10,10,10,10,10"}
+
+# A command: mnemonic, its parameters, then ";" or the start of the next command
+COMMAND_RE = re.compile(r"[\s;]*([A-Za-z]{2})([^A-Za-z;\x1b\x03]*)(?:;|(?=[A-Za-z\x1b\x03]))")
+# What may still grow into a command once more bytes arrive
+PARTIAL_RE = re.compile(r"[\s;]*(?:[A-Za-z](?:[A-Za-z][^A-Za-z;\x1b\x03]*)?|\x1b\.?)?\Z")
+NUMBER_RE = re.compile(r"[-+]?(?:\d+\.?\d*|\.\d+)")
+ESCAPE_PARAMS = "@HIMNT"    # Device control sequences that take parameters up to ":"
+
+
+class SvgWriter:
+    """Writes polylines and labels to an SVG file as they are finished"""
+
+    def __init__(self, out):
+        self.out = out
+        self.points = []
+        self.style = ""
+        self.paths = 0
+        x0, y0, x1, y1 = HARD_LIMITS
+        out.write('<?xml version="1.0" encoding="UTF-8"?>\n')
+        out.write(f'<svg xmlns="http://www.w3.org/2000/svg" width="{(x1 - x0) / UNITS_PER_MM}mm" '
+                  f'height="{(y1 - y0) / UNITS_PER_MM}mm" viewBox="{x0} {y0} {x1 - x0} {y1 - y0}">\n')
+        out.write(f'<g transform="translate(0,{y1 + y0}) scale(1,-1)" fill="none" '
+                  f'stroke-width="12" stroke-linecap="round" stroke-linejoin="round">\n')
+
+    def move(self, x, y, style):
+        """Starts a new polyline at (x, y)"""
+        self.flush()
+        self.points.append(f"{x:g},{y:g}")
+        self.style = style
+
+    def line(self, x, y):
+        self.points.append(f"{x:g},{y:g}")
+        if len(self.points) >= PATH_MAX:
+            last = self.points[-1]
+            self.flush()
+            self.points.append(last)
+
+    def flush(self):
+        if len(self.points) > 1:
+            self.out.write(f'<polyline {self.style} points="{" ".join(self.points)}"/>\n')
+            self.paths += 1
+        self.points = []
+
+    def label(self, x, y, text, height, colour):
+        self.flush()
+        text = text.replace("&", "&amp;").replace("<", "&lt;").replace(">", "&gt;")
+        self.out.write(f'<text transform="translate({x:g},{y:g}) scale(1,-1)" font-family="monospace" '
+                       f'font-size="{height:g}" fill="{colour}" stroke="none">{text}</text>\n')
+
+    def close(self):
+        self.flush()
+        self.out.write("</g>\n</svg>\n")
+        self.out.flush()
+
+
+class HpglPlotter:
+    """Incremental HP-GL parser and plotter state
+
+    feed() takes bytes as they arrive; respond is called with the reply
+    to each output query. Only an unfinished command is kept between
+    calls.
+    """
+
+    def __init__(self, svg, respond=None):
+        self.svg = svg
+        self.respond = respond or (lambda reply: None)
+        self.pending = ""
+        self.commands = 0
+        self.unknown = 0
+        self.queries = 0
+        self.peak_pending = 0
+        self.initialise()
+
+    def initialise(self):
+        self.p1p2 = DEFAULT_P1P2
+        self.scale = None
+        self.x = self.y = 0.0       # Plotter units
+        self.pen = 0
+        self.pen_down = False
+        self.absolute = True
+        self.line_type = None
+        self.terminator = ETX
+        self.char_size = (0.19, 0.27)   # cm, width and height
+        self.error = 0
+        self.status = 0x08          # Initialized
+        self.svg.flush()
+
+    # Stream input
+
+    def feed(self, data):
+        self.pending += data.decode("latin-1")
+        text = self.pending
+        pos = 0
+        end = len(text)
+        while pos < end:
+            if text[pos] == "\x1b":
+                used = self._device_control(text, pos)
+                if not used:
+                    break
+                pos += used
+                continue
+            m = COMMAND_RE.match(text, pos)
+            if m:
+                mnemonic = m.group(1).upper()
+                if mnemonic == "LB":
+                    stop = text.find(self.terminator, m.end(1))
+                    if stop < 0:
+                        if end - pos < PENDING_MAX:
+                            break
+                        stop = end
+                    self._label(text[m.end(1):stop])
+                    pos = stop + 1
+                    continue
+                if mnemonic == "DT":
+                    # DT takes the next character, whatever it is; "DT;" restores ETX
+                    stop = m.end(1)
+                    self.terminator = text[stop] if text[stop] != ";" else ETX
+                    pos = stop + 1
+                    if pos < end and text[pos] == ";" and self.terminator != ";":
+                        pos += 1
+                    self.commands += 1
+                    continue
+                self._execute(mnemonic, m.group(2))
+                pos = m.end()
+                continue
+            if PARTIAL_RE.match(text, pos) and end - pos < PENDING_MAX:
+                break                   # Wait for the rest of the command
+            pos += 1                    # Not HP-GL: skip it
+        self.pending = text[pos:]
+        if len(self.pending) > self.peak_pending:
+            self.peak_pending = len(self.pending)
+
+    def finish(self):
+        """End of input: run a last command that had no terminator"""
+        if self.pending:
+            self.feed(b";")
+        self.svg.flush()
+
+    # Device control (ESC . x)
+
+    def _device_control(self, text, pos):
+        """Returns the characters used, 0 if the sequence is incomplete"""
+        if pos + 2 >= len(text):
+            return 0
+        if text[pos + 1] != ".":
+            return 1
+        code = text[pos + 2]
+        used = 3
+        if code in ESCAPE_PARAMS:
+            stop = text.find(":", pos + 3)
+            if stop < 0:
+                return 0 if len(text) - pos < 64 else 3
+            used = stop + 1 - pos
+        self.commands += 1
+        reply = {"B": str(BUFFER_SIZE), "L": str(BUFFER_SIZE), "S": str(BUFFER_SIZE),
+                 "O": "8", "E": "0", "A": "7475A,0"}.get(code)
+        if reply is not None:
+            self.queries += 1
+            self.respond(reply + "\r")
+        return used
+
+    # Commands
+
+    def _execute(self, mnemonic, params):
+        self.commands += 1
+        handler = COMMANDS.get(mnemonic)
+        if not handler:
+            self.unknown += 1
+            self.error = 1
+            return
+        handler(self, [float(n) for n in NUMBER_RE.findall(params)] if params else [])
+
+    def to_plotter(self, x, y):
+        """User units to plotter units"""
+        if not self.scale:
+            return x, y
+        xmin, xmax, ymin, ymax = self.scale
+        p1x, p1y, p2x, p2y = self.p1p2
+        return (p1x + (x - xmin) * (p2x - p1x) / ((xmax - xmin) or 1),
+                p1y + (y - ymin) * (p2y - p1y) / ((ymax - ymin) or 1))
+
+    def from_plotter(self, x, y):
+        if not self.scale:
+            return x, y
+        xmin, xmax, ymin, ymax = self.scale
+        p1x, p1y, p2x, p2y = self.p1p2
+        return (xmin + (x - p1x) * (xmax - xmin) / ((p2x - p1x) or 1),
+                ymin + (y - p1y) * (ymax - ymin) / ((p2y - p1y) or 1))
+
+    def style(self):
+        style = f'stroke="{PEN_COLOURS[self.pen % len(PEN_COLOURS)] if self.pen else "none"}"'
+        if self.line_type in LINE_DASHES:
+            style += f' stroke-dasharray="{LINE_DASHES[self.line_type]}"'
+        return style
+
+    def move_to(self, x, y):
+        """Pen move in plotter units, drawing if the pen is down"""
+        if self.pen_down and self.pen:
+            if not self.svg.points:
+                self.svg.move(self.x, self.y, self.style())
+            self.svg.line(x, y)
+        self.x, self.y = x, y
+
+    def pen_up(self):
+        self.pen_down = False
+        self.svg.flush()
+
+    def plot(self, params):
+        """Coordinate pairs for PA/PR/PU/PD"""
+        for i in range(0, len(params) - 1, 2):
+            if self.absolute:
+                x, y = self.to_plotter(params[i], params[i + 1])
+            else:
+                ux, uy = self.from_plotter(self.x, self.y)
+                x, y = self.to_plotter(ux + params[i], uy + params[i + 1])
+            self.move_to(x, y)
+
+    def arc(self, cx, cy, sweep, chord):
+        """Arc around (cx, cy) in plotter units, from the pen position"""
+        radius = math.hypot(self.x - cx, self.y - cy)
+        start = math.atan2(self.y - cy, self.x - cx)
+        steps = max(1, int(abs(sweep) / (chord or 5)))
+        for i in range(1, steps + 1):
+            a = start + math.radians(sweep * i / steps)
+            self.move_to(cx + radius * math.cos(a), cy + radius * math.sin(a))
+
+    def _label(self, text):
+        self.commands += 1
+        width, height = self.char_size
+        if self.pen:
+            self.svg.label(self.x, self.y, text, height * 400, PEN_COLOURS[self.pen % len(PEN_COLOURS)])
+        self.x += len(text) * width * 400 * 1.5
+        if self.pen_down:
+            self.svg.flush()
+
+    def reply(self, text):
+        self.queries += 1
+        self.respond(text + "\r")
+
+
+def _in(p, a):
+    p.initialise()
+
+
+def _df(p, a):
+    p.scale = None
+    p.absolute = True
+    p.line_type = None
+    p.terminator = ETX
+
+
+def _ip(p, a):
+    p.p1p2 = tuple(a[:4]) if len(a) >= 4 else DEFAULT_P1P2
+    p.status |= 0x02
+
+
+def _sc(p, a):
+    p.scale = tuple(a[:4]) if len(a) >= 4 else None
+
+
+def _pu(p, a):
+    p.pen_up()
+    p.plot(a)
+
+
+def _pd(p, a):
+    p.pen_down = True
+    p.plot(a)
+
+
+def _pa(p, a):
+    p.absolute = True
+    p.plot(a)
+
+
+def _pr(p, a):
+    p.absolute = False
+    p.plot(a)
+
+
+def _sp(p, a):
+    p.svg.flush()
+    p.pen = int(a[0]) if a else 0
+
+
+def _lt(p, a):
+    p.svg.flush()
+    p.line_type = int(a[0]) if a else None
+
+
+def _si(p, a):
+    p.char_size = (a[0], a[1]) if len(a) >= 2 else (0.19, 0.27)
+
+
+def _ci(p, a):
+    if not a:
+        p.error = 2
+        return
+    cx, cy = p.x, p.y
+    ux, uy = p.from_plotter(cx, cy)
+    ex, _ = p.to_plotter(ux + a[0], uy)
+    radius = abs(ex - cx)
+    chord = a[1] if len(a) > 1 else 5
+    down = p.pen_down
+    p.pen_up()
+    p.move_to(cx + radius, cy)
+    p.pen_down = True
+    p.arc(cx, cy, 360, chord)
+    p.pen_up()
+    p.move_to(cx, cy)
+    p.pen_down = down
+
+
+def _aa(p, a):
+    if len(a) < 3:
+        p.error = 2
+        return
+    cx, cy = p.to_plotter(a[0], a[1])
+    p.arc(cx, cy, a[2], a[3] if len(a) > 3 else 5)
+
+
+def _ar(p, a):
+    if len(a) < 3:
+        p.error = 2
+        return
+    ux, uy = p.from_plotter(p.x, p.y)
+    cx, cy = p.to_plotter(ux + a[0], uy + a[1])
+    p.arc(cx, cy, a[2], a[3] if len(a) > 3 else 5)
+
+
+def _ignore(p, a):
+    pass
+
+
+def _oa(p, a):
+    p.reply(f"{p.x:.0f},{p.y:.0f},{int(p.pen_down)}")
+
+
+def _oc(p, a):
+    ux, uy = p.from_plotter(p.x, p.y)
+    p.reply(f"{ux:.0f},{uy:.0f},{int(p.pen_down)}")
+
+
+def _oe(p, a):
+    p.reply(str(p.error))
+    p.error = 0
+
+
+def _os(p, a):
+    p.reply(str(p.status | int(p.pen_down)))
+    p.status &= ~0x0A               # P1/P2 changed and initialized clear once read
+
+
+COMMANDS = {
+    "IN": _in, "DF": _df, "IP": _ip, "SC": _sc,
+    "PU": _pu, "PD": _pd, "PA": _pa, "PR": _pr,
+    "SP": _sp, "LT": _lt, "SI": _si, "CI": _ci, "AA": _aa, "AR": _ar,
+    "VS": _ignore, "PG": _ignore, "IW": _ignore, "RO": _ignore, "CS": _ignore, "DI": _ignore,
+    "OA": _oa, "OC": _oc, "OE": _oe, "OS": _os,
+    "OI": lambda p, a: p.reply("7475A"),
+    "OP": lambda p, a: p.reply(",".join(f"{v:.0f}" for v in p.p1p2)),
+    "OH": lambda p, a: p.reply(",".join(str(v) for v in HARD_LIMITS)),
+    "OW": lambda p, a: p.reply(",".join(str(v) for v in HARD_LIMITS)),
+    "OF": lambda p, a: p.reply(f"{UNITS_PER_MM},{UNITS_PER_MM}"),
+    "OD": lambda p, a: p.reply(f"{p.x:.0f},{p.y:.0f},0"),
+    "OO": lambda p, a: p.reply("0,1,0,0,1,0,0,0"),
+}
+
+
+def plot_stream(source, out_path, respond=None):
+    """Plots everything read from source(); returns the plotter"""
+    with open(out_path, "w", encoding="utf-8", newline="\n") as out:
+        svg = SvgWriter(out)
+        plotter = HpglPlotter(svg, respond)
+        try:
+            while True:
+                data = source()
+                if data is None:
+                    break
+                if data:
+                    plotter.feed(data)
+                else:
+                    out.flush()         # Line idle: let viewers see the plot so far
+        finally:
+            plotter.finish()
+            svg.close()
+    return plotter
+
+
+def generate(path, commands, seed=1):
+    """Writes a synthetic plot of about the given number of commands"""
+    rng = random.Random(seed)
+    written = 0
+    with open(path, "w", encoding="latin-1", newline="\n") as f:
+        f.write("IN;IP430,200,10430,7400;SC0,10000,0,7000;")
+        while written < commands:
+            f.write(f"SP{rng.randint(1, 6)};PU{rng.randint(0, 10000)},{rng.randint(0, 7000)};")
+            points = rng.randint(5, 60)
+            f.write("PD" + ",".join(f"{rng.randint(0, 10000)},{rng.randint(0, 7000)}" for _ in range(points)) + ";")
+            f.write(f"PR{rng.randint(-50, 50)},{rng.randint(-50, 50)}PA{rng.randint(0, 10000)},{rng.randint(0, 7000)}\n")
+            f.write(f"PU;CI{rng.randint(10, 300)};LBPart {written}\x03LT{rng.randint(0, 6)};")
+            written += 10
+        f.write("PU;SP0;")
+    return written
+
+
+def peak_memory_kb():
+    try:
+        import resource
+        return resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    except ImportError:
+        return None
+
+
+def bench(paths, out_path):
+    for path in paths:
+        size = 0
+        with open(path, "rb") as f:
+            def source():
+                data = f.read(READ_SIZE)
+                return data or None
+            start = time.perf_counter()
+            plotter = plot_stream(source, out_path)
+            elapsed = time.perf_counter() - start
+            size = f.tell()
+        memory = peak_memory_kb()
+        print(f"{path}: {size / 1e6:.1f} MB, {plotter.commands} commands in {elapsed:.2f} s: "
+              f"{plotter.commands / elapsed:,.0f} commands/s, {size / elapsed / 1e6:.2f} MB/s")
+        print(f"  {plotter.svg.paths} paths written, {plotter.unknown} unknown commands, "
+              f"longest pending command {plotter.peak_pending} chars"
+              + (f", peak RSS {memory / 1024:.1f} MB" if memory else ""))
+        line_rate = 960.0   # Bytes/s at 9600 baud
+        print(f"  {size / elapsed / line_rate:,.0f} times the rate of a 9600 baud line")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="HP-GL plotter emulation writing SVG")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=9600, help="Baud rate (default: 9600)")
+    parser.add_argument("-o", "--output", default="plot.svg", help="SVG file to write (default: plot.svg)")
+    parser.add_argument("--idle", type=float, default=0, help="End the plot after N idle seconds (default: never)")
+    parser.add_argument("--file", help="Plot a recorded HP-GL file instead of the serial port")
+    parser.add_argument("--generate", help="Write a synthetic plot file and exit")
+    parser.add_argument("--commands", type=int, default=1000000, help="Commands for --generate (default: 1000000)")
+    parser.add_argument("--bench", nargs="+", metavar="FILE", help="Benchmark the parser on recorded plot files")
+    args = parser.parse_args()
+
+    if args.generate:
+        count = generate(args.generate, args.commands)
+        print(f"Wrote about {count} commands to {args.generate}")
+        return
+    if args.bench:
+        bench(args.bench, os.devnull)
+        return
+    if args.file:
+        with open(args.file, "rb") as f:
+            plotter = plot_stream(lambda: f.read(READ_SIZE) or None, args.output,
+                                  lambda reply: print(f"Query reply: {reply.strip()}"))
+        print(f"{plotter.commands} commands, {plotter.svg.paths} paths written to {args.output}")
+        return
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    ser = serial.serial_for_url(args.port, baudrate=args.baud, timeout=0.1,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+    print(f"Plotter on {args.port} at {args.baud} baud, writing {args.output}")
+    state = {"last": time.monotonic()}
+
+    def source():
+        data = ser.read(max(1, min(ser.in_waiting, READ_SIZE)))
+        now = time.monotonic()
+        if data:
+            state["last"] = now
+        elif args.idle and now - state["last"] >= args.idle:
+            return None
+        return data
+
+    try:
+        plotter = plot_stream(source, args.output, lambda reply: ser.write(reply.encode("ascii")))
+        print(f"{plotter.commands} commands, {plotter.svg.paths} paths written to {args.output}")
+    except KeyboardInterrupt:
+        print(f"Stopped; {args.output} is complete up to here")
+    finally:
+        ser.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,157 @@
+# file: link_calibrate.py
+"""
+Host side of the framework's link-rate calibration (amiga_packet_calibrate.c).
+
+The Amiga drives the exchange; this script follows it:
+    home rate:  "CALRATE <baud> <length>"  -> "CALRATE OK", switch to <baud>
+    trial rate: receive <length> PRBS-7 bytes, send "CALRESULT <received> <errors>"
+                and the same PRBS-7 burst back, switch home
+    home rate:  "CALSET <baud>"            -> "CALSET OK", switch for good
+
+Start it before the Amiga calibrates (example app: CALIBRATE argument or
+command). With --start it sends the CALIBRATE command itself.
+
+    python link_calibrate.py -p /dev/ttyUSB0 --start
+    python link_calibrate.py -p COM6 -b 9600 --stay
+"""
+import sys
+import time
+import argparse
+
+PRBS_SEED = 0x7F
+
+
+def prbs7_bytes(length, state=PRBS_SEED):
+    """PRBS-7 (x^7 + x^6 + 1) packed MSB first, as PrbsByte() on the Amiga"""
+    out = bytearray()
+    for _ in range(length):
+        byte = 0
+        for _ in range(8):
+            bit = ((state >> 6) ^ (state >> 5)) & 1
+            state = ((state << 1) | bit) & 0x7F
+            byte = (byte << 1) | bit
+        out.append(byte)
+    return bytes(out)
+
+
+class CalibrationResponder:
+    """Answers calibration lines on an open pyserial port"""
+
+    def __init__(self, ser, verbose=True):
+        self.ser = ser
+        self.home = ser.baudrate
+        self.verbose = verbose
+        self.results = []
+        self.final = None
+
+    def _send(self, text):
+        self.ser.write(text.encode('ascii') + b"\r\n")
+        self.ser.flush()
+
+    def _switch(self, baud):
+        # Let the last bytes leave before the UART changes speed
+        self.ser.flush()
+        time.sleep(0.01)
+        self.ser.baudrate = baud
+        self.ser.reset_input_buffer()
+
+    def _read_exact(self, length, timeout):
+        data = bytearray()
+        deadline = time.monotonic() + timeout
+        while len(data) < length and time.monotonic() < deadline:
+            chunk = self.ser.read(min(length - len(data), max(1, self.ser.in_waiting)))
+            if chunk:
+                data += chunk
+        return bytes(data)
+
+    def handle_line(self, line):
+        """Handle one received line; returns True if it was a calibration line"""
+        fields = line.decode('ascii', 'replace').split()
+        if not fields:
+            return False
+
+        if fields[0] == "CALRATE" and len(fields) == 3:
+            baud, length = int(fields[1]), int(fields[2])
+            self._send("CALRATE OK")
+            self._switch(baud)
+            self.trial(baud, length)
+            self._switch(self.home)
+            return True
+
+        if fields[0] == "CALSET" and len(fields) == 2:
+            baud = int(fields[1])
+            self._send("CALSET OK")
+            self._switch(baud)
+            self.home = baud
+            self.final = baud
+            if self.verbose:
+                print(f"Link set to {baud} baud")
+            return True
+
+        return False
+
+    def trial(self, baud, length):
+        expected = prbs7_bytes(length)
+        timeout = length * 10 / baud * 1.5 + 1.0
+        data = self._read_exact(length, timeout)
+        errors = (length - len(data)) + sum(1 for a, b in zip(data, expected) if a != b)
+
+        self.ser.write(f"CALRESULT {len(data)} {errors}\r\n".encode('ascii') + expected)
+        self.ser.flush()
+
+        self.results.append((baud, length, len(data), errors))
+        if self.verbose:
+            print(f"{baud:>7} baud  {length:>5} bytes  received {len(data):>5}  errors {errors}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Follow the Amiga's link-rate calibration")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=9600, help="Current (home) rate (default: 9600)")
+    parser.add_argument("--start", action="store_true", help="Send CALIBRATE to the example app first")
+    parser.add_argument("--stay", action="store_true", help="Keep running and answer later recalibrations")
+    args = parser.parse_args()
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    ser = serial.serial_for_url(args.port, baudrate=args.baud, timeout=0.05,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+    responder = CalibrationResponder(ser)
+
+    if args.start:
+        ser.write(b"CALIBRATE\r\n")
+
+    print(f"Waiting for calibration on {args.port} at {args.baud} baud (Ctrl+C to stop)")
+    buffer = bytearray()
+    try:
+        while True:
+            data = ser.read(max(1, ser.in_waiting))
+            if not data:
+                continue
+            buffer += data
+            while b"\n" in buffer:
+                line, _, rest = bytes(buffer).partition(b"\n")
+                buffer = bytearray(rest)
+                line = line.rstrip(b"\r")
+                if responder.handle_line(line):
+                    # Anything queued across a rate switch is garbage
+                    buffer.clear()
+                    if responder.final and not args.stay:
+                        ser.close()
+                        return
+                elif line:
+                    print(line.decode('ascii', 'replace'))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if ser.is_open:
+            ser.close()
+
+
+if __name__ == "__main__":
+    main()
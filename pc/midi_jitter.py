@@ -0,0 +1,259 @@
+# file: midi_jitter.py
+"""
+MIDI timing check for the Amiga packet application's MIDI mode.
+
+Start the app with "example_app MIDI 120" (add TASK for event-driven
+input). It switches the port to 31250 baud and sends a MIDI clock with a
+beat note, both scheduled on the EClock. This tool records the arrival
+time of every byte, parses the stream (running status, real-time bytes
+between the bytes of other messages) and reports how evenly the clock
+and the beats arrived:
+
+    python midi_jitter.py -p /dev/ttyUSB0 --bpm 120 --seconds 30
+    python midi_jitter.py -p /dev/ttyUSB0 --thru 200
+    python midi_jitter.py -p /dev/ttyUSB0 --loopback --seconds 10
+
+Each read is time-stamped and the earlier bytes in it are back-dated by
+one byte time (320 us at 31250 baud). USB serial adapters deliver in
+bursts (FTDI parts wait up to 16 ms by default), which shows up here as
+jitter: use --low-latency on Linux, and measure the host's own floor
+first with --loopback, which sends the clock from the host into a
+loopback plug. --thru sends note-ons and times their return through
+the Amiga's MIDI thru. On exit System Reset (FF) is sent, which ends
+MIDI mode on the Amiga.
+"""
+import sys
+import time
+import argparse
+import statistics
+import threading
+
+MIDI_BAUD = 31250
+BYTE_TIME = 10.0 / MIDI_BAUD
+CLOCKS_PER_BEAT = 24
+
+
+def data_length(status):
+    """Data bytes that follow a status byte"""
+    if status < 0xF0:
+        return 1 if (status & 0xE0) == 0xC0 else 2
+    return {0xF1: 1, 0xF2: 2, 0xF3: 1}.get(status, 0)
+
+
+class MidiParser:
+    """Same rules as ParseMidiBytes() in amiga_packet_midi.c"""
+
+    def __init__(self):
+        self.status = 0
+        self.needed = 0
+        self.data = []
+        self.sysex = None
+        self.stray = 0
+
+    def feed(self, data, times):
+        """Returns [(time, message bytes)]; a message takes its last byte's time"""
+        messages = []
+        for byte, t in zip(data, times):
+            if byte >= 0xF8:
+                messages.append((t, bytes((byte,))))
+                continue
+            if byte & 0x80:
+                if self.sysex is not None:
+                    if byte == 0xF7:
+                        self.sysex.append(byte)
+                        messages.append((t, bytes(self.sysex)))
+                        self.sysex = None
+                        continue
+                    messages.append((t, bytes(self.sysex)))
+                    self.sysex = None
+                if byte == 0xF0:
+                    self.sysex = bytearray((byte,))
+                    self.status = 0
+                elif byte == 0xF7:
+                    self.stray += 1
+                else:
+                    self.status = byte
+                    self.needed = data_length(byte)
+                    self.data = []
+                    if self.needed == 0:
+                        messages.append((t, bytes((byte,))))
+                        self.status = 0
+                continue
+            if self.sysex is not None:
+                self.sysex.append(byte)
+            elif not self.status:
+                self.stray += 1
+            else:
+                self.data.append(byte)
+                if len(self.data) == self.needed:
+                    messages.append((t, bytes([self.status] + self.data)))
+                    self.data = []
+                    if self.status >= 0xF0:
+                        self.status = 0
+        return messages
+
+
+def read_messages(ser, parser, until):
+    """Reads and parses until the deadline; returns [(time, message)]"""
+    messages = []
+    while time.perf_counter() < until:
+        data = ser.read(max(1, ser.in_waiting))
+        now = time.perf_counter()
+        if not data:
+            continue
+        # The last byte finished arriving about now, each earlier one a byte time before
+        count = len(data)
+        times = [now - (count - 1 - i) * BYTE_TIME for i in range(count)]
+        messages.extend(parser.feed(data, times))
+    return messages
+
+
+def grid_residuals(times):
+    """Least-squares fit of times against their index; returns (period, residuals)"""
+    n = len(times)
+    mean_i = (n - 1) / 2.0
+    mean_t = sum(times) / n
+    sxx = sum((i - mean_i) ** 2 for i in range(n))
+    sxy = sum((i - mean_i) * (t - mean_t) for i, t in enumerate(times))
+    period = sxy / sxx
+    start = mean_t - period * mean_i
+    return period, [t - (start + period * i) for i, t in enumerate(times)]
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def report(name, times, expected=None):
+    """Print interval and grid statistics for a periodic event"""
+    if len(times) < 3:
+        print(f"{name}: only {len(times)} events, nothing to measure")
+        return
+    intervals = [b - a for a, b in zip(times, times[1:])]
+    period, residuals = grid_residuals(times)
+    deviation = [abs(r) for r in residuals]
+    print(f"{name}: {len(times)} events, period {period * 1e3:.3f} ms"
+          + (f" (expected {expected * 1e3:.3f} ms, {(period - expected) * 1e6 / expected:+.0f} ppm)"
+             if expected else ""))
+    print(f"  interval  mean {statistics.mean(intervals) * 1e3:8.3f} ms  "
+          f"stdev {statistics.pstdev(intervals) * 1e3:7.3f} ms  "
+          f"min {min(intervals) * 1e3:8.3f}  max {max(intervals) * 1e3:8.3f}")
+    print(f"  vs grid   rms {statistics.pstdev(residuals) * 1e3:7.3f} ms  "
+          f"p99 {percentile(deviation, 0.99) * 1e3:7.3f} ms  max {max(deviation) * 1e3:7.3f} ms")
+
+
+def send_clock(ser, bpm, seconds, stop):
+    """Host-generated clock with a beat note, for the loopback baseline"""
+    period = 60.0 / (bpm * CLOCKS_PER_BEAT)
+    start = time.perf_counter() + 0.1
+    ser.write(b"\xFA")
+    index = 0
+    while not stop.is_set() and index * period < seconds:
+        due = start + index * period
+        while time.perf_counter() < due:
+            pass
+        if index % CLOCKS_PER_BEAT == 0:
+            ser.write(b"\xF8\x99\x25\x64")
+        elif index % CLOCKS_PER_BEAT == CLOCKS_PER_BEAT // 4:
+            ser.write(b"\xF8\x89\x25\x00")
+        else:
+            ser.write(b"\xF8")
+        index += 1
+
+
+def measure_clock(ser, args):
+    parser = MidiParser()
+    stop = threading.Event()
+    sender = None
+
+    # Bytes already buffered would arrive in one burst and skew the fit
+    ser.reset_input_buffer()
+    if args.loopback:
+        sender = threading.Thread(target=send_clock, args=(ser, args.bpm, args.seconds, stop), daemon=True)
+        sender.start()
+
+    print(f"Recording for {args.seconds:.0f} s ...")
+    messages = read_messages(ser, parser, time.perf_counter() + args.seconds)
+    stop.set()
+
+    clocks = [t for t, m in messages if m[0] == 0xF8]
+    beats = [t for t, m in messages if (m[0] & 0xF0) == 0x90 and len(m) == 3 and m[2] > 0]
+    other = sum(1 for t, m in messages if m[0] not in (0xF8, 0xFA, 0xFC) and (m[0] & 0xF0) not in (0x80, 0x90))
+    period = 60.0 / (args.bpm * CLOCKS_PER_BEAT)
+
+    print(f"Messages: {len(messages)}, clocks {len(clocks)}, beats {len(beats)}, "
+          f"other {other}, stray data bytes {parser.stray}")
+    report("Clock (F8)", clocks, period)
+    report("Beat (note on)", beats, period * CLOCKS_PER_BEAT)
+
+
+def measure_thru(ser, args):
+    parser = MidiParser()
+    sent = {}
+    latencies = []
+    interval = args.interval / 1000.0
+
+    for i in range(args.thru):
+        note = i % 128
+        sent[note] = time.perf_counter()
+        ser.write(bytes((0x90, note, 64)))
+        deadline = time.perf_counter() + interval
+        for t, m in read_messages(ser, parser, deadline):
+            if (m[0] & 0xF0) == 0x90 and len(m) == 3 and m[1] in sent:
+                latencies.append(t - sent.pop(m[1]))
+
+    for t, m in read_messages(ser, parser, time.perf_counter() + 0.5):
+        if (m[0] & 0xF0) == 0x90 and len(m) == 3 and m[1] in sent:
+            latencies.append(t - sent.pop(m[1]))
+
+    print(f"Thru: {len(latencies)} of {args.thru} notes returned")
+    if latencies:
+        print(f"  latency mean {statistics.mean(latencies) * 1e3:.3f} ms  "
+              f"stdev {statistics.pstdev(latencies) * 1e3:.3f} ms  "
+              f"min {min(latencies) * 1e3:.3f}  p99 {percentile(latencies, 0.99) * 1e3:.3f}  "
+              f"max {max(latencies) * 1e3:.3f} ms")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Record MIDI timing from the Amiga's MIDI mode")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=MIDI_BAUD, help="Baud rate (default: 31250)")
+    parser.add_argument("--bpm", type=float, default=120.0, help="Tempo the Amiga was started with (default: 120)")
+    parser.add_argument("--seconds", type=float, default=20.0, help="Recording time (default: 20)")
+    parser.add_argument("--thru", type=int, default=0, help="Time N notes through the Amiga's MIDI thru instead")
+    parser.add_argument("--interval", type=float, default=50.0, help="ms between thru notes (default: 50)")
+    parser.add_argument("--loopback", action="store_true", help="Send the clock from the host (loopback plug)")
+    parser.add_argument("--low-latency", action="store_true", help="Ask the driver for low latency (Linux)")
+    args = parser.parse_args()
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    ser = serial.serial_for_url(args.port, baudrate=args.baud, timeout=0.001,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+    if args.low_latency:
+        try:
+            ser.set_low_latency_mode(True)
+        except (AttributeError, ValueError, OSError) as e:
+            print(f"Low latency mode not available: {e}")
+
+    try:
+        if args.thru:
+            measure_thru(ser, args)
+        else:
+            measure_clock(ser, args)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if not args.loopback:
+            ser.write(b"\xFF")
+        ser.close()
+
+
+if __name__ == "__main__":
+    main()
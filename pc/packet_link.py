@@ -0,0 +1,376 @@
+# file: packet_link.py
+"""
+Host side of the framework's framed, credit-controlled link.
+
+Frame format (same as amiga_packet_frame.c):
+    FEND | type | credit(hi) | credit(lo) | payload... | crc(hi) | crc(lo) | FEND
+with FEND/FESC byte stuffing and CRC-16/CCITT (poly 0x1021, init 0xFFFF)
+over type..payload.
+
+Flow control (same as amiga_packet_flow.c): every frame carries the
+sender's credit limit = payload bytes it has consumed (mod 65536) plus
+free receive space. A sender never lets its sent-byte count pass the
+peer's limit, so neither side can overrun the other, even on a
+three-wire cable with XON/XOFF and RTS/CTS disabled.
+
+DATA and CREDIT payloads start with the sender's count of payload bytes
+sent before the frame and the count it expects next from the peer
+(offset(2) ack(2), big-endian); a CREDIT adds a flags byte. Frames
+arrive in order, so DATA starting past the expected count means a frame
+was lost: it is dropped, and a CREDIT with FLOW_CREDIT_RESEND asks the
+peer to go back to the expected count and send everything again
+(go-back-N). Each side keeps its unacknowledged bytes for that, so the
+stream arrives whole.
+
+The module is used by the other host tools; run it directly to talk to
+the example app after it has been started with the FLOW argument:
+
+    python packet_link.py -p COM6 STATUS PING
+    python packet_link.py -p COM6 --flood 20000
+"""
+import sys
+import time
+import argparse
+from collections import deque
+
+FEND = 0xC0
+FESC = 0xDB
+TFEND = 0xDC
+TFESC = 0xDD
+
+FRAME_DATA = 0x01
+FRAME_CREDIT = 0x02
+
+FRAME_MAX_PAYLOAD = 256
+FLOW_MAX_WINDOW = 32767
+FLOW_DATA_HEADER = 4
+FLOW_MAX_CHUNK = FRAME_MAX_PAYLOAD - FLOW_DATA_HEADER
+FLOW_TX_BUFFER_SIZE = 2048  # Unacknowledged bytes kept for resending, as on the Amiga
+FLOW_CREDIT_RESEND = 0x01
+FLOW_REFRESH = 2.0      # Seconds of silence before poll() re-advertises, as the Amiga does
+
+
+def _build_crc_table():
+    table = []
+    for i in range(256):
+        crc = i << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+        table.append(crc & 0xFFFF)
+    return table
+
+
+_CRC_TABLE = _build_crc_table()
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT, continuing from crc"""
+    for b in data:
+        crc = ((crc << 8) & 0xFFFF) ^ _CRC_TABLE[(crc >> 8) ^ b]
+    return crc
+
+
+def encode_frame(frame_type, credit, payload=b""):
+    """Return the stuffed wire bytes for one frame"""
+    if len(payload) > FRAME_MAX_PAYLOAD:
+        raise ValueError("payload too long")
+    body = bytes([frame_type, (credit >> 8) & 0xFF, credit & 0xFF]) + bytes(payload)
+    crc = crc16(body)
+    body += bytes([crc >> 8, crc & 0xFF])
+
+    out = bytearray([FEND])
+    for b in body:
+        if b == FEND:
+            out += bytes([FESC, TFEND])
+        elif b == FESC:
+            out += bytes([FESC, TFESC])
+        else:
+            out.append(b)
+    out.append(FEND)
+    return bytes(out)
+
+
+class FrameDecoder:
+    """Incremental decoder; feed() any chunking of the byte stream"""
+
+    def __init__(self, callback):
+        self.callback = callback
+        self.buffer = bytearray()
+        self.escaped = False
+        self.discard = False
+        self.frames = 0
+        self.crc_errors = 0
+        self.dropped = 0
+
+    def feed(self, data):
+        for b in data:
+            if b == FEND:
+                self._finish()
+                self.buffer.clear()
+                self.escaped = False
+                self.discard = False
+                continue
+
+            if self.escaped:
+                self.escaped = False
+                if b == TFEND:
+                    b = FEND
+                elif b == TFESC:
+                    b = FESC
+                else:
+                    self.discard = True
+            elif b == FESC:
+                self.escaped = True
+                continue
+
+            if self.discard:
+                continue
+            if len(self.buffer) >= FRAME_MAX_PAYLOAD + 5:
+                self.discard = True
+                continue
+            self.buffer.append(b)
+
+    def _finish(self):
+        if self.discard:
+            self.dropped += 1
+            return
+        if not self.buffer:
+            return
+        if len(self.buffer) < 5 or crc16(self.buffer[:-2]) != (self.buffer[-2] << 8 | self.buffer[-1]):
+            self.crc_errors += 1
+            return
+        self.frames += 1
+        self.callback(self.buffer[0], self.buffer[1] << 8 | self.buffer[2], bytes(self.buffer[3:-2]))
+
+
+class FlowLink:
+    """One end of the credit-controlled link over any object with read/write"""
+
+    def __init__(self, port, rx_size=8192, frame_handler=None):
+        self.port = port
+        self.rx_size = min(rx_size, FLOW_MAX_WINDOW)
+        self.rx = deque()
+        self.rx_consumed = 0
+        self.advertised = 0
+        self.rx_gap = False
+        self.rx_gap_end = 0
+        self.tx_sent = 0
+        self.tx_acked = 0
+        self.tx_ring = bytearray()
+        self.tx_limit = 0
+        self.frame_handler = frame_handler
+        self.decoder = FrameDecoder(self._frame)
+        self.credit_stalls = 0
+        self.overruns = 0
+        self.gaps = 0
+        self.resent = 0
+        self.bytes_on_wire = 0
+        self.last_write = 0.0
+
+    def _limit(self):
+        return (self.rx_consumed + self.rx_size - len(self.rx)) & 0xFFFF
+
+    def _write_frame(self, frame_type, payload=b""):
+        limit = self._limit()
+        wire = encode_frame(frame_type, limit, payload)
+        self.advertised = limit
+        self.port.write(wire)
+        self.bytes_on_wire += len(wire)
+        self.last_write = time.monotonic()
+
+    def _expected(self):
+        return (self.rx_consumed + len(self.rx)) & 0xFFFF
+
+    def _missing(self, offset):
+        """Does the peer's offset lie past what has arrived?"""
+        return 0 < ((offset - self._expected()) & 0xFFFF) <= FLOW_MAX_WINDOW
+
+    def _header(self, offset):
+        return offset.to_bytes(2, "big") + self._expected().to_bytes(2, "big")
+
+    def _write_credit(self, flags=0):
+        self._write_frame(FRAME_CREDIT, self._header(self.tx_sent) + bytes([flags]))
+
+    def _advertise_opening(self):
+        # A quarter of the window, or of the peer's resend ring our ack frees
+        if ((self._limit() - self.advertised) & 0xFFFF) >= min(self.rx_size, FLOW_TX_BUFFER_SIZE) // 4:
+            self._write_credit()
+
+    def _take_ack(self, ack):
+        """Drop ring bytes the peer has acknowledged"""
+        acked = (ack - self.tx_acked) & 0xFFFF
+        if acked <= len(self.tx_ring):
+            del self.tx_ring[:acked]
+            self.tx_acked = ack
+
+    def _resend(self):
+        """Go back to the peer's expected offset and send everything again"""
+        for start in range(0, len(self.tx_ring), FLOW_MAX_CHUNK):
+            chunk = self.tx_ring[start:start + FLOW_MAX_CHUNK]
+            self._write_frame(FRAME_DATA, self._header((self.tx_acked + start) & 0xFFFF) + chunk)
+            self.resent += len(chunk)
+
+    def start(self):
+        """Announce our window"""
+        self._write_credit()
+
+    def refresh(self):
+        """Re-advertise the window and our offsets"""
+        self._write_credit()
+
+    def credit(self):
+        credit = (self.tx_limit - self.tx_sent) & 0xFFFF
+        if credit > FLOW_MAX_WINDOW:
+            return 0
+        # Unacknowledged bytes are kept for resending
+        return min(credit, FLOW_TX_BUFFER_SIZE - len(self.tx_ring))
+
+    def _frame(self, frame_type, credit, payload):
+        if ((credit - self.tx_limit) & 0xFFFF) <= FLOW_MAX_WINDOW:
+            self.tx_limit = credit
+        if frame_type not in (FRAME_DATA, FRAME_CREDIT):
+            if self.frame_handler:
+                self.frame_handler(frame_type, payload)
+            return
+        if len(payload) < FLOW_DATA_HEADER:
+            return
+        offset = payload[0] << 8 | payload[1]
+        self._take_ack(payload[2] << 8 | payload[3])
+        if frame_type == FRAME_CREDIT:
+            if len(payload) > FLOW_DATA_HEADER and payload[FLOW_DATA_HEADER] & FLOW_CREDIT_RESEND:
+                self._resend()
+            # The peer has sent more than arrived: its last frames were lost
+            if self._missing(offset):
+                self.rx_gap = True
+                self.rx_gap_end = offset
+                self._write_credit(FLOW_CREDIT_RESEND)
+            return
+        if self._missing(offset):
+            # Ask once for the frames already in flight; a gap in the
+            # resend itself starts below rx_gap_end and is asked for again
+            self.gaps += 1
+            if not self.rx_gap or 0 < ((self.rx_gap_end - offset) & 0xFFFF) <= FLOW_MAX_WINDOW:
+                self.rx_gap = True
+                self.rx_gap_end = (offset + 1) & 0xFFFF
+                self._write_credit(FLOW_CREDIT_RESEND)
+            return
+        # Skip anything already received; a resend can overlap
+        behind = (self._expected() - offset) & 0xFFFF
+        payload = payload[FLOW_DATA_HEADER:]
+        if behind >= len(payload):
+            return
+        payload = payload[behind:]
+        space = self.rx_size - len(self.rx)
+        if len(payload) > space:
+            # Peer overran its credit; keep what fits, the rest comes again
+            self.overruns += len(payload) - space
+            payload = payload[:space]
+        if payload:
+            self.rx.extend(payload)
+            self.rx_gap = False
+
+    def poll(self):
+        """Take in whatever the port has; returns True if anything arrived"""
+        # Repairs a lost CREDIT frame, and shows the peer when our last
+        # DATA frames never arrived so it can ask for them again
+        if time.monotonic() - self.last_write > FLOW_REFRESH:
+            self.refresh()
+        waiting = getattr(self.port, "in_waiting", 0)
+        data = self.port.read(max(1, waiting))
+        if data:
+            self.decoder.feed(data)
+            return True
+        return False
+
+    def send(self, data, timeout=10.0):
+        """Send all of data, waiting for credit as needed"""
+        data = memoryview(bytes(data))
+        deadline = time.monotonic() + timeout
+        while data:
+            chunk = min(len(data), FLOW_MAX_CHUNK, self.credit())
+            if chunk == 0:
+                self.credit_stalls += 1
+                if time.monotonic() > deadline:
+                    raise TimeoutError("peer granted no credit")
+                self.poll()
+                continue
+            self.tx_ring += data[:chunk]
+            self._write_frame(FRAME_DATA, self._header(self.tx_sent) + bytes(data[:chunk]))
+            self.tx_sent = (self.tx_sent + chunk) & 0xFFFF
+            data = data[chunk:]
+            deadline = time.monotonic() + timeout
+
+    def send_frame(self, frame_type, payload=b""):
+        """Send a non-data frame; carries credit but consumes none"""
+        self._write_frame(frame_type, payload)
+
+    def read(self, max_length=65536):
+        """Return buffered payload, re-advertising credit as space frees up"""
+        count = min(max_length, len(self.rx))
+        out = bytes(self.rx.popleft() for _ in range(count))
+        self.rx_consumed = (self.rx_consumed + count) & 0xFFFF
+        if count:
+            self._advertise_opening()
+        return out
+
+    def read_line(self, timeout=2.0):
+        """Return one CR/LF terminated line of payload, or None on timeout"""
+        line = bytearray()
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            if not self.rx:
+                self.poll()
+                continue
+            b = self.read(1)
+            if b == b"\n":
+                return bytes(line).rstrip(b"\r")
+            line += b
+        return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Framed, flow-controlled link to the Amiga packet app")
+    parser.add_argument("commands", nargs="*", help="Command lines to send (e.g. STATUS PING)")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=9600, help="Baud rate (default: 9600)")
+    parser.add_argument("--flood", type=int, default=0, help="Send N bytes of echo data and report throughput")
+    args = parser.parse_args()
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    ser = serial.serial_for_url(args.port, baudrate=args.baud, timeout=0.05,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+    link = FlowLink(ser)
+    link.start()
+
+    for command in args.commands:
+        link.send(command.encode("ascii") + b"\r\n")
+        reply = link.read_line()
+        print(f"{command} -> {reply.decode('ascii', 'replace') if reply is not None else '(no reply)'}")
+
+    if args.flood:
+        line = b"." * 120 + b"\r\n"
+        sent = 0
+        start = time.monotonic()
+        while sent < args.flood:
+            link.send(line)
+            sent += len(line)
+            while link.rx:
+                link.read()
+            link.poll()
+        elapsed = time.monotonic() - start
+        print(f"Flooded {sent} bytes in {elapsed:.2f} s ({sent / elapsed:.0f} B/s), "
+              f"credit stalls={link.credit_stalls}, wire bytes={link.bytes_on_wire}")
+
+    print(f"Frames ok={link.decoder.frames} crc errors={link.decoder.crc_errors} "
+          f"dropped={link.decoder.dropped} overruns={link.overruns} gaps={link.gaps} resent={link.resent}")
+    ser.close()
+
+
+if __name__ == "__main__":
+    main()
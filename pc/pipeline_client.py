@@ -0,0 +1,165 @@
+# file: pipeline_client.py
+"""
+Pipelined command client for the Amiga packet application.
+
+Sends commands to the example app (ProcessLines loop) either one at a time,
+waiting for each reply, or pipelined with "#<id> " request tags so several
+commands are in flight per round trip. Replies are matched by tag, so the
+order they come back in does not matter. Prints commands/sec for both modes.
+
+Usage:
+    python pipeline_client.py -p COM6 -n 200 -w 16
+    python pipeline_client.py -p socket://192.168.1.50:2323 -c STATUS,PING
+"""
+import sys
+import time
+import argparse
+
+try:
+    import serial
+except ImportError:
+    print("Error: PySerial not installed.")
+    print("Please install it with: pip install pyserial")
+    sys.exit(1)
+
+
+class LineReader:
+    """Splits the serial byte stream into lines without losing partial data"""
+
+    def __init__(self, ser):
+        self.ser = ser
+        self.buffer = bytearray()
+
+    def read_line(self, deadline):
+        """Return the next complete line (without CR/LF), or None on timeout"""
+        while True:
+            newline = self.buffer.find(b'\n')
+            if newline >= 0:
+                line = bytes(self.buffer[:newline]).rstrip(b'\r')
+                del self.buffer[:newline + 1]
+                if line:
+                    return line
+                continue
+
+            if time.monotonic() > deadline:
+                return None
+
+            data = self.ser.read(max(1, self.ser.in_waiting))
+            if data:
+                self.buffer.extend(data)
+
+
+def parse_tag(line):
+    """Split '#<id> rest' into (id, rest); untagged lines give (None, line)"""
+    if line.startswith(b'#'):
+        space = line.find(b' ')
+        if space > 1:
+            return line[1:space].decode('ascii', 'replace'), line[space + 1:]
+    return None, line
+
+
+def run_sequential(ser, reader, commands, count, timeout):
+    """Classic one-at-a-time exchange: send, wait for reply, repeat"""
+    failures = 0
+    start = time.monotonic()
+
+    for i in range(count):
+        command = commands[i % len(commands)]
+        ser.write(command.encode('ascii') + b'\r\n')
+        if reader.read_line(time.monotonic() + timeout) is None:
+            failures += 1
+
+    elapsed = time.monotonic() - start
+    return elapsed, failures
+
+
+def run_pipelined(ser, reader, commands, count, window, timeout):
+    """Keep up to 'window' tagged commands in flight and match replies by tag"""
+    outstanding = {}
+    next_id = 1
+    completed = 0
+    failures = 0
+    reordered = 0
+    last_completed = 0
+    start = time.monotonic()
+
+    while completed + failures < count:
+        # Top up the window with a single write per batch
+        batch = bytearray()
+        while len(outstanding) < window and next_id <= count:
+            command = commands[(next_id - 1) % len(commands)]
+            batch += f"#{next_id} {command}\r\n".encode('ascii')
+            outstanding[str(next_id)] = time.monotonic()
+            next_id += 1
+        if batch:
+            ser.write(batch)
+
+        line = reader.read_line(time.monotonic() + timeout)
+        if line is None:
+            # Everything still in flight is lost
+            failures += len(outstanding)
+            outstanding.clear()
+            continue
+
+        tag, _ = parse_tag(line)
+        if tag is None or tag not in outstanding:
+            continue  # Unsolicited output or continuation line
+
+        del outstanding[tag]
+        completed += 1
+        if int(tag) < last_completed:
+            reordered += 1
+        last_completed = int(tag)
+
+    elapsed = time.monotonic() - start
+    return elapsed, failures, reordered
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Pipelined command benchmark for the Amiga packet app")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=9600, help="Baud rate (default: 9600)")
+    parser.add_argument("-n", "--count", type=int, default=100, help="Commands per run (default: 100)")
+    parser.add_argument("-w", "--window", type=int, default=16, help="Commands in flight when pipelining (default: 16)")
+    parser.add_argument("-c", "--commands", default="STATUS,PING", help="Comma separated command mix (default: STATUS,PING)")
+    parser.add_argument("-t", "--timeout", type=float, default=2.0, help="Reply timeout in seconds (default: 2.0)")
+    args = parser.parse_args()
+
+    commands = [c.strip() for c in args.commands.split(',') if c.strip()]
+
+    try:
+        ser = serial.serial_for_url(args.port, baudrate=args.baud, timeout=0.05,
+                                    xonxoff=False, rtscts=False, dsrdtr=False)
+    except Exception as e:
+        print(f"Error opening {args.port}: {e}")
+        sys.exit(1)
+
+    reader = LineReader(ser)
+    ser.reset_input_buffer()
+
+    print(f"Benchmarking {args.count} commands ({', '.join(commands)}) on {args.port} at {args.baud} baud")
+    print("-" * 60)
+
+    seq_time, seq_fail = run_sequential(ser, reader, commands, args.count, args.timeout)
+    seq_rate = (args.count - seq_fail) / seq_time if seq_time > 0 else 0.0
+    print(f"Sequential        : {seq_time:8.3f} s  {seq_rate:8.1f} cmd/s  failures={seq_fail}")
+
+    # Drain any stragglers before the pipelined run
+    time.sleep(args.timeout / 4)
+    ser.reset_input_buffer()
+    reader.buffer.clear()
+
+    pipe_time, pipe_fail, reordered = run_pipelined(ser, reader, commands, args.count,
+                                                    args.window, args.timeout)
+    pipe_rate = (args.count - pipe_fail) / pipe_time if pipe_time > 0 else 0.0
+    print(f"Pipelined (w={args.window:<3}): {pipe_time:8.3f} s  {pipe_rate:8.1f} cmd/s  "
+          f"failures={pipe_fail} out-of-order={reordered}")
+
+    if seq_rate > 0:
+        print(f"Speedup           : {pipe_rate / seq_rate:8.2f}x")
+
+    ser.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,389 @@
+# file: print_spooler.py
+"""
+Serial printer emulation: a spooler for print jobs from the Amiga.
+
+Print data is written to disk as it arrives, one append-only file per
+job in the spool directory, so memory use stays at one read buffer
+whatever the job size. A job ends when the line goes quiet for --idle
+seconds, or for the shorter --ff-idle after a form feed (the usual last
+byte of a page). Finished jobs are renamed from .part to .prn and handed
+to the backend, which runs at its own pace in a separate thread:
+
+    python print_spooler.py -p /dev/ttyUSB0 --spool spool --out-dir printed
+    python print_spooler.py -p COM6 --backend "lp -d laser" --flow xonxoff
+    python print_spooler.py --pty-test
+
+The receive loop only reads and appends, so it keeps up with the serial
+line. Back-pressure toward the Amiga (XOFF, or RTS dropped for the
+CTS-wired printer.device setting) is applied only when the finished
+jobs waiting for the backend reach --max-queue bytes, or the disk is
+nearly full, and released once the backend has brought it down to
+three quarters.
+Bytes still in flight after XOFF are stored, not dropped. Jobs left in
+the spool directory by an earlier run are printed first.
+
+--pty-test sends jobs through a pty the way printer.device would
+(honouring XON/XOFF) into a spooler with a slow backend and a small
+queue, and checks every job arrives intact.
+"""
+import os
+import sys
+import time
+import queue
+import shutil
+import argparse
+import threading
+import subprocess
+
+XON = b"\x11"
+XOFF = b"\x13"
+FORM_FEED = 0x0C
+READ_SIZE = 4096
+LOW_WATER = 0.75                        # Release back-pressure below this part of max_queue
+DISK_RESERVE = 16 * 1024 * 1024         # Free space kept on the spool disk
+
+
+class FlowControl:
+    """Back-pressure toward the Amiga: "xonxoff", "rts" or "none" """
+
+    def __init__(self, ser, mode):
+        self.ser = ser
+        self.mode = mode
+        self.stopped = False
+        self.stops = 0
+
+    def stop(self, stop):
+        if stop == self.stopped:
+            return
+        self.stopped = stop
+        if stop:
+            self.stops += 1
+        if self.mode == "xonxoff":
+            self.ser.write(XOFF if stop else XON)
+        elif self.mode == "rts":
+            self.ser.rts = not stop
+
+
+class Spooler:
+    """Streams print data into job files and tracks the unprinted queue"""
+
+    def __init__(self, spool_dir, max_queue, idle, ff_idle, flow):
+        self.spool_dir = spool_dir
+        self.max_queue = max_queue
+        self.idle = idle
+        self.ff_idle = ff_idle
+        self.flow = flow
+        self.ready = queue.Queue()      # Finished job paths, oldest first
+        self.lock = threading.Lock()
+        self.queued = 0                 # Bytes in finished jobs not yet printed
+        self.job = None
+        self.job_path = None
+        self.job_bytes = 0
+        self.last_data = 0.0
+        self.ended_with_ff = False
+        self.jobs = 0
+        self.received = 0
+        self.disk_checked = -1.0
+        self.disk_low = False
+        os.makedirs(spool_dir, exist_ok=True)
+        self.sequence = self._recover()
+
+    def _recover(self):
+        """Queue jobs left by an earlier run; returns the next job number"""
+        last = 0
+        for name in sorted(os.listdir(self.spool_dir)):
+            stem, ext = os.path.splitext(name)
+            if not stem.isdigit() or ext not in (".part", ".prn"):
+                continue
+            path = os.path.join(self.spool_dir, name)
+            if ext == ".part":          # Cut short by a restart; print what arrived
+                os.replace(path, os.path.join(self.spool_dir, stem + ".prn"))
+                path = os.path.join(self.spool_dir, stem + ".prn")
+            self.queued += os.path.getsize(path)
+            self.ready.put(path)
+            last = max(last, int(stem))
+        return last + 1
+
+    def feed(self, data, now):
+        """Append received bytes to the current job, starting one if needed"""
+        if not self.job:
+            self.job_path = os.path.join(self.spool_dir, f"{self.sequence:06d}.part")
+            self.sequence += 1
+            self.job = open(self.job_path, "ab")
+            self.job_bytes = 0
+        self.job.write(data)
+        self.job_bytes += len(data)
+        self.received += len(data)
+        self.last_data = now
+        self.ended_with_ff = data[-1] == FORM_FEED
+
+    def poll(self, now):
+        """Ends the job after its idle time and updates back-pressure"""
+        if self.job:
+            quiet = now - self.last_data
+            if quiet >= self.idle or (self.ended_with_ff and quiet >= self.ff_idle):
+                self.finish_job()
+        self._update_flow(now)
+
+    def finish_job(self):
+        if not self.job:
+            return
+        self.job.close()
+        self.job = None
+        path = self.job_path[:-len(".part")] + ".prn"
+        os.replace(self.job_path, path)
+        self.jobs += 1
+        with self.lock:
+            self.queued += self.job_bytes
+        self.ready.put(path)
+
+    def printed(self, size):
+        """Called by the backend once a job's file is gone"""
+        with self.lock:
+            self.queued -= size
+
+    def full(self):
+        """The job being received does not count until it ends: the backend
+        cannot take it yet, so only the disk reserve limits it."""
+        with self.lock:
+            queued = self.queued
+        if self.flow.stopped:
+            if queued > self.max_queue * LOW_WATER:
+                return True
+        elif queued >= self.max_queue:
+            return True
+        return self.disk_low
+
+    def _update_flow(self, now):
+        if now - self.disk_checked >= 0.5:
+            self.disk_checked = now
+            self.disk_low = shutil.disk_usage(self.spool_dir).free < DISK_RESERVE
+        self.flow.stop(self.full())
+
+
+class Backend(threading.Thread):
+    """Prints finished jobs: a command's stdin, a directory or nowhere
+
+    rate limits it to that many bytes a second, to try out back-pressure
+    against a slow printer.
+    """
+
+    def __init__(self, spooler, command=None, out_dir=None, rate=0):
+        threading.Thread.__init__(self, daemon=True)
+        self.spooler = spooler
+        self.command = command
+        self.out_dir = out_dir
+        self.rate = rate
+        self.printed = 0
+        if out_dir:
+            os.makedirs(out_dir, exist_ok=True)
+
+    def run(self):
+        while True:
+            path = self.spooler.ready.get()
+            if path is None:
+                return
+            size = os.path.getsize(path)
+            self.print_job(path)
+            if os.path.exists(path):
+                os.remove(path)
+            self.spooler.printed(size)
+            self.printed += 1
+
+    def print_job(self, path):
+        if self.out_dir:
+            target = os.path.join(self.out_dir, os.path.basename(path))
+            if not self.rate:
+                shutil.move(path, target)
+                return
+            out = open(target, "wb")
+        elif self.command:
+            process = subprocess.Popen(self.command, shell=True, stdin=subprocess.PIPE)
+            out = process.stdin
+        else:
+            out = None
+
+        with open(path, "rb") as f:
+            start = time.monotonic()
+            sent = 0
+            while True:
+                chunk = f.read(READ_SIZE)
+                if not chunk:
+                    break
+                if out:
+                    out.write(chunk)
+                sent += len(chunk)
+                if self.rate:
+                    delay = start + sent / self.rate - time.monotonic()
+                    if delay > 0:
+                        time.sleep(delay)
+
+        if out:
+            out.close()
+        if self.command:
+            process.wait()
+
+
+def run_port(spooler, ser):
+    """Receive loop: read what the port has, append it, check the timers"""
+    while True:
+        data = ser.read(max(1, min(ser.in_waiting, READ_SIZE)))
+        now = time.monotonic()
+        if data:
+            spooler.feed(data, now)
+        spooler.poll(now)
+
+
+def pty_test(args):
+    """Jobs through a pty with XON/XOFF into a slow backend; checks them all"""
+    import random
+    import tty
+
+    master, slave = os.openpty()
+    tty.setraw(master)
+    tty.setraw(slave)
+    os.set_blocking(master, False)
+    os.set_blocking(slave, False)
+
+    class PtyPort:
+        def __init__(self, fd):
+            self.fd = fd
+            self.in_waiting = 0
+
+        def read(self, size):
+            try:
+                return os.read(self.fd, READ_SIZE)
+            except BlockingIOError:
+                time.sleep(0.001)
+                return b""
+
+        def write(self, data):
+            os.write(self.fd, data)
+
+    spool_dir = args.spool
+    out_dir = os.path.join(spool_dir, "printed")
+    shutil.rmtree(spool_dir, ignore_errors=True)
+    port = PtyPort(slave)
+    spooler = Spooler(spool_dir, args.max_queue, args.idle, args.ff_idle,
+                      FlowControl(port, "xonxoff"))
+    backend = Backend(spooler, out_dir=out_dir, rate=args.rate)
+    backend.start()
+
+    rng = random.Random(1)
+    jobs = [bytes(rng.randrange(32, 127) for _ in range(rng.randrange(2000, 60000))) + b"\x0c"
+            for _ in range(args.jobs)]
+    state = {"paused": False, "xoffs": 0, "sent": 0}
+
+    def amiga():
+        """printer.device with XON/XOFF: stops on XOFF, resumes on XON"""
+        byte_time = 10.0 / args.baud
+        for job in jobs:
+            offset = 0
+            while offset < len(job):
+                try:
+                    for c in os.read(master, 64):
+                        if c == XOFF[0] and not state["paused"]:
+                            state["paused"] = True
+                            state["xoffs"] += 1
+                        elif c == XON[0]:
+                            state["paused"] = False
+                except BlockingIOError:
+                    pass
+                if state["paused"]:
+                    time.sleep(0.002)
+                    continue
+                chunk = job[offset:offset + 64]
+                os.write(master, chunk)
+                offset += len(chunk)
+                state["sent"] += len(chunk)
+                time.sleep(len(chunk) * byte_time)
+            time.sleep(args.ff_idle * 2)
+
+    sender = threading.Thread(target=amiga, daemon=True)
+    start = time.monotonic()
+    sender.start()
+    while sender.is_alive() or spooler.job:
+        data = port.read(READ_SIZE)
+        now = time.monotonic()
+        if data:
+            spooler.feed(data, now)
+        spooler.poll(now)
+    elapsed = time.monotonic() - start
+
+    while backend.printed < len(jobs) and time.monotonic() - start < elapsed + 60:
+        time.sleep(0.05)
+    printed = sorted(os.listdir(out_dir))
+    contents = [open(os.path.join(out_dir, name), "rb").read() for name in printed]
+    total = sum(len(job) for job in jobs)
+    line_rate = args.baud / 10.0
+    busy = elapsed - len(jobs) * args.ff_idle * 2
+    print(f"Sent {len(jobs)} jobs, {total} bytes in {elapsed:.1f} s "
+          f"({total / busy:.0f} B/s between jobs, line {line_rate:.0f} B/s)")
+    print(f"Spooled {spooler.jobs} jobs, printed {backend.printed}, XOFF sent {spooler.flow.stops} times, "
+          f"Amiga paused {state['xoffs']} times")
+    print("PASS" if contents == jobs else "FAIL: printed jobs differ from what was sent")
+    shutil.rmtree(spool_dir, ignore_errors=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Print spooler for the Amiga's serial printer output")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=9600, help="Baud rate (default: 9600)")
+    parser.add_argument("--spool", default="spool", help="Spool directory (default: spool)")
+    parser.add_argument("--out-dir", help="Move printed jobs here")
+    parser.add_argument("--backend", help="Command that prints a job from stdin (e.g. \"lp -d laser\")")
+    parser.add_argument("--rate", type=int, default=0, help="Limit the backend to N bytes/s (testing)")
+    parser.add_argument("--flow", choices=("xonxoff", "rts", "none"), default="xonxoff",
+                        help="Back-pressure toward the Amiga (default: xonxoff)")
+    parser.add_argument("--max-queue", type=int, default=64 * 1024 * 1024,
+                        help="Unprinted bytes before back-pressure (default: 64 MB)")
+    parser.add_argument("--idle", type=float, default=10.0, help="Seconds of silence that end a job (default: 10)")
+    parser.add_argument("--ff-idle", type=float, default=2.0,
+                        help="Seconds of silence after a form feed that end a job (default: 2)")
+    parser.add_argument("--pty-test", action="store_true", help="Self-test through a pty")
+    parser.add_argument("--jobs", type=int, default=6, help="pty test: number of jobs (default: 6)")
+    args = parser.parse_args()
+
+    if args.pty_test:
+        if args.max_queue == parser.get_default("max_queue"):
+            args.max_queue = 48 * 1024
+        if not args.rate:
+            args.rate = 4000
+        if args.baud == parser.get_default("baud"):
+            args.baud = 115200
+        if args.ff_idle == parser.get_default("ff_idle"):
+            args.ff_idle = 0.3
+        args.spool = os.path.join(args.spool, "pty-test")
+        pty_test(args)
+        return
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    ser = serial.serial_for_url(args.port, baudrate=args.baud, timeout=0.05,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+    flow = FlowControl(ser, args.flow)
+    flow.stop(False)
+    spooler = Spooler(args.spool, args.max_queue, args.idle, args.ff_idle, flow)
+    backend = Backend(spooler, command=args.backend, out_dir=args.out_dir, rate=args.rate)
+    backend.start()
+    print(f"Spooling {args.port} at {args.baud} baud into {args.spool} "
+          f"({spooler.ready.qsize()} jobs waiting)")
+
+    try:
+        run_port(spooler, ser)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        spooler.finish_job()
+        ser.close()
+        print(f"Jobs: {spooler.jobs} spooled, {backend.printed} printed; {spooler.received} bytes; "
+              f"back-pressure applied {flow.stops} times")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,345 @@
+# file: screen_viewer.py
+"""
+Show an Amiga screen streamed by the screen streaming module
+(amiga_packet_screen.c) over the framed, credit-controlled link.
+
+The Amiga splits each bitplane into 32x8 pixel tiles and sends only
+the tiles that changed since the last pass, each plane as raw bytes,
+ByteRun1, or ByteRun1 of the XOR with what it sent before. Messages
+travel as FRAME_SCREEN (0x04) frames next to the normal command traffic:
+    op | seq | body...
+    FORMAT  width(2) height(2) depth(1) flags(1)   the screen starts over
+    PALETTE count(1) 0x0RGB words
+    TILES   records: tile(2) planes(1), then per plane: encoding(1) data
+    END     frame(2) tiles(2) bytes(4)             a pass is complete
+big-endian. A gap in seq means messages were lost: this side asks for
+them with RESEND, and the Amiga sends their tiles again whole. If too
+many are gone, or tiles arrive before any FORMAT, it asks for REFRESH.
+
+The picture is written as a PNG (EHB and HAM6 screens included), at
+most once per --interval seconds and after the last frame.
+
+Start the example app with the FLOW argument, then:
+
+    python screen_viewer.py -p COM6 -o amiga.png
+    python screen_viewer.py -p COM6 --frames 100 --screen Workbench
+
+--frames sends "SCREEN <frames> [screen]" to start the stream; without
+it, type SCREEN on the Amiga side or in another tool.
+"""
+import os
+import sys
+import time
+import struct
+import zlib
+import argparse
+
+from packet_link import FlowLink
+
+FRAME_SCREEN = 0x04
+
+OP_FORMAT = 1
+OP_PALETTE = 2
+OP_TILES = 3
+OP_END = 4
+OP_REFRESH = 5
+OP_RESEND = 6
+
+ENC_RAW = 0
+ENC_RLE = 1
+ENC_XOR = 2
+
+FLAG_HAM = 0x01
+FLAG_EHB = 0x02
+
+TILE_BYTES = 4
+TILE_ROWS = 8
+HISTORY = 32        # Messages the Amiga remembers for RESEND
+
+
+def unpack_byterun1(data, pos, length):
+    """Unpack ByteRun1 from data[pos:] into length bytes; returns (bytes, new pos)"""
+    out = bytearray()
+    while len(out) < length:
+        c = data[pos]
+        pos += 1
+        if c < 128:
+            out += data[pos:pos + c + 1]
+            pos += c + 1
+        elif c > 128:
+            out += bytes([data[pos]]) * (257 - c)
+            pos += 1
+    if len(out) != length:
+        raise ValueError("run overflows the tile")
+    return bytes(out), pos
+
+
+def write_png(path, width, height, rgb):
+    """Write 8-bit RGB rows as a PNG; replaces path in one step"""
+    def chunk(kind, body):
+        return (struct.pack(">I", len(body)) + kind + body +
+                struct.pack(">I", zlib.crc32(kind + body) & 0xFFFFFFFF))
+
+    stride = width * 3
+    raw = b"".join(b"\x00" + rgb[y * stride:(y + 1) * stride] for y in range(height))
+    png = (b"\x89PNG\r\n\x1a\n" +
+           chunk(b"IHDR", struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0)) +
+           chunk(b"IDAT", zlib.compress(raw, 6)) +
+           chunk(b"IEND", b""))
+    temp = path + ".tmp"
+    with open(temp, "wb") as f:
+        f.write(png)
+    os.replace(temp, path)
+
+
+class ScreenDecoder:
+    """Rebuilds the Amiga's bitplanes from FRAME_SCREEN messages"""
+
+    def __init__(self, link, verbose=False):
+        self.link = link
+        self.verbose = verbose
+        self.width = self.height = self.depth = self.flags = 0
+        self.row_bytes = 0
+        self.planes = []
+        self.palette = [0] * 32
+        self.formatted = False
+        self.next_seq = None
+        self.missing = []
+        self.refresh_asked = False
+        self.refresh_wait = 0
+        self.frames = 0
+        self.frame_bytes = 0
+        self.total_bytes = 0
+        self.tiles = 0
+        self.lost = 0
+        self.resends = 0
+        self.refreshes = 0
+        self.bad = 0
+        self.started = None
+        self.changed = False
+
+    def handle_frame(self, payload):
+        if len(payload) < 2:
+            return
+        op, seq = payload[0], payload[1]
+        if self.next_seq is not None and seq != self.next_seq:
+            gap = (seq - self.next_seq) & 0xFF
+            self.lost += gap
+            if gap > HISTORY // 2 or len(self.missing) + gap > HISTORY:
+                self.refresh()
+            else:
+                self.missing += [(self.next_seq + i) & 0xFF for i in range(gap)]
+        self.next_seq = (seq + 1) & 0xFF
+
+        body = payload[2:]
+        try:
+            if op == OP_FORMAT:
+                self.format(*struct.unpack(">HHBB", body[:6]))
+            elif not self.formatted:
+                self.refresh()
+            elif op == OP_PALETTE:
+                count = body[0]
+                for i, value in enumerate(struct.unpack(f">{count}H", body[1:1 + 2 * count])):
+                    self.palette[i] = value
+                self.changed = True
+            elif op == OP_TILES:
+                self.apply_tiles(body)
+            elif op == OP_END:
+                frame, tiles, length = struct.unpack(">HHI", body[:8])
+                self.end_of_pass(frame, tiles, length)
+        except (ValueError, IndexError, struct.error):
+            # Damage the frame CRC missed; have the whole screen again
+            self.bad += 1
+            self.refresh()
+        self.ask()
+
+    def format(self, width, height, depth, flags):
+        self.width, self.height, self.depth, self.flags = width, height, depth, flags
+        self.row_bytes = (width + 15) // 16 * 2
+        self.planes = [bytearray(self.row_bytes * height) for _ in range(depth)]
+        self.formatted = True
+        self.refresh_asked = False
+        self.refresh_wait = 0
+        self.missing = []
+        self.changed = True
+        if self.verbose:
+            mode = " HAM" if flags & FLAG_HAM else " EHB" if flags & FLAG_EHB else ""
+            print(f"[screen {width}x{height}x{depth}{mode}]")
+
+    def apply_tiles(self, body):
+        columns = (self.row_bytes + TILE_BYTES - 1) // TILE_BYTES
+        pos = 0
+        while pos + 3 <= len(body):
+            tile, mask = struct.unpack(">HB", body[pos:pos + 3])
+            pos += 3
+            x = (tile % columns) * TILE_BYTES
+            y = (tile // columns) * TILE_ROWS
+            if y >= self.height:
+                raise ValueError("tile outside the screen")
+            width = min(TILE_BYTES, self.row_bytes - x)
+            rows = min(TILE_ROWS, self.height - y)
+            length = width * rows
+            for p in range(self.depth):
+                if not mask & (1 << p):
+                    continue
+                encoding = body[pos]
+                pos += 1
+                if encoding == ENC_RAW:
+                    data = body[pos:pos + length]
+                    pos += length
+                    if len(data) != length:
+                        raise ValueError("short tile")
+                else:
+                    data, pos = unpack_byterun1(body, pos, length)
+                plane = self.planes[p]
+                for r in range(rows):
+                    start = (y + r) * self.row_bytes + x
+                    row = data[r * width:(r + 1) * width]
+                    if encoding == ENC_XOR:
+                        row = bytes(a ^ b for a, b in zip(plane[start:start + width], row))
+                    plane[start:start + width] = row
+            self.tiles += 1
+        self.changed = True
+
+    def end_of_pass(self, frame, tiles, length):
+        now = time.monotonic()
+        if self.started is None:
+            self.started = now
+        else:
+            self.frames += 1
+            self.total_bytes += length
+        self.frame_bytes = length
+        if self.refresh_asked:
+            # The REFRESH itself may have been lost; ask again after two passes
+            self.refresh_wait += 1
+            if self.refresh_wait > 2:
+                self.refresh_asked = False
+                self.refresh_wait = 0
+        if self.verbose:
+            print(f"[frame {frame}: {tiles} tiles, {length} bytes]")
+
+    def refresh(self):
+        if not self.refresh_asked:
+            self.refresh_asked = True
+            self.refreshes += 1
+            self.link.send_frame(FRAME_SCREEN, bytes([OP_REFRESH, 0]))
+        self.missing = []
+
+    def ask(self):
+        """Ask for the messages found missing"""
+        if self.missing:
+            self.resends += 1
+            self.link.send_frame(FRAME_SCREEN, bytes([OP_RESEND]) + bytes(self.missing))
+            if self.verbose:
+                print(f"[resend {len(self.missing)} messages]")
+            self.missing = []
+
+    def colors(self):
+        """The palette as 8-bit RGB triples, EHB half-bright colours added"""
+        rgb = [(((v >> 8) & 15) * 17, ((v >> 4) & 15) * 17, (v & 15) * 17) for v in self.palette]
+        if self.flags & FLAG_EHB:
+            rgb = rgb[:32] + [(r >> 1, g >> 1, b >> 1) for r, g, b in rgb[:32]]
+        return rgb
+
+    def rgb(self):
+        """The screen as 8-bit RGB rows"""
+        colors = self.colors()
+        ham = self.flags & FLAG_HAM
+        out = bytearray(self.width * self.height * 3)
+        o = 0
+        for y in range(self.height):
+            rows = [plane[y * self.row_bytes:(y + 1) * self.row_bytes] for plane in self.planes]
+            r, g, b = colors[0]
+            for x in range(self.width):
+                byte, bit = x >> 3, 0x80 >> (x & 7)
+                index = 0
+                for p in range(self.depth):
+                    if rows[p][byte] & bit:
+                        index |= 1 << p
+                if ham:
+                    # HAM6: the top two bits hold or modify one component
+                    value = (index & 15) * 17
+                    control = index >> 4
+                    if control == 0:
+                        r, g, b = colors[index & 15]
+                    elif control == 1:
+                        b = value
+                    elif control == 2:
+                        r = value
+                    else:
+                        g = value
+                else:
+                    r, g, b = colors[index] if index < len(colors) else colors[0]
+                out[o:o + 3] = (r, g, b)
+                o += 3
+        return bytes(out)
+
+    def save(self, path):
+        if self.formatted and self.changed:
+            write_png(path, self.width, self.height, self.rgb())
+            self.changed = False
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Show an Amiga screen streamed over the framed link")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=9600, help="Baud rate (default: 9600)")
+    parser.add_argument("-o", "--output", default="amiga_screen.png", help="PNG to write (default: amiga_screen.png)")
+    parser.add_argument("--interval", type=float, default=1.0, help="Seconds between PNG writes (default: 1)")
+    parser.add_argument("--frames", type=int, help="Send SCREEN with this many frames to start the stream")
+    parser.add_argument("--screen", default="", help="Public screen to stream with --frames (default: Workbench)")
+    parser.add_argument("-v", "--verbose", action="store_true", help="Print every pass and resend")
+    args = parser.parse_args()
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    ser = serial.serial_for_url(args.port, baudrate=args.baud, timeout=0.05,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+    link = FlowLink(ser, frame_handler=lambda t, p: viewer.handle_frame(p) if t == FRAME_SCREEN else None)
+    viewer = ScreenDecoder(link, args.verbose)
+    link.start()
+    print(f"Viewing on {args.port} at {args.baud} baud into {args.output} (Ctrl+C to stop)")
+    if args.frames:
+        link.send(f"SCREEN {args.frames} {args.screen}".rstrip().encode("ascii") + b"\r\n")
+
+    last_save = time.monotonic()
+    last_report = last_save
+    try:
+        while True:
+            link.poll()
+            while link.rx:
+                # Command replies and other line traffic pass through to the console
+                text = link.read()
+                sys.stdout.write(text.decode("latin-1"))
+                sys.stdout.flush()
+            now = time.monotonic()
+            if now - last_save >= args.interval:
+                last_save = now
+                viewer.save(args.output)
+            if viewer.frames and now - last_report > 10:
+                last_report = now
+                elapsed = now - viewer.started
+                print(f"[{viewer.frames / elapsed:.2f} frames/s, "
+                      f"{viewer.total_bytes // viewer.frames} bytes/frame]")
+    except KeyboardInterrupt:
+        pass
+    finally:
+        viewer.save(args.output)
+        ser.close()
+
+    if viewer.frames:
+        elapsed = time.monotonic() - viewer.started
+        print(f"\n{viewer.frames} frames after the first, {viewer.frames / elapsed:.2f} frames/s, "
+              f"{viewer.total_bytes // viewer.frames} bytes/frame; {viewer.lost} messages lost, "
+              f"{viewer.resends} resends, {viewer.refreshes} refreshes")
+    else:
+        print(f"\nNo complete frames; {viewer.lost} messages lost, {viewer.refreshes} refreshes")
+
+
+if __name__ == "__main__":
+    main()
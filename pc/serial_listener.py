@@ -4,7 +4,7 @@ import time
 import argparse
 from datetime import datetime
 
-def listen_to_serial(port="COM6", baud=9600, timeout=None):
+def listen_to_serial(port="COM6", baud=9600, timeout=None, monotonic=False):
     """
     Listen to the specified serial port and print any incoming data.
     
@@ -12,7 +12,14 @@ def listen_to_serial(port="COM6", baud=9600, timeout=None):
         port (str): Serial port name (e.g. 'COM6' on Windows)
         baud (int): Baud rate (must match the sender's rate)
         timeout (float): Read timeout in seconds, None for blocking
+        monotonic (bool): Stamp lines with time.monotonic() seconds, the
+                          timeline clock_sync.py maps Amiga EClock times to
     """
+    def stamp():
+        if monotonic:
+            return f"{time.monotonic():.6f}"
+        return datetime.now().strftime("%H:%M:%S.%f")[:-3]
+    
     try:
         # Open serial connection
         ser = serial.Serial(
@@ -45,12 +52,12 @@ def listen_to_serial(port="COM6", baud=9600, timeout=None):
                     # Try to decode as string, fallback to hex if it fails
                     try:
                         decoded = line.decode('utf-8').strip()
-                        timestamp = datetime.now().strftime("%H:%M:%S.%f")[:-3]
+                        timestamp = stamp()
                         print(f"[{timestamp}] Text: {decoded}")
                     except UnicodeDecodeError:
                         # For binary data, show hex representation
                         hex_data = ' '.join([f'{b:02X}' for b in line])
-                        timestamp = datetime.now().strftime("%H:%M:%S.%f")[:-3]
+                        timestamp = stamp()
                         print(f"[{timestamp}] Binary: {hex_data}")
                 
                 # If we have data but no newline after a while, print what we have
@@ -58,12 +65,12 @@ def listen_to_serial(port="COM6", baud=9600, timeout=None):
                     # Try to decode as string, fallback to hex if it fails
                     try:
                         decoded = buffer.decode('utf-8').strip()
-                        timestamp = datetime.now().strftime("%H:%M:%S.%f")[:-3]
+                        timestamp = stamp()
                         print(f"[{timestamp}] Partial: {decoded}")
                     except UnicodeDecodeError:
                         # For binary data, show hex representation
                         hex_data = ' '.join([f'{b:02X}' for b in buffer])
-                        timestamp = datetime.now().strftime("%H:%M:%S.%f")[:-3]
+                        timestamp = stamp()
                         print(f"[{timestamp}] Partial binary: {hex_data}")
                     buffer = bytearray()
             
@@ -84,9 +91,11 @@ def main():
     parser.add_argument("-p", "--port", default="COM6", help="Serial port (default: COM6)")
     parser.add_argument("-b", "--baud", type=int, default=9600, help="Baud rate (default: 9600)")
     parser.add_argument("-t", "--timeout", type=float, default=None, help="Read timeout in seconds (default: None)")
+    parser.add_argument("--monotonic", action="store_true",
+                        help="Stamp lines with host monotonic seconds (for clock_sync.py models)")
     
     args = parser.parse_args()
-    listen_to_serial(args.port, args.baud, args.timeout)
+    listen_to_serial(args.port, args.baud, args.timeout, args.monotonic)
 
 if __name__ == "__main__":
     main()
\ No newline at end of file
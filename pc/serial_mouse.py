@@ -0,0 +1,474 @@
+# file: serial_mouse.py
+"""
+Serial mouse emulation for the Amiga serial port.
+
+Sends Microsoft (1200 baud 7N1, 3-byte packets) or Mouse Systems
+(1200 baud 8N1, 5-byte packets) mouse protocol, driven by a Linux input
+device or a built-in demo pattern:
+
+    python serial_mouse.py -p /dev/ttyUSB0 --evdev /dev/input/event5
+    python serial_mouse.py -p COM6 --protocol mousesystems --demo
+    python serial_mouse.py --pty-test
+    python serial_mouse.py --bench
+
+At 1200 baud a Microsoft mouse has room for about 44 packets a second,
+fewer than a modern mouse reports. A forwarder that turns every report
+into a packet builds a backlog and the pointer trails the hand. The
+engine here never queues motion: while a packet is on the wire it adds
+new motion to a running total, and the next packet carries that total,
+clamped to what the packet can hold. Motion is therefore at most one
+packet time old. Button changes are queued instead, one per packet, so
+a click shorter than a packet time still reaches the Amiga as a press
+and a release.
+
+--pty-test runs the engine into a pty and decodes the other end;
+--bench compares the engine with a per-report forwarder under load.
+"""
+import os
+import sys
+import time
+import math
+import random
+import struct
+import argparse
+import threading
+from collections import deque
+
+BUTTON_LEFT = 1
+BUTTON_RIGHT = 2
+BUTTON_MIDDLE = 4
+
+
+def clamp(value, low, high):
+    return low if value < low else high if value > high else value
+
+
+class MicrosoftProtocol:
+    """3 bytes, 7N1: sync bit 6 in the first byte, 8-bit deltas split 2+6"""
+
+    name = "microsoft"
+    packet_bytes = 3
+    bits_per_byte = 9                   # Start, 7 data, stop
+    bytesize = 7
+    low, high = -128, 127
+
+    def encode(self, dx, dy, buttons):
+        """Returns (packet, dx sent, dy sent)"""
+        dx = clamp(dx, self.low, self.high)
+        dy = clamp(dy, self.low, self.high)
+        x = dx & 0xFF
+        y = dy & 0xFF
+        first = 0x40 | (0x20 if buttons & BUTTON_LEFT else 0) | (0x10 if buttons & BUTTON_RIGHT else 0)
+        first |= ((y >> 6) & 0x03) << 2 | ((x >> 6) & 0x03)
+        return bytes((first, x & 0x3F, y & 0x3F)), dx, dy
+
+
+class MouseSystemsProtocol:
+    """5 bytes, 8N1: inverted buttons, two delta pairs, Y up is positive"""
+
+    name = "mousesystems"
+    packet_bytes = 5
+    bits_per_byte = 10
+    bytesize = 8
+    low, high = -256, 254               # Two deltas of -128..127 each
+
+    def encode(self, dx, dy, buttons):
+        dx = clamp(dx, self.low, self.high)
+        dy = clamp(dy, self.low, self.high)
+        dx1 = clamp(dx, -128, 127)
+        dy1 = clamp(dy, -128, 127)
+        dx2 = dx - dx1
+        dy2 = dy - dy1
+        first = 0x80 | (0 if buttons & BUTTON_LEFT else 0x04) \
+            | (0 if buttons & BUTTON_MIDDLE else 0x02) | (0 if buttons & BUTTON_RIGHT else 0x01)
+        return bytes((first, dx1 & 0xFF, -dy1 & 0xFF, dx2 & 0xFF, -dy2 & 0xFF)), dx, dy
+
+
+PROTOCOLS = {p.name: p for p in (MicrosoftProtocol(), MouseSystemsProtocol())}
+
+
+def packet_time(protocol, baud):
+    return protocol.packet_bytes * protocol.bits_per_byte / float(baud)
+
+
+class MouseEngine:
+    """Coalescing packet generator
+
+    move() and set_buttons() record input; poll() sends one packet when
+    the line is free and something is pending. The line counts as busy
+    for one packet time after each send, since a pty or USB adapter
+    would accept the bytes long before the wire carries them.
+    """
+
+    def __init__(self, protocol, baud, write):
+        self.protocol = protocol
+        self.write = write
+        self.packet_time = packet_time(protocol, baud)
+        self.dx = 0
+        self.dy = 0
+        self.buttons = 0                # Latest state from the input
+        self.sent_buttons = 0
+        self.button_queue = deque()     # States not yet sent, oldest first
+        self.busy_until = 0.0
+        self.packets = 0
+        self.clipped = 0                # Motion dropped by clamping
+
+    def move(self, dx, dy):
+        self.dx += dx
+        self.dy += dy
+
+    def set_buttons(self, buttons):
+        last = self.button_queue[-1] if self.button_queue else self.sent_buttons
+        if buttons != last:
+            self.button_queue.append(buttons)
+        self.buttons = buttons
+
+    def pending(self):
+        return bool(self.dx or self.dy or self.button_queue)
+
+    def poll(self, now):
+        """Sends a packet if the line is free; returns (dx, dy, buttons) or None"""
+        if now < self.busy_until or not self.pending():
+            return None
+        buttons = self.button_queue.popleft() if self.button_queue else self.sent_buttons
+        packet, dx, dy = self.protocol.encode(self.dx, self.dy, buttons)
+        self.clipped += abs(self.dx - dx) + abs(self.dy - dy)
+        self.dx = 0
+        self.dy = 0
+        self.sent_buttons = buttons
+        self.write(packet)
+        self.packets += 1
+        self.busy_until = max(now, self.busy_until) + self.packet_time
+        return dx, dy, buttons
+
+
+class ForwardingMouse(MouseEngine):
+    """Baseline for --bench: one packet per report, queued while the line is busy
+
+    report_time is the time of the report being added; completed lists the
+    reports whose last byte went out with the latest packet.
+    """
+
+    def __init__(self, protocol, baud, write):
+        MouseEngine.__init__(self, protocol, baud, write)
+        self.queue = deque()
+        self.report_time = 0.0
+        self.completed = []
+
+    def move(self, dx, dy):
+        self.queue.append((dx, dy, self.buttons, self.report_time))
+
+    def set_buttons(self, buttons):
+        if buttons != self.buttons:
+            self.buttons = buttons
+            self.queue.append((0, 0, buttons, None))
+
+    def pending(self):
+        return bool(self.queue)
+
+    def poll(self, now):
+        if now < self.busy_until or not self.queue:
+            return None
+        dx, dy, buttons, reported = self.queue.popleft()
+        packet, sent_dx, sent_dy = self.protocol.encode(dx, dy, buttons)
+        self.completed = []
+        if (sent_dx, sent_dy) != (dx, dy):
+            self.queue.appendleft((dx - sent_dx, dy - sent_dy, buttons, reported))
+        elif reported is not None:
+            self.completed.append(reported)
+        self.write(packet)
+        self.packets += 1
+        self.busy_until = max(now, self.busy_until) + self.packet_time
+        return sent_dx, sent_dy, buttons
+
+
+class MouseDecoder:
+    """Decodes either protocol back into (dx, dy, buttons)"""
+
+    def __init__(self, protocol):
+        self.protocol = protocol
+        self.packet = bytearray()
+        self.resyncs = 0
+
+    def feed(self, data):
+        events = []
+        for byte in data:
+            # Microsoft data bytes never have bit 6 set; a Mouse Systems
+            # data byte can look like a header, so only a gap resyncs it
+            if self.protocol.name == "microsoft":
+                start = bool(byte & 0x40)
+            else:
+                start = not self.packet and (byte & 0xF8) == 0x80
+            if start:
+                if self.packet:
+                    self.resyncs += 1
+                self.packet = bytearray((byte,))
+            elif self.packet:
+                self.packet.append(byte)
+            else:
+                self.resyncs += 1
+                continue
+            if len(self.packet) == self.protocol.packet_bytes:
+                events.append(self._decode(self.packet))
+                self.packet = bytearray()
+        return events
+
+    def _decode(self, p):
+        def signed(v):
+            return v - 256 if v & 0x80 else v
+        if self.protocol.name == "microsoft":
+            dx = signed(((p[0] & 0x03) << 6) | (p[1] & 0x3F))
+            dy = signed(((p[0] & 0x0C) << 4) | (p[2] & 0x3F))
+            buttons = (BUTTON_LEFT if p[0] & 0x20 else 0) | (BUTTON_RIGHT if p[0] & 0x10 else 0)
+            return dx, dy, buttons
+        buttons = (0 if p[0] & 0x04 else BUTTON_LEFT) | (0 if p[0] & 0x02 else BUTTON_MIDDLE) \
+            | (0 if p[0] & 0x01 else BUTTON_RIGHT)
+        return signed(p[1]) + signed(p[3]), -(signed(p[2]) + signed(p[4])), buttons
+
+
+class DemoInput:
+    """Circles at a steady speed with a short click every second"""
+
+    def __init__(self, rate=500.0, speed=1500.0):
+        self.rate = rate
+        self.speed = speed
+        self.angle = 0.0
+        self.fx = 0.0
+        self.fy = 0.0
+
+    def events(self, t):
+        """Reports for one input period at time t: [(dx, dy, buttons)]"""
+        step = self.speed / self.rate
+        self.angle += 2 * math.pi / self.rate
+        self.fx += step * math.cos(self.angle)
+        self.fy += step * math.sin(self.angle)
+        dx, dy = int(self.fx), int(self.fy)
+        self.fx -= dx
+        self.fy -= dy
+        buttons = BUTTON_LEFT if (t % 1.0) < 0.01 else 0
+        return [(dx, dy, buttons)]
+
+
+def read_evdev(path, engine, lock):
+    """Feeds a Linux input device (struct input_event) into the engine"""
+    event = struct.Struct("llHHi")
+    masks = {0x110: BUTTON_LEFT, 0x111: BUTTON_RIGHT, 0x112: BUTTON_MIDDLE}
+    buttons = 0
+    with open(path, "rb") as f:
+        while True:
+            data = f.read(event.size)
+            if len(data) < event.size:
+                return
+            _, _, kind, code, value = event.unpack(data)
+            with lock:
+                if kind == 2 and code == 0:         # EV_REL, REL_X
+                    engine.move(value, 0)
+                elif kind == 2 and code == 1:       # REL_Y
+                    engine.move(0, value)
+                elif kind == 1 and code in masks:   # EV_KEY
+                    buttons = (buttons | masks[code]) if value else (buttons & ~masks[code])
+                    engine.set_buttons(buttons)
+
+
+def simulate(engine_class, protocol, baud, rate, seconds, seed=1):
+    """Runs reports at rate through an engine on a virtual clock
+
+    Returns (report latencies, button changes made, button changes sent,
+    motion clipped); a report's latency runs until the packet carrying
+    the last of its motion has left.
+    """
+    rng = random.Random(seed)
+    engine = engine_class(protocol, baud, lambda packet: None)
+    waiting = []                        # Coalescing: reports since the last packet
+    latencies = []
+    changes = 0
+    delivered = 0
+    last_buttons = 0
+    release_at = None
+    step = 1.0 / rate
+
+    for i in range(int(seconds * rate)):
+        t = i * step
+
+        # A fast, jittery hand at 2000-4000 counts/s, clicking about every
+        # 0.3 s with clicks shorter than a packet time
+        speed = rng.uniform(2000, 4000) / rate
+        engine.report_time = t
+        engine.move(int(speed * rng.uniform(-1, 1)), int(speed * rng.uniform(-1, 1)))
+        waiting.append(t)
+        if release_at is not None and t >= release_at:
+            release_at = None
+            engine.set_buttons(0)
+            changes += 1
+        elif release_at is None and rng.random() < step / 0.3:
+            release_at = t + 0.015
+            engine.set_buttons(BUTTON_LEFT)
+            changes += 1
+
+        # Let the line run until the next report
+        now = t
+        while True:
+            sent = engine.poll(now)
+            if sent is None:
+                if not engine.pending() or engine.busy_until >= t + step:
+                    break
+                now = engine.busy_until
+                continue
+            done = engine.busy_until
+            if sent[2] != last_buttons:
+                delivered += 1
+                last_buttons = sent[2]
+            if engine_class is ForwardingMouse:
+                latencies.extend(done - reported for reported in engine.completed)
+            else:
+                latencies.extend(done - reported for reported in waiting)
+                waiting = []
+
+    return latencies, changes, delivered, engine.clipped
+
+
+def benchmark(args):
+    protocol = PROTOCOLS[args.protocol]
+    print(f"{protocol.name} at {args.baud} baud: {packet_time(protocol, args.baud) * 1e3:.1f} ms per packet, "
+          f"{args.rate:.0f} reports/s for {args.seconds:.0f} s")
+    print(f"{'engine':<12} {'mean ms':>9} {'p99 ms':>9} {'max ms':>9} {'clicks':>11} {'clipped':>8}")
+    for name, engine_class in (("forwarding", ForwardingMouse), ("coalescing", MouseEngine)):
+        latencies, changes, delivered, clipped = simulate(engine_class, protocol, args.baud,
+                                                          args.rate, args.seconds)
+        latencies.sort()
+        mean = sum(latencies) / len(latencies) if latencies else 0.0
+        p99 = latencies[int(0.99 * (len(latencies) - 1))] if latencies else 0.0
+        worst = latencies[-1] if latencies else 0.0
+        print(f"{name:<12} {mean * 1e3:>9.1f} {p99 * 1e3:>9.1f} {worst * 1e3:>9.1f} "
+              f"{delivered:>5}/{changes:<5} {clipped:>8}")
+    print("clicks: button changes sent / made; clipped: motion counts dropped by clamping")
+
+
+def pty_test(args):
+    """Engine into a pty, decoder on the other end; checks what arrives"""
+    import tty
+
+    protocol = PROTOCOLS[args.protocol]
+    master, slave = os.openpty()
+    tty.setraw(master)
+    tty.setraw(slave)
+    decoder = MouseDecoder(protocol)
+    received = []
+
+    def reader():
+        while True:
+            try:
+                data = os.read(master, 256)
+            except OSError:
+                return
+            received.extend(decoder.feed(data))
+
+    threading.Thread(target=reader, daemon=True).start()
+    engine = MouseEngine(protocol, args.baud, lambda packet: os.write(slave, packet))
+    demo = DemoInput(rate=args.rate)
+    total_x = total_y = 0
+    clicks = 0
+    buttons = 0
+    sent = []
+    start = time.monotonic()
+    next_report = start
+
+    while time.monotonic() - start < args.seconds:
+        now = time.monotonic()
+        if now >= next_report:
+            for dx, dy, pressed in demo.events(now - start):
+                engine.move(dx, dy)
+                engine.set_buttons(pressed)
+                clicks += 1 if pressed & ~buttons else 0
+                buttons = pressed
+                total_x += dx
+                total_y += dy
+            next_report += 1.0 / args.rate
+        packet = engine.poll(now)
+        if packet:
+            sent.append(packet)
+        time.sleep(0.0005)
+
+    time.sleep(0.2)
+    got_x = sum(e[0] for e in received)
+    got_y = sum(e[1] for e in received)
+    presses = sum(1 for a, b in zip([(0, 0, 0)] + received, received) if b[2] & ~a[2] & BUTTON_LEFT)
+    print(f"Packets: {len(sent)} sent, {len(received)} decoded, {decoder.resyncs} resyncs")
+    print(f"Motion: input ({total_x}, {total_y}), decoded ({got_x}, {got_y}), "
+          f"pending ({engine.dx}, {engine.dy}), clipped {engine.clipped}")
+    print(f"Clicks: {clicks} made, {presses} decoded")
+    ok = (received == sent and decoder.resyncs == 0 and presses == clicks
+          and engine.clipped == 0 and (got_x + engine.dx, got_y + engine.dy) == (total_x, total_y))
+    print("PASS" if ok else "FAIL")
+    os.close(slave)
+    os.close(master)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Microsoft / Mouse Systems serial mouse emulation")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=1200, help="Baud rate (default: 1200)")
+    parser.add_argument("--protocol", choices=sorted(PROTOCOLS), default="microsoft",
+                        help="Mouse protocol (default: microsoft)")
+    parser.add_argument("--evdev", help="Linux input device to follow (e.g. /dev/input/event5)")
+    parser.add_argument("--demo", action="store_true", help="Draw circles and click once a second")
+    parser.add_argument("--rate", type=float, default=500.0, help="Demo/bench reports per second (default: 500)")
+    parser.add_argument("--seconds", type=float, default=10.0, help="Demo, pty test or bench length (default: 10)")
+    parser.add_argument("--pty-test", action="store_true", help="Run the demo into a pty and decode it")
+    parser.add_argument("--bench", action="store_true", help="Latency under load: coalescing vs forwarding")
+    args = parser.parse_args()
+
+    if args.bench:
+        benchmark(args)
+        return
+    if args.pty_test:
+        pty_test(args)
+        return
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    protocol = PROTOCOLS[args.protocol]
+    ser = serial.serial_for_url(args.port, baudrate=args.baud, bytesize=protocol.bytesize,
+                                timeout=0, xonxoff=False, rtscts=False, dsrdtr=False)
+    engine = MouseEngine(protocol, args.baud, ser.write)
+    lock = threading.Lock()
+
+    if args.evdev:
+        threading.Thread(target=read_evdev, args=(args.evdev, engine, lock), daemon=True).start()
+    elif not args.demo:
+        print("Nothing to follow: give --evdev or --demo")
+        sys.exit(1)
+
+    # A Microsoft mouse announces itself with 'M' when the driver raises RTS
+    if protocol.name == "microsoft":
+        ser.write(b"M")
+
+    print(f"{protocol.name} mouse on {args.port} at {args.baud} baud")
+    demo = DemoInput(rate=args.rate) if args.demo else None
+    start = time.monotonic()
+    next_report = start
+    try:
+        while True:
+            now = time.monotonic()
+            with lock:
+                if demo and now >= next_report:
+                    for dx, dy, buttons in demo.events(now - start):
+                        engine.move(dx, dy)
+                        engine.set_buttons(buttons)
+                    next_report += 1.0 / args.rate
+                engine.poll(now)
+            time.sleep(0.001)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        print(f"Packets: {engine.packets}, motion clipped: {engine.clipped}")
+        ser.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,980 @@
+# file: slip_gateway.py
+"""
+SLIP/CSLIP gateway: IP for the Amiga over its serial port, with no TUN
+device and no root access on the host.
+
+The Amiga's own TCP/IP stack (AmiTCP, Miami, Roadshow...) runs a SLIP or
+CSLIP interface on the serial port. This side takes the frames apart
+(RFC 1055), undoes Van Jacobson TCP/IP header compression (RFC 1144)
+and hands the packets to a small userspace endpoint:
+
+  - TCP connections are relayed: a SYN to any address:port opens a host
+    socket to it (the gateway address itself means this host) and the
+    data is carried both ways.
+  - UDP datagrams are relayed through host sockets; port 53 on the
+    gateway goes to --dns.
+  - ICMP echo requests are answered by the gateway.
+
+Packets to the Amiga are compressed the same way: always (--mode
+cslip), never (slip), or once the Amiga has sent a compressed packet
+itself (auto, the default). A 40-byte TCP/IP header usually shrinks to
+3-7 bytes.
+
+Amiga side, e.g. for AmiTCP: a cslip0 (or slip0) interface on
+serial.device at the same baud rate, address 10.0.2.15, gateway and DNS
+10.0.2.2, MTU 576 (or 296 for snappier interactive use).
+
+    python slip_gateway.py -p /dev/ttyUSB0 -b 38400
+    python slip_gateway.py -p COM6 -b 19200 --mode slip -v
+    python slip_gateway.py -p COM6 --loopback
+    python slip_gateway.py --bench
+
+--loopback sends every TCP connection to a local echo service instead
+of its destination. --bench runs interactive and bulk TCP traffic
+through the real compressor and framing and reports goodput per baud
+rate with and without header compression.
+"""
+import sys
+import time
+import errno
+import socket
+import struct
+import select
+import argparse
+
+from hayes_modem import LoopbackListener
+
+SLIP_END = 0xC0
+SLIP_ESC = 0xDB
+SLIP_ESC_END = 0xDC
+SLIP_ESC_ESC = 0xDD
+SLIP_MAX_FRAME = 2048
+
+# RFC 1144 packet types, carried in the top bits of the first byte
+TYPE_IP = 0x40
+TYPE_UNCOMPRESSED_TCP = 0x70
+TYPE_COMPRESSED_TCP = 0x80
+
+# RFC 1144 change mask
+NEW_C = 0x40
+NEW_I = 0x20
+TCP_PUSH_BIT = 0x10
+NEW_S = 0x08
+NEW_A = 0x04
+NEW_W = 0x02
+NEW_U = 0x01
+SPECIAL_I = NEW_S | NEW_W | NEW_U       # Echoed interactive traffic
+SPECIAL_D = NEW_S | NEW_A | NEW_W | NEW_U   # Unidirectional data
+VJ_SLOTS = 16
+
+PROTO_ICMP = 1
+PROTO_TCP = 6
+PROTO_UDP = 17
+
+TH_FIN = 0x01
+TH_SYN = 0x02
+TH_RST = 0x04
+TH_PUSH = 0x08
+TH_ACK = 0x10
+TH_URG = 0x20
+
+GATEWAY_ADDRESS = "10.0.2.2"
+DEFAULT_MTU = 576
+TCP_WINDOW = 8192               # Advertised to the Amiga
+TCP_MAX_FLIGHT = 4              # Segments in flight: keeps other connections responsive
+TCP_SOCKET_READ = 16384
+UDP_IDLE = 60.0
+BENCH_RATES = (9600, 19200, 38400)
+
+
+# ------------------------------------------------------------------ #
+# IP helpers                                                          #
+# ------------------------------------------------------------------ #
+
+def checksum(data):
+    """Internet checksum (RFC 1071)"""
+    if len(data) & 1:
+        data = bytes(data) + b"\0"
+    total = sum(struct.unpack(f">{len(data) // 2}H", data))
+    while total >> 16:
+        total = (total & 0xFFFF) + (total >> 16)
+    return ~total & 0xFFFF
+
+
+def build_ip(proto, src, dst, payload, ident):
+    header = bytearray(struct.pack(">BBHHHBBH4s4s", 0x45, 0, 20 + len(payload), ident & 0xFFFF,
+                                   0x4000, 64, proto, 0, src, dst))
+    struct.pack_into(">H", header, 10, checksum(header))
+    return bytes(header) + payload
+
+
+def build_tcp(src, dst, sport, dport, seq, ack, flags, window, payload=b"", options=b"", ident=0):
+    header = bytearray(struct.pack(">HHIIBBHHH", sport, dport, seq & 0xFFFFFFFF, ack & 0xFFFFFFFF,
+                                   (5 + len(options) // 4) << 4, flags, window, 0, 0))
+    header += options
+    pseudo = struct.pack(">4s4sBBH", src, dst, 0, PROTO_TCP, len(header) + len(payload))
+    struct.pack_into(">H", header, 16, checksum(pseudo + header + payload))
+    return build_ip(PROTO_TCP, src, dst, bytes(header) + payload, ident)
+
+
+def build_udp(src, dst, sport, dport, payload, ident):
+    header = bytearray(struct.pack(">HHHH", sport, dport, 8 + len(payload), 0))
+    pseudo = struct.pack(">4s4sBBH", src, dst, 0, PROTO_UDP, len(header) + len(payload))
+    struct.pack_into(">H", header, 6, checksum(pseudo + header + payload) or 0xFFFF)
+    return build_ip(PROTO_UDP, src, dst, bytes(header) + payload, ident)
+
+
+def seq_after(a, b):
+    """a comes after b in sequence space"""
+    return 0 < ((a - b) & 0xFFFFFFFF) < 0x80000000
+
+
+# ------------------------------------------------------------------ #
+# SLIP framing (RFC 1055)                                             #
+# ------------------------------------------------------------------ #
+
+def slip_encode(packet):
+    """Frame a packet; the leading END flushes any line noise"""
+    body = packet.replace(b"\xdb", b"\xdb\xdd").replace(b"\xc0", b"\xdb\xdc")
+    return b"\xc0" + body + b"\xc0"
+
+
+class SlipDecoder:
+    """Collects frames from serial input; calls callback(frame) for each"""
+
+    def __init__(self, callback):
+        self.callback = callback
+        self.frame = bytearray()
+        self.escaped = False
+        self.frames = 0
+        self.oversize = 0
+
+    def feed(self, data):
+        for byte in data:
+            if byte == SLIP_END:
+                if self.frame:
+                    self.frames += 1
+                    self.callback(bytes(self.frame))
+                    self.frame.clear()
+                self.escaped = False
+                continue
+            if self.escaped:
+                self.escaped = False
+                if byte == SLIP_ESC_END:
+                    byte = SLIP_END
+                elif byte == SLIP_ESC_ESC:
+                    byte = SLIP_ESC
+            elif byte == SLIP_ESC:
+                self.escaped = True
+                continue
+            if len(self.frame) < SLIP_MAX_FRAME:
+                self.frame.append(byte)
+            else:
+                self.oversize += 1
+
+
+# ------------------------------------------------------------------ #
+# Van Jacobson header compression (RFC 1144)                          #
+# ------------------------------------------------------------------ #
+
+def _encode(out, n):
+    """Delta as 1 byte, or 0 then 2 bytes when it is 0 or does not fit"""
+    if 0 < n < 256:
+        out.append(n)
+    else:
+        out += struct.pack(">BH", 0, n & 0xFFFF)
+
+
+def _encodez(out, n):
+    """As _encode, but 0 fits in one byte (urgent pointer, IP id)"""
+    if 0 <= n < 256:
+        out.append(n)
+    else:
+        out += struct.pack(">BH", 0, n & 0xFFFF)
+
+
+def _tcp_header_length(packet):
+    return 20 + (packet[32] >> 4) * 4
+
+
+class VJCompressor:
+    """Sender half: turns IP packets into TYPE_IP, UNCOMPRESSED_TCP or
+    COMPRESSED_TCP frames, keeping one saved header per connection"""
+
+    def __init__(self, slots=VJ_SLOTS):
+        self.slots = slots
+        self.states = {}            # connection -> [slot, saved header]
+        self.order = []             # Connections, least recently used first
+        self.last_sent = None
+        self.packets = 0
+        self.compressed = 0
+        self.uncompressed = 0
+
+    def _state(self, key):
+        state = self.states.get(key)
+        if state is not None:
+            self.order.remove(key)
+        else:
+            if len(self.states) < self.slots:
+                slot = len(self.states)
+            else:
+                oldest = self.order.pop(0)
+                slot = self.states.pop(oldest)[0]
+            state = [slot, None]
+            self.states[key] = state
+        self.order.append(key)
+        return state
+
+    def compress(self, packet):
+        self.packets += 1
+        if (len(packet) < 40 or packet[0] != 0x45 or packet[9] != PROTO_TCP or
+                struct.unpack_from(">H", packet, 6)[0] & 0x3FFF):
+            return packet
+        hlen = _tcp_header_length(packet)
+        flags = packet[33]
+        if len(packet) < hlen or flags & (TH_SYN | TH_FIN | TH_RST) or not flags & TH_ACK:
+            return packet
+
+        state = self._state(packet[12:24])
+        old = state[1]
+        if (old is None or len(old) != hlen or old[0:2] != packet[0:2] or
+                old[6:10] != packet[6:10] or old[40:hlen] != packet[40:hlen]):
+            return self._uncompressed(state, packet, hlen)
+
+        seq, ack = struct.unpack_from(">II", packet, 24)
+        window, _, urgent = struct.unpack_from(">HHH", packet, 34)
+        old_seq, old_ack = struct.unpack_from(">II", old, 24)
+        old_window, _, old_urgent = struct.unpack_from(">HHH", old, 34)
+        old_length = struct.unpack_from(">H", old, 2)[0]
+        length = struct.unpack_from(">H", packet, 2)[0]
+
+        changes = 0
+        deltas = bytearray()
+        if flags & TH_URG:
+            _encodez(deltas, urgent)
+            changes |= NEW_U
+        elif urgent != old_urgent:
+            return self._uncompressed(state, packet, hlen)
+        delta_window = (window - old_window) & 0xFFFF
+        if delta_window:
+            _encode(deltas, delta_window)
+            changes |= NEW_W
+        delta_ack = (ack - old_ack) & 0xFFFFFFFF
+        if delta_ack:
+            if delta_ack > 0xFFFF:
+                return self._uncompressed(state, packet, hlen)
+            _encode(deltas, delta_ack)
+            changes |= NEW_A
+        delta_seq = (seq - old_seq) & 0xFFFFFFFF
+        if delta_seq:
+            if delta_seq > 0xFFFF:
+                return self._uncompressed(state, packet, hlen)
+            _encode(deltas, delta_seq)
+            changes |= NEW_S
+
+        if changes == 0:
+            # Data after a pure ACK is normal for interactive traffic;
+            # anything else unchanged is a retransmission or keepalive
+            if length == old_length or old_length != hlen:
+                return self._uncompressed(state, packet, hlen)
+        elif changes in (SPECIAL_I, SPECIAL_D):
+            return self._uncompressed(state, packet, hlen)
+        elif changes == NEW_S | NEW_A:
+            if delta_seq == delta_ack == old_length - hlen:
+                changes = SPECIAL_I
+                deltas.clear()
+        elif changes == NEW_S:
+            if delta_seq == old_length - hlen:
+                changes = SPECIAL_D
+                deltas.clear()
+
+        delta_id = (struct.unpack_from(">H", packet, 4)[0] - struct.unpack_from(">H", old, 4)[0]) & 0xFFFF
+        if delta_id != 1:
+            _encodez(deltas, delta_id)
+            changes |= NEW_I
+        if flags & TH_PUSH:
+            changes |= TCP_PUSH_BIT
+
+        state[1] = packet[:hlen]
+        out = bytearray()
+        if state[0] != self.last_sent:
+            self.last_sent = state[0]
+            out += bytes((TYPE_COMPRESSED_TCP | changes | NEW_C, state[0]))
+        else:
+            out.append(TYPE_COMPRESSED_TCP | changes)
+        out += packet[36:38]            # TCP checksum, always sent
+        out += deltas
+        out += packet[hlen:]
+        self.compressed += 1
+        return bytes(out)
+
+    def _uncompressed(self, state, packet, hlen):
+        state[1] = packet[:hlen]
+        self.last_sent = state[0]
+        self.uncompressed += 1
+        out = bytearray(packet)
+        out[9] = state[0]
+        out[0] |= TYPE_UNCOMPRESSED_TCP
+        return bytes(out)
+
+
+class VJDecompressor:
+    """Receiver half: rebuilds IP packets from any of the three types"""
+
+    def __init__(self, slots=VJ_SLOTS):
+        self.saved = [None] * slots
+        self.last_received = 0
+        self.toss = True            # Until a connection number is known
+        self.errors = 0
+        self.compressed_seen = False
+
+    def decompress(self, frame):
+        if not frame:
+            return None
+        kind = frame[0] & 0xF0
+        if kind == TYPE_IP:
+            return frame
+        if kind & TYPE_COMPRESSED_TCP:
+            self.compressed_seen = True
+            return self._compressed(frame)
+        if kind == TYPE_UNCOMPRESSED_TCP:
+            self.compressed_seen = True
+            return self._uncompressed(frame)
+        self.errors += 1
+        return None
+
+    def _uncompressed(self, frame):
+        slot = frame[9]
+        if slot >= len(self.saved) or len(frame) < 40 or len(frame) < _tcp_header_length(frame):
+            self.toss = True
+            self.errors += 1
+            return None
+        packet = bytearray(frame)
+        packet[0] &= 0x4F
+        packet[9] = PROTO_TCP
+        self.saved[slot] = bytearray(packet[:_tcp_header_length(packet)])
+        self.last_received = slot
+        self.toss = False
+        return bytes(packet)
+
+    def _compressed(self, frame):
+        try:
+            return self._rebuild(frame)
+        except (IndexError, struct.error):
+            self.toss = True
+            self.errors += 1
+            return None
+
+    def _decode(self, frame, pos):
+        if frame[pos] == 0:
+            return struct.unpack_from(">H", frame, pos + 1)[0], pos + 3
+        return frame[pos], pos + 1
+
+    def _rebuild(self, frame):
+        changes = frame[0]
+        pos = 1
+        if changes & NEW_C:
+            slot = frame[1]
+            pos = 2
+            if slot >= len(self.saved) or self.saved[slot] is None:
+                self.toss = True
+                self.errors += 1
+                return None
+            self.last_received = slot
+            self.toss = False
+        elif self.toss:
+            return None
+        header = self.saved[self.last_received]
+        hlen = len(header)
+        tcp_checksum = frame[pos:pos + 2]
+        pos += 2
+
+        if changes & TCP_PUSH_BIT:
+            header[33] |= TH_PUSH
+        else:
+            header[33] &= ~TH_PUSH & 0xFF
+
+        seq, ack = struct.unpack_from(">II", header, 24)
+        window, _, urgent = struct.unpack_from(">HHH", header, 34)
+        low = changes & 0x0F
+        if low in (SPECIAL_I, SPECIAL_D):
+            last_data = struct.unpack_from(">H", header, 2)[0] - hlen
+            seq += last_data
+            if low == SPECIAL_I:
+                ack += last_data
+        else:
+            if changes & NEW_U:
+                header[33] |= TH_URG
+                urgent, pos = self._decode(frame, pos)
+            else:
+                header[33] &= ~TH_URG & 0xFF
+            if changes & NEW_W:
+                delta, pos = self._decode(frame, pos)
+                window += delta
+            if changes & NEW_A:
+                delta, pos = self._decode(frame, pos)
+                ack += delta
+            if changes & NEW_S:
+                delta, pos = self._decode(frame, pos)
+                seq += delta
+        ident = struct.unpack_from(">H", header, 4)[0]
+        if changes & NEW_I:
+            delta, pos = self._decode(frame, pos)
+            ident += delta
+        else:
+            ident += 1
+        if pos > len(frame):
+            raise IndexError("compressed header runs past the frame")
+
+        payload = frame[pos:]
+        struct.pack_into(">II", header, 24, seq & 0xFFFFFFFF, ack & 0xFFFFFFFF)
+        struct.pack_into(">H", header, 34, window & 0xFFFF)
+        struct.pack_into(">H", header, 38, urgent)
+        header[36:38] = tcp_checksum
+        struct.pack_into(">HH", header, 2, hlen + len(payload), ident & 0xFFFF)
+        struct.pack_into(">H", header, 10, 0)
+        struct.pack_into(">H", header, 10, checksum(header[:20]))
+        return bytes(header) + payload
+
+
+# ------------------------------------------------------------------ #
+# Userspace endpoint                                                  #
+# ------------------------------------------------------------------ #
+
+class TcpRelay:
+    """One Amiga TCP connection carried over a host socket"""
+
+    def __init__(self, stack, key, syn_seq, mss, target):
+        self.stack = stack
+        self.key = key                  # (amiga addr, amiga port, dest addr, dest port)
+        self.rcv_nxt = (syn_seq + 1) & 0xFFFFFFFF
+        self.iss = int.from_bytes(socket.inet_aton(time.strftime("%H%M")), "big") ^ (key[1] << 16)
+        self.snd_una = self.iss
+        self.snd_nxt = self.iss
+        self.mss = mss
+        self.peer_window = 0
+        self.unacked = bytearray()      # From snd_una on
+        self.to_socket = bytearray()
+        self.state = "connecting"
+        self.socket_eof = False
+        self.fin_sent = False
+        self.peer_fin = False
+        self.ack_due = False
+        self.rto = 1.0
+        self.retransmit_at = None
+        self.retransmits = 0
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.sock.setblocking(False)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        err = self.sock.connect_ex(target)
+        if err not in (0, errno.EINPROGRESS, errno.EWOULDBLOCK, getattr(errno, "WSAEWOULDBLOCK", -1)):
+            self.state = "refused"
+
+    def window(self):
+        return max(0, TCP_WINDOW - len(self.to_socket))
+
+    def send_segment(self, flags, seq, payload=b"", options=b""):
+        amiga, amiga_port, dest, dest_port = self.key
+        self.stack.send_tcp(dest, amiga, dest_port, amiga_port, seq, self.rcv_nxt, flags,
+                            self.window(), payload, options)
+        self.ack_due = False
+
+    def send_syn_ack(self):
+        options = struct.pack(">BBH", 2, 4, self.stack.mtu - 40)
+        self.send_segment(TH_SYN | TH_ACK, self.iss, options=options)
+        self.snd_nxt = (self.iss + 1) & 0xFFFFFFFF
+        self.retransmit_at = time.monotonic() + self.rto
+
+    def segment(self, seq, ack, flags, window, payload):
+        """A segment from the Amiga"""
+        if flags & TH_RST:
+            self.close()
+            return
+        if flags & TH_SYN:
+            if self.state == "syn-received":
+                self.send_syn_ack()     # Our SYN+ACK was lost
+            return
+        if not flags & TH_ACK:
+            return
+
+        if seq_after(ack, self.snd_una) and not seq_after(ack, self.snd_nxt):
+            acked = (ack - self.snd_una) & 0xFFFFFFFF
+            if self.state == "syn-received":
+                self.state = "established"
+                acked -= 1
+            if self.fin_sent and ack == self.snd_nxt:
+                acked -= 1
+            del self.unacked[:max(0, acked)]
+            self.snd_una = ack
+            self.rto = max(1.0, self.rto / 2)
+            self.retransmit_at = None if self.snd_una == self.snd_nxt else time.monotonic() + self.link_rto()
+        self.peer_window = window
+
+        if payload or flags & TH_FIN:
+            if seq == self.rcv_nxt and self.window() >= len(payload):
+                self.to_socket += payload
+                self.rcv_nxt = (self.rcv_nxt + len(payload)) & 0xFFFFFFFF
+                if flags & TH_FIN and not self.peer_fin:
+                    self.peer_fin = True
+                    self.rcv_nxt = (self.rcv_nxt + 1) & 0xFFFFFFFF
+            self.ack_due = True         # Also re-acks duplicates and gaps
+
+    def link_rto(self):
+        """Allow for everything in flight to cross the serial line first"""
+        in_flight = (self.snd_nxt - self.snd_una) & 0xFFFFFFFF
+        return self.rto + 2.0 * (in_flight + 48 * TCP_MAX_FLIGHT) * 10 / self.stack.baud
+
+    def poll(self, now):
+        if self.state == "connecting":
+            try:
+                connected = select.select([], [self.sock], [], 0)[1]
+            except (OSError, ValueError):
+                connected = False
+            if connected:
+                if self.sock.getsockopt(socket.SOL_SOCKET, socket.SO_ERROR):
+                    self.state = "refused"
+                else:
+                    self.state = "syn-received"
+                    self.send_syn_ack()
+            return
+        if self.state == "refused":
+            amiga, amiga_port, dest, dest_port = self.key
+            self.stack.send_tcp(dest, amiga, dest_port, amiga_port, 0, self.rcv_nxt,
+                                TH_RST | TH_ACK, 0)
+            self.close()
+            return
+
+        if self.to_socket:
+            try:
+                sent = self.sock.send(self.to_socket)
+                del self.to_socket[:sent]
+            except BlockingIOError:
+                pass
+            except OSError:
+                self.close()
+                return
+        if self.peer_fin and not self.to_socket:
+            try:
+                self.sock.shutdown(socket.SHUT_WR)
+            except OSError:
+                pass
+
+        if not self.socket_eof and len(self.unacked) < TCP_SOCKET_READ:
+            try:
+                data = self.sock.recv(TCP_SOCKET_READ - len(self.unacked))
+                if data:
+                    self.unacked += data
+                else:
+                    self.socket_eof = True
+            except BlockingIOError:
+                pass
+            except OSError:
+                self.socket_eof = True
+
+        if self.retransmit_at is not None and now >= self.retransmit_at:
+            # Go back to the oldest unacknowledged byte
+            self.retransmits += 1
+            self.rto = min(self.rto * 2, 30.0)
+            if self.state == "syn-received":
+                self.send_syn_ack()
+                return
+            self.snd_nxt = self.snd_una
+            self.fin_sent = False
+            self.retransmit_at = None
+
+        if self.state == "established":
+            self.send_data(now)
+        if self.ack_due:
+            self.send_segment(TH_ACK, self.snd_nxt)
+        if self.fin_sent and self.peer_fin and self.snd_una == self.snd_nxt and not self.to_socket:
+            self.close()
+
+    def send_data(self, now):
+        limit = min(self.peer_window, TCP_MAX_FLIGHT * self.mss)
+        while True:
+            offset = (self.snd_nxt - self.snd_una) & 0xFFFFFFFF
+            room = limit - offset
+            chunk = bytes(self.unacked[offset:offset + min(self.mss, room)]) if room > 0 else b""
+            if chunk:
+                more = offset + len(chunk) < len(self.unacked)
+                self.send_segment(TH_ACK if more else TH_ACK | TH_PUSH, self.snd_nxt, chunk)
+                self.snd_nxt = (self.snd_nxt + len(chunk)) & 0xFFFFFFFF
+            elif (self.socket_eof and not self.fin_sent and offset == len(self.unacked)):
+                self.send_segment(TH_FIN | TH_ACK, self.snd_nxt)
+                self.snd_nxt = (self.snd_nxt + 1) & 0xFFFFFFFF
+                self.fin_sent = True
+            else:
+                break
+            if self.retransmit_at is None:
+                self.retransmit_at = now + self.link_rto()
+
+    def close(self):
+        self.state = "closed"
+        try:
+            self.sock.close()
+        except OSError:
+            pass
+
+
+class UserStack:
+    """Terminates the Amiga's IP traffic in userspace"""
+
+    def __init__(self, send_packet, gateway=GATEWAY_ADDRESS, dns="127.0.0.1", loopback_port=None,
+                 mtu=DEFAULT_MTU, baud=9600, verbose=False):
+        self.send_packet = send_packet
+        self.gateway = socket.inet_aton(gateway)
+        self.dns = dns
+        self.loopback_port = loopback_port
+        self.mtu = mtu
+        self.baud = baud
+        self.verbose = verbose
+        self.ident = 0
+        self.tcp = {}
+        self.udp = {}                   # (amiga addr, port, dest addr, port) -> [socket, last use]
+        self.dropped = 0
+
+    def log(self, text):
+        if self.verbose:
+            print(text)
+
+    def send_ip(self, proto, src, dst, payload):
+        self.ident = (self.ident + 1) & 0xFFFF
+        self.send_packet(build_ip(proto, src, dst, payload, self.ident))
+
+    def send_tcp(self, src, dst, sport, dport, seq, ack, flags, window, payload=b"", options=b""):
+        self.ident = (self.ident + 1) & 0xFFFF
+        self.send_packet(build_tcp(src, dst, sport, dport, seq, ack, flags, window, payload,
+                                   options, self.ident))
+
+    def target(self, dest, port):
+        if self.loopback_port:
+            return ("127.0.0.1", self.loopback_port)
+        if dest == self.gateway:
+            return ("127.0.0.1", port)
+        return (socket.inet_ntoa(dest), port)
+
+    def packet(self, packet):
+        """An IP packet from the Amiga"""
+        if len(packet) < 20 or packet[0] >> 4 != 4:
+            self.dropped += 1
+            return
+        ihl = (packet[0] & 0x0F) * 4
+        length = struct.unpack_from(">H", packet, 2)[0]
+        if length > len(packet) or ihl < 20 or struct.unpack_from(">H", packet, 6)[0] & 0x3FFF:
+            self.dropped += 1           # Truncated, or a fragment
+            return
+        proto = packet[9]
+        src, dst = packet[12:16], packet[16:20]
+        body = packet[ihl:length]
+        if proto == PROTO_TCP and len(body) >= 20:
+            self.tcp_segment(src, dst, body)
+        elif proto == PROTO_UDP and len(body) >= 8:
+            self.udp_datagram(src, dst, body)
+        elif proto == PROTO_ICMP and len(body) >= 8 and body[0] == 8:
+            reply = bytearray(body)
+            reply[0] = 0
+            struct.pack_into(">H", reply, 2, 0)
+            struct.pack_into(">H", reply, 2, checksum(reply))
+            self.send_ip(PROTO_ICMP, dst, src, bytes(reply))
+        else:
+            self.dropped += 1
+
+    def tcp_segment(self, src, dst, body):
+        sport, dport, seq, ack, offset, flags, window = struct.unpack_from(">HHIIBBH", body)
+        data_offset = (offset >> 4) * 4
+        key = (src, sport, dst, dport)
+        relay = self.tcp.get(key)
+        if relay is None:
+            if flags & TH_RST:
+                return
+            if not flags & TH_SYN or flags & TH_ACK:
+                self.send_tcp(dst, src, dport, sport, ack, seq + len(body) - data_offset,
+                              TH_RST | TH_ACK, 0)
+                return
+            mss = 536
+            options = body[20:data_offset]
+            i = 0
+            while i < len(options) and options[i] != 0:
+                if options[i] == 1:
+                    i += 1
+                    continue
+                if options[i] == 2 and i + 3 < len(options):
+                    mss = struct.unpack_from(">H", options, i + 2)[0]
+                i += max(2, options[i + 1] if i + 1 < len(options) else 2)
+            mss = min(mss, self.mtu - 40)
+            relay = TcpRelay(self, key, seq, mss, self.target(dst, dport))
+            self.tcp[key] = relay
+            self.log(f"TCP {socket.inet_ntoa(src)}:{sport} -> {socket.inet_ntoa(dst)}:{dport} "
+                     f"via {relay.sock.getsockname() if relay.state != 'refused' else 'refused'}")
+            return
+        relay.segment(seq, ack, flags, window, body[data_offset:])
+
+    def udp_datagram(self, src, dst, body):
+        sport, dport, length = struct.unpack_from(">HHH", body)
+        key = (src, sport, dst, dport)
+        entry = self.udp.get(key)
+        if entry is None:
+            sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            sock.setblocking(False)
+            entry = self.udp[key] = [sock, 0.0]
+        entry[1] = time.monotonic()
+        if dst == self.gateway and dport == 53:
+            target = (self.dns, 53)
+        else:
+            target = self.target(dst, dport)
+        try:
+            entry[0].sendto(body[8:length], target)
+        except OSError:
+            self.dropped += 1
+
+    def poll(self):
+        now = time.monotonic()
+        for key, relay in list(self.tcp.items()):
+            relay.poll(now)
+            if relay.state == "closed":
+                self.log(f"TCP {socket.inet_ntoa(key[0])}:{key[1]} closed, "
+                         f"{relay.retransmits} retransmits")
+                del self.tcp[key]
+        for key, (sock, last) in list(self.udp.items()):
+            try:
+                while True:
+                    data, _ = sock.recvfrom(65536)
+                    self.ident = (self.ident + 1) & 0xFFFF
+                    self.send_packet(build_udp(key[2], key[0], key[3], key[1], data, self.ident))
+            except (BlockingIOError, OSError):
+                pass
+            if now - last > UDP_IDLE:
+                sock.close()
+                del self.udp[key]
+
+    def close(self):
+        for relay in self.tcp.values():
+            relay.close()
+        for sock, _ in self.udp.values():
+            sock.close()
+
+
+class SlipGateway:
+    """Serial side: SLIP framing plus header compression in each direction"""
+
+    def __init__(self, write, mode="auto"):
+        self.write = write
+        self.mode = mode
+        self.decoder = SlipDecoder(self._frame)
+        self.compressor = VJCompressor()
+        self.decompressor = VJDecompressor()
+        self.stack = None
+        self.bytes_in = 0
+        self.bytes_out = 0
+
+    def _frame(self, frame):
+        if self.mode == "slip":
+            packet = frame if frame[0] >> 4 == 4 else None
+        else:
+            packet = self.decompressor.decompress(frame)
+        if packet is not None and self.stack:
+            self.stack.packet(packet)
+
+    def serial_input(self, data):
+        self.bytes_in += len(data)
+        self.decoder.feed(data)
+
+    def send(self, packet):
+        """An IP packet for the Amiga"""
+        if self.mode == "cslip" or (self.mode == "auto" and self.decompressor.compressed_seen):
+            packet = self.compressor.compress(packet)
+        wire = slip_encode(packet)
+        self.bytes_out += len(wire)
+        self.write(wire)
+
+
+# ------------------------------------------------------------------ #
+# Benchmark                                                           #
+# ------------------------------------------------------------------ #
+
+class TraceFlow:
+    """One direction of a scripted TCP connection, with real headers"""
+
+    def __init__(self, src, dst, sport, dport, seq):
+        self.src, self.dst = socket.inet_aton(src), socket.inet_aton(dst)
+        self.sport, self.dport = sport, dport
+        self.seq = seq
+        self.ack = 0
+        self.ident = sport * 7
+
+    def segment(self, payload=b"", push=False, window=TCP_WINDOW):
+        self.ident += 1
+        packet = build_tcp(self.src, self.dst, self.sport, self.dport, self.seq, self.ack,
+                           TH_ACK | (TH_PUSH if push else 0), window, payload, ident=self.ident)
+        self.seq = (self.seq + len(payload)) & 0xFFFFFFFF
+        return packet
+
+
+class TraceLink:
+    """A compressor, framing and decompressor for one direction; checks
+    every packet survives and counts the bytes on the wire"""
+
+    def __init__(self, compress):
+        self.compressor = VJCompressor() if compress else None
+        self.decompressor = VJDecompressor()
+        self.received = []
+        self.decoder = SlipDecoder(lambda frame: self.received.append(self.decompressor.decompress(frame)))
+        self.wire = 0
+        self.packets = 0
+
+    def carry(self, packet):
+        frame = self.compressor.compress(packet) if self.compressor else packet
+        wire = slip_encode(frame)
+        self.decoder.feed(wire)
+        if self.received.pop() != packet:
+            raise AssertionError("packet changed on the way through")
+        self.wire += len(wire)
+        self.packets += 1
+        return len(wire)
+
+
+def bench_interactive(compress, keys=500):
+    """Telnet-style typing: each keystroke and its echo carry the ACK for
+    the other; returns wire bytes per keystroke each way"""
+    up, down = TraceLink(compress), TraceLink(compress)
+    amiga = TraceFlow("10.0.2.15", "10.0.2.2", 1025, 23, 1000)
+    host = TraceFlow("10.0.2.2", "10.0.2.15", 23, 1025, 5000)
+    for i in range(keys):
+        key = bytes([97 + i % 26])
+        amiga.ack = host.seq
+        up.carry(amiga.segment(key, push=True))
+        host.ack = amiga.seq
+        down.carry(host.segment(key, push=True))
+    return up.wire / keys, down.wire / keys
+
+
+def bench_bulk(compress, mss, total=65536):
+    """Host -> Amiga transfer, the Amiga acking every second segment;
+    returns data-direction and ACK-direction wire bytes"""
+    down, up = TraceLink(compress), TraceLink(compress)
+    host = TraceFlow("10.0.2.2", "10.0.2.15", 21, 1026, 7000)
+    amiga = TraceFlow("10.0.2.15", "10.0.2.2", 1026, 21, 9000)
+    block = bytes(range(256)) * (mss // 256 + 1)
+    sent = 0
+    count = 0
+    while sent < total:
+        size = min(mss, total - sent)
+        down.carry(host.segment(block[:size], push=(size < mss)))
+        sent += size
+        count += 1
+        if count % 2 == 0 or sent >= total:
+            amiga.ack = host.seq
+            up.carry(amiga.segment())
+    return down.wire, up.wire
+
+
+def benchmark():
+    """Interactive echo time and bulk goodput, SLIP vs CSLIP"""
+    start = time.perf_counter()
+    plain_keys = bench_interactive(False)
+    vj_keys = bench_interactive(True)
+    print("Interactive: one keystroke up, its echo down, each carrying the other's ACK")
+    print(f"  wire bytes per keystroke: SLIP {plain_keys[0]:.1f} up / {plain_keys[1]:.1f} down, "
+          f"CSLIP {vj_keys[0]:.1f} / {vj_keys[1]:.1f}")
+    print(f"{'baud':>6} | {'SLIP echo ms':>12} {'keys/s':>7} | {'CSLIP echo ms':>13} {'keys/s':>7} | {'gain':>5}")
+    for baud in BENCH_RATES:
+        plain_ms = (plain_keys[0] + plain_keys[1]) * 10000.0 / baud
+        vj_ms = (vj_keys[0] + vj_keys[1]) * 10000.0 / baud
+        plain_rate = baud / 10.0 / max(plain_keys)
+        vj_rate = baud / 10.0 / max(vj_keys)
+        print(f"{baud:>6} | {plain_ms:>12.1f} {plain_rate:>7.0f} | {vj_ms:>13.1f} {vj_rate:>7.0f} | "
+              f"{vj_rate / plain_rate:>4.1f}x")
+
+    total = 65536
+    print(f"\nBulk: {total // 1024} KB to the Amiga, ACK every second segment "
+          f"(goodput = payload / data-direction line time)")
+    print(f"{'MSS':>4} {'baud':>6} | {'SLIP B/s':>9} {'eff':>5} | {'CSLIP B/s':>9} {'eff':>5} | "
+          f"{'ACK B SLIP/CSLIP':>17} | {'gain':>5}")
+    for mss in (256, 536):
+        plain = bench_bulk(False, mss, total)
+        vj = bench_bulk(True, mss, total)
+        for baud in BENCH_RATES:
+            line = baud / 10.0
+            plain_rate = total * line / plain[0]
+            vj_rate = total * line / vj[0]
+            print(f"{mss:>4} {baud:>6} | {plain_rate:>9.0f} {plain_rate * 100 / line:>4.0f}% | "
+                  f"{vj_rate:>9.0f} {vj_rate * 100 / line:>4.0f}% | {plain[1]:>8} / {vj[1]:<6} | "
+                  f"{vj_rate / plain_rate:>4.2f}x")
+    print(f"\nEvery packet was checked to come out of the framing and decompressor unchanged "
+          f"({time.perf_counter() - start:.2f} s)")
+
+
+# ------------------------------------------------------------------ #
+# Main                                                                #
+# ------------------------------------------------------------------ #
+
+def default_dns():
+    try:
+        with open("/etc/resolv.conf") as f:
+            for line in f:
+                fields = line.split()
+                if len(fields) >= 2 and fields[0] == "nameserver" and "." in fields[1]:
+                    return fields[1]
+    except OSError:
+        pass
+    return "127.0.0.1"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="SLIP/CSLIP gateway giving the Amiga IP without TUN or root")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=9600, help="Baud rate (default: 9600)")
+    parser.add_argument("--mode", choices=("auto", "slip", "cslip"), default="auto",
+                        help="Header compression toward the Amiga (default: auto)")
+    parser.add_argument("--mtu", type=int, default=DEFAULT_MTU, help=f"Interface MTU (default: {DEFAULT_MTU})")
+    parser.add_argument("--gateway", default=GATEWAY_ADDRESS, help=f"Gateway address (default: {GATEWAY_ADDRESS})")
+    parser.add_argument("--dns", default=None, help="Where DNS queries to the gateway go (default: resolv.conf)")
+    parser.add_argument("--loopback", action="store_true", help="Connect every TCP connection to a local echo service")
+    parser.add_argument("--bench", action="store_true", help="Benchmark SLIP against CSLIP and exit")
+    parser.add_argument("-v", "--verbose", action="store_true", help="Log connections")
+    args = parser.parse_args()
+
+    if args.bench:
+        benchmark()
+        return
+
+    try:
+        import serial
+    except ImportError:
+        print("Error: PySerial not installed.")
+        print("Please install it with: pip install pyserial")
+        sys.exit(1)
+
+    loopback_port = None
+    if args.loopback:
+        listener = LoopbackListener()
+        loopback_port = listener.port
+        print(f"Loopback echo service on 127.0.0.1:{loopback_port}")
+
+    ser = serial.serial_for_url(args.port, baudrate=args.baud, timeout=0.01,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+    gateway = SlipGateway(ser.write, args.mode)
+    gateway.stack = UserStack(gateway.send, args.gateway, args.dns or default_dns(), loopback_port,
+                              args.mtu, args.baud, args.verbose)
+    print(f"{args.mode.upper()} gateway {args.gateway} on {args.port} at {args.baud} baud, MTU {args.mtu}")
+
+    try:
+        while True:
+            data = ser.read(max(1, ser.in_waiting))
+            if data:
+                gateway.serial_input(data)
+            gateway.stack.poll()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        gateway.stack.close()
+        ser.close()
+
+    c = gateway.compressor
+    print(f"\n{gateway.bytes_in} bytes in, {gateway.bytes_out} out; {gateway.decoder.frames} frames, "
+          f"{gateway.decompressor.errors} decompression errors; sent {c.compressed} compressed, "
+          f"{c.uncompressed} uncompressed of {c.packets} packets")
+
+
+if __name__ == "__main__":
+    main()
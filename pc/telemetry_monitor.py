@@ -0,0 +1,132 @@
+# file: telemetry_monitor.py
+"""
+Telemetry monitor for the Amiga packet application.
+
+Subscribes to the push stream (SUBSCRIBE <ms>) instead of polling STATUS.
+The Amiga sends a dictionary line once and then only records for channels
+that changed, at most one per interval:
+
+    @D 0=packets 1=commands 2=echo 3=verbose
+    @T 0=12 1=7
+
+The monitor keeps the last known state locally and prints it whenever a
+record arrives, together with link usage in bytes/sec.
+
+Usage:
+    python telemetry_monitor.py -p COM6 -i 250
+"""
+import sys
+import time
+import argparse
+from datetime import datetime
+
+try:
+    import serial
+except ImportError:
+    print("Error: PySerial not installed.")
+    print("Please install it with: pip install pyserial")
+    sys.exit(1)
+
+
+class TelemetryState:
+    """Last known value of every channel, keyed by channel name"""
+
+    def __init__(self):
+        self.names = {}
+        self.values = {}
+        self.records = 0
+
+    def apply(self, line):
+        """Apply one @D or @T line; returns list of (name, old, new) changes"""
+        fields = line.split()
+        kind = fields[0]
+        changes = []
+
+        for field in fields[1:]:
+            key, _, value = field.partition('=')
+            if not key.isdigit():
+                continue
+            channel = int(key)
+
+            if kind == '@D':
+                self.names[channel] = value
+            elif kind == '@T':
+                name = self.names.get(channel, f"ch{channel}")
+                new = int(value)
+                old = self.values.get(name)
+                self.values[name] = new
+                changes.append((name, old, new))
+
+        if kind == '@T':
+            self.records += 1
+        return changes
+
+
+def monitor(port, baud, interval_ms, duration):
+    ser = serial.serial_for_url(port, baudrate=baud, timeout=0.1,
+                                xonxoff=False, rtscts=False, dsrdtr=False)
+    ser.reset_input_buffer()
+
+    state = TelemetryState()
+    buffer = bytearray()
+    rx_bytes = 0
+    tx_bytes = 0
+
+    subscribe = f"SUBSCRIBE {interval_ms}\r\n".encode('ascii')
+    ser.write(subscribe)
+    tx_bytes += len(subscribe)
+
+    print(f"Subscribed on {port} at {baud} baud, interval {interval_ms} ms")
+    print("Press Ctrl+C to exit")
+    print("-" * 50)
+
+    start = time.monotonic()
+    try:
+        while duration <= 0 or time.monotonic() - start < duration:
+            data = ser.read(max(1, ser.in_waiting))
+            if not data:
+                continue
+            rx_bytes += len(data)
+            buffer.extend(data)
+
+            while b'\n' in buffer:
+                raw, _, rest = buffer.partition(b'\n')
+                buffer = bytearray(rest)
+                line = raw.decode('ascii', 'replace').strip()
+
+                if line.startswith('@D') or line.startswith('@T'):
+                    changes = state.apply(line)
+                    if changes:
+                        timestamp = datetime.now().strftime("%H:%M:%S.%f")[:-3]
+                        summary = ' '.join(f"{n}={v}" for n, v in sorted(state.values.items()))
+                        print(f"[{timestamp}] {summary}")
+                elif line:
+                    print(f"  {line}")
+    except KeyboardInterrupt:
+        print("\nExiting...")
+    finally:
+        unsubscribe = b"UNSUBSCRIBE\r\n"
+        ser.write(unsubscribe)
+        tx_bytes += len(unsubscribe)
+        ser.close()
+
+    elapsed = max(time.monotonic() - start, 1e-6)
+    print("-" * 50)
+    print(f"Records received : {state.records}")
+    print(f"Link usage       : rx {rx_bytes / elapsed:.1f} B/s, tx {tx_bytes / elapsed:.1f} B/s")
+    print(f"Final state      : {state.values}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Push-based telemetry monitor for the Amiga packet app")
+    parser.add_argument("-p", "--port", default="COM6", help="Serial port or pyserial URL (default: COM6)")
+    parser.add_argument("-b", "--baud", type=int, default=9600, help="Baud rate (default: 9600)")
+    parser.add_argument("-i", "--interval", type=int, default=500, help="Coalescing interval in ms (default: 500)")
+    parser.add_argument("-d", "--duration", type=float, default=0, help="Stop after N seconds (default: run until Ctrl+C)")
+    args = parser.parse_args()
+
+    monitor(args.port, args.baud, args.interval, args.duration)
+
+
+if __name__ == "__main__":
+    main()
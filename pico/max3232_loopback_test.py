@@ -1,6 +1,9 @@
 import machine
 import utime
 
+# PRBS generator/checker shared with pc/ber_test.py; copy prbs.py to the Pico too
+import prbs
+
 # Define pins separately so we can control them directly
 tx_pin = machine.Pin(0, machine.Pin.OUT)
 rx_pin = machine.Pin(1, machine.Pin.IN)
@@ -18,7 +21,7 @@ def blink_led(times=3, delay=0.2):
         led.off()
         utime.sleep(delay)
 
-def create_uart(baud_rate=9600):
+def create_uart(baud_rate=9600, rxbuf=256):
     """Create and return a UART instance with the specified baud rate"""
     return machine.UART(0,
                        baudrate=baud_rate,
@@ -27,7 +30,8 @@ def create_uart(baud_rate=9600):
                        bits=8,
                        parity=None,
                        stop=1,
-                       timeout=1000)
+                       timeout=1000,
+                       rxbuf=rxbuf)
 
 def max3232_loopback_test(baud_rate=9600):
     """Test loopback through MAX3232 by sending data and checking if it returns"""
@@ -174,6 +178,35 @@ def test_signal_levels():
     
     print("Signal level test completed")
 
+def prbs_ber_sweep(rates=prbs.SWEEP_RATES, order=7, bits=100000):
+    """Stream PRBS-7/PRBS-15 through the loopback at each rate and print a BER table"""
+    print(f"PRBS-{order} BER sweep, {bits} bits per rate")
+    blink_led(3, 0.2)
+
+    rows = []
+    for baud_rate in rates:
+        # Buffer larger than the checker's in-flight window so overruns are real errors
+        uart = create_uart(baud_rate, rxbuf=1024)
+        utime.sleep(0.1)
+        while uart.any():
+            uart.read()
+
+        def read_waiting():
+            waiting = uart.any()
+            return uart.read(waiting) if waiting else None
+
+        print(f"Testing {baud_rate} baud...")
+        result = prbs.run_ber_test(uart.write, read_waiting, bits, order)
+        rows.append((baud_rate, result))
+
+        # One blink for a clean rate, three for errors or lost data
+        blink_led(1 if result["errors"] == 0 and result["lost"] == 0 else 3, 0.1)
+
+    print()
+    for line in prbs.format_ber_table(rows):
+        print(line)
+    return rows
+
 if __name__ == "__main__":
     print("MAX3232 Loopback Test")
     print("=====================")
@@ -193,5 +226,8 @@ if __name__ == "__main__":
     elif test_mode == 3:
         # Test signal levels directly
         test_signal_levels()
+    elif test_mode == 4:
+        # PRBS bit-error-rate sweep over all rates (order 7 or 15)
+        prbs_ber_sweep(order=7, bits=100000)
     else:
         print("Invalid test mode selected")
\ No newline at end of file
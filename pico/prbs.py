@@ -0,0 +1,200 @@
+# file: prbs.py
+"""
+PRBS-7 / PRBS-15 pattern generator and self-synchronizing checker.
+
+Shared by the Pico (MicroPython) and the host (CPython): copy it to the
+Pico next to max3232_loopback_test.py; pc/ber_test.py imports it from
+here. Only plain integer operations are used so both interpreters give
+identical streams.
+
+Sequences (ITU-T O.150 polynomials, bits packed MSB first):
+    PRBS-7:  x^7 + x^6 + 1     period 127 bits
+    PRBS-15: x^15 + x^14 + 1   period 32767 bits
+PRBS-7 from seed 0x7F is the burst used by the Amiga's link calibration.
+"""
+
+try:
+    from utime import ticks_ms, ticks_diff
+except ImportError:
+    import time
+
+    def ticks_ms():
+        return int(time.monotonic() * 1000)
+
+    def ticks_diff(a, b):
+        return a - b
+
+POLYNOMIALS = {7: 6, 15: 14}    # order -> second tap
+
+# Serial rates swept by default (the Amiga's standard set)
+SWEEP_RATES = (1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200)
+
+# Loss of lock: this many bit errors inside one window means a slip, not noise
+RESYNC_WINDOW = 16              # bytes
+RESYNC_THRESHOLD = 24           # bit errors within the window
+
+_POPCOUNT = bytes(bin(i).count("1") for i in range(256))
+
+
+def _step(state, order, bits):
+    """Advance an x^n + x^(n-1) + 1 register by bits (< order) at once"""
+    chunk = ((state >> (order - bits)) ^ (state >> (order - bits - 1))) & ((1 << bits) - 1)
+    return ((state << bits) | chunk) & ((1 << order) - 1), chunk
+
+
+def _next_byte(state, order):
+    """Return (new state, next 8 sequence bits)"""
+    if order > 8:
+        return _step(state, order, 8)
+    # Short registers feed back within a byte; take it a nibble at a time
+    state, high = _step(state, order, 4)
+    state, low = _step(state, order, 4)
+    return state, (high << 4) | low
+
+
+class PrbsGenerator:
+    """Produces the sequence a byte at a time"""
+
+    def __init__(self, order=7, seed=None):
+        if order not in POLYNOMIALS:
+            raise ValueError("order must be 7 or 15")
+        self.order = order
+        mask = (1 << order) - 1
+        self.state = (seed if seed is not None else mask) & mask
+        if self.state == 0:
+            raise ValueError("seed must be non-zero")
+
+    def next_bytes(self, count):
+        out = bytearray(count)
+        state = self.state
+        order = self.order
+        for i in range(count):
+            state, out[i] = _next_byte(state, order)
+        self.state = state
+        return out
+
+
+class PrbsChecker:
+    """
+    Counts bit errors in a received PRBS stream without knowing its
+    phase. The register is loaded from the received bits, then each byte
+    is predicted from it; too many errors in a short window (dropped or
+    inserted bytes) reloads it from the received bits again.
+    """
+
+    def __init__(self, order=7):
+        if order not in POLYNOMIALS:
+            raise ValueError("order must be 7 or 15")
+        self.order = order
+        self.mask = (1 << order) - 1
+        self.bits = 0           # Bits compared while locked
+        self.errors = 0         # Bit errors while locked
+        self.resyncs = 0        # Times lock was lost and regained
+        self.locked = False
+        self._state = 0
+        self._fill = 0          # Received bits loaded while acquiring
+        self._window_bytes = 0
+        self._window_errors = 0
+
+    def feed(self, data):
+        order = self.order
+        for byte in data:
+            if not self.locked:
+                self._state = ((self._state << 8) | byte) & self.mask
+                self._fill += 8
+                if self._fill >= order and self._state != 0:
+                    self.locked = True
+                    self._window_bytes = 0
+                    self._window_errors = 0
+                continue
+
+            self._state, expected = _next_byte(self._state, order)
+            wrong = _POPCOUNT[expected ^ byte]
+            self.bits += 8
+            self.errors += wrong
+
+            self._window_bytes += 1
+            self._window_errors += wrong
+            if self._window_errors >= RESYNC_THRESHOLD:
+                # Lost lock: the window's errors were slip, not noise
+                self.errors -= self._window_errors
+                self.bits -= 8 * self._window_bytes
+                self.resyncs += 1
+                self.locked = False
+                self._state = byte & self.mask
+                self._fill = 8
+            elif self._window_bytes >= RESYNC_WINDOW:
+                self._window_bytes = 0
+                self._window_errors = 0
+
+    def ber(self):
+        return self.errors / self.bits if self.bits else 0.0
+
+
+def run_ber_test(write, read, bits, order=7, chunk=64, window=512, idle_ms=500):
+    """
+    Stream bits of PRBS through a loopback and check what comes back.
+
+    write(data) sends bytes; read() returns whatever bytes are waiting
+    (or None) without blocking. At most window bytes are kept in flight
+    so the receiver's buffer is not the thing being measured. A loopback
+    that stays silent for idle_ms gives up the bytes still outstanding
+    as lost and carries on. Returns a dict for format_ber_table().
+    """
+    generator = PrbsGenerator(order)
+    checker = PrbsChecker(order)
+    total = (bits + 7) // 8
+    sent = 0
+    received = 0
+    lost = 0
+    start = ticks_ms()
+    last = start
+
+    while sent < total or sent - lost > received:
+        if sent < total and sent - lost - received < window:
+            count = min(chunk, total - sent, window - (sent - lost - received))
+            write(generator.next_bytes(count))
+            sent += count
+
+        data = read()
+        if data:
+            checker.feed(data)
+            received += len(data)
+            last = ticks_ms()
+        elif ticks_diff(ticks_ms(), last) > idle_ms:
+            lost = sent - received
+            last = ticks_ms()
+            if received == 0:
+                break           # Nothing is looping back at all
+
+    return {
+        "order": order,
+        "sent": sent,
+        "received": received,
+        "lost": lost,
+        "bits": checker.bits,
+        "errors": checker.errors,
+        "resyncs": checker.resyncs,
+        "seconds": ticks_diff(ticks_ms(), start) / 1000,
+    }
+
+
+def format_ber(errors, bits):
+    """BER as text; an error-free run shows its 95% upper bound (3 / bits)"""
+    if bits == 0:
+        return "no data"
+    if errors == 0:
+        return "<%.1e" % (3 / bits)
+    return "%.2e" % (errors / bits)
+
+
+def format_ber_table(rows):
+    """rows: (baud, result) pairs; returns the table as a list of lines"""
+    lines = ["%8s %10s %8s %10s %8s %8s %7s" %
+             ("Baud", "Bits", "Errors", "BER", "Resyncs", "Lost", "Secs")]
+    for baud, result in rows:
+        lines.append("%8d %10d %8d %10s %8d %8d %7.1f" %
+                     (baud, result["bits"], result["errors"],
+                      format_ber(result["errors"], result["bits"]),
+                      result["resyncs"], result["lost"], result["seconds"]))
+    return lines